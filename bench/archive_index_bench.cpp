@@ -0,0 +1,167 @@
+#include "ArchiveIndex.h"
+#include "EntryTable.h"
+#include "PathSecurity.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Builds archive indexes of 1000 .. N entries and times the metadata side of
+// LoadArchive: decoding the index, then filing every entry under its name with
+// the collision check, followed by exact and case-folded lookups. Decryption
+// is left out; archive_stream_bench measures it.
+//
+//   archive_index_bench [max entries]
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::uint64_t BLOB_REGION_BEGIN = 12288;
+constexpr std::size_t CHUNK_SIZE = 1024U * 1024U;
+constexpr std::uint64_t SEALED_BLOB_SIZE = 64 + 16;
+
+double Milliseconds(Clock::duration elapsed) {
+    return std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+std::string EntryName(std::size_t i) {
+    // Room for the widest size_t, so no index is ever truncated.
+    char name[sizeof("Document-.txt") + 20];
+    std::snprintf(name, sizeof(name), "Document-%07zu.txt", i);
+    return name;
+}
+
+ArchiveIndex::Index MakeIndex(std::size_t entries) {
+    ArchiveIndex::Index index;
+    index.segments.reserve(entries);
+    index.entries.reserve(entries);
+    for (std::size_t i = 0; i < entries; ++i) {
+        ArchiveIndex::Segment segment;
+        std::memcpy(segment.blobId.data(), &i, sizeof(i));
+        segment.blobOffset = BLOB_REGION_BEGIN + i * SEALED_BLOB_SIZE;
+        segment.storedSize = SEALED_BLOB_SIZE - 16;
+        segment.size = segment.storedSize;
+        index.segments.push_back(segment);
+
+        ArchiveIndex::Entry entry;
+        entry.name = EntryName(i);
+        entry.size = segment.size;
+        entry.timestamp = "2026-01-02 08:30:00";
+        entry.hash = std::string(64, 'a');
+        entry.segments.push_back(static_cast<std::uint32_t>(i));
+        index.entries.push_back(std::move(entry));
+    }
+    return index;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t maxEntries = std::min<std::size_t>(
+        argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000, ArchiveIndex::MAX_ENTRIES);
+    if (maxEntries == 0) {
+        std::cerr << "At least one entry is required" << std::endl;
+        return 1;
+    }
+    std::vector<std::size_t> counts;
+    for (std::size_t entries = 1000; entries < maxEntries; entries *= 10) {
+        counts.push_back(entries);
+    }
+    counts.push_back(maxEntries);
+
+    std::cout << std::setw(9) << "entries" << std::setw(11) << "index MiB" << std::setw(12)
+              << "decode ms" << std::setw(11) << "table ms" << std::setw(13) << "lookup ns"
+              << std::setw(13) << "folded ns" << "\n";
+    for (const std::size_t entries : counts) {
+        std::vector<std::uint8_t> encoded;
+        if (!ArchiveIndex::Encode(MakeIndex(entries),
+                                  [&encoded](const std::uint8_t* data, std::size_t size) {
+                                      encoded.insert(encoded.end(), data, data + size);
+                                      return true;
+                                  })) {
+            std::cerr << "Encoding failed for " << entries << " entries" << std::endl;
+            return 1;
+        }
+
+        std::size_t position = 0;
+        ArchiveIndex::Index index;
+        const auto decodeStart = Clock::now();
+        const bool decoded = ArchiveIndex::Decode(
+            [&encoded, &position](std::uint8_t* data, std::size_t size) {
+                if (size > encoded.size() - position) {
+                    return false;
+                }
+                std::memcpy(data, encoded.data() + position, size);
+                position += size;
+                return true;
+            },
+            encoded.size(), CHUNK_SIZE, BLOB_REGION_BEGIN,
+            BLOB_REGION_BEGIN + entries * SEALED_BLOB_SIZE, index);
+        const auto decodeElapsed = Clock::now() - decodeStart;
+        if (!decoded) {
+            std::cerr << "Decoding failed for " << entries << " entries" << std::endl;
+            return 1;
+        }
+
+        // The same checks ReadContainer applies to every entry it loads.
+        EntryTable table;
+        const auto tableStart = Clock::now();
+        for (ArchiveIndex::Entry& entry : index.entries) {
+            FileEntry file;
+            file.name = entry.name;
+            file.size = static_cast<std::size_t>(entry.size);
+            file.timestamp = std::move(entry.timestamp);
+            file.hash = std::move(entry.hash);
+            if (!PathSecurity::ValidateStoredFilename(entry.name) ||
+                !table.insert(entry.name, std::move(file))) {
+                std::cerr << "Rejected entry " << entry.name << std::endl;
+                return 1;
+            }
+        }
+        const auto tableElapsed = Clock::now() - tableStart;
+
+        std::vector<std::string> names;
+        std::vector<std::string> folded;
+        names.reserve(entries);
+        folded.reserve(entries);
+        for (std::size_t i = 0; i < entries; ++i) {
+            names.push_back(EntryName((i * 7919U) % entries));
+            folded.push_back(names.back());
+            std::transform(folded.back().begin(), folded.back().end(), folded.back().begin(),
+                           [](unsigned char value) { return static_cast<char>(std::toupper(value)); });
+        }
+        std::size_t found = 0;
+        const auto lookupStart = Clock::now();
+        for (const std::string& name : names) {
+            found += table.count(name);
+        }
+        const auto lookupElapsed = Clock::now() - lookupStart;
+        const auto foldedStart = Clock::now();
+        for (const std::string& name : folded) {
+            found += table.FindEquivalent(name) != table.end() ? 1 : 0;
+        }
+        const auto foldedElapsed = Clock::now() - foldedStart;
+        if (found != 2 * entries) {
+            std::cerr << "Lookups missed entries" << std::endl;
+            return 1;
+        }
+
+        const double perLookup = 1e6 / static_cast<double>(entries);
+        std::cout << std::setw(9) << entries << std::fixed << std::setprecision(1)
+                  << std::setw(11) << static_cast<double>(encoded.size()) / (1024.0 * 1024.0)
+                  << std::setw(12) << Milliseconds(decodeElapsed) << std::setw(11)
+                  << Milliseconds(tableElapsed) << std::setw(13)
+                  << Milliseconds(lookupElapsed) * perLookup << std::setw(13)
+                  << Milliseconds(foldedElapsed) * perLookup << "\n";
+    }
+    return 0;
+}
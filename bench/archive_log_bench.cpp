@@ -0,0 +1,168 @@
+#include "CryptoArchive.h"
+#include "Log.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Times LoadArchive plus an in-memory extraction of every entry under three
+// logging setups, all writing to the same file sink:
+//
+//   sync debug   every record written and flushed in the calling thread, the
+//                way the std::cout << std::endl diagnostics used to behave
+//   async debug  the same records, written by the background thread
+//   info         the default level; per-entry diagnostics are filtered out
+//
+// Building with -DPQCWALLET_LOG_MIN_LEVEL=2 removes the Debug statements from
+// the binary altogether.
+//
+//   archive_log_bench [entries]
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr const char* PASSWORD = "benchmark passphrase";
+
+double Milliseconds(Clock::duration elapsed) {
+    return std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+struct Setup {
+    const char* label;
+    Log::Level level;
+    bool asynchronous;
+};
+
+struct Timing {
+    double loadMs = 0;
+    double extractMs = 0;
+    std::uint64_t records = 0;
+};
+
+bool CreateArchive(const std::filesystem::path& root, std::size_t entries) {
+    std::vector<std::pair<std::string, std::string>> files;
+    files.reserve(entries);
+    for (std::size_t i = 0; i < entries; ++i) {
+        // Room for the widest size_t, so no index is ever truncated.
+        char name[sizeof("Document-.txt") + 20];
+        std::snprintf(name, sizeof(name), "Document-%05zu.txt", i);
+        const std::filesystem::path path = root / name;
+        std::ofstream file(path, std::ios::binary);
+        file << "Benchmark document " << i << "\n" << std::string(512 + i % 512, 'x');
+        files.emplace_back(path.string(), name);
+    }
+    CryptoArchive archive("bench", "logging");
+    std::string error;
+    if (!archive.InitializeArchive(PASSWORD) || !archive.AddFiles(files, &error)) {
+        std::cerr << "Could not build the benchmark archive: " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Measure(const Setup& setup, std::FILE* out, Timing& timing) {
+    std::uint64_t records = 0;
+    const bool flushEachRecord = !setup.asynchronous;
+    Log::SetSink([out, flushEachRecord, &records](Log::Level, Log::Module module,
+                                                   const std::string& message) {
+        std::fprintf(out, "[%s] %s\n", Log::ModuleName(module), message.c_str());
+        if (flushEachRecord) {
+            std::fflush(out);
+        }
+        ++records;
+    });
+    Log::SetAsynchronous(setup.asynchronous);
+    Log::SetLevel(setup.level);
+
+    CryptoArchive archive("bench", "logging");
+    const auto loadStart = Clock::now();
+    if (!archive.LoadArchive(PASSWORD)) {
+        return false;
+    }
+    const auto extractStart = Clock::now();
+    std::vector<uint8_t> data;
+    for (const FileEntry& entry : archive.GetFileList()) {
+        if (!archive.ExtractFileToMemory(entry.name, data)) {
+            return false;
+        }
+    }
+    // The writer thread's share of the work counts too.
+    Log::Flush();
+    const auto end = Clock::now();
+
+    timing.loadMs = Milliseconds(extractStart - loadStart);
+    timing.extractMs = Milliseconds(end - extractStart);
+    timing.records = records;
+    Log::SetSink(nullptr);
+    std::fflush(out);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    namespace fs = std::filesystem;
+    const std::size_t entries = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    if (entries == 0) {
+        std::cerr << "At least one entry is required" << std::endl;
+        return 1;
+    }
+
+    const fs::path originalPath = fs::current_path();
+    const fs::path root = fs::temp_directory_path() /
+                          ("pqcwallet_log_bench_" +
+                           std::to_string(Clock::now().time_since_epoch().count()));
+    fs::create_directories(root);
+    fs::current_path(root);
+
+    int status = 0;
+    Log::SetLevel(Log::Level::Warning);
+    if (!CreateArchive(root, entries)) {
+        status = 1;
+    }
+
+    const Setup setups[] = {
+        {"sync debug", Log::Level::Debug, false},
+        {"async debug", Log::Level::Debug, true},
+        {"info", Log::Level::Info, true},
+    };
+    std::FILE* out = std::fopen((root / "bench.log").string().c_str(), "w");
+    if (status == 0 && out == nullptr) {
+        std::cerr << "Could not open the log file" << std::endl;
+        status = 1;
+    }
+    if (status == 0) {
+        std::cout << "entries: " << entries << "\n"
+                  << std::setw(12) << "setup" << std::setw(10) << "records" << std::setw(10)
+                  << "load ms" << std::setw(13) << "extract ms" << "\n";
+        for (const Setup& setup : setups) {
+            Timing timing;
+            if (!Measure(setup, out, timing)) {
+                std::cerr << "Benchmark run failed: " << setup.label << std::endl;
+                status = 1;
+                break;
+            }
+            std::cout << std::setw(12) << setup.label << std::setw(10) << timing.records
+                      << std::fixed << std::setprecision(1) << std::setw(10) << timing.loadMs
+                      << std::setw(13) << timing.extractMs << "\n";
+        }
+        std::cout << "dropped records: " << Log::Dropped() << std::endl;
+    }
+    if (out != nullptr) {
+        std::fclose(out);
+    }
+
+    fs::current_path(originalPath);
+    std::error_code cleanupError;
+    fs::remove_all(root, cleanupError);
+    return status;
+}
@@ -0,0 +1,111 @@
+#include "ArchiveStream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Seals and opens one in-memory payload with 1 .. N threads and prints the
+// throughput of every run, so the scaling curve of the chunked GCM can be
+// compared between machines.
+//
+//   archive_stream_bench [payload MiB] [max threads]
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double MebibytesPerSecond(std::size_t bytes, Clock::duration elapsed) {
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    return seconds > 0.0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t payloadMiB = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    std::size_t maxThreads = argc > 2 ? std::strtoul(argv[2], nullptr, 10)
+                                      : std::thread::hardware_concurrency();
+    maxThreads = std::clamp<std::size_t>(maxThreads, 1, ArchiveStream::MAX_WORKER_THREADS);
+    if (payloadMiB == 0) {
+        std::cerr << "Payload size must be at least 1 MiB" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::uint8_t> payload(payloadMiB * 1024U * 1024U);
+    for (std::size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<std::uint8_t>((i * 131U + 17U) & 0xffU);
+    }
+    const SecureMemory::SecureBytes key(ArchiveStream::KEY_SIZE, 0x42);
+    const std::vector<std::uint8_t> nonce(ArchiveStream::NONCE_SIZE, 0);
+    const ArchiveStream::ChunkCipher cipher(key, nonce, {'b', 'e', 'n', 'c', 'h'});
+
+    std::vector<std::size_t> threadCounts;
+    for (std::size_t threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    std::cout << "payload " << payloadMiB << " MiB, chunk "
+              << ArchiveStream::DEFAULT_CHUNK_SIZE / 1024U << " KiB\n";
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "seal MiB/s" << std::setw(14)
+              << "open MiB/s" << std::setw(10) << "speedup" << "\n";
+
+    double baseline = 0.0;
+    std::vector<std::uint8_t> sealed;
+    std::vector<std::uint8_t> opened(payload.size());
+    for (const std::size_t threads : threadCounts) {
+        ArchiveStream::SetWorkerThreads(threads);
+
+        sealed.clear();
+        sealed.reserve(static_cast<std::size_t>(
+            ArchiveStream::SealedSize(payload.size(), ArchiveStream::DEFAULT_CHUNK_SIZE)));
+        const auto sealStart = Clock::now();
+        ArchiveStream::SealingWriter writer(
+            cipher, ArchiveStream::DEFAULT_CHUNK_SIZE,
+            [&sealed](const std::uint8_t* data, std::size_t size) {
+                sealed.insert(sealed.end(), data, data + size);
+                return true;
+            });
+        if (!writer.Write(payload.data(), payload.size()) || !writer.Finish()) {
+            std::cerr << "Sealing failed with " << threads << " threads" << std::endl;
+            return 1;
+        }
+        const auto sealElapsed = Clock::now() - sealStart;
+
+        std::size_t position = 0;
+        const auto openStart = Clock::now();
+        ArchiveStream::OpeningReader reader(
+            cipher, payload.size(), ArchiveStream::DEFAULT_CHUNK_SIZE,
+            ArchiveStream::View([&sealed, &position](std::size_t size) -> const std::uint8_t* {
+                if (size > sealed.size() - position) {
+                    return nullptr;
+                }
+                const std::uint8_t* data = sealed.data() + position;
+                position += size;
+                return data;
+            }));
+        if (!reader.Read(opened.data(), opened.size()) || !reader.finished() ||
+            opened != payload) {
+            std::cerr << "Opening failed with " << threads << " threads" << std::endl;
+            return 1;
+        }
+        const auto openElapsed = Clock::now() - openStart;
+
+        const double sealRate = MebibytesPerSecond(payload.size(), sealElapsed);
+        const double openRate = MebibytesPerSecond(payload.size(), openElapsed);
+        if (baseline == 0.0) {
+            baseline = sealRate + openRate;
+        }
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(1)
+                  << std::setw(14) << sealRate << std::setw(14) << openRate
+                  << std::setw(9) << std::setprecision(2)
+                  << (baseline > 0.0 ? (sealRate + openRate) / baseline : 0.0) << "x\n";
+    }
+    return 0;
+}
@@ -0,0 +1,548 @@
+#include "CryptoArchive.h"
+#include "EncryptedDatabase.h"
+#include "Log.h"
+#include "PasswordManager.h"
+#include "TransactionalFileBatch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// End-to-end timings of the archive, database, login and transaction paths,
+// written as one JSON document so runs from different releases can be
+// compared. Every case runs in a fresh directory under the system temp dir.
+//
+//   pqcwallet_bench [--quick] [--filter text] [--output file.json]
+//
+// The full run covers archives from 1 MiB to 1 GiB and from 1 to 100,000
+// entries, and databases of 10 to 100,000 records; --quick stops at 16 MiB,
+// 1000 entries and 1000 records. --filter keeps the benchmarks whose name
+// contains the text, e.g. "archive.load" or "database.".
+
+namespace {
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+constexpr const char* PASSWORD = "benchmark passphrase";
+constexpr std::uint64_t MIB = 1024ULL * 1024ULL;
+constexpr std::size_t MAX_EXTRACTED_ENTRIES = 1000;
+constexpr std::size_t DATABASE_LOOKUPS = 1000;
+constexpr int LOGIN_ITERATIONS = 5;
+
+double Milliseconds(Clock::duration elapsed) {
+    return std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+struct Result {
+    std::string name;
+    std::vector<std::pair<std::string, std::uint64_t>> params;
+    std::vector<double> samples;
+    // Payload bytes handled by each sample, for the throughput column.
+    std::uint64_t bytesPerSample = 0;
+};
+
+std::string JsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+std::string JsonNumber(double value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.4f", value);
+    return text;
+}
+
+class Suite {
+public:
+    Suite(bool quick, std::string filter) : quick_(quick), filter_(std::move(filter)) {}
+
+    bool quick() const noexcept { return quick_; }
+
+    bool Wants(const std::string& name) const {
+        return filter_.empty() || name.find(filter_) != std::string::npos;
+    }
+
+    bool WantsAny(std::initializer_list<const char*> names) const {
+        return std::any_of(names.begin(), names.end(),
+                           [this](const char* name) { return Wants(name); });
+    }
+
+    void Add(Result result) {
+        if (result.samples.empty()) {
+            return;
+        }
+        std::cerr << result.name;
+        for (const auto& [key, value] : result.params) {
+            std::cerr << " " << key << "=" << value;
+        }
+        std::cerr << ": " << JsonNumber(Mean(result)) << " ms" << std::endl;
+        results_.push_back(std::move(result));
+    }
+
+    void Fail(const std::string& what) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures_.push_back(what);
+    }
+
+    bool failed() const noexcept { return !failures_.empty(); }
+
+    void Write(std::ostream& out) const {
+        char timestamp[32] = "";
+        const std::time_t now = std::time(nullptr);
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+        out << "{\n  \"suite\": \"pqcwallet_bench\",\n  \"schema\": 1,\n"
+            << "  \"timestamp\": " << JsonString(timestamp) << ",\n"
+            << "  \"quick\": " << (quick_ ? "true" : "false") << ",\n"
+            << "  \"results\": [";
+        for (std::size_t i = 0; i < results_.size(); ++i) {
+            const Result& result = results_[i];
+            std::vector<double> sorted = result.samples;
+            std::sort(sorted.begin(), sorted.end());
+            const double mean = Mean(result);
+            out << (i == 0 ? "\n" : ",\n") << "    {\"name\": " << JsonString(result.name)
+                << ", \"params\": {";
+            for (std::size_t p = 0; p < result.params.size(); ++p) {
+                out << (p == 0 ? "" : ", ") << JsonString(result.params[p].first) << ": "
+                    << result.params[p].second;
+            }
+            out << "}, \"iterations\": " << sorted.size()
+                << ", \"mean_ms\": " << JsonNumber(mean)
+                << ", \"median_ms\": " << JsonNumber(sorted[sorted.size() / 2])
+                << ", \"min_ms\": " << JsonNumber(sorted.front())
+                << ", \"max_ms\": " << JsonNumber(sorted.back());
+            if (result.bytesPerSample != 0 && mean > 0) {
+                out << ", \"mib_per_s\": "
+                    << JsonNumber(static_cast<double>(result.bytesPerSample) / MIB / (mean / 1000.0));
+            }
+            out << "}";
+        }
+        out << "\n  ],\n  \"failures\": [";
+        for (std::size_t i = 0; i < failures_.size(); ++i) {
+            out << (i == 0 ? "" : ", ") << JsonString(failures_[i]);
+        }
+        out << "]\n}\n";
+    }
+
+private:
+    static double Mean(const Result& result) {
+        double total = 0;
+        for (const double sample : result.samples) {
+            total += sample;
+        }
+        return total / static_cast<double>(result.samples.size());
+    }
+
+    bool quick_;
+    std::string filter_;
+    std::vector<Result> results_;
+    std::vector<std::string> failures_;
+};
+
+// Runs each case in its own directory, since archives, user files and the
+// transaction journal all live relative to the working directory.
+class Workspace {
+public:
+    explicit Workspace(const fs::path& root) : previous_(fs::current_path()), path_(root) {
+        fs::create_directories(path_);
+        fs::current_path(path_);
+    }
+
+    ~Workspace() {
+        std::error_code error;
+        fs::current_path(previous_, error);
+        fs::remove_all(path_, error);
+    }
+
+    Workspace(const Workspace&) = delete;
+    Workspace& operator=(const Workspace&) = delete;
+
+    const fs::path& path() const noexcept { return path_; }
+
+private:
+    fs::path previous_;
+    fs::path path_;
+};
+
+// Incompressible, never-repeating content so neither compression nor
+// deduplication shortcuts the measured work.
+class ContentGenerator {
+public:
+    explicit ContentGenerator(std::uint64_t seed) : state_(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+
+    void Fill(std::vector<std::uint8_t>& buffer) {
+        std::size_t i = 0;
+        for (; i + sizeof(std::uint64_t) <= buffer.size(); i += sizeof(std::uint64_t)) {
+            const std::uint64_t value = Next();
+            std::memcpy(buffer.data() + i, &value, sizeof(value));
+        }
+        for (; i < buffer.size(); ++i) {
+            buffer[i] = static_cast<std::uint8_t>(Next());
+        }
+    }
+
+private:
+    std::uint64_t Next() noexcept {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 7;
+        state_ ^= state_ << 17;
+        return state_;
+    }
+
+    std::uint64_t state_;
+};
+
+bool WriteSource(const fs::path& path, std::uint64_t size, ContentGenerator& generator) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    std::vector<std::uint8_t> chunk(static_cast<std::size_t>(std::min<std::uint64_t>(size, 4 * MIB)));
+    std::uint64_t remaining = size;
+    while (file && remaining != 0) {
+        const std::size_t part = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, chunk.size()));
+        chunk.resize(part);
+        generator.Fill(chunk);
+        file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(part));
+        remaining -= part;
+    }
+    return static_cast<bool>(file);
+}
+
+std::string EntryName(std::size_t i) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "entry-%06zu.bin", i);
+    return name;
+}
+
+template <typename Operation>
+bool Sample(Result& result, Operation&& operation) {
+    const auto start = Clock::now();
+    const bool ok = operation();
+    result.samples.push_back(Milliseconds(Clock::now() - start));
+    return ok;
+}
+
+void BenchmarkArchive(Suite& suite, const fs::path& root, std::uint64_t totalBytes,
+                      std::size_t entries) {
+    const std::uint64_t entryBytes = std::max<std::uint64_t>(totalBytes / entries, 1);
+    const std::vector<std::pair<std::string, std::uint64_t>> params = {
+        {"bytes", entryBytes * entries}, {"entries", entries}};
+    const auto make = [&](const char* name, std::uint64_t bytesPerSample) {
+        Result result;
+        result.name = name;
+        result.params = params;
+        result.bytesPerSample = bytesPerSample;
+        return result;
+    };
+    const std::string label = "archive " + std::to_string(entryBytes * entries) + " bytes, " +
+                              std::to_string(entries) + " entries";
+
+    Workspace workspace(root / ("archive_" + std::to_string(totalBytes) + "_" + std::to_string(entries)));
+    const fs::path sources = workspace.path() / "sources";
+    fs::create_directories(sources);
+    ContentGenerator generator(entries ^ totalBytes);
+    std::vector<std::pair<std::string, std::string>> files;
+    files.reserve(entries);
+    for (std::size_t i = 0; i < entries; ++i) {
+        const fs::path source = sources / EntryName(i);
+        if (!WriteSource(source, entryBytes, generator)) {
+            suite.Fail(label + ": could not write source files");
+            return;
+        }
+        files.emplace_back(source.string(), EntryName(i));
+    }
+    const fs::path extraSource = sources / "extra.bin";
+    if (!WriteSource(extraSource, std::min<std::uint64_t>(entryBytes, MIB), generator)) {
+        suite.Fail(label + ": could not write source files");
+        return;
+    }
+
+    {
+        // The writer holds the archive lock until it is destroyed.
+        CryptoArchive writer("bench", "archive");
+        if (!writer.InitializeArchive(PASSWORD)) {
+            suite.Fail(label + ": InitializeArchive");
+            return;
+        }
+        // Building the archive is itself the batch AddFiles measurement.
+        Result addFiles = make("archive.add_files", entryBytes * entries);
+        std::string error;
+        if (!Sample(addFiles, [&] { return writer.AddFiles(files, &error); })) {
+            suite.Fail(label + ": AddFiles: " + error);
+            return;
+        }
+        if (suite.Wants(addFiles.name)) {
+            suite.Add(std::move(addFiles));
+        }
+        if (suite.Wants("archive.add_file")) {
+            Result addFile = make("archive.add_file", std::min<std::uint64_t>(entryBytes, MIB));
+            if (!Sample(addFile, [&] { return writer.AddFile(extraSource.string(), "extra.bin"); })) {
+                suite.Fail(label + ": AddFile");
+            }
+            suite.Add(std::move(addFile));
+        }
+        if (suite.Wants("archive.save")) {
+            Result save = make("archive.save", 0);
+            for (int i = 0; i < 3; ++i) {
+                if (!Sample(save, [&] { return writer.SaveArchive(); })) {
+                    suite.Fail(label + ": SaveArchive");
+                    break;
+                }
+            }
+            suite.Add(std::move(save));
+        }
+    }
+    fs::remove_all(sources);
+
+    CryptoArchive reader("bench", "archive");
+    Result load = make("archive.load", 0);
+    if (!Sample(load, [&] { return reader.LoadArchive(PASSWORD); })) {
+        suite.Fail(label + ": LoadArchive");
+        return;
+    }
+    if (suite.Wants(load.name)) {
+        suite.Add(std::move(load));
+    }
+
+    if (suite.Wants("archive.extract")) {
+        // Extract an even sample, so the largest entry counts stay bounded.
+        const std::size_t step = std::max<std::size_t>(entries / MAX_EXTRACTED_ENTRIES, 1);
+        const fs::path output = workspace.path() / "extracted";
+        fs::create_directories(output);
+        Result extract = make("archive.extract", entryBytes);
+        for (std::size_t i = 0; i < entries; i += step) {
+            if (!Sample(extract, [&] { return reader.ExtractFile(EntryName(i), output.string()); })) {
+                suite.Fail(label + ": ExtractFile " + EntryName(i));
+                break;
+            }
+            std::error_code ignored;
+            fs::remove(output / EntryName(i), ignored);
+        }
+        suite.Add(std::move(extract));
+    }
+    if (suite.Wants("archive.verify")) {
+        Result verify = make("archive.verify", entryBytes * entries);
+        if (!Sample(verify, [&] { return reader.VerifyIntegrity(); })) {
+            suite.Fail(label + ": VerifyIntegrity");
+        }
+        suite.Add(std::move(verify));
+    }
+}
+
+// Seeds the database through the legacy plaintext format, which initialize()
+// migrates with one key derivation. Adding the records one by one would run
+// scrypt once per record.
+bool SeedDatabase(const fs::path& path, std::size_t records) {
+    SimpleJSON database;
+    for (std::size_t i = 0; i < records; ++i) {
+        EncryptedDatabase::UserRecord record;
+        record.username = "user" + std::to_string(i);
+        record.email = record.username + "@example.com";
+        record.website = "https://example.com/" + record.username;
+        record.encrypted_password = std::string(64, 'a');
+        record.salt = std::string(32, 'b');
+        record.created_at = "2026-01-02 08:30:00";
+        record.last_login = record.created_at;
+        database["user_" + record.username] = record.toJson().toJsonString();
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << "PQCWALLET_DB_v1.0\n" << database.toJsonString();
+    return static_cast<bool>(file);
+}
+
+void BenchmarkDatabase(Suite& suite, const fs::path& root, std::size_t records) {
+    const std::string label = "database with " + std::to_string(records) + " records";
+    Workspace workspace(root / ("database_" + std::to_string(records)));
+    const fs::path path = workspace.path() / "users.db";
+    if (!SeedDatabase(path, records)) {
+        suite.Fail(label + ": could not seed");
+        return;
+    }
+    EncryptedDatabase database(path.string(), PASSWORD);
+    if (!database.initialize()) {
+        suite.Fail(label + ": initialize");
+        return;
+    }
+
+    if (suite.Wants("database.add")) {
+        // Every add re-encrypts and rewrites the whole database.
+        Result add;
+        add.name = "database.add";
+        add.params = {{"records", records}};
+        for (int i = 0; i < 3; ++i) {
+            EncryptedDatabase::UserRecord record;
+            record.username = "added" + std::to_string(i);
+            record.email = record.username + "@example.com";
+            record.created_at = "2026-01-02 08:30:00";
+            if (!Sample(add, [&] { return database.addUser(record); })) {
+                suite.Fail(label + ": addUser");
+                break;
+            }
+        }
+        suite.Add(std::move(add));
+    }
+    if (suite.Wants("database.get")) {
+        Result get;
+        get.name = "database.get";
+        get.params = {{"records", records}, {"lookups", DATABASE_LOOKUPS}};
+        EncryptedDatabase::UserRecord record;
+        bool found = true;
+        Sample(get, [&] {
+            for (std::size_t i = 0; i < DATABASE_LOOKUPS; ++i) {
+                found &= database.getUser("user" + std::to_string((i * 7919U) % records), record);
+            }
+            return found;
+        });
+        if (!found) {
+            suite.Fail(label + ": getUser");
+        }
+        suite.Add(std::move(get));
+    }
+}
+
+void BenchmarkLogin(Suite& suite, const fs::path& root) {
+    Workspace workspace(root / "login");
+    PasswordManager manager;
+    if (!manager.CreateUser("bench", PASSWORD)) {
+        suite.Fail("login: CreateUser");
+        return;
+    }
+    Result verify;
+    verify.name = "login.verify_password";
+    for (int i = 0; i < LOGIN_ITERATIONS; ++i) {
+        if (!Sample(verify, [&] { return manager.VerifyPassword("bench", PASSWORD); })) {
+            suite.Fail("login: VerifyPassword");
+            break;
+        }
+    }
+    suite.Add(std::move(verify));
+}
+
+void BenchmarkTransaction(Suite& suite, const fs::path& root, std::size_t files,
+                          std::uint64_t fileBytes) {
+    Workspace workspace(root / ("transaction_" + std::to_string(files) + "_" + std::to_string(fileBytes)));
+    ContentGenerator generator(files * 31 + fileBytes);
+    std::vector<TransactionalFileBatch::Entry> entries(files);
+    for (std::size_t i = 0; i < files; ++i) {
+        entries[i].destination = workspace.path() / ("target" + std::to_string(i) + ".bin");
+        entries[i].replacement.resize(static_cast<std::size_t>(fileBytes));
+        generator.Fill(entries[i].replacement);
+        if (!WriteSource(entries[i].destination, fileBytes, generator)) {
+            suite.Fail("transaction: could not write targets");
+            return;
+        }
+    }
+    Result commit;
+    commit.name = "transaction.commit";
+    commit.params = {{"files", files}, {"bytes", files * fileBytes}};
+    commit.bytesPerSample = files * fileBytes;
+    for (int i = 0; i < 3; ++i) {
+        if (!Sample(commit, [&] { return TransactionalFileBatch::Commit(entries); })) {
+            suite.Fail("transaction: Commit");
+            break;
+        }
+    }
+    suite.Add(std::move(commit));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool quick = false;
+    std::string filter;
+    std::string outputPath;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (argument == "--quick") {
+            quick = true;
+        } else if (argument == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (argument == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else {
+            std::cerr << "usage: pqcwallet_bench [--quick] [--filter text] [--output file.json]"
+                      << std::endl;
+            return 2;
+        }
+    }
+
+    // Keep stdout for the JSON document.
+    Log::SetLevel(Log::Level::Warning);
+
+    Suite suite(quick, filter);
+    const fs::path root = fs::temp_directory_path() /
+                          ("pqcwallet_bench_" + std::to_string(Clock::now().time_since_epoch().count()));
+    try {
+        if (suite.WantsAny({"archive.add_files", "archive.add_file", "archive.save", "archive.load",
+                           "archive.extract", "archive.verify"})) {
+            const std::vector<std::pair<std::uint64_t, std::size_t>> sizes = {
+                {MIB, 1}, {16 * MIB, 16}, {256 * MIB, 64}, {1024 * MIB, 256}};
+            for (const auto& [bytes, entries] : sizes) {
+                if (!quick || bytes <= 16 * MIB) {
+                    BenchmarkArchive(suite, root, bytes, entries);
+                }
+            }
+            for (const std::size_t entries : {1U, 100U, 1000U, 10000U, 100000U}) {
+                if (!quick || entries <= 1000) {
+                    BenchmarkArchive(suite, root, entries * 1024ULL, entries);
+                }
+            }
+        }
+        if (suite.WantsAny({"database.add", "database.get"})) {
+            for (const std::size_t records : {10U, 100U, 1000U, 10000U, 100000U}) {
+                if (!quick || records <= 1000) {
+                    BenchmarkDatabase(suite, root, records);
+                }
+            }
+        }
+        if (suite.Wants("login.verify_password")) {
+            BenchmarkLogin(suite, root);
+        }
+        if (suite.Wants("transaction.commit")) {
+            BenchmarkTransaction(suite, root, 1, 4096);
+            BenchmarkTransaction(suite, root, 3, MIB);
+            if (!quick) {
+                BenchmarkTransaction(suite, root, 16, 16 * MIB);
+            }
+        }
+    } catch (const std::exception& exception) {
+        suite.Fail(std::string("exception: ") + exception.what());
+    }
+    std::error_code cleanupError;
+    fs::remove_all(root, cleanupError);
+    Log::Flush();
+
+    if (outputPath.empty()) {
+        suite.Write(std::cout);
+    } else {
+        std::ofstream output(outputPath, std::ios::trunc);
+        suite.Write(output);
+        if (!output) {
+            std::cerr << "Could not write " << outputPath << std::endl;
+            return 1;
+        }
+    }
+    return suite.failed() ? 1 : 0;
+}
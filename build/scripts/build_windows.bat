@@ -80,7 +80,7 @@ if defined VCPKG_ROOT (
     echo To use vcpkg:
     echo 1. Install vcpkg: https://github.com/Microsoft/vcpkg
     echo 2. Set VCPKG_ROOT environment variable
-    echo 3. Install dependencies: vcpkg install glfw3 openssl liboqs
+    echo 3. Install dependencies: vcpkg install glfw3 openssl zlib liboqs
     echo.
 )
 
@@ -101,7 +101,7 @@ if errorlevel 1 (
     echo.
     echo Common solutions:
     echo 1. Install missing dependencies using vcpkg:
-    echo    vcpkg install glfw3:x64-windows openssl:x64-windows
+    echo    vcpkg install glfw3:x64-windows openssl:x64-windows zlib:x64-windows
     echo.
     echo 2. Install liboqs manually:
     echo    - Download from: https://github.com/open-quantum-safe/liboqs
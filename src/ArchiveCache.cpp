@@ -0,0 +1,81 @@
+#include "ArchiveCache.h"
+
+#include "SecureMemory.h"
+
+#include <cstring>
+
+namespace ArchiveCache {
+
+SegmentCache::~SegmentCache() {
+    Clear();
+}
+
+void SegmentCache::SetBudget(std::size_t budget) {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = budget;
+    EvictTo(budget_);
+}
+
+bool SegmentCache::Lookup(const ArchiveIndex::BlobId& id, std::uint8_t* output,
+                          std::size_t size) {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    const auto found = segments_.find(id);
+    if (found == segments_.end() || found->second->data.size() != size ||
+        (size != 0 && output == nullptr)) {
+        ++misses_;
+        return false;
+    }
+    order_.splice(order_.begin(), order_, found->second);
+    if (size != 0) {
+        std::memcpy(output, found->second->data.data(), size);
+    }
+    ++hits_;
+    return true;
+}
+
+void SegmentCache::Insert(const ArchiveIndex::BlobId& id, const std::uint8_t* data,
+                          std::size_t size) {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    if (size == 0 || data == nullptr || size > budget_ || segments_.count(id) != 0) {
+        return;
+    }
+    EvictTo(budget_ - size);
+    order_.push_front(Segment{id, SecureMemory::SecureBytes(data, data + size)});
+    segments_[id] = order_.begin();
+    residentBytes_ += size;
+}
+
+void SegmentCache::EvictTo(std::size_t budget) noexcept {
+    while (residentBytes_ > budget && !order_.empty()) {
+        Segment& oldest = order_.back();
+        residentBytes_ -= oldest.data.size();
+        SecureMemory::Cleanse(oldest.data);
+        segments_.erase(oldest.id);
+        order_.pop_back();
+        ++evictions_;
+    }
+}
+
+void SegmentCache::Clear() noexcept {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    for (Segment& segment : order_) {
+        SecureMemory::Cleanse(segment.data);
+    }
+    order_.clear();
+    segments_.clear();
+    residentBytes_ = 0;
+}
+
+Stats SegmentCache::GetStats() const {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+    stats.residentBytes = residentBytes_;
+    stats.budget = budget_;
+    stats.segments = segments_.size();
+    return stats;
+}
+
+} // namespace ArchiveCache
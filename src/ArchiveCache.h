@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ArchiveIndex.h"
+#include "SecureArena.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Bounded LRU cache of decrypted archive segments, keyed by blob id. A blob id
+// always names the same plaintext: commits, compaction and re-keying carry a
+// stored segment over with its id, and new segments get fresh random ids. So
+// cached segments stay valid across commits, and entries that share segments
+// share their cache space. Evicted and cleared buffers are cleansed.
+namespace ArchiveCache {
+
+constexpr std::size_t DEFAULT_BUDGET = 64U * 1024U * 1024U;
+
+struct Stats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+    std::uint64_t residentBytes = 0;
+    std::uint64_t budget = 0;
+    std::size_t segments = 0;
+};
+
+class SegmentCache {
+public:
+    explicit SegmentCache(std::size_t budget = DEFAULT_BUDGET) : budget_(budget) {}
+    ~SegmentCache();
+
+    SegmentCache(const SegmentCache&) = delete;
+    SegmentCache& operator=(const SegmentCache&) = delete;
+
+    // A budget of zero disables caching. Shrinking evicts at once.
+    void SetBudget(std::size_t budget);
+
+    // Copy the cached plaintext of id, which must be exactly size bytes, to
+    // output and mark it most recently used. Counts a hit or a miss.
+    bool Lookup(const ArchiveIndex::BlobId& id, std::uint8_t* output, std::size_t size);
+
+    // Cache a copy of an authenticated segment, evicting the least recently
+    // used ones to stay within the budget. Segments larger than the budget
+    // are not cached.
+    void Insert(const ArchiveIndex::BlobId& id, const std::uint8_t* data, std::size_t size);
+
+    void Clear() noexcept;
+    Stats GetStats() const;
+
+private:
+    struct Segment {
+        ArchiveIndex::BlobId id;
+        SecureMemory::SecureBytes data;
+    };
+
+    void EvictTo(std::size_t budget) noexcept;
+
+    mutable std::mutex mutex_;
+    std::list<Segment> order_;  // Most recently used first.
+    std::map<ArchiveIndex::BlobId, std::list<Segment>::iterator> segments_;
+    std::size_t budget_;
+    std::size_t residentBytes_ = 0;
+    std::uint64_t hits_ = 0;
+    std::uint64_t misses_ = 0;
+    std::uint64_t evictions_ = 0;
+};
+
+} // namespace ArchiveCache
@@ -0,0 +1,110 @@
+#include "ArchiveChunker.h"
+
+#include "SecureMemory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+namespace ArchiveChunker {
+namespace {
+
+constexpr const char* GEAR_LABEL = "PQC_Vault segment gear";
+constexpr const char* DIGEST_LABEL = "PQC_Vault segment digest";
+
+// Normalized chunking: a stricter mask before the average size and a looser
+// one after it keep most segments close to the average. The high bits of the
+// gear hash depend on the most bytes, so the masks select those.
+constexpr std::uint64_t MASK_BEFORE_AVERAGE = ((1ULL << 20U) - 1U) << 44U;
+constexpr std::uint64_t MASK_AFTER_AVERAGE = ((1ULL << 16U) - 1U) << 48U;
+
+bool Hmac(const std::uint8_t* key, std::size_t keySize, const std::uint8_t* data,
+          std::size_t size, std::uint8_t* output) {
+    unsigned int outputSize = 0;
+    return size <= static_cast<std::size_t>(std::numeric_limits<int>::max()) &&
+           HMAC(EVP_sha256(), key, static_cast<int>(keySize), data, size, output,
+                &outputSize) != nullptr &&
+           outputSize == ArchiveIndex::DIGEST_SIZE;
+}
+
+} // namespace
+
+Chunker::Chunker(const ArchiveIndex::SegmentKey& segmentKey) {
+    std::vector<std::uint8_t> label(GEAR_LABEL, GEAR_LABEL + std::strlen(GEAR_LABEL));
+    label.resize(label.size() + sizeof(std::uint32_t));
+    std::array<std::uint8_t, ArchiveIndex::DIGEST_SIZE> block{};
+    constexpr std::size_t valuesPerBlock = block.size() / sizeof(std::uint64_t);
+    valid_ = true;
+    for (std::uint32_t counter = 0; valid_ && counter < gear_.size() / valuesPerBlock;
+         ++counter) {
+        for (std::size_t i = 0; i < sizeof(counter); ++i) {
+            label[label.size() - 1 - i] = static_cast<std::uint8_t>(counter >> (8U * i));
+        }
+        valid_ = Hmac(segmentKey.data(), segmentKey.size(), label.data(), label.size(),
+                      block.data());
+        for (std::size_t value = 0; valid_ && value < valuesPerBlock; ++value) {
+            std::uint64_t entry = 0;
+            for (std::size_t byte = 0; byte < sizeof(entry); ++byte) {
+                entry = (entry << 8U) | block[value * sizeof(entry) + byte];
+            }
+            gear_[counter * valuesPerBlock + value] = entry;
+        }
+    }
+    valid_ = valid_ && Hmac(segmentKey.data(), segmentKey.size(),
+                            reinterpret_cast<const std::uint8_t*>(DIGEST_LABEL),
+                            std::strlen(DIGEST_LABEL), digestKey_.data());
+    SecureMemory::Cleanse(block.data(), block.size());
+}
+
+Chunker::~Chunker() {
+    SecureMemory::Cleanse(gear_.data(), sizeof(gear_));
+    SecureMemory::Cleanse(digestKey_.data(), digestKey_.size());
+}
+
+std::size_t Chunker::CutPoint(const std::uint8_t* data, std::size_t size) const noexcept {
+    if (size <= MIN_SEGMENT_SIZE) {
+        return size;
+    }
+    const std::size_t limit = std::min(size, MAX_SEGMENT_SIZE);
+    const std::size_t average = std::min(limit, AVERAGE_SEGMENT_SIZE);
+    std::uint64_t hash = 0;
+    std::size_t position = MIN_SEGMENT_SIZE;
+    for (; position < average; ++position) {
+        hash = (hash << 1U) + gear_[data[position]];
+        if ((hash & MASK_BEFORE_AVERAGE) == 0) {
+            return position + 1;
+        }
+    }
+    for (; position < limit; ++position) {
+        hash = (hash << 1U) + gear_[data[position]];
+        if ((hash & MASK_AFTER_AVERAGE) == 0) {
+            return position + 1;
+        }
+    }
+    return limit;
+}
+
+std::vector<std::size_t> Chunker::Split(const std::uint8_t* data, std::size_t size) const {
+    std::vector<std::size_t> segments;
+    if (!valid_ || data == nullptr) {
+        return segments;
+    }
+    segments.reserve(size / AVERAGE_SEGMENT_SIZE + 1);
+    for (std::size_t offset = 0; offset < size;) {
+        const std::size_t length = CutPoint(data + offset, size - offset);
+        segments.push_back(length);
+        offset += length;
+    }
+    return segments;
+}
+
+bool Chunker::Digest(const std::uint8_t* data, std::size_t size,
+                     ArchiveIndex::Digest& digest) const {
+    return valid_ && (data != nullptr || size == 0) &&
+           Hmac(digestKey_.data(), digestKey_.size(), data, size, digest.data());
+}
+
+} // namespace ArchiveChunker
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "ArchiveIndex.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Content-defined segmentation of archive entry payloads for deduplication.
+// Segment boundaries follow the content (a gear rolling hash over the last 64
+// bytes), so inserting or removing bytes only changes the segments around the
+// edit and shifted content still produces the same segments. Segments are
+// identified by a keyed digest. Both the gear table and the digest key are
+// derived from the archive's secret segment key, so neither the boundaries nor
+// the digests can be predicted for known content.
+namespace ArchiveChunker {
+
+constexpr std::size_t MIN_SEGMENT_SIZE = 64U * 1024U;
+constexpr std::size_t AVERAGE_SEGMENT_SIZE = 256U * 1024U;
+constexpr std::size_t MAX_SEGMENT_SIZE = 1024U * 1024U;
+
+class Chunker {
+public:
+    explicit Chunker(const ArchiveIndex::SegmentKey& segmentKey);
+    ~Chunker();
+
+    Chunker(const Chunker&) = delete;
+    Chunker& operator=(const Chunker&) = delete;
+
+    [[nodiscard]] bool valid() const noexcept { return valid_; }
+
+    // Lengths of the segments that cover data, in order. Payloads up to
+    // MIN_SEGMENT_SIZE are a single segment.
+    std::vector<std::size_t> Split(const std::uint8_t* data, std::size_t size) const;
+
+    // Length of the segment at the start of data. Only the first
+    // MAX_SEGMENT_SIZE bytes are looked at, so a stream can cut segments as
+    // soon as that much of it is buffered, or its end has been reached.
+    std::size_t CutPoint(const std::uint8_t* data, std::size_t size) const noexcept;
+
+    // HMAC-SHA256 of a segment under the digest key.
+    bool Digest(const std::uint8_t* data, std::size_t size,
+                ArchiveIndex::Digest& digest) const;
+
+private:
+    std::array<std::uint64_t, 256> gear_{};
+    std::array<std::uint8_t, ArchiveIndex::DIGEST_SIZE> digestKey_{};
+    bool valid_ = false;
+};
+
+} // namespace ArchiveChunker
@@ -0,0 +1,212 @@
+#include "ArchiveCodec.h"
+
+#include "Metrics.h"
+#include "SecureMemory.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include <zlib.h>
+
+namespace ArchiveCodec {
+namespace {
+
+// Raw deflate: the stream is already authenticated by the chunk tags, so the
+// zlib header and Adler-32 trailer would only add bytes.
+constexpr int RAW_WINDOW_BITS = -15;
+constexpr int MEMORY_LEVEL = 8;
+constexpr std::size_t SAMPLE_WINDOWS = 4;
+constexpr std::size_t SAMPLE_WINDOW_SIZE = 4096;
+constexpr double MAX_SAMPLE_ENTROPY = 7.5;
+constexpr std::size_t INFLATE_BLOCK_SIZE = 64 * 1024;
+
+struct Signature {
+    std::size_t offset;
+    std::size_t size;
+    const char* bytes;
+};
+
+// Containers whose payload is already compressed or encoded media.
+constexpr std::array<Signature, 11> COMPRESSED_SIGNATURES = {{
+    {0, 3, "\xff\xd8\xff"},                       // JPEG
+    {0, 8, "\x89PNG\r\n\x1a\n"},                  // PNG
+    {0, 4, "GIF8"},                               // GIF
+    {0, 4, "PK\x03\x04"},                         // ZIP, Office, JAR
+    {0, 2, "\x1f\x8b"},                           // gzip
+    {0, 3, "BZh"},                                // bzip2
+    {0, 6, "\xfd" "7zXZ\x00"},                    // xz
+    {0, 6, "7z\xbc\xaf\x27\x1c"},                 // 7-Zip
+    {0, 4, "\x28\xb5\x2f\xfd"},                   // zstd
+    {0, 6, "Rar!\x1a\x07"},                       // RAR
+    {4, 4, "ftyp"},                               // MP4, MOV, HEIC
+}};
+
+bool HasCompressedSignature(const std::uint8_t* data, std::size_t size) noexcept {
+    for (const Signature& signature : COMPRESSED_SIGNATURES) {
+        if (size >= signature.offset + signature.size &&
+            std::memcmp(data + signature.offset, signature.bytes, signature.size) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Order-0 entropy in bits per byte over a few windows spread across the payload.
+double SampleEntropy(const std::uint8_t* data, std::size_t size) noexcept {
+    std::array<std::uint64_t, 256> counts{};
+    std::uint64_t total = 0;
+    const std::size_t window = std::min(size, SAMPLE_WINDOW_SIZE);
+    for (std::size_t i = 0; i < SAMPLE_WINDOWS; ++i) {
+        const std::size_t start = (size - window) / (SAMPLE_WINDOWS - 1) * i;
+        for (std::size_t j = 0; j < window; ++j) {
+            ++counts[data[start + j]];
+        }
+        total += window;
+    }
+    double entropy = 0.0;
+    for (const std::uint64_t count : counts) {
+        if (count != 0) {
+            const double probability = static_cast<double>(count) / static_cast<double>(total);
+            entropy -= probability * std::log2(probability);
+        }
+    }
+    return entropy;
+}
+
+} // namespace
+
+bool IsKnown(std::uint8_t codec) noexcept {
+    return codec == STORED || codec == DEFLATE;
+}
+
+bool LooksCompressible(const std::uint8_t* data, std::size_t size) noexcept {
+    return data != nullptr && size >= MIN_COMPRESSED_INPUT &&
+           !HasCompressedSignature(data, size) &&
+           SampleEntropy(data, size) < MAX_SAMPLE_ENTROPY;
+}
+
+bool Compress(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& packed) {
+    const Metrics::ScopedTimer timer(Metrics::Stage::Compression, size);
+    SecureMemory::Cleanse(packed);
+    packed.clear();
+    if (data == nullptr || size < MIN_COMPRESSED_INPUT ||
+        size > std::numeric_limits<uInt>::max()) {
+        return false;
+    }
+
+    z_stream stream{};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, RAW_WINDOW_BITS,
+                     MEMORY_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    // Anything above this limit is not worth keeping, so deflate stops there.
+    const std::size_t limit = size - size / 16;
+    packed.resize(limit);
+    stream.next_in = const_cast<Bytef*>(data);
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = packed.data();
+    stream.avail_out = static_cast<uInt>(packed.size());
+    const int result = deflate(&stream, Z_FINISH);
+    const std::size_t packedSize = static_cast<std::size_t>(stream.total_out);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END || packedSize >= limit) {
+        SecureMemory::Cleanse(packed);
+        packed.clear();
+        return false;
+    }
+    packed.resize(packedSize);
+    return true;
+}
+
+bool Decompress(const std::uint8_t* packed, std::size_t packedSize,
+                std::uint8_t* data, std::size_t size) {
+    const Metrics::ScopedTimer timer(Metrics::Stage::Compression, size);
+    if ((packedSize != 0 && packed == nullptr) || (size != 0 && data == nullptr) ||
+        packedSize > std::numeric_limits<uInt>::max() ||
+        size > std::numeric_limits<uInt>::max()) {
+        return false;
+    }
+
+    z_stream stream{};
+    if (inflateInit2(&stream, RAW_WINDOW_BITS) != Z_OK) {
+        return false;
+    }
+    stream.next_in = const_cast<Bytef*>(packed);
+    stream.avail_in = static_cast<uInt>(packedSize);
+    stream.next_out = data;
+    stream.avail_out = static_cast<uInt>(size);
+    const int result = inflate(&stream, Z_FINISH);
+    const bool complete = result == Z_STREAM_END && stream.avail_in == 0 &&
+                          stream.total_out == size;
+    inflateEnd(&stream);
+    if (!complete) {
+        SecureMemory::Cleanse(data, size);
+    }
+    return complete;
+}
+
+Inflater::Inflater(std::uint64_t expectedSize, ArchiveStream::Sink sink)
+    : stream_(std::make_unique<z_stream>()), sink_(std::move(sink)),
+      output_(INFLATE_BLOCK_SIZE), expectedSize_(expectedSize) {
+    if (!sink_ || inflateInit2(stream_.get(), RAW_WINDOW_BITS) != Z_OK) {
+        stream_.reset();
+        failed_ = true;
+    }
+}
+
+Inflater::~Inflater() {
+    if (stream_) {
+        inflateEnd(stream_.get());
+    }
+    SecureMemory::Cleanse(output_);
+}
+
+bool Inflater::Write(const std::uint8_t* data, std::size_t size) {
+    const Metrics::ScopedTimer timer(Metrics::Stage::Compression, size);
+    if (failed_ || (size != 0 && data == nullptr) || (ended_ && size != 0)) {
+        failed_ = true;
+        return false;
+    }
+    while (size != 0) {
+        const std::size_t count = std::min<std::size_t>(size, std::numeric_limits<uInt>::max());
+        stream_->next_in = const_cast<Bytef*>(data);
+        stream_->avail_in = static_cast<uInt>(count);
+        do {
+            stream_->next_out = output_.data();
+            stream_->avail_out = static_cast<uInt>(output_.size());
+            const int result = inflate(stream_.get(), Z_NO_FLUSH);
+            const std::size_t produced = output_.size() - stream_->avail_out;
+            if (result == Z_BUF_ERROR && produced == 0) {
+                break;  // Everything written so far is consumed.
+            }
+            if ((result != Z_OK && result != Z_STREAM_END) ||
+                produced > expectedSize_ - producedBytes_ ||
+                (produced != 0 && !sink_(output_.data(), produced))) {
+                failed_ = true;
+                return false;
+            }
+            producedBytes_ += produced;
+            if (result == Z_STREAM_END) {
+                ended_ = true;
+                // Bytes after the end of the deflate stream are not allowed.
+                if (stream_->avail_in != 0) {
+                    failed_ = true;
+                    return false;
+                }
+            }
+        } while (!ended_ && (stream_->avail_in != 0 || stream_->avail_out == 0));
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool Inflater::Finish() {
+    return !failed_ && ended_ && producedBytes_ == expectedSize_;
+}
+
+} // namespace ArchiveCodec
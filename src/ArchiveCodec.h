@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ArchiveStream.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct z_stream_s;
+
+// Optional compression of archive entry payloads before they are sealed. A
+// payload is stored compressed only when a cheap sample suggests it is
+// compressible and the result is clearly smaller; the codec and both sizes are
+// recorded in the authenticated index entry.
+namespace ArchiveCodec {
+
+constexpr std::uint8_t STORED = 0;
+constexpr std::uint8_t DEFLATE = 1;
+
+// Payloads below this size are never compressed.
+constexpr std::size_t MIN_COMPRESSED_INPUT = 512;
+
+bool IsKnown(std::uint8_t codec) noexcept;
+
+// False for well-known compressed formats (JPEG, PNG, ZIP, gzip, ...) and for
+// payloads whose sampled byte entropy is close to eight bits.
+bool LooksCompressible(const std::uint8_t* data, std::size_t size) noexcept;
+
+// Raw deflate of data. Returns false and leaves packed empty when the payload
+// does not shrink by at least 1/16.
+bool Compress(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& packed);
+
+// Inflates a complete packed payload that must expand to exactly size bytes
+// at data. data is cleansed when it does not.
+bool Decompress(const std::uint8_t* packed, std::size_t packedSize,
+                std::uint8_t* data, std::size_t size);
+
+// Streaming form of Decompress: packed bytes are written in any split and the
+// inflated bytes reach sink in blocks. Finish fails unless the stream ended
+// after exactly expectedSize bytes.
+class Inflater {
+public:
+    Inflater(std::uint64_t expectedSize, ArchiveStream::Sink sink);
+    ~Inflater();
+
+    Inflater(const Inflater&) = delete;
+    Inflater& operator=(const Inflater&) = delete;
+
+    bool Write(const std::uint8_t* data, std::size_t size);
+    bool Finish();
+
+private:
+    std::unique_ptr<z_stream_s> stream_;
+    ArchiveStream::Sink sink_;
+    std::vector<std::uint8_t> output_;
+    std::uint64_t expectedSize_;
+    std::uint64_t producedBytes_ = 0;
+    bool ended_ = false;
+    bool failed_ = false;
+};
+
+} // namespace ArchiveCodec
@@ -0,0 +1,303 @@
+#include "ArchiveIndex.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace ArchiveIndex {
+namespace {
+
+constexpr std::uint64_t FIXED_HEADER_SIZE =
+    3 * sizeof(std::uint32_t) + SEGMENT_KEY_SIZE + DIGEST_SIZE;
+constexpr std::uint64_t FIXED_SEGMENT_SIZE =
+    BLOB_ID_SIZE + sizeof(std::uint64_t) + 1 + 2 * sizeof(std::uint64_t) + DIGEST_SIZE;
+constexpr std::uint64_t FIXED_ENTRY_SIZE =
+    sizeof(std::uint16_t) + sizeof(std::uint64_t) + 1 + 1 + sizeof(std::uint32_t);
+constexpr std::uint64_t FIXED_ENTRY_SIZE_V1 =
+    sizeof(std::uint16_t) + sizeof(std::uint64_t) + 1 + 1 + BLOB_ID_SIZE +
+    sizeof(std::uint64_t);
+constexpr std::uint64_t FIXED_ENTRY_SIZE_V2 = FIXED_ENTRY_SIZE_V1 + 1 + sizeof(std::uint64_t);
+
+template <typename T>
+void AppendBe(std::vector<std::uint8_t>& output, T value) {
+    for (int shift = static_cast<int>(sizeof(T) * 8) - 8; shift >= 0; shift -= 8) {
+        output.push_back(
+            static_cast<std::uint8_t>((static_cast<std::uint64_t>(value) >> shift) & 0xffU));
+    }
+}
+
+template <typename T>
+bool ReadBe(const ArchiveStream::Source& source, std::uint64_t& remaining, T& value) {
+    std::array<std::uint8_t, sizeof(T)> bytes{};
+    if (remaining < bytes.size() || !source(bytes.data(), bytes.size())) {
+        return false;
+    }
+    remaining -= bytes.size();
+    std::uint64_t decoded = 0;
+    for (const std::uint8_t byte : bytes) {
+        decoded = (decoded << 8U) | byte;
+    }
+    value = static_cast<T>(decoded);
+    return true;
+}
+
+bool ReadBytes(const ArchiveStream::Source& source, std::uint64_t& remaining,
+               std::size_t size, std::string& value) {
+    if (remaining < size) {
+        return false;
+    }
+    value.assign(size, '\0');
+    if (size != 0 && !source(reinterpret_cast<std::uint8_t*>(value.data()), size)) {
+        return false;
+    }
+    remaining -= size;
+    return true;
+}
+
+template <std::size_t N>
+bool ReadArray(const ArchiveStream::Source& source, std::uint64_t& remaining,
+               std::array<std::uint8_t, N>& value) {
+    if (remaining < N || !source(value.data(), N)) {
+        return false;
+    }
+    remaining -= N;
+    return true;
+}
+
+// Name, size, timestamp and hash, common to every version.
+bool ReadEntryHeader(const ArchiveStream::Source& source, std::uint64_t& remaining,
+                     Entry& entry) {
+    std::uint16_t nameSize = 0;
+    std::uint8_t timestampSize = 0;
+    std::uint8_t hashSize = 0;
+    return ReadBe(source, remaining, nameSize) && nameSize != 0 &&
+           nameSize <= MAX_NAME_SIZE &&
+           ReadBytes(source, remaining, nameSize, entry.name) &&
+           ReadBe(source, remaining, entry.size) &&
+           ReadBe(source, remaining, timestampSize) &&
+           timestampSize <= MAX_TIMESTAMP_SIZE &&
+           ReadBytes(source, remaining, timestampSize, entry.timestamp) &&
+           ReadBe(source, remaining, hashSize) && hashSize <= MAX_HASH_SIZE &&
+           ReadBytes(source, remaining, hashSize, entry.hash);
+}
+
+// A compressed blob is kept only when it is smaller than the payload.
+bool StoredSizeValid(const Segment& segment) noexcept {
+    return segment.codec == 0 ? segment.storedSize == segment.size
+                              : segment.storedSize < segment.size;
+}
+
+bool SegmentFits(const Segment& segment, std::size_t chunkSize,
+                 std::uint64_t blobRegionBegin, std::uint64_t blobRegionEnd) noexcept {
+    const std::uint64_t sealedSize = ArchiveStream::SealedSize(segment.storedSize, chunkSize);
+    return chunkSize != 0 && sealedSize >= segment.storedSize && StoredSizeValid(segment) &&
+           segment.blobOffset >= blobRegionBegin && segment.blobOffset <= blobRegionEnd &&
+           sealedSize <= blobRegionEnd - segment.blobOffset;
+}
+
+// Every segment is used, and the segments of each entry add up to its size.
+bool ReferencesValid(const Index& index) {
+    std::vector<bool> referenced(index.segments.size(), false);
+    for (const Entry& entry : index.entries) {
+        std::uint64_t total = 0;
+        for (const std::uint32_t segment : entry.segments) {
+            if (segment >= index.segments.size() ||
+                index.segments[segment].size > entry.size - total) {
+                return false;
+            }
+            total += index.segments[segment].size;
+            referenced[segment] = true;
+        }
+        if (total != entry.size) {
+            return false;
+        }
+    }
+    return std::find(referenced.begin(), referenced.end(), false) == referenced.end();
+}
+
+bool DecodeSegments(const ArchiveStream::Source& source, std::uint64_t& remaining,
+                    bool hasRoot, std::size_t chunkSize, std::uint64_t blobRegionBegin,
+                    std::uint64_t blobRegionEnd, Index& index) {
+    std::uint32_t segmentCount = 0;
+    if (!ReadArray(source, remaining, index.segmentKey) ||
+        (hasRoot && !ReadArray(source, remaining, index.integrityRoot)) ||
+        !ReadBe(source, remaining, segmentCount) || segmentCount > MAX_SEGMENTS ||
+        remaining / FIXED_SEGMENT_SIZE < segmentCount) {
+        return false;
+    }
+    index.segments.reserve(segmentCount);
+    for (std::uint32_t i = 0; i < segmentCount; ++i) {
+        Segment segment;
+        if (!ReadArray(source, remaining, segment.blobId) ||
+            !ReadBe(source, remaining, segment.blobOffset) ||
+            !ReadBe(source, remaining, segment.codec) ||
+            !ReadBe(source, remaining, segment.storedSize) ||
+            !ReadBe(source, remaining, segment.size) ||
+            !ReadArray(source, remaining, segment.digest) || segment.size == 0 ||
+            !SegmentFits(segment, chunkSize, blobRegionBegin, blobRegionEnd)) {
+            return false;
+        }
+        index.segments.push_back(segment);
+    }
+
+    std::uint32_t entryCount = 0;
+    if (!ReadBe(source, remaining, entryCount) || entryCount > MAX_ENTRIES ||
+        remaining / FIXED_ENTRY_SIZE < entryCount) {
+        return false;
+    }
+    index.entries.reserve(entryCount);
+    for (std::uint32_t i = 0; i < entryCount; ++i) {
+        Entry entry;
+        std::uint32_t referenceCount = 0;
+        if (!ReadEntryHeader(source, remaining, entry) ||
+            !ReadBe(source, remaining, referenceCount) ||
+            remaining / sizeof(std::uint32_t) < referenceCount) {
+            return false;
+        }
+        entry.segments.resize(referenceCount);
+        for (std::uint32_t& segment : entry.segments) {
+            if (!ReadBe(source, remaining, segment)) {
+                return false;
+            }
+        }
+        index.entries.push_back(std::move(entry));
+    }
+    return ReferencesValid(index);
+}
+
+// Versions 1 and 2: the blob of every entry is stored inline.
+bool DecodeSingleBlobs(const ArchiveStream::Source& source, std::uint64_t& remaining,
+                       bool hasCodec, std::size_t chunkSize, std::uint64_t blobRegionBegin,
+                       std::uint64_t blobRegionEnd, Index& index) {
+    std::uint32_t entryCount = 0;
+    if (!ReadBe(source, remaining, entryCount) || entryCount > MAX_ENTRIES ||
+        remaining / (hasCodec ? FIXED_ENTRY_SIZE_V2 : FIXED_ENTRY_SIZE_V1) < entryCount) {
+        return false;
+    }
+    index.entries.reserve(entryCount);
+    for (std::uint32_t i = 0; i < entryCount; ++i) {
+        Entry entry;
+        Segment segment;
+        if (!ReadEntryHeader(source, remaining, entry) ||
+            !ReadArray(source, remaining, segment.blobId) ||
+            !ReadBe(source, remaining, segment.blobOffset)) {
+            return false;
+        }
+        segment.size = entry.size;
+        segment.storedSize = entry.size;
+        if ((hasCodec && (!ReadBe(source, remaining, segment.codec) ||
+                          !ReadBe(source, remaining, segment.storedSize))) ||
+            !SegmentFits(segment, chunkSize, blobRegionBegin, blobRegionEnd)) {
+            return false;
+        }
+        // An empty payload needs no segment.
+        if (entry.size != 0) {
+            entry.segments.push_back(static_cast<std::uint32_t>(index.segments.size()));
+            index.segments.push_back(segment);
+        }
+        index.entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+} // namespace
+
+std::uint64_t EncodedSize(const Index& index) noexcept {
+    std::uint64_t size = FIXED_HEADER_SIZE + index.segments.size() * FIXED_SEGMENT_SIZE;
+    for (const Entry& entry : index.entries) {
+        size += FIXED_ENTRY_SIZE + entry.name.size() + entry.timestamp.size() +
+                entry.hash.size() + entry.segments.size() * sizeof(std::uint32_t);
+    }
+    return size;
+}
+
+bool Encode(const Index& index, const ArchiveStream::Sink& sink) {
+    if (index.entries.size() > MAX_ENTRIES || index.segments.size() > MAX_SEGMENTS ||
+        !ReferencesValid(index)) {
+        return false;
+    }
+
+    std::vector<std::uint8_t> record;
+    AppendBe(record, FORMAT_VERSION);
+    record.insert(record.end(), index.segmentKey.begin(), index.segmentKey.end());
+    record.insert(record.end(), index.integrityRoot.begin(), index.integrityRoot.end());
+    AppendBe(record, static_cast<std::uint32_t>(index.segments.size()));
+    if (!sink(record.data(), record.size())) {
+        return false;
+    }
+
+    for (const Segment& segment : index.segments) {
+        if (segment.size == 0 || !StoredSizeValid(segment)) {
+            return false;
+        }
+        record.clear();
+        record.insert(record.end(), segment.blobId.begin(), segment.blobId.end());
+        AppendBe(record, segment.blobOffset);
+        AppendBe(record, segment.codec);
+        AppendBe(record, segment.storedSize);
+        AppendBe(record, segment.size);
+        record.insert(record.end(), segment.digest.begin(), segment.digest.end());
+        if (!sink(record.data(), record.size())) {
+            return false;
+        }
+    }
+
+    record.clear();
+    AppendBe(record, static_cast<std::uint32_t>(index.entries.size()));
+    if (!sink(record.data(), record.size())) {
+        return false;
+    }
+    for (const Entry& entry : index.entries) {
+        if (entry.name.empty() || entry.name.size() > MAX_NAME_SIZE ||
+            entry.timestamp.size() > MAX_TIMESTAMP_SIZE ||
+            entry.hash.size() > MAX_HASH_SIZE) {
+            return false;
+        }
+        record.clear();
+        AppendBe(record, static_cast<std::uint16_t>(entry.name.size()));
+        record.insert(record.end(), entry.name.begin(), entry.name.end());
+        AppendBe(record, entry.size);
+        AppendBe(record, static_cast<std::uint8_t>(entry.timestamp.size()));
+        record.insert(record.end(), entry.timestamp.begin(), entry.timestamp.end());
+        AppendBe(record, static_cast<std::uint8_t>(entry.hash.size()));
+        record.insert(record.end(), entry.hash.begin(), entry.hash.end());
+        AppendBe(record, static_cast<std::uint32_t>(entry.segments.size()));
+        for (const std::uint32_t segment : entry.segments) {
+            AppendBe(record, segment);
+        }
+        if (!sink(record.data(), record.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Decode(const ArchiveStream::Source& source, std::uint64_t encodedSize,
+            std::size_t chunkSize, std::uint64_t blobRegionBegin,
+            std::uint64_t blobRegionEnd, Index& index) {
+    index = Index{};
+    if (!source || blobRegionBegin > blobRegionEnd) {
+        return false;
+    }
+
+    std::uint64_t remaining = encodedSize;
+    std::uint32_t version = 0;
+    bool decoded = false;
+    if (ReadBe(source, remaining, version)) {
+        if (version == FORMAT_VERSION || version == SEGMENTED_FORMAT_VERSION) {
+            decoded = DecodeSegments(source, remaining, version == FORMAT_VERSION, chunkSize,
+                                     blobRegionBegin, blobRegionEnd, index);
+        } else if (version == SINGLE_BLOB_FORMAT_VERSION ||
+                   version == UNCOMPRESSED_FORMAT_VERSION) {
+            decoded = DecodeSingleBlobs(source, remaining,
+                                        version == SINGLE_BLOB_FORMAT_VERSION, chunkSize,
+                                        blobRegionBegin, blobRegionEnd, index);
+        }
+    }
+    if (!decoded || remaining != 0) {
+        index = Index{};
+        return false;
+    }
+    return true;
+}
+
+} // namespace ArchiveIndex
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "ArchiveStream.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Plaintext table of contents of a PQCENC04/05 container. It is sealed on its own
+// so that opening an archive only decrypts metadata; entry payloads live in
+// independently sealed blobs elsewhere in the container.
+//
+// Encoding (big-endian):
+//   [version:4][segmentKey:32][integrityRoot:32][segmentCount:4] then per segment
+//   [blobId:16][blobOffset:8][codec:1][storedSize:8][size:8][digest:32]
+//   then [entryCount:4] and per entry
+//   [nameLen:2][name][size:8][timestampLen:1][timestamp][hashLen:1][hash]
+//   [segmentCount:4][segment:4]...
+// A segment is one sealed blob holding size payload bytes, storedSize of them
+// after codec. Entries list the segments that make up their payload in order,
+// and entries with the same content share segments. digest is the keyed
+// digest of the segment plaintext under segmentKey (see ArchiveChunker).
+// integrityRoot is the root of the Merkle tree over the entries in index
+// order (see ArchiveMerkle); version 3 has no root and decodes with a zero one.
+//
+// Versions 1 and 2 store one blob per entry inline with the entry:
+//   [nameLen:2][name][size:8][timestampLen:1][timestamp][hashLen:1][hash]
+//   [blobId:16][blobOffset:8] and, from version 2, [codec:1][storedSize:8]
+// They decode into one segment per non-empty entry with a zero digest, which
+// never matches new content, and a zero segment key.
+namespace ArchiveIndex {
+
+constexpr std::uint32_t FORMAT_VERSION = 4;
+constexpr std::uint32_t SEGMENTED_FORMAT_VERSION = 3;
+constexpr std::uint32_t SINGLE_BLOB_FORMAT_VERSION = 2;
+constexpr std::uint32_t UNCOMPRESSED_FORMAT_VERSION = 1;
+constexpr std::size_t BLOB_ID_SIZE = 16;
+constexpr std::size_t SEGMENT_KEY_SIZE = 32;
+constexpr std::size_t DIGEST_SIZE = 32;
+constexpr std::uint32_t MAX_ENTRIES = 1U << 22;
+constexpr std::uint32_t MAX_SEGMENTS = 1U << 24;
+constexpr std::size_t MAX_NAME_SIZE = 1024;
+constexpr std::size_t MAX_TIMESTAMP_SIZE = 64;
+constexpr std::size_t MAX_HASH_SIZE = 128;
+
+using BlobId = std::array<std::uint8_t, BLOB_ID_SIZE>;
+using SegmentKey = std::array<std::uint8_t, SEGMENT_KEY_SIZE>;
+using Digest = std::array<std::uint8_t, DIGEST_SIZE>;
+
+struct Segment {
+    BlobId blobId{};
+    std::uint64_t blobOffset = 0;
+    std::uint8_t codec = 0;
+    std::uint64_t storedSize = 0;
+    std::uint64_t size = 0;
+    Digest digest{};
+};
+
+struct Entry {
+    std::string name;
+    std::uint64_t size = 0;
+    std::string timestamp;
+    std::string hash;
+    std::vector<std::uint32_t> segments;
+};
+
+struct Index {
+    SegmentKey segmentKey{};
+    Digest integrityRoot{};
+    std::vector<Segment> segments;
+    std::vector<Entry> entries;
+};
+
+std::uint64_t EncodedSize(const Index& index) noexcept;
+
+// Writes the current version. Every segment must be non-empty and referenced,
+// and the segments of an entry must add up to its size.
+bool Encode(const Index& index, const ArchiveStream::Sink& sink);
+
+// Decodes exactly encodedSize bytes of any version. Every blob must fit,
+// sealed with chunkSize, inside [blobRegionBegin, blobRegionEnd), and a raw
+// blob must store exactly size bytes. Names and codec ids are not checked
+// here; the archive validates them with its own policies.
+bool Decode(const ArchiveStream::Source& source, std::uint64_t encodedSize,
+            std::size_t chunkSize, std::uint64_t blobRegionBegin,
+            std::uint64_t blobRegionEnd, Index& index);
+
+} // namespace ArchiveIndex
@@ -0,0 +1,112 @@
+#include "ArchiveMerkle.h"
+
+#include <algorithm>
+#include <utility>
+
+#include <openssl/sha.h>
+
+namespace ArchiveMerkle {
+namespace {
+
+constexpr std::uint8_t LEAF_PREFIX = 0x00;
+constexpr std::uint8_t NODE_PREFIX = 0x01;
+
+Hash NodeHash(const Hash& left, const Hash& right) {
+    std::uint8_t input[1 + 2 * sizeof(Hash)];
+    input[0] = NODE_PREFIX;
+    std::copy(left.begin(), left.end(), input + 1);
+    std::copy(right.begin(), right.end(), input + 1 + left.size());
+    Hash node{};
+    SHA256(input, sizeof(input), node.data());
+    return node;
+}
+
+} // namespace
+
+Hash LeafHash(const std::string& name, std::uint64_t size, const std::string& hash) {
+    std::vector<std::uint8_t> input;
+    input.reserve(1 + 2 + name.size() + 8 + 1 + hash.size());
+    input.push_back(LEAF_PREFIX);
+    input.push_back(static_cast<std::uint8_t>((name.size() >> 8U) & 0xffU));
+    input.push_back(static_cast<std::uint8_t>(name.size() & 0xffU));
+    input.insert(input.end(), name.begin(), name.end());
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        input.push_back(static_cast<std::uint8_t>((size >> shift) & 0xffU));
+    }
+    input.push_back(static_cast<std::uint8_t>(hash.size() & 0xffU));
+    input.insert(input.end(), hash.begin(), hash.end());
+    Hash leaf{};
+    SHA256(input.data(), input.size(), leaf.data());
+    return leaf;
+}
+
+void Tree::Build(std::vector<Hash> leaves) {
+    levels_.clear();
+    levels_.push_back(std::move(leaves));
+    while (levels_.back().size() > 1) {
+        const std::vector<Hash>& below = levels_.back();
+        std::vector<Hash> level((below.size() + 1) / 2);
+        for (std::size_t i = 0; i < level.size(); ++i) {
+            level[i] = 2 * i + 1 < below.size() ? NodeHash(below[2 * i], below[2 * i + 1])
+                                                : below[2 * i];
+        }
+        levels_.push_back(std::move(level));
+    }
+}
+
+bool Tree::Update(std::size_t position, const Hash& leaf) {
+    if (position >= size()) {
+        return false;
+    }
+    levels_[0][position] = leaf;
+    for (std::size_t level = 1; level < levels_.size(); ++level) {
+        position /= 2;
+        Rehash(level, position);
+    }
+    return true;
+}
+
+void Tree::Rehash(std::size_t level, std::size_t position) {
+    const std::vector<Hash>& below = levels_[level - 1];
+    levels_[level][position] = 2 * position + 1 < below.size()
+        ? NodeHash(below[2 * position], below[2 * position + 1])
+        : below[2 * position];
+}
+
+std::size_t Tree::size() const noexcept {
+    return levels_.empty() ? 0 : levels_[0].size();
+}
+
+Hash Tree::Root() const {
+    if (size() == 0) {
+        Hash empty{};
+        SHA256(nullptr, 0, empty.data());
+        return empty;
+    }
+    return levels_.back()[0];
+}
+
+std::vector<PathStep> Tree::Path(std::size_t position) const {
+    std::vector<PathStep> path;
+    if (position >= size()) {
+        return path;
+    }
+    for (std::size_t level = 0; level + 1 < levels_.size(); ++level) {
+        const std::size_t sibling = position ^ 1U;
+        if (sibling < levels_[level].size()) {
+            path.push_back(PathStep{levels_[level][sibling], sibling < position});
+        }
+        position /= 2;
+    }
+    return path;
+}
+
+bool VerifyPath(const Hash& leaf, const std::vector<PathStep>& path, const Hash& root) {
+    Hash node = leaf;
+    for (const PathStep& step : path) {
+        node = step.siblingOnLeft ? NodeHash(step.sibling, node) : NodeHash(node, step.sibling);
+    }
+    return node == root;
+}
+
+} // namespace ArchiveMerkle
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ArchiveIndex.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Merkle tree over the entries of an archive index, in index order. A leaf
+// commits to the name, size and SHA-256 of one entry; the root is stored in
+// the sealed index, so one entry can be checked against it with the
+// log2(n) sibling hashes of its path instead of every other entry.
+//
+// Leaves are SHA-256(0x00 || [nameLen:2][name][size:8][hashLen:1][hash]) and
+// inner nodes SHA-256(0x01 || left || right), so a leaf can never be passed
+// off as an inner node. A node without a sibling is carried up unchanged.
+// The root of an empty tree is SHA-256 of the empty string.
+namespace ArchiveMerkle {
+
+using Hash = ArchiveIndex::Digest;
+
+Hash LeafHash(const std::string& name, std::uint64_t size, const std::string& hash);
+
+// One sibling on the way from a leaf to the root.
+struct PathStep {
+    Hash sibling{};
+    bool siblingOnLeft = false;
+};
+
+class Tree {
+public:
+    // Hashes every level above leaves.
+    void Build(std::vector<Hash> leaves);
+
+    // Replaces one leaf and rehashes only the nodes on its path.
+    bool Update(std::size_t position, const Hash& leaf);
+
+    [[nodiscard]] std::size_t size() const noexcept;
+    [[nodiscard]] const Hash& Leaf(std::size_t position) const { return levels_[0][position]; }
+    [[nodiscard]] Hash Root() const;
+
+    // Siblings from the leaf upwards; empty when position is out of range.
+    std::vector<PathStep> Path(std::size_t position) const;
+
+private:
+    void Rehash(std::size_t level, std::size_t position);
+
+    std::vector<std::vector<Hash>> levels_;
+};
+
+bool VerifyPath(const Hash& leaf, const std::vector<PathStep>& path, const Hash& root);
+
+} // namespace ArchiveMerkle
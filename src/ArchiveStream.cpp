@@ -0,0 +1,539 @@
+#include "ArchiveStream.h"
+
+#include "Metrics.h"
+#include "SecureMemory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+
+namespace ArchiveStream {
+namespace {
+
+using CipherContext = std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)>;
+
+bool InitializeContext(EVP_CIPHER_CTX* context, bool encrypt,
+                       const std::uint8_t* key, const std::uint8_t* nonce,
+                       const std::vector<std::uint8_t>& associatedData) {
+    const auto init = encrypt ? EVP_EncryptInit_ex : EVP_DecryptInit_ex;
+    if (init(context, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) != 1 ||
+        EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_SET_IVLEN,
+                            static_cast<int>(NONCE_SIZE), nullptr) != 1 ||
+        init(context, nullptr, nullptr, key, nonce) != 1) {
+        return false;
+    }
+    if (associatedData.empty()) {
+        return true;
+    }
+    int outputLength = 0;
+    const auto update = encrypt ? EVP_EncryptUpdate : EVP_DecryptUpdate;
+    return update(context, nullptr, &outputLength, associatedData.data(),
+                  static_cast<int>(associatedData.size())) == 1;
+}
+
+std::atomic<std::size_t> g_workerThreads{0};
+
+// Persistent threads shared by every stream. The tasks of one call are
+// claimed through an atomic counter by the calling thread and by idle workers,
+// so a call finishes even when all workers are busy with another stream.
+class WorkerPool {
+public:
+    using Task = std::function<bool(std::size_t index)>;
+
+    static WorkerPool& Instance() {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    // Runs task(0) .. task(count - 1) on up to threads threads, including the
+    // caller, and returns true only when every task returned true.
+    bool Run(std::size_t count, std::size_t threads, const Task& task) {
+        if (count <= 1 || threads <= 1) {
+            bool succeeded = true;
+            for (std::size_t index = 0; index < count; ++index) {
+                succeeded = Invoke(task, index) && succeeded;
+            }
+            return succeeded;
+        }
+
+        const auto job = std::make_shared<Job>(task, count);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            StartWorkers(std::min(threads, count) - 1);
+            queue_.push_back(job);
+        }
+        wake_.notify_all();
+        Execute(*job);
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->done.wait(lock, [&job] { return job->completed == job->count; });
+        return !job->failed.load();
+    }
+
+private:
+    struct Job {
+        Job(const Task& task, std::size_t count) : task(task), count(count) {}
+
+        const Task& task;
+        const std::size_t count;
+        std::atomic<std::size_t> next{0};
+        std::atomic<bool> failed{false};
+        std::mutex mutex;
+        std::condition_variable done;
+        std::size_t completed = 0;
+    };
+
+    WorkerPool() = default;
+
+    static bool Invoke(const Task& task, std::size_t index) noexcept {
+        try {
+            return task(index);
+        } catch (...) {
+            return false;
+        }
+    }
+
+    static void Execute(Job& job) {
+        for (;;) {
+            const std::size_t index = job.next.fetch_add(1);
+            if (index >= job.count) {
+                return;
+            }
+            if (!Invoke(job.task, index)) {
+                job.failed.store(true);
+            }
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (++job.completed == job.count) {
+                job.done.notify_all();
+            }
+        }
+    }
+
+    // Called with mutex_ held. A thread that cannot be started only means the
+    // caller runs more of the tasks itself.
+    void StartWorkers(std::size_t wanted) {
+        wanted = std::min(wanted, MAX_WORKER_THREADS - 1);
+        while (workers_.size() < wanted) {
+            try {
+                workers_.emplace_back([this] { WorkerLoop(); });
+            } catch (const std::system_error&) {
+                return;
+            }
+        }
+    }
+
+    void WorkerLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (stop_) {
+                return;
+            }
+            const std::shared_ptr<Job> job = queue_.front();
+            if (job->next.load() >= job->count) {
+                queue_.pop_front();
+                continue;
+            }
+            lock.unlock();
+            Execute(*job);
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::shared_ptr<Job>> queue_;
+    std::vector<std::thread> workers_;
+    bool stop_ = false;
+};
+
+} // namespace
+
+void SetWorkerThreads(std::size_t threads) noexcept {
+    g_workerThreads.store(std::min(threads, MAX_WORKER_THREADS));
+}
+
+std::size_t WorkerThreads() noexcept {
+    std::size_t threads = g_workerThreads.load();
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    return std::clamp<std::size_t>(threads, 1, MAX_WORKER_THREADS);
+}
+
+std::size_t BatchSize(std::size_t chunkSize, std::size_t limit) noexcept {
+    if (chunkSize == 0) {
+        return 0;
+    }
+    const std::size_t chunks = std::clamp<std::size_t>(
+        std::min(limit, MAX_BATCH_SIZE) / chunkSize, 1, WorkerThreads());
+    return chunks * chunkSize;
+}
+
+bool ParallelFor(std::size_t count, const std::function<bool(std::size_t index)>& task) {
+    return WorkerPool::Instance().Run(count, WorkerThreads(), task);
+}
+
+bool DeriveStreamKey(const SecureMemory::SecureBytes& containerKey, const char* label,
+                     const std::uint8_t* context, std::size_t contextSize,
+                     SecureMemory::SecureBytes& streamKey) {
+    SecureMemory::Cleanse(streamKey);
+    streamKey.clear();
+    if (containerKey.size() != KEY_SIZE || label == nullptr ||
+        (contextSize != 0 && context == nullptr)) {
+        return false;
+    }
+
+    std::vector<std::uint8_t> info(label, label + std::strlen(label));
+    info.insert(info.end(), context, context + contextSize);
+    std::unique_ptr<EVP_PKEY_CTX, decltype(&EVP_PKEY_CTX_free)> kdf(
+        EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr), EVP_PKEY_CTX_free);
+    streamKey.assign(KEY_SIZE, 0);
+    std::size_t keySize = streamKey.size();
+    if (!kdf || EVP_PKEY_derive_init(kdf.get()) <= 0 ||
+        EVP_PKEY_CTX_set_hkdf_md(kdf.get(), EVP_sha256()) <= 0 ||
+        EVP_PKEY_CTX_set1_hkdf_key(kdf.get(), containerKey.data(),
+                                   static_cast<int>(containerKey.size())) <= 0 ||
+        EVP_PKEY_CTX_add1_hkdf_info(kdf.get(), info.data(),
+                                    static_cast<int>(info.size())) <= 0 ||
+        EVP_PKEY_derive(kdf.get(), streamKey.data(), &keySize) <= 0 ||
+        keySize != KEY_SIZE) {
+        SecureMemory::Cleanse(streamKey);
+        streamKey.clear();
+        return false;
+    }
+    return true;
+}
+
+std::uint64_t ChunkCount(std::uint64_t payloadSize, std::size_t chunkSize) noexcept {
+    if (chunkSize == 0) {
+        return 0;
+    }
+    return payloadSize / chunkSize + (payloadSize % chunkSize != 0 ? 1U : 0U);
+}
+
+std::uint64_t SealedSize(std::uint64_t payloadSize, std::size_t chunkSize) noexcept {
+    return payloadSize + ChunkCount(payloadSize, chunkSize) * TAG_SIZE;
+}
+
+ChunkCipher::ChunkCipher(const SecureMemory::SecureBytes& key,
+                         const std::vector<std::uint8_t>& baseNonce,
+                         std::vector<std::uint8_t> associatedData)
+    : associatedData_(std::move(associatedData)) {
+    if (key.size() != KEY_SIZE || baseNonce.size() != NONCE_SIZE ||
+        associatedData_.size() > static_cast<std::size_t>(std::numeric_limits<int>::max())) {
+        return;
+    }
+    std::copy(key.begin(), key.end(), key_.begin());
+    std::copy(baseNonce.begin(), baseNonce.end(), baseNonce_.begin());
+    valid_ = true;
+}
+
+ChunkCipher::~ChunkCipher() {
+    SecureMemory::Cleanse(key_.data(), key_.size());
+}
+
+std::array<std::uint8_t, NONCE_SIZE> ChunkCipher::NonceFor(std::uint64_t index) const noexcept {
+    std::array<std::uint8_t, NONCE_SIZE> nonce = baseNonce_;
+    for (std::size_t i = 0; i < sizeof(index); ++i) {
+        nonce[NONCE_SIZE - 1 - i] ^= static_cast<std::uint8_t>((index >> (8U * i)) & 0xffU);
+    }
+    return nonce;
+}
+
+bool ChunkCipher::Seal(std::uint64_t index, const std::uint8_t* plaintext, std::size_t size,
+                       std::uint8_t* ciphertext, std::uint8_t* tag) const {
+    if (!valid_ || (size != 0 && (plaintext == nullptr || ciphertext == nullptr)) ||
+        tag == nullptr || size > MAX_CHUNK_SIZE) {
+        return false;
+    }
+
+    const Metrics::ScopedTimer timer(Metrics::Stage::AesGcm, size);
+    const auto nonce = NonceFor(index);
+    CipherContext context(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
+    if (!context ||
+        !InitializeContext(context.get(), true, key_.data(), nonce.data(), associatedData_)) {
+        return false;
+    }
+
+    int outputLength = 0;
+    if (size != 0 &&
+        (EVP_EncryptUpdate(context.get(), ciphertext, &outputLength, plaintext,
+                           static_cast<int>(size)) != 1 ||
+         static_cast<std::size_t>(outputLength) != size)) {
+        return false;
+    }
+    int finalLength = 0;
+    return EVP_EncryptFinal_ex(context.get(), ciphertext + outputLength, &finalLength) == 1 &&
+           finalLength == 0 &&
+           EVP_CIPHER_CTX_ctrl(context.get(), EVP_CTRL_GCM_GET_TAG,
+                               static_cast<int>(TAG_SIZE), tag) == 1;
+}
+
+bool ChunkCipher::Open(std::uint64_t index, const std::uint8_t* ciphertext, std::size_t size,
+                       const std::uint8_t* tag, std::uint8_t* plaintext) const {
+    if (!valid_ || (size != 0 && (plaintext == nullptr || ciphertext == nullptr)) ||
+        tag == nullptr || size > MAX_CHUNK_SIZE) {
+        return false;
+    }
+
+    const Metrics::ScopedTimer timer(Metrics::Stage::AesGcm, size);
+    const auto nonce = NonceFor(index);
+    CipherContext context(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
+    if (!context ||
+        !InitializeContext(context.get(), false, key_.data(), nonce.data(), associatedData_)) {
+        return false;
+    }
+
+    int outputLength = 0;
+    if (size != 0 &&
+        (EVP_DecryptUpdate(context.get(), plaintext, &outputLength, ciphertext,
+                           static_cast<int>(size)) != 1 ||
+         static_cast<std::size_t>(outputLength) != size)) {
+        SecureMemory::Cleanse(plaintext, size);
+        return false;
+    }
+
+    std::array<std::uint8_t, TAG_SIZE> mutableTag{};
+    std::memcpy(mutableTag.data(), tag, mutableTag.size());
+    int finalLength = 0;
+    const bool authenticated =
+        EVP_CIPHER_CTX_ctrl(context.get(), EVP_CTRL_GCM_SET_TAG,
+                            static_cast<int>(mutableTag.size()), mutableTag.data()) == 1 &&
+        EVP_DecryptFinal_ex(context.get(), plaintext + outputLength, &finalLength) == 1 &&
+        finalLength == 0;
+    if (!authenticated && size != 0) {
+        SecureMemory::Cleanse(plaintext, size);
+    }
+    return authenticated;
+}
+
+SealingWriter::SealingWriter(const ChunkCipher& cipher, std::size_t chunkSize, Sink sink)
+    : cipher_(cipher), chunkSize_(chunkSize), sink_(std::move(sink)) {
+    if (chunkSize_ < MIN_CHUNK_SIZE || chunkSize_ > MAX_CHUNK_SIZE || !sink_ ||
+        !cipher_.valid()) {
+        failed_ = true;
+        return;
+    }
+    batchSize_ = BatchSize(chunkSize_);
+    // A payload of at most one chunk never needs the full batch buffer.
+    plaintext_.reserve(chunkSize_);
+}
+
+SealingWriter::~SealingWriter() {
+    SecureMemory::Cleanse(plaintext_);
+}
+
+bool SealingWriter::Write(const std::uint8_t* data, std::size_t size) {
+    if (failed_ || (size != 0 && data == nullptr)) {
+        failed_ = true;
+        return false;
+    }
+    while (size != 0) {
+        if (plaintext_.size() == plaintext_.capacity()) {
+            // Grow by hand so no uncleansed copy of the plaintext is freed.
+            std::vector<std::uint8_t> grown;
+            grown.reserve(batchSize_);
+            grown.assign(plaintext_.begin(), plaintext_.end());
+            SecureMemory::Cleanse(plaintext_);
+            plaintext_.swap(grown);
+        }
+        const std::size_t count = std::min(size, plaintext_.capacity() - plaintext_.size());
+        plaintext_.insert(plaintext_.end(), data, data + count);
+        data += count;
+        size -= count;
+        payloadBytes_ += count;
+        if (plaintext_.size() == batchSize_ && !SealBuffered()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SealingWriter::Finish() {
+    if (failed_) {
+        return false;
+    }
+    return plaintext_.empty() || SealBuffered();
+}
+
+bool SealingWriter::SealBuffered() {
+    const std::size_t size = plaintext_.size();
+    const auto chunks = static_cast<std::size_t>(ChunkCount(size, chunkSize_));
+    sealed_.resize(size + chunks * TAG_SIZE);
+    const bool sealed = WorkerPool::Instance().Run(
+        chunks, WorkerThreads(), [this, size](std::size_t chunk) {
+            const std::size_t offset = chunk * chunkSize_;
+            const std::size_t length = std::min(chunkSize_, size - offset);
+            std::uint8_t* output = sealed_.data() + chunk * (chunkSize_ + TAG_SIZE);
+            return cipher_.Seal(nextIndex_ + chunk, plaintext_.data() + offset, length, output,
+                                output + length);
+        });
+    SecureMemory::Cleanse(plaintext_);
+    if (!sealed || !sink_(sealed_.data(), sealed_.size())) {
+        failed_ = true;
+        return false;
+    }
+    plaintext_.clear();
+    nextIndex_ += chunks;
+    return true;
+}
+
+OpeningReader::OpeningReader(const ChunkCipher& cipher, std::uint64_t payloadSize,
+                             std::size_t chunkSize, Source source, std::size_t batchLimit)
+    : cipher_(cipher), payloadSize_(payloadSize), chunkSize_(chunkSize),
+      source_(std::move(source)) {
+    if (chunkSize_ < MIN_CHUNK_SIZE || chunkSize_ > MAX_CHUNK_SIZE || !source_ ||
+        !cipher_.valid()) {
+        failed_ = true;
+        return;
+    }
+    batchChunks_ = BatchSize(chunkSize_, batchLimit) / chunkSize_;
+}
+
+OpeningReader::OpeningReader(const ChunkCipher& cipher, std::uint64_t payloadSize,
+                             std::size_t chunkSize, View view, std::size_t batchLimit)
+    : cipher_(cipher), payloadSize_(payloadSize), chunkSize_(chunkSize),
+      view_(std::move(view)) {
+    if (chunkSize_ < MIN_CHUNK_SIZE || chunkSize_ > MAX_CHUNK_SIZE || !view_ ||
+        !cipher_.valid()) {
+        failed_ = true;
+        return;
+    }
+    batchChunks_ = BatchSize(chunkSize_, batchLimit) / chunkSize_;
+}
+
+OpeningReader::~OpeningReader() {
+    SecureMemory::Cleanse(plaintext_);
+}
+
+bool OpeningReader::Read(std::uint8_t* data, std::size_t size) {
+    if (failed_ || (size != 0 && data == nullptr)) {
+        failed_ = true;
+        return false;
+    }
+    while (size != 0) {
+        if (position_ == plaintext_.size()) {
+            const std::size_t direct = WholeChunksWithin(size);
+            if (direct != 0) {
+                const std::size_t bytes = ChunkBytes(direct);
+                if (!OpenChunks(direct, data)) {
+                    return false;
+                }
+                data += bytes;
+                size -= bytes;
+                continue;
+            }
+            if (!OpenChunks(NextBatchChunks(), nullptr)) {
+                return false;
+            }
+        }
+        const std::size_t count = std::min(size, plaintext_.size() - position_);
+        std::memcpy(data, plaintext_.data() + position_, count);
+        position_ += count;
+        data += count;
+        size -= count;
+    }
+    return true;
+}
+
+bool OpeningReader::finished() const noexcept {
+    return !failed_ && openedBytes_ == payloadSize_ && position_ == plaintext_.size();
+}
+
+// Chunks in the next batch: the rest of the payload, at most one batch.
+std::size_t OpeningReader::NextBatchChunks() const noexcept {
+    if (openedBytes_ >= payloadSize_) {
+        return 0;
+    }
+    return static_cast<std::size_t>(std::min<std::uint64_t>(
+        ChunkCount(payloadSize_ - openedBytes_, chunkSize_), batchChunks_));
+}
+
+// Whole chunks of the next batch that fit into size bytes of output.
+std::size_t OpeningReader::WholeChunksWithin(std::size_t size) const noexcept {
+    const std::size_t remaining = NextBatchChunks();
+    if (remaining == 0) {
+        return 0;
+    }
+    if (payloadSize_ - openedBytes_ <= size) {
+        return remaining;
+    }
+    return std::min(remaining, size / chunkSize_);
+}
+
+std::size_t OpeningReader::ChunkBytes(std::size_t count) const noexcept {
+    return static_cast<std::size_t>(std::min<std::uint64_t>(
+        static_cast<std::uint64_t>(count) * chunkSize_, payloadSize_ - openedBytes_));
+}
+
+// Opens the next count chunks into output when it is set, which must hold all
+// of them, and into the internal plaintext buffer otherwise.
+bool OpeningReader::OpenChunks(std::size_t count, std::uint8_t* output) {
+    if (count == 0) {
+        failed_ = true;
+        return false;
+    }
+    const std::size_t size = ChunkBytes(count);
+    const std::size_t sealedSize = size + count * TAG_SIZE;
+    const std::uint8_t* sealed = nullptr;
+    if (view_) {
+        sealed = view_(sealedSize);
+    } else {
+        ciphertext_.resize(sealedSize);
+        if (source_(ciphertext_.data(), ciphertext_.size())) {
+            sealed = ciphertext_.data();
+        }
+    }
+    SecureMemory::Cleanse(plaintext_);
+    if (output == nullptr) {
+        plaintext_.resize(size);
+        output = plaintext_.data();
+    } else {
+        plaintext_.clear();
+    }
+    position_ = 0;
+    const bool opened =
+        sealed != nullptr &&
+        WorkerPool::Instance().Run(
+            count, WorkerThreads(), [this, sealed, size, output](std::size_t chunk) {
+                const std::size_t offset = chunk * chunkSize_;
+                const std::size_t length = std::min(chunkSize_, size - offset);
+                const std::uint8_t* input = sealed + chunk * (chunkSize_ + TAG_SIZE);
+                return cipher_.Open(nextIndex_ + chunk, input, length, input + length,
+                                    output + offset);
+            });
+    if (!opened) {
+        // Chunks that did authenticate are discarded with the failed one.
+        SecureMemory::Cleanse(output, size);
+        plaintext_.clear();
+        failed_ = true;
+        return false;
+    }
+    openedBytes_ += size;
+    nextIndex_ += count;
+    return true;
+}
+
+} // namespace ArchiveStream
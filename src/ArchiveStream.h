@@ -0,0 +1,226 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "SecureArena.h"
+
+// Chunked AES-256-GCM used by streamed archive containers. The payload is cut
+// into fixed-size chunks that are sealed independently; chunk i uses the base
+// nonce with i XORed into its last eight bytes, so chunks cannot be reordered,
+// and every chunk authenticates the complete container header, which declares
+// the exact payload size and therefore detects truncation.
+namespace ArchiveStream {
+
+constexpr std::size_t KEY_SIZE = 32;
+constexpr std::size_t NONCE_SIZE = 12;
+constexpr std::size_t TAG_SIZE = 16;
+constexpr std::size_t DEFAULT_CHUNK_SIZE = 1024U * 1024U;
+constexpr std::size_t MIN_CHUNK_SIZE = 4U * 1024U;
+constexpr std::size_t MAX_CHUNK_SIZE = 16U * 1024U * 1024U;
+// Plaintext bound of one parallel batch, whatever the thread count.
+constexpr std::size_t MAX_BATCH_SIZE = 64U * 1024U * 1024U;
+constexpr std::size_t MAX_WORKER_THREADS = 64;
+
+// Consumes bytes produced by a writer. Returning false aborts the stream.
+using Sink = std::function<bool(const std::uint8_t* data, std::size_t size)>;
+
+// Reads exactly size bytes. A short read must return false.
+using Source = std::function<bool(std::uint8_t* data, std::size_t size)>;
+
+// Returns a pointer to the next size bytes without copying them, e.g. from a
+// memory-mapped container, or nullptr on a short read. The bytes must stay
+// valid until the next call.
+using View = std::function<const std::uint8_t*(std::size_t size)>;
+
+// Receives an authenticated payload stream and its declared size.
+using PayloadConsumer =
+    std::function<bool(const Source& payload, std::uint64_t payloadSize)>;
+
+// Positional read of exactly size bytes, used by indexed containers to reach a
+// single entry without reading the ones stored before it.
+using ReadAt = std::function<bool(std::uint64_t offset, std::uint8_t* data, std::size_t size)>;
+
+// HKDF-SHA256 of a container key into an independent stream key. The label
+// separates key purposes and the context (e.g. a blob id) separates streams.
+bool DeriveStreamKey(const SecureMemory::SecureBytes& containerKey, const char* label,
+                     const std::uint8_t* context, std::size_t contextSize,
+                     SecureMemory::SecureBytes& streamKey);
+
+// Number of threads that seal or open the chunks of one stream; 0 selects the
+// hardware concurrency. Readers and writers created afterwards use it.
+void SetWorkerThreads(std::size_t threads) noexcept;
+std::size_t WorkerThreads() noexcept;
+
+// Plaintext bytes that a reader or writer processes as one parallel batch:
+// one chunk per worker thread, within limit but at least one chunk.
+std::size_t BatchSize(std::size_t chunkSize, std::size_t limit = MAX_BATCH_SIZE) noexcept;
+
+// Runs task(0) .. task(count - 1) on the shared worker threads and the caller.
+// True only when every task returned true.
+bool ParallelFor(std::size_t count, const std::function<bool(std::size_t index)>& task);
+
+// Fixed-capacity queue between two pipeline stages. Push waits while the
+// queue is full and Pop while it is empty. Close ends the stream: Push fails
+// from then on, leaving the value with the caller, and Pop hands out what is
+// left, then fails, so either side can stop the other.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t capacity) : capacity_(capacity == 0 ? 1 : capacity) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool Push(T&& value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+        items_.push_back(std::move(value));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    bool Pop(T& value) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) {
+            return false;
+        }
+        value = std::move(items_.front());
+        items_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void Close() {
+        const std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable notFull_;
+    std::condition_variable notEmpty_;
+    std::deque<T> items_;
+    std::size_t capacity_;
+    bool closed_ = false;
+};
+
+std::uint64_t ChunkCount(std::uint64_t payloadSize, std::size_t chunkSize) noexcept;
+
+// Size of the sealed chunk sequence (ciphertext plus one tag per chunk).
+std::uint64_t SealedSize(std::uint64_t payloadSize, std::size_t chunkSize) noexcept;
+
+class ChunkCipher {
+public:
+    ChunkCipher(const SecureMemory::SecureBytes& key,
+                const std::vector<std::uint8_t>& baseNonce,
+                std::vector<std::uint8_t> associatedData);
+    ~ChunkCipher();
+
+    ChunkCipher(const ChunkCipher&) = delete;
+    ChunkCipher& operator=(const ChunkCipher&) = delete;
+
+    [[nodiscard]] bool valid() const noexcept { return valid_; }
+
+    bool Seal(std::uint64_t index, const std::uint8_t* plaintext, std::size_t size,
+              std::uint8_t* ciphertext, std::uint8_t* tag) const;
+    bool Open(std::uint64_t index, const std::uint8_t* ciphertext, std::size_t size,
+              const std::uint8_t* tag, std::uint8_t* plaintext) const;
+
+private:
+    std::array<std::uint8_t, NONCE_SIZE> NonceFor(std::uint64_t index) const noexcept;
+
+    std::array<std::uint8_t, KEY_SIZE> key_{};
+    std::array<std::uint8_t, NONCE_SIZE> baseNonce_{};
+    std::vector<std::uint8_t> associatedData_;
+    bool valid_ = false;
+};
+
+// Buffers up to one batch of plaintext, seals its chunks in parallel and emits
+// ciphertext || tag for every chunk in order. Finish must be called once to
+// seal the final partial batch.
+class SealingWriter {
+public:
+    SealingWriter(const ChunkCipher& cipher, std::size_t chunkSize, Sink sink);
+    ~SealingWriter();
+
+    SealingWriter(const SealingWriter&) = delete;
+    SealingWriter& operator=(const SealingWriter&) = delete;
+
+    bool Write(const std::uint8_t* data, std::size_t size);
+    bool Finish();
+
+    [[nodiscard]] std::uint64_t payloadBytes() const noexcept { return payloadBytes_; }
+
+private:
+    bool SealBuffered();
+
+    const ChunkCipher& cipher_;
+    std::size_t chunkSize_;
+    std::size_t batchSize_ = 0;
+    Sink sink_;
+    std::vector<std::uint8_t> plaintext_;
+    std::vector<std::uint8_t> sealed_;
+    std::uint64_t nextIndex_ = 0;
+    std::uint64_t payloadBytes_ = 0;
+    bool failed_ = false;
+};
+
+// Pulls sealed chunks from a source and serves only authenticated plaintext.
+// At most one batch of ciphertext and one of plaintext are held at a time, and
+// the chunks of a batch are opened in parallel; a batch is served only when
+// every chunk in it authenticated. A view source is opened in place, and a
+// read that covers whole chunks is decrypted straight into the caller's buffer.
+// batchLimit bounds the buffered batch (see BatchSize).
+class OpeningReader {
+public:
+    OpeningReader(const ChunkCipher& cipher, std::uint64_t payloadSize,
+                  std::size_t chunkSize, Source source,
+                  std::size_t batchLimit = MAX_BATCH_SIZE);
+    OpeningReader(const ChunkCipher& cipher, std::uint64_t payloadSize,
+                  std::size_t chunkSize, View view,
+                  std::size_t batchLimit = MAX_BATCH_SIZE);
+    ~OpeningReader();
+
+    OpeningReader(const OpeningReader&) = delete;
+    OpeningReader& operator=(const OpeningReader&) = delete;
+
+    bool Read(std::uint8_t* data, std::size_t size);
+
+    // True once every declared payload byte was authenticated and consumed.
+    [[nodiscard]] bool finished() const noexcept;
+
+private:
+    bool OpenChunks(std::size_t count, std::uint8_t* output);
+    std::size_t NextBatchChunks() const noexcept;
+    std::size_t WholeChunksWithin(std::size_t size) const noexcept;
+    std::size_t ChunkBytes(std::size_t count) const noexcept;
+
+    const ChunkCipher& cipher_;
+    std::uint64_t payloadSize_;
+    std::size_t chunkSize_;
+    std::size_t batchChunks_ = 1;
+    Source source_;
+    View view_;
+    std::vector<std::uint8_t> ciphertext_;
+    std::vector<std::uint8_t> plaintext_;
+    std::size_t position_ = 0;
+    std::uint64_t nextIndex_ = 0;
+    std::uint64_t openedBytes_ = 0;
+    bool failed_ = false;
+};
+
+} // namespace ArchiveStream
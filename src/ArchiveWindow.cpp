@@ -1,7 +1,9 @@
 #include "ArchiveWindow.h"
 #include "Settings.h"
 #include "FileDropQueue.h"
+#include "Metrics.h"
 #include "PathSecurity.h"
+#include "SecureArena.h"
 #include <imgui.h>
 #include "ImGuiFileDialogConfig.h" // Include custom configuration first
 #include "ImGuiFileDialog.h"
@@ -9,6 +11,7 @@
 #include <filesystem>
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <sstream>
 #include <iomanip>
 
@@ -46,6 +49,7 @@ ArchiveWindow::ArchiveWindow(const std::string& username)
 }
 
 ArchiveWindow::~ArchiveWindow() {
+    WaitForVerification();
     ResetPreview();
     for (auto& entry : m_fileList) {
         SecureMemory::Cleanse(entry.data);
@@ -61,6 +65,8 @@ void ArchiveWindow::Render() {
     }
     
     UpdateStatusMessage();
+    PollCommitStatus();
+    PollVerification();
     
     // Get theme-appropriate colors
     Settings& settings = Settings::Instance();
@@ -94,12 +100,9 @@ void ArchiveWindow::Render() {
                     SetStatusMessage("Failed to save archive!", 5.0f);
                 }
             }
-            if (ImGui::MenuItem("Verify Integrity", "Ctrl+V")) {
-                if (m_archive->VerifyIntegrity()) {
-                    SetStatusMessage("Archive integrity verified!");
-                } else {
-                    SetStatusMessage("Archive integrity check failed!", 5.0f);
-                }
+            if (ImGui::MenuItem("Verify Integrity", "Ctrl+V", false,
+                                !m_verifyThread.joinable())) {
+                StartVerification();
             }
             ImGui::Separator();
             if (ImGui::MenuItem("Reset Archive", nullptr)) {
@@ -298,12 +301,17 @@ void ArchiveWindow::Render() {
         "Refresh", Settings::UiIcon::Archive,
         Settings::ButtonVariant::Ghost, 100.0f);
 
-    const auto stats = m_archive->GetStats();
+    const auto commitStatus = m_archive->GetCommitStatus();
     const std::string selectionText = hasSelectedFile
         ? "Selected: " + m_fileList[m_selectedFile].name
         : "Drop files into the list, or select a file to enable actions.";
-    const std::string statsText = "Files: " + std::to_string(stats.totalFiles) +
-        "  |  Total: " + FormatFileSize(stats.totalSize);
+    std::string statsText = "Files: " + std::to_string(m_archiveStats.totalFiles) +
+        "  |  Total: " + FormatFileSize(m_archiveStats.totalSize);
+    if (commitStatus.committing) {
+        statsText += "  |  Saving...";
+    } else if (commitStatus.dirty) {
+        statsText += "  |  Unsaved changes";
+    }
     ImGui::TextDisabled("%s", selectionText.c_str());
     ImGui::SameLine();
     const float statsStart = ImGui::GetWindowWidth() -
@@ -423,6 +431,8 @@ void ArchiveWindow::Render() {
         ImGui::EndPopup();
     }
 
+    ShowVerificationDialogs();
+
     if (refreshRequested) {
         RefreshFileList();
     }
@@ -430,7 +440,8 @@ void ArchiveWindow::Render() {
     DrawToastNotification();
     
     // Process keyboard shortcuts
-    if (ImGui::IsKeyPressed(ImGuiKey_F3) && m_selectedFile >= 0) {
+    if (ImGui::IsKeyPressed(ImGuiKey_F3) && m_selectedFile >= 0 &&
+        !m_verifyThread.joinable()) {
         // Check if the selected file can be previewed
         if (m_selectedFile < static_cast<int>(m_fileList.size())) {
             const FileEntry& entry = m_fileList[m_selectedFile];
@@ -461,6 +472,7 @@ void ArchiveWindow::Render() {
     
     ImGui::End();
     if (!m_isVisible) {
+        FlushPendingChanges();
         ResetPreview();
     }
 }
@@ -486,11 +498,25 @@ bool ArchiveWindow::Initialize(const std::string& password) {
         success = m_archive->InitializeArchive(password);
     }
     
+    return FinishInitialize(success, createdNewArchive);
+}
+
+bool ArchiveWindow::AdoptArchive(std::unique_ptr<CryptoArchive> archive, bool created) {
+    std::cout << "---------- ARCHIVE WINDOW ADOPT ----------" << std::endl;
+    const bool success = archive != nullptr;
+    if (success) {
+        m_archive = std::move(archive);
+    }
+    return FinishInitialize(success, created);
+}
+
+bool ArchiveWindow::FinishInitialize(bool success, bool createdNewArchive) {
     std::cout << "Archive initialization result: " << (success ? "Success" : "Failed") << std::endl;
     
     if (success) {
         m_isLoaded = true;
         std::cout << "m_isLoaded set to true" << std::endl;
+        ApplyCommitSettings();
         
         // Run diagnostic to check archive state
         m_archive->DiagnoseArchive();
@@ -529,9 +555,158 @@ void ArchiveWindow::Show() {
 
 void ArchiveWindow::Hide() {
     m_isVisible = false;
+    FlushPendingChanges();
     ResetPreview();
 }
 
+void ArchiveWindow::ApplyCommitSettings() {
+    if (!m_archive || !m_isLoaded) {
+        return;
+    }
+    const Settings& settings = Settings::Instance();
+    m_archive->SetCompression(settings.GetCompressArchiveEntries());
+    m_archive->SetCacheBudget(static_cast<size_t>(settings.GetArchiveCacheMiB()) * 1024U * 1024U);
+    if (!m_archive->SetDeferredCommit(
+            settings.GetDeferArchiveCommits(),
+            std::chrono::milliseconds(settings.GetArchiveCommitDelayMs()))) {
+        SetStatusMessage("Failed to change how archive changes are saved.", 5.0f);
+    }
+}
+
+bool ArchiveWindow::FlushPendingChanges() {
+    if (!m_archive || !m_isLoaded) {
+        return true;
+    }
+    if (!m_archive->Flush()) {
+        PollCommitStatus();
+        return false;
+    }
+    return true;
+}
+
+void ArchiveWindow::StartVerification() {
+    if (!m_archive || !m_isLoaded || m_verifyThread.joinable()) {
+        return;
+    }
+    // The statistics window reads the archive every frame, which would wait
+    // for the whole check.
+    m_showArchiveStats = false;
+    m_showVerifyReport = false;
+    m_verifyReport = CryptoArchive::IntegrityReport{};
+    m_verifyChecked = 0;
+    m_verifyTotal = m_fileList.size();
+    m_verifyRunning = true;
+    try {
+        m_verifyThread = std::thread([this]() {
+            m_verifyReport = m_archive->CheckIntegrity([this](size_t checked, size_t total) {
+                m_verifyChecked = checked;
+                m_verifyTotal = total;
+            });
+            m_verifyRunning = false;
+        });
+    } catch (const std::system_error&) {
+        m_verifyRunning = false;
+        SetStatusMessage("Could not start the integrity check.", 5.0f);
+    }
+}
+
+void ArchiveWindow::PollVerification() {
+    if (!m_verifyThread.joinable() || m_verifyRunning) {
+        return;
+    }
+    m_verifyThread.join();
+    if (m_verifyReport.failures == 0) {
+        SetStatusMessage("Archive integrity verified: " +
+                         std::to_string(m_verifyReport.entries.size()) + " files checked.");
+    } else {
+        SetStatusMessage("Archive integrity check failed for " +
+                         std::to_string(m_verifyReport.failures) + " of " +
+                         std::to_string(m_verifyReport.entries.size()) + " files.", 5.0f);
+        m_showVerifyReport = true;
+    }
+}
+
+void ArchiveWindow::WaitForVerification() {
+    if (m_verifyThread.joinable()) {
+        m_verifyThread.join();
+    }
+    m_verifyRunning = false;
+}
+
+void ArchiveWindow::ShowVerificationDialogs() {
+    Settings& settings = Settings::Instance();
+    const auto& guiMetrics = Settings::Metrics();
+    if (m_verifyThread.joinable() && !ImGui::IsPopupOpen("Verifying archive")) {
+        ImGui::OpenPopup("Verifying archive");
+    }
+    ImGui::SetNextWindowSize(ImVec2(460.0f, 180.0f), ImGuiCond_Appearing);
+    ImGui::SetNextWindowPos(ImGui::GetMainViewport()->GetCenter(), ImGuiCond_Appearing,
+                           ImVec2(0.5f, 0.5f));
+    if (ImGui::BeginPopupModal("Verifying archive", nullptr,
+                               ImGuiWindowFlags_NoResize |
+                                   ImGuiWindowFlags_NoSavedSettings)) {
+        settings.DialogHeader(Settings::UiIcon::Lock, "Verifying archive",
+                              "Every file is decrypted and hashed again.");
+        const size_t checked = m_verifyChecked.load();
+        const size_t total = m_verifyTotal.load();
+        const float fraction = total == 0 ? 0.0f
+            : static_cast<float>(checked) / static_cast<float>(total);
+        const std::string overlay =
+            std::to_string(checked) + " / " + std::to_string(total) + " files";
+        ImGui::ProgressBar(fraction, ImVec2(-1.0f, 0.0f), overlay.c_str());
+        if (!m_verifyThread.joinable()) {
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
+    }
+
+    if (m_showVerifyReport && !ImGui::IsPopupOpen("Integrity report")) {
+        ImGui::OpenPopup("Integrity report");
+    }
+    ImGui::SetNextWindowSize(ImVec2(520.0f, 360.0f), ImGuiCond_Appearing);
+    ImGui::SetNextWindowPos(ImGui::GetMainViewport()->GetCenter(), ImGuiCond_Appearing,
+                           ImVec2(0.5f, 0.5f));
+    if (ImGui::BeginPopupModal("Integrity report", &m_showVerifyReport,
+                               ImGuiWindowFlags_NoSavedSettings)) {
+        settings.DialogHeader(Settings::UiIcon::Warning, "Integrity report",
+                              "These files did not match the data recorded when they were added.");
+        ImGui::BeginChild("IntegrityFailures",
+                          ImVec2(0.0f, -(guiMetrics.buttonHeight + guiMetrics.itemSpacing)),
+                          true);
+        for (const auto& check : m_verifyReport.entries) {
+            if (check.status == CryptoArchive::EntryStatus::Ok) {
+                continue;
+            }
+            const char* reason =
+                check.status == CryptoArchive::EntryStatus::SizeMismatch   ? "size mismatch"
+                : check.status == CryptoArchive::EntryStatus::HashMismatch ? "hash mismatch"
+                                                                           : "unreadable";
+            ImGui::TextUnformatted(check.name.c_str());
+            ImGui::SameLine();
+            ImGui::TextDisabled("%s", reason);
+        }
+        ImGui::EndChild();
+        if (settings.Button("Close", Settings::ButtonVariant::Ghost, 100.0f)) {
+            m_showVerifyReport = false;
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
+    }
+}
+
+void ArchiveWindow::PollCommitStatus() {
+    if (!m_archive) {
+        return;
+    }
+    const auto status = m_archive->GetCommitStatus();
+    if (status.lastError != m_lastCommitError) {
+        m_lastCommitError = status.lastError;
+        if (!m_lastCommitError.empty()) {
+            SetStatusMessage("Background save failed: " + m_lastCommitError + ".", 6.0f);
+        }
+    }
+}
+
 bool ArchiveWindow::IsVisible() const {
     return m_isVisible;
 }
@@ -547,6 +722,7 @@ void ArchiveWindow::RefreshFileList() {
         SecureMemory::Cleanse(entry.data);
     }
     m_fileList = m_archive->GetFileList();
+    m_archiveStats = m_archive->GetStats();
     m_fileList.erase(
         std::remove_if(m_fileList.begin(), m_fileList.end(),
                        [](const FileEntry& entry) {
@@ -878,19 +1054,10 @@ void ArchiveWindow::ShowFileViewer() {
          m_previewType == PreviewType::IMAGE ? "IMAGE" : "NONE") << std::endl;
     
     // Check if we have data to display
-    if (m_previewType == PreviewType::TEXT && !m_textPreviewData.empty()) {
-        // Convert binary data to text
-        std::string text;
-        SecureMemory::ScopedCleanse textGuard(text);
-        
-        // Add a null terminator to ensure the text is valid
-        std::vector<uint8_t> textData = m_textPreviewData;
-        SecureMemory::ScopedCleanse textDataGuard(textData);
-        textData.push_back(0); // null terminator
-        
-        // Convert to character string
-        text.assign(reinterpret_cast<const char*>(textData.data()),
-                    m_textPreviewData.size());
+    if (m_previewType == PreviewType::TEXT && m_previewLease && m_previewLease.size() != 0) {
+        // The lease is zero terminated, so the text is shown without copying
+        const char* text = reinterpret_cast<const char*>(m_previewLease.data());
+        const size_t textSize = m_previewLease.size();
         
         // Open a modal window for preview
         ImGui::OpenPopup("Text Preview");
@@ -924,14 +1091,14 @@ void ArchiveWindow::ShowFileViewer() {
             ImGui::BeginChild("TextContent", ImVec2(0, -60), true, ImGuiWindowFlags_HorizontalScrollbar);
             
             // Use our helper function to display selectable text
-            DisplaySelectableText(text, ImGui::GetContentRegionAvail());
+            DisplaySelectableText(text, textSize, ImGui::GetContentRegionAvail());
             
             ImGui::EndChild();
             
             ImGui::Separator();
             
             // Display information about file size
-            ImGui::Text("Size: %s (%zu bytes)", FormatFileSize(m_textPreviewData.size()).c_str(), m_textPreviewData.size());
+            ImGui::Text("Size: %s (%zu bytes)", FormatFileSize(textSize).c_str(), textSize);
             
             // Button for copying all text with button styling and theme-appropriate colors
             ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(themeColors.accentText[0], themeColors.accentText[1], themeColors.accentText[2], 1.0f));
@@ -940,7 +1107,7 @@ void ArchiveWindow::ShowFileViewer() {
             Settings::PushBlackButtonText();
             
             if (ImGui::Button("[C] Copy All Text", ImVec2(160, 0))) {
-                ImGui::SetClipboardText(text.c_str());
+                ImGui::SetClipboardText(text);
                 SetStatusMessage("Text copied to clipboard!", 2.0f);
             }
             
@@ -959,7 +1126,7 @@ void ArchiveWindow::ShowFileViewer() {
             ImGui::EndPopup();
         }
     } 
-    else if (m_previewType == PreviewType::IMAGE && !m_imagePreviewData.empty()) {
+    else if (m_previewType == PreviewType::IMAGE && m_previewLease && m_previewLease.size() != 0) {
         // Deschidem o fereastră modală pentru previzualizare imagini
         ImGui::OpenPopup("Image Preview");
         
@@ -993,14 +1160,14 @@ void ArchiveWindow::ShowFileViewer() {
             // Deocamdată afișăm un mesaj informativ
             ImGui::TextColored(ImVec4(themeColors.warningText[0], themeColors.warningText[1], themeColors.warningText[2], themeColors.warningText[3]), "Image preview is not fully implemented yet");
             ImGui::TextWrapped("This feature requires loading the image data into a texture.");
-            ImGui::TextWrapped("Image size: %zu bytes", m_imagePreviewData.size());
+            ImGui::TextWrapped("Image size: %zu bytes", m_previewLease.size());
             
             ImGui::EndChild();
             
             ImGui::Separator();
             
             // Display information about file size
-            ImGui::Text("Size: %s (%zu bytes)", FormatFileSize(m_imagePreviewData.size()).c_str(), m_imagePreviewData.size());
+            ImGui::Text("Size: %s (%zu bytes)", FormatFileSize(m_previewLease.size()).c_str(), m_previewLease.size());
             
             // Close button
             Settings::PushBlackButtonText();
@@ -1033,6 +1200,14 @@ void ArchiveWindow::ShowArchiveStats() {
                                 themeColors.surfaceElevated[3]);
 
     const auto stats = m_archive->GetStats();
+    const auto keyStats = m_archive->GetKeyDerivationStats();
+    const auto storageStats = m_archive->GetStorageStats();
+    const auto cacheStats = m_archive->GetCacheStats();
+    const auto arenaStats = SecureMemory::DefaultArena().GetStats();
+    const auto commitStatus = m_archive->GetCommitStatus();
+    const uint64_t reclaimableSize = storageStats.containerSize > storageStats.liveSize
+        ? storageStats.containerSize - storageStats.liveSize
+        : 0;
     const auto files = m_archive->GetFileList();
     const std::string archiveName = m_archive->GetArchiveName();
     const std::string archivePath = m_archive->GetArchiveFilePath();
@@ -1148,6 +1323,151 @@ void ArchiveWindow::ShowArchiveStats() {
         ImGui::TextDisabled("Protection");
         ImGui::SameLine(150.0f);
         ImGui::TextUnformatted("AES-256-GCM authenticated encryption");
+        ImGui::TextDisabled("Integrity root");
+        ImGui::SameLine(150.0f);
+        if (!stats.integrityRoot.empty()) {
+            ImGui::Text("%.16s", stats.integrityRoot.c_str());
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("%s", stats.integrityRoot.c_str());
+            }
+        } else {
+            ImGui::TextUnformatted("Written by the next save");
+        }
+        ImGui::TextDisabled("Key derivation");
+        ImGui::SameLine(150.0f);
+        ImGui::Text("scrypt N=%llu r=%u p=%u, %llu run(s), %llu avoided by the session key",
+                    static_cast<unsigned long long>(keyStats.scrypt.n), keyStats.scrypt.r,
+                    keyStats.scrypt.p, static_cast<unsigned long long>(keyStats.scryptRuns),
+                    static_cast<unsigned long long>(keyStats.scryptRunsAvoided));
+        if (keyStats.scrypt != KeyDerivation::PreferredScrypt()) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("(re-keyed by the next save)");
+        }
+        ImGui::TextDisabled("Container");
+        ImGui::SameLine(150.0f);
+        ImGui::Text("%s on disk, %s reclaimable by compaction",
+                    FormatFileSize(static_cast<size_t>(storageStats.containerSize)).c_str(),
+                    FormatFileSize(static_cast<size_t>(reclaimableSize)).c_str());
+        ImGui::TextDisabled("Commits");
+        ImGui::SameLine(150.0f);
+        ImGui::Text("%llu appended, %llu compaction(s)",
+                    static_cast<unsigned long long>(storageStats.appendedCommits),
+                    static_cast<unsigned long long>(storageStats.compactions));
+        ImGui::TextDisabled("Compression");
+        ImGui::SameLine(150.0f);
+        if (stats.storedSize < stats.totalSize) {
+            ImGui::Text("%s stored, ratio %.2f:1",
+                        FormatFileSize(static_cast<size_t>(stats.storedSize)).c_str(),
+                        stats.compressionRatio);
+        } else {
+            ImGui::TextUnformatted("No entries are stored compressed");
+        }
+        ImGui::TextDisabled("Deduplication");
+        ImGui::SameLine(150.0f);
+        if (stats.physicalSize < stats.storedSize) {
+            ImGui::Text("%s of payload, %s saved by shared segments",
+                        FormatFileSize(static_cast<size_t>(stats.physicalSize)).c_str(),
+                        FormatFileSize(static_cast<size_t>(stats.storedSize -
+                                                           stats.physicalSize)).c_str());
+        } else {
+            ImGui::TextUnformatted("No segments are shared between entries");
+        }
+        ImGui::TextDisabled("Plaintext cache");
+        ImGui::SameLine(150.0f);
+        ImGui::Text("%s of %s, %llu hit(s), %llu miss(es), %llu eviction(s)",
+                    FormatFileSize(static_cast<size_t>(cacheStats.residentBytes)).c_str(),
+                    FormatFileSize(static_cast<size_t>(cacheStats.budget)).c_str(),
+                    static_cast<unsigned long long>(cacheStats.hits),
+                    static_cast<unsigned long long>(cacheStats.misses),
+                    static_cast<unsigned long long>(cacheStats.evictions));
+        ImGui::TextDisabled("Secure memory");
+        ImGui::SameLine(150.0f);
+        ImGui::Text("%s in use, %s peak, %s of %s locked",
+                    FormatFileSize(arenaStats.inUse).c_str(),
+                    FormatFileSize(arenaStats.highWater).c_str(),
+                    FormatFileSize(arenaStats.locked).c_str(),
+                    FormatFileSize(arenaStats.mapped).c_str());
+        ImGui::TextDisabled("Revision checks");
+        ImGui::SameLine(150.0f);
+        ImGui::Text("%llu from file metadata, %llu read from disk",
+                    static_cast<unsigned long long>(storageStats.revisionMetadataChecks),
+                    static_cast<unsigned long long>(storageStats.revisionReads));
+        ImGui::TextDisabled("Background saves");
+        ImGui::SameLine(150.0f);
+        if (commitStatus.deferred) {
+            ImGui::Text("%llu pending, %llu change(s) in %llu commit(s)",
+                        static_cast<unsigned long long>(commitStatus.pendingChanges),
+                        static_cast<unsigned long long>(commitStatus.coalescedChanges),
+                        static_cast<unsigned long long>(commitStatus.deferredCommits));
+        } else {
+            ImGui::TextUnformatted("Off; every change is saved immediately");
+        }
+
+        ImGui::Spacing();
+        ImGui::TextUnformatted("Timings");
+        ImGui::Separator();
+        bool collectTimings = Metrics::Enabled();
+        if (ImGui::Checkbox("Collect stage timings", &collectTimings)) {
+            Metrics::SetEnabled(collectTimings);
+        }
+        ImGui::SameLine();
+        if (settings.Button("Reset##Timings", Settings::ButtonVariant::Secondary, 80.0f)) {
+            Metrics::Reset();
+        }
+        ImGui::SameLine();
+        if (settings.Button("Save report", Settings::ButtonVariant::Secondary, 110.0f)) {
+            const std::filesystem::path reportPath = "pqcwallet_metrics.txt";
+            std::string reportError;
+            if (Metrics::DumpToFile(reportPath, &reportError)) {
+                SetStatusMessage("Timings saved to " + std::filesystem::absolute(reportPath).string());
+            } else {
+                SetStatusMessage(reportError, 5.0f);
+            }
+        }
+        const auto stageStats = Metrics::Snapshot();
+        const bool anyTimings = std::any_of(stageStats.begin(), stageStats.end(),
+                                            [](const Metrics::StageStats& stage) {
+                                                return stage.count != 0;
+                                            });
+        if (!anyTimings) {
+            ImGui::TextDisabled(collectTimings ? "No timed operations yet."
+                                               : "Enable collection to time scrypt, AES-GCM, "
+                                                 "hashing, fsync and lock waits.");
+        } else if (ImGui::BeginTable(
+                       "ArchiveStageTimings", 6,
+                       ImGuiTableFlags_BordersInnerH | ImGuiTableFlags_RowBg |
+                           ImGuiTableFlags_SizingStretchProp)) {
+            ImGui::TableSetupColumn("Stage", ImGuiTableColumnFlags_WidthStretch);
+            ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_WidthFixed, 70.0f);
+            ImGui::TableSetupColumn("Total ms", ImGuiTableColumnFlags_WidthFixed, 80.0f);
+            ImGui::TableSetupColumn("p50 us", ImGuiTableColumnFlags_WidthFixed, 70.0f);
+            ImGui::TableSetupColumn("p99 us", ImGuiTableColumnFlags_WidthFixed, 70.0f);
+            ImGui::TableSetupColumn("Data", ImGuiTableColumnFlags_WidthFixed, 90.0f);
+            ImGui::TableHeadersRow();
+            for (const auto& stage : stageStats) {
+                if (stage.count == 0) {
+                    continue;
+                }
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+                ImGui::TextUnformatted(Metrics::StageName(stage.stage));
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%llu", static_cast<unsigned long long>(stage.count));
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%.1f", static_cast<double>(stage.totalNanoseconds) / 1e6);
+                ImGui::TableSetColumnIndex(3);
+                ImGui::Text("%.0f", stage.PercentileMicroseconds(0.5));
+                ImGui::TableSetColumnIndex(4);
+                ImGui::Text("%.0f", stage.PercentileMicroseconds(0.99));
+                ImGui::TableSetColumnIndex(5);
+                if (stage.bytes != 0) {
+                    ImGui::TextUnformatted(FormatFileSize(static_cast<size_t>(stage.bytes)).c_str());
+                } else {
+                    ImGui::TextDisabled("-");
+                }
+            }
+            ImGui::EndTable();
+        }
 
         ImGui::Spacing();
         ImGui::TextUnformatted("File types");
@@ -1186,7 +1506,19 @@ void ArchiveWindow::ShowArchiveStats() {
         ImGui::Separator();
 
         const float closeWidth = 100.0f;
-        ImGui::SetCursorPosX(ImGui::GetWindowWidth() - closeWidth - metrics.windowPadding);
+        const float compactWidth = 120.0f;
+        ImGui::SetCursorPosX(ImGui::GetWindowWidth() - closeWidth - compactWidth -
+                             metrics.itemSpacing - metrics.windowPadding);
+        ImGui::BeginDisabled(reclaimableSize == 0);
+        if (settings.Button("Compact", Settings::ButtonVariant::Secondary, compactWidth)) {
+            if (m_archive->CompactArchive()) {
+                SetStatusMessage("Archive compacted successfully!");
+            } else {
+                SetStatusMessage("Failed to compact archive!", 5.0f);
+            }
+        }
+        ImGui::EndDisabled();
+        ImGui::SameLine();
         if (settings.Button("Close", Settings::ButtonVariant::Primary, closeWidth)) {
             m_showArchiveStats = false;
             ImGui::CloseCurrentPopup();
@@ -1205,6 +1537,7 @@ void ArchiveWindow::HandleDragDrop() {
     std::size_t skippedCount = 0;
     std::string firstFailure;
     std::string firstAddedName;
+    std::vector<std::pair<std::string, std::string>> pendingFiles;
     std::vector<std::string> knownNames;
     knownNames.reserve(m_fileList.size());
     for (const FileEntry& entry : m_fileList) {
@@ -1266,20 +1599,24 @@ void ArchiveWindow::HandleDragDrop() {
                 continue;
             }
 
-            if (!m_archive || !m_isLoaded ||
-                !m_archive->AddFile(path.u8string(), fileName)) {
-                ++skippedCount;
-                if (firstFailure.empty()) {
-                    firstFailure = "the archive could not store a file";
-                }
-                continue;
-            }
+            knownNames.push_back(fileName);
+            pendingFiles.emplace_back(path.u8string(), fileName);
+        }
+    }
 
-            if (firstAddedName.empty()) {
-                firstAddedName = fileName;
+    // Everything dropped in one frame is committed by a single save.
+    if (!pendingFiles.empty()) {
+        std::string addError;
+        if (m_archive && m_isLoaded && m_archive->AddFiles(pendingFiles, &addError)) {
+            addedCount = pendingFiles.size();
+            firstAddedName = pendingFiles.front().second;
+        } else {
+            skippedCount += pendingFiles.size();
+            if (firstFailure.empty()) {
+                firstFailure = addError.empty()
+                    ? "the archive could not store the files"
+                    : addError;
             }
-            knownNames.push_back(fileName);
-            ++addedCount;
         }
     }
 
@@ -1541,12 +1878,11 @@ bool ArchiveWindow::IsDocumentFile(const std::string& filename) const {
     return ext == ".pdf" || ext == ".doc" || ext == ".docx";
 }
 
-void ArchiveWindow::ShowImagePreview(const std::vector<uint8_t>& data) {
-    std::cout << "ShowImagePreview called with " << data.size() << " bytes" << std::endl;
+void ArchiveWindow::ShowImagePreview(CryptoArchive::EntryLease lease) {
+    std::cout << "ShowImagePreview called with " << lease.size() << " bytes" << std::endl;
     
-    // Save data for display in the rendering cycle
-    SecureMemory::Cleanse(m_imagePreviewData);
-    m_imagePreviewData = data;
+    // Keep the lease for display in the rendering cycle
+    m_previewLease = std::move(lease);
     m_previewType = PreviewType::IMAGE;
     m_showFileViewer = true;
     
@@ -1556,12 +1892,11 @@ void ArchiveWindow::ShowImagePreview(const std::vector<uint8_t>& data) {
     // and to ensure consistent handling of previews
 }
 
-void ArchiveWindow::ShowTextPreview(const std::vector<uint8_t>& data) {
-    std::cout << "ShowTextPreview called with " << data.size() << " bytes" << std::endl;
+void ArchiveWindow::ShowTextPreview(CryptoArchive::EntryLease lease) {
+    std::cout << "ShowTextPreview called with " << lease.size() << " bytes" << std::endl;
     
-    // Save data for display in the rendering cycle
-    SecureMemory::Cleanse(m_textPreviewData);
-    m_textPreviewData = data;
+    // Keep the lease for display in the rendering cycle
+    m_previewLease = std::move(lease);
     m_previewType = PreviewType::TEXT;
     m_showFileViewer = true;
     
@@ -1583,15 +1918,17 @@ void ArchiveWindow::ShowFilePreview(const FileEntry& entry) {
         return;
     }
     
-    // Extract file data into memory
-    std::vector<uint8_t> fileData;
-    SecureMemory::ScopedCleanse fileDataGuard(fileData);
-    std::cout << "Calling ExtractFileToMemory for file: " << entry.name << std::endl;
-    bool success = m_archive->ExtractFileToMemory(entry.name, fileData);
-    std::cout << "ExtractFileToMemory result: " << (success ? "Success" : "Failed") << std::endl;
-    std::cout << "Data size received: " << fileData.size() << " bytes" << std::endl;
+    // Lease the plaintext instead of copying it; the previous preview is
+    // released first so a repair below is not blocked by it
+    ResetPreview();
+    const bool isText = IsTextFile(entry.name);
+    std::cout << "Leasing file data for: " << entry.name << std::endl;
+    CryptoArchive::EntryLease lease = m_archive->LeaseEntry(entry.name, isText);
+    bool success = lease.valid();
+    std::cout << "LeaseEntry result: " << (success ? "Success" : "Failed") << std::endl;
+    std::cout << "Data size received: " << lease.size() << " bytes" << std::endl;
     
-    if (!success || fileData.empty()) {
+    if (!success || lease.size() == 0) {
         std::cout << "Failed to extract file data - trying to fix the archive..." << std::endl;
         
         // Try to repair the archive
@@ -1599,11 +1936,12 @@ void ArchiveWindow::ShowFilePreview(const FileEntry& entry) {
             std::cout << "Archive repaired, trying extraction again..." << std::endl;
             
             // Try extraction again after repair
-            success = m_archive->ExtractFileToMemory(entry.name, fileData);
+            lease = m_archive->LeaseEntry(entry.name, isText);
+            success = lease.valid();
             std::cout << "Second extraction attempt result: " << (success ? "Success" : "Failed") << std::endl;
-            std::cout << "Data size received on retry: " << fileData.size() << " bytes" << std::endl;
+            std::cout << "Data size received on retry: " << lease.size() << " bytes" << std::endl;
             
-            if (!success || fileData.empty()) {
+            if (!success || lease.size() == 0) {
                 std::cout << "Failed to extract file even after repair" << std::endl;
                 SetStatusMessage("Failed to extract file data for preview!", 3.0f);
                 m_showFileViewer = false;
@@ -1623,7 +1961,7 @@ void ArchiveWindow::ShowFilePreview(const FileEntry& entry) {
         return;
     }
     
-    if (fileData.empty()) {
+    if (lease.size() == 0) {
         std::cout << "File extraction returned empty data" << std::endl;
         SetStatusMessage("File appears to be empty!", 3.0f);
         return;
@@ -1636,12 +1974,12 @@ void ArchiveWindow::ShowFilePreview(const FileEntry& entry) {
     std::cout << "File type checks - IsText: " << (IsTextFile(entry.name) ? "Yes" : "No") 
               << ", IsImage: " << (IsImageFile(entry.name) ? "Yes" : "No") << std::endl;
               
-    if (IsTextFile(entry.name)) {
+    if (isText) {
         std::cout << "Showing text preview" << std::endl;
-        ShowTextPreview(fileData);
+        ShowTextPreview(std::move(lease));
     } else if (IsImageFile(entry.name)) {
         std::cout << "Showing image preview" << std::endl;
-        ShowImagePreview(fileData);
+        ShowImagePreview(std::move(lease));
     } else {
         std::cout << "Unsupported file type for preview" << std::endl;
         SetStatusMessage("Preview not available for this file type!", 3.0f);
@@ -1669,7 +2007,7 @@ ImVec2 ArchiveWindow::GetStandardDialogPosition() const {
 
 // Helper implementation for multi-line selectable text
 // Helper for displaying selectable text
-void ArchiveWindow::DisplaySelectableText(const std::string& text, const ImVec2& size) {
+void ArchiveWindow::DisplaySelectableText(const char* text, size_t length, const ImVec2& size) {
     static bool showCopySuccessMsg = false;
     static float copyMsgTimer = 0.0f;
     
@@ -1677,15 +2015,12 @@ void ArchiveWindow::DisplaySelectableText(const std::string& text, const ImVec2&
     Settings& settings = Settings::Instance();
     auto themeColors = settings.GetThemeColors();
     
-    std::vector<char> buffer(text.begin(), text.end());
-    buffer.push_back('\0');
-    SecureMemory::ScopedCleanse bufferGuard(buffer);
-    
-    // Display text as readonly input that allows selection with theme-appropriate background
+    // Display text as readonly input that allows selection with theme-appropriate background.
+    // A read-only input never writes to its buffer, so the leased text is used directly.
     ImGui::PushStyleColor(ImGuiCol_FrameBg, ImVec4(themeColors.accentText[0] * 0.1f, themeColors.accentText[1] * 0.1f, themeColors.accentText[2] * 0.1f, 0.5f));
     ImGui::InputTextMultiline("##TextPreviewContent", 
-                             buffer.data(),
-                             buffer.size(),
+                             const_cast<char*>(text),
+                             length + 1,
                              size, 
                              ImGuiInputTextFlags_ReadOnly);
     ImGui::PopStyleColor();
@@ -1701,7 +2036,7 @@ void ArchiveWindow::DisplaySelectableText(const std::string& text, const ImVec2&
     ImGui::PushID("CopyAllTextButton");
     Settings::PushBlackButtonText();
     if (ImGui::Button("Copy All Text", ImVec2(140, 0))) {
-        ImGui::SetClipboardText(text.c_str());
+        ImGui::SetClipboardText(text);
         showCopySuccessMsg = true;
         copyMsgTimer = 2.0f; // Show message for 2 seconds
     }
@@ -1726,6 +2061,9 @@ bool ArchiveWindow::LoadArchive(const std::string& archiveName, const std::strin
     std::cout << "Loading archive: " << archiveName << " for user " << m_username << std::endl;
     
     // Create a new archive object with the specified archive name
+    WaitForVerification();
+    ResetPreview();
+    m_showVerifyReport = false;
     m_archive = std::make_unique<CryptoArchive>(m_username, archiveName);
     bool success = false;
     
@@ -1742,6 +2080,7 @@ bool ArchiveWindow::LoadArchive(const std::string& archiveName, const std::strin
         if (success) {
             std::cout << "Successfully loaded archive: " << archiveName << std::endl;
             m_isLoaded = true;
+            ApplyCommitSettings();
             // Reset UI state for the new archive
             m_selectedFile = -1; // Reset selected file
             ResetPreview();
@@ -2,6 +2,8 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <thread>
 #include <imgui.h>
 #include "CryptoArchive.h"
 
@@ -22,6 +24,9 @@ public:
     
     // Initialize archive for user
     bool Initialize(const std::string& password);
+    // Take over an archive that was already loaded or created, e.g. by the
+    // login worker; null reports the same failure as Initialize().
+    bool AdoptArchive(std::unique_ptr<CryptoArchive> archive, bool created);
     
     // Change the current archive
     // Returns true if the archive was successfully loaded, false otherwise
@@ -34,6 +39,12 @@ public:
     bool IsLoaded() const;
     std::string GetArchiveName() const;
     
+    // Apply the write-behind settings to the open archive
+    void ApplyCommitSettings();
+
+    // Commit staged archive changes now; false if they could not be saved
+    bool FlushPendingChanges();
+    
     // Show/hide window
     void Show();
     void Hide();
@@ -76,8 +87,9 @@ private:
     std::string m_addFileError;
     std::string m_extractFileError;
    // PreviewType m_previewType;  // Tipul de previzualizare curent
-    std::vector<uint8_t> m_textPreviewData;  // Date pentru previzualizare text
-    std::vector<uint8_t> m_imagePreviewData; // Date pentru previzualizare imagine
+    // Plaintext of the previewed entry, read in place from the archive; text
+    // previews are leased with a terminating zero byte.
+    CryptoArchive::EntryLease m_previewLease;
     std::string m_statusMessage;
     float m_statusMessageTime;
     float m_statusMessageDuration;
@@ -86,18 +98,36 @@ private:
     ImVec2 m_dropZoneMax;
     bool m_dropZoneValid;
     float m_dropFeedbackTime;
+    // Stats of the last refresh, so frames do not wait on a background commit
+    CryptoArchive::ArchiveStats m_archiveStats{};
+    std::string m_lastCommitError;
+
+    // Integrity check running on its own thread while a modal shows its
+    // progress; the report is read only after the thread has been joined.
+    std::thread m_verifyThread;
+    std::atomic<bool> m_verifyRunning{false};
+    std::atomic<size_t> m_verifyChecked{0};
+    std::atomic<size_t> m_verifyTotal{0};
+    CryptoArchive::IntegrityReport m_verifyReport{};
+    bool m_showVerifyReport = false;
 
     // Preview data
     PreviewType m_previewType;
     std::vector<uint8_t> m_previewData;
     
     // File operations
+    bool FinishInitialize(bool success, bool createdNewArchive);
     void RefreshFileList();
     void ShowAddFileDialog();
     void ShowExtractDialog();
     void ShowFileViewer();
     void ShowArchiveStats();
     void HandleDragDrop();
+    void PollCommitStatus();
+    void StartVerification();
+    void PollVerification();
+    void WaitForVerification();
+    void ShowVerificationDialogs();
 
     
     // Utility functions
@@ -114,21 +144,19 @@ private:
     
     // Preview functionality
     void ShowFilePreview(const FileEntry& entry);
-    void ShowTextPreview(const std::vector<uint8_t>& data);
-    void ShowImagePreview(const std::vector<uint8_t>& data);
+    void ShowTextPreview(CryptoArchive::EntryLease lease);
+    void ShowImagePreview(CryptoArchive::EntryLease lease);
     
     // Helper pentru resetarea variabilelor de previzualizare
     void ResetPreview() {
         m_showFileViewer = false;
         m_previewType = PreviewType::NONE;
         SecureMemory::Cleanse(m_previewData);
-        SecureMemory::Cleanse(m_textPreviewData);
-        SecureMemory::Cleanse(m_imagePreviewData);
         m_previewData.clear();
-        m_textPreviewData.clear();
-        m_imagePreviewData.clear();
+        m_previewLease.Release();
     }
     
     // Helper pentru afișarea textului selectabil
-    void DisplaySelectableText(const std::string& text, const ImVec2& size);
+    // text must be followed by a zero byte at text[length].
+    void DisplaySelectableText(const char* text, size_t length, const ImVec2& size);
 };
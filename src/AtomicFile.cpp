@@ -1,5 +1,7 @@
 #include "AtomicFile.h"
 
+#include "Metrics.h"
+
 #include <algorithm>
 #include <atomic>
 #include <cerrno>
@@ -51,7 +53,18 @@ void RemoveTemporaryFile(const std::filesystem::path& path) noexcept {
     std::filesystem::remove(path, error);
 }
 
-#ifndef _WIN32
+// Durability flushes are timed, since they often dominate a save.
+#ifdef _WIN32
+bool FlushToDisk(HANDLE handle) {
+    const Metrics::ScopedTimer timer(Metrics::Stage::Fsync);
+    return FlushFileBuffers(handle) != 0;
+}
+#else
+bool FlushToDisk(int descriptor) {
+    const Metrics::ScopedTimer timer(Metrics::Stage::Fsync);
+    return fsync(descriptor) == 0;
+}
+
 bool SynchronizeDirectory(const std::filesystem::path& directory) {
     int flags = O_RDONLY;
 #ifdef O_DIRECTORY
@@ -65,7 +78,7 @@ bool SynchronizeDirectory(const std::filesystem::path& directory) {
         return false;
     }
 
-    const bool synchronized = fsync(descriptor) == 0;
+    const bool synchronized = FlushToDisk(descriptor);
     const int savedError = errno;
     close(descriptor);
     errno = savedError;
@@ -88,7 +101,17 @@ void FailNextWriteBeforeTemporaryCreate() {
 } // namespace Testing
 
 bool Write(const std::filesystem::path& destination, const uint8_t* data, size_t size) {
-    if (destination.empty() || destination.filename().empty() || (size != 0 && data == nullptr)) {
+    if (size != 0 && data == nullptr) {
+        return false;
+    }
+    return WriteStreamed(destination, [data, size](const ChunkWriter& writer) {
+        return size == 0 || writer(data, size);
+    });
+}
+
+bool WriteStreamed(const std::filesystem::path& destination,
+                   const std::function<bool(const ChunkWriter& writer)>& producer) {
+    if (destination.empty() || destination.filename().empty() || !producer) {
         return false;
     }
 
@@ -121,21 +144,33 @@ bool Write(const std::filesystem::path& destination, const uint8_t* data, size_t
             return false;
         }
 
-        bool success = true;
-        size_t offset = 0;
-        while (offset < size) {
-            const size_t remaining = size - offset;
-            const DWORD chunk = static_cast<DWORD>(std::min<size_t>(
-                remaining, static_cast<size_t>(std::numeric_limits<DWORD>::max())));
-            DWORD written = 0;
-            if (!WriteFile(handle, data + offset, chunk, &written, nullptr) || written != chunk) {
-                success = false;
-                break;
+        const ChunkWriter writer = [handle](const uint8_t* data, size_t size) {
+            if (size != 0 && data == nullptr) {
+                return false;
             }
-            offset += written;
+            size_t offset = 0;
+            while (offset < size) {
+                const size_t remaining = size - offset;
+                const DWORD chunk = static_cast<DWORD>(std::min<size_t>(
+                    remaining, static_cast<size_t>(std::numeric_limits<DWORD>::max())));
+                DWORD written = 0;
+                if (!WriteFile(handle, data + offset, chunk, &written, nullptr) ||
+                    written != chunk) {
+                    return false;
+                }
+                offset += written;
+            }
+            return true;
+        };
+
+        bool success = false;
+        try {
+            success = producer(writer);
+        } catch (...) {
+            success = false;
         }
 
-        if (success && !FlushFileBuffers(handle)) {
+        if (success && !FlushToDisk(handle)) {
             success = false;
         }
         if (!CloseHandle(handle)) {
@@ -176,20 +211,34 @@ bool Write(const std::filesystem::path& destination, const uint8_t* data, size_t
             return false;
         }
 
+        const ChunkWriter writer = [descriptor](const uint8_t* data, size_t size) {
+            if (size != 0 && data == nullptr) {
+                return false;
+            }
+            size_t offset = 0;
+            while (offset < size) {
+                const ssize_t written = write(descriptor, data + offset, size - offset);
+                if (written > 0) {
+                    offset += static_cast<size_t>(written);
+                } else if (written < 0 && errno == EINTR) {
+                    continue;
+                } else {
+                    return false;
+                }
+            }
+            return true;
+        };
+
         bool success = fchmod(descriptor, S_IRUSR | S_IWUSR) == 0;
-        size_t offset = 0;
-        while (success && offset < size) {
-            const ssize_t written = write(descriptor, data + offset, size - offset);
-            if (written > 0) {
-                offset += static_cast<size_t>(written);
-            } else if (written < 0 && errno == EINTR) {
-                continue;
-            } else {
+        if (success) {
+            try {
+                success = producer(writer);
+            } catch (...) {
                 success = false;
             }
         }
 
-        if (success && fsync(descriptor) != 0) {
+        if (success && !FlushToDisk(descriptor)) {
             success = false;
         }
         if (close(descriptor) != 0) {
@@ -224,6 +273,126 @@ bool Write(const std::filesystem::path& destination, const uint8_t* data, size_t
     }
 }
 
+bool WriteAt(const std::filesystem::path& destination,
+             uint64_t offset,
+             const std::function<bool(const ChunkWriter& writer)>& producer) {
+    if (destination.empty() || destination.filename().empty() || !producer) {
+        return false;
+    }
+
+    try {
+        std::error_code statusError;
+        const auto status = std::filesystem::symlink_status(destination, statusError);
+        if (statusError || status.type() != std::filesystem::file_type::regular) {
+            return false;
+        }
+        if (g_failBeforeReplace.exchange(false, std::memory_order_acq_rel)) {
+            return false;
+        }
+
+#ifdef _WIN32
+        HANDLE handle = CreateFileW(destination.c_str(), GENERIC_WRITE, FILE_SHARE_READ,
+                                    nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) {
+            std::cerr << "Cannot open file for writing: " << destination << std::endl;
+            return false;
+        }
+
+        LARGE_INTEGER position{};
+        position.QuadPart = static_cast<LONGLONG>(offset);
+        bool success = offset <= static_cast<uint64_t>(std::numeric_limits<LONGLONG>::max()) &&
+                       SetFilePointerEx(handle, position, nullptr, FILE_BEGIN);
+        const ChunkWriter writer = [handle](const uint8_t* data, size_t size) {
+            if (size != 0 && data == nullptr) {
+                return false;
+            }
+            size_t written = 0;
+            while (written < size) {
+                const DWORD chunk = static_cast<DWORD>(std::min<size_t>(
+                    size - written, static_cast<size_t>(std::numeric_limits<DWORD>::max())));
+                DWORD count = 0;
+                if (!WriteFile(handle, data + written, chunk, &count, nullptr) ||
+                    count != chunk) {
+                    return false;
+                }
+                written += count;
+            }
+            return true;
+        };
+
+        if (success) {
+            try {
+                success = producer(writer);
+            } catch (...) {
+                success = false;
+            }
+        }
+        if (success && !FlushToDisk(handle)) {
+            success = false;
+        }
+        if (!CloseHandle(handle)) {
+            success = false;
+        }
+        return success;
+#else
+        int flags = O_WRONLY;
+#ifdef O_CLOEXEC
+        flags |= O_CLOEXEC;
+#endif
+#ifdef O_NOFOLLOW
+        flags |= O_NOFOLLOW;
+#endif
+        const int descriptor = open(destination.c_str(), flags);
+        if (descriptor < 0) {
+            std::cerr << "Cannot open file for writing: " << destination << std::endl;
+            return false;
+        }
+
+        uint64_t position = offset;
+        const ChunkWriter writer = [descriptor, &position](const uint8_t* data, size_t size) {
+            if (size != 0 && data == nullptr) {
+                return false;
+            }
+            size_t written = 0;
+            while (written < size) {
+                if (position > static_cast<uint64_t>(std::numeric_limits<off_t>::max())) {
+                    return false;
+                }
+                const ssize_t count = pwrite(descriptor, data + written, size - written,
+                                             static_cast<off_t>(position));
+                if (count > 0) {
+                    written += static_cast<size_t>(count);
+                    position += static_cast<uint64_t>(count);
+                } else if (count < 0 && errno == EINTR) {
+                    continue;
+                } else {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        bool success = false;
+        try {
+            success = producer(writer);
+        } catch (...) {
+            success = false;
+        }
+        if (success && !FlushToDisk(descriptor)) {
+            success = false;
+        }
+        if (close(descriptor) != 0) {
+            success = false;
+        }
+        return success;
+#endif
+    } catch (const std::exception& error) {
+        std::cerr << "In-place write failed for " << destination << ": " << error.what()
+                  << std::endl;
+        return false;
+    }
+}
+
 bool RenameNoReplace(const std::filesystem::path& source,
                      const std::filesystem::path& destination) {
     if (source.empty() || destination.empty() || source.filename().empty() ||
@@ -3,6 +3,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -26,6 +27,24 @@ inline bool Write(const std::filesystem::path& destination,
                  data.size());
 }
 
+// Appends bytes to the private temporary file of WriteStreamed.
+using ChunkWriter = std::function<bool(const uint8_t* data, size_t size)>;
+
+// Same protocol as Write, but the content is produced incrementally so callers
+// never have to hold the complete file in memory. The destination is replaced
+// only when the producer returns true and every chunk was written and synced.
+bool WriteStreamed(const std::filesystem::path& destination,
+                   const std::function<bool(const ChunkWriter& writer)>& producer);
+
+// Writes the produced bytes into an existing regular file starting at offset,
+// extending it when needed, and synchronizes the file before returning. This
+// is not atomic by itself: callers must keep a partially written range
+// harmless, e.g. by appending data first and only then updating a small head
+// that is authenticated independently.
+bool WriteAt(const std::filesystem::path& destination,
+             uint64_t offset,
+             const std::function<bool(const ChunkWriter& writer)>& producer);
+
 // Renames a regular file within one directory without replacing an existing
 // destination. The operation is atomic on supported platforms and preserves
 // the source if the destination already exists.
@@ -35,7 +54,8 @@ bool RenameNoReplace(const std::filesystem::path& source,
 namespace Testing {
 
 // One-shot fault injection used to prove that an interrupted write leaves the
-// old destination untouched. It is intentionally not used by production code.
+// old destination untouched. WriteAt fails before changing any byte. It is
+// intentionally not used by production code.
 void FailNextWriteBeforeReplace();
 
 // Simulates an inability to create the temporary file (for example a
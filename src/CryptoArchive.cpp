@@ -1,8 +1,13 @@
 #include "CryptoArchive.h"
+#include "ArchiveChunker.h"
+#include "ArchiveCodec.h"
 #include "AtomicFile.h"
 #include "FormatValidation.h"
+#include "KeyDerivation.h"
+#include "Log.h"
+#include "MappedFile.h"
+#include "Metrics.h"
 #include "PathSecurity.h"
-#include <iostream>
 #include <fstream>
 #include <filesystem>
 #include <chrono>
@@ -15,7 +20,9 @@
 #include <array>
 #include <limits>
 #include <memory>
+#include <system_error>
 #include <thread>
+#include <unordered_set>
 #include <openssl/crypto.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
@@ -34,21 +41,45 @@
 
 namespace {
 
+constexpr Log::Module LOG_MODULE = Log::Module::Archive;
+
+constexpr std::array<uint8_t, 8> LOG_ARCHIVE_MAGIC = {'P', 'Q', 'C', 'E', 'N', 'C', '0', '5'};
+constexpr std::array<uint8_t, 8> INDEXED_ARCHIVE_MAGIC = {'P', 'Q', 'C', 'E', 'N', 'C', '0', '4'};
+constexpr std::array<uint8_t, 8> STREAMED_ARCHIVE_MAGIC = {'P', 'Q', 'C', 'E', 'N', 'C', '0', '3'};
 constexpr std::array<uint8_t, 8> SECURE_ARCHIVE_MAGIC = {'P', 'Q', 'C', 'E', 'N', 'C', '0', '2'};
 constexpr std::array<uint8_t, 8> LEGACY_ARCHIVE_MAGIC = {'P', 'Q', 'C', 'E', 'N', 'C', '0', '1'};
+constexpr uint32_t LOG_ARCHIVE_FORMAT_VERSION = 5;
 constexpr uint32_t ARCHIVE_FORMAT_VERSION = 2;
 constexpr uint32_t KDF_SCRYPT = 1;
-constexpr uint64_t SCRYPT_N = 32768;
-constexpr uint32_t SCRYPT_R = 8;
-constexpr uint32_t SCRYPT_P = 1;
-constexpr uint64_t SCRYPT_MAX_MEMORY = 128ULL * 1024ULL * 1024ULL;
+// Offset of the scrypt N, r and p after the magic, version and KDF id; the
+// same in every container format that records them.
+constexpr size_t SCRYPT_FIELDS_OFFSET = 16;
 constexpr size_t KEY_SIZE = 32;
 constexpr size_t SALT_SIZE = 32;
 constexpr size_t NONCE_SIZE = 12;
 constexpr size_t TAG_SIZE = 16;
 constexpr size_t SECURE_FIXED_HEADER_SIZE = 52;
+constexpr size_t STREAMED_FIXED_HEADER_SIZE = 56;
+constexpr size_t INDEXED_FIXED_HEADER_SIZE = 64;
+constexpr size_t HEAD_SLOT_COUNT = 2;
+// Index and blob sealing is shared by PQCENC04 and PQCENC05.
+constexpr char INDEX_KEY_LABEL[] = "PQCENC04 index";
+constexpr char ENTRY_KEY_LABEL[] = "PQCENC04 entry";
+// An append is replaced by a compacting rewrite once the unreferenced bytes
+// exceed both this floor and the bytes still referenced by the head.
+constexpr uint64_t COMPACTION_MIN_DEAD_SIZE = 1024ULL * 1024ULL;
+// Bound for legacy single-message containers, which are decrypted in memory.
 constexpr uint64_t MAX_ARCHIVE_CONTAINER_SIZE = 1024ULL * 1024ULL * 1024ULL;
+constexpr uint64_t MAX_STREAMED_ARCHIVE_SIZE = 64ULL * 1024ULL * 1024ULL * 1024ULL;
 constexpr uint64_t MAX_ARCHIVE_ENTRY_SIZE = 512ULL * 1024ULL * 1024ULL;
+// ExtractFile decrypts at most this much plaintext at once, whatever the
+// entry size; compressed segments add at most their packed size.
+constexpr size_t EXTRACT_BATCH_SIZE = 4U * 1024U * 1024U;
+// Sources larger than one ingest block stream into the container through the
+// ingest pipeline instead of being read whole. Each queue between its stages
+// holds at most INGEST_QUEUE_DEPTH blocks or segment batches of that size.
+constexpr size_t INGEST_BLOCK_SIZE = 4U * 1024U * 1024U;
+constexpr size_t INGEST_QUEUE_DEPTH = 4;
 constexpr auto ARCHIVE_LOCK_TIMEOUT = std::chrono::seconds(5);
 
 using CipherContext = std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)>;
@@ -59,6 +90,7 @@ public:
         if (archivePath.empty()) {
             return;
         }
+        const Metrics::ScopedTimer timer(Metrics::Stage::LockWait);
         lockPath_ = archivePath;
         lockPath_ += ".lock";
         const auto deadline = std::chrono::steady_clock::now() + ARCHIVE_LOCK_TIMEOUT;
@@ -172,55 +204,46 @@ private:
 #endif
 };
 
-bool FileRevision(const std::filesystem::path& path, bool& exists,
-                  std::string& revision) {
-    exists = false;
-    revision.clear();
-    std::error_code fileError;
-    if (!std::filesystem::exists(path, fileError)) {
-        return !fileError;
-    }
-    if (fileError || !std::filesystem::is_regular_file(path, fileError) || fileError) {
-        return false;
+std::string HexEncode(const unsigned char* data, size_t size) {
+    std::ostringstream encoded;
+    for (size_t i = 0; i < size; ++i) {
+        encoded << std::hex << std::setw(2) << std::setfill('0')
+                << static_cast<unsigned int>(data[i]);
     }
+    return encoded.str();
+}
 
-    std::ifstream file(path, std::ios::binary);
-    if (!file) {
-        return false;
+// Incremental SHA-256 over the exact bytes of an archive file, used both while
+// streaming a container to disk and while reading one back, or of an entry
+// payload while it is extracted.
+class RevisionDigest {
+public:
+    RevisionDigest() : context_(EVP_MD_CTX_new(), EVP_MD_CTX_free) {
+        valid_ = context_ && EVP_DigestInit_ex(context_.get(), EVP_sha256(), nullptr) == 1;
     }
-    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> digest(
-        EVP_MD_CTX_new(), EVP_MD_CTX_free);
-    if (!digest || EVP_DigestInit_ex(digest.get(), EVP_sha256(), nullptr) != 1) {
-        return false;
+
+    bool Update(const uint8_t* data, size_t size) {
+        const Metrics::ScopedTimer timer(Metrics::Stage::Sha256, size);
+        valid_ = valid_ && (size == 0 || EVP_DigestUpdate(context_.get(), data, size) == 1);
+        return valid_;
     }
 
-    std::array<char, 64 * 1024> buffer{};
-    while (file) {
-        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
-        const std::streamsize count = file.gcount();
-        if (count > 0 &&
-            EVP_DigestUpdate(digest.get(), buffer.data(), static_cast<size_t>(count)) != 1) {
+    bool Finish(std::string& revision) {
+        std::array<unsigned char, EVP_MAX_MD_SIZE> hash{};
+        unsigned int hashSize = 0;
+        if (!valid_ || EVP_DigestFinal_ex(context_.get(), hash.data(), &hashSize) != 1) {
+            valid_ = false;
             return false;
         }
-    }
-    if (!file.eof()) {
-        return false;
+        valid_ = false;
+        revision = HexEncode(hash.data(), hashSize);
+        return true;
     }
 
-    std::array<unsigned char, EVP_MAX_MD_SIZE> hash{};
-    unsigned int hashSize = 0;
-    if (EVP_DigestFinal_ex(digest.get(), hash.data(), &hashSize) != 1) {
-        return false;
-    }
-    std::ostringstream encoded;
-    for (unsigned int i = 0; i < hashSize; ++i) {
-        encoded << std::hex << std::setw(2) << std::setfill('0')
-                << static_cast<unsigned int>(hash[i]);
-    }
-    revision = encoded.str();
-    exists = true;
-    return true;
-}
+private:
+    std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> context_;
+    bool valid_ = false;
+};
 
 void AppendUint32(std::vector<uint8_t>& output, uint32_t value) {
     for (int shift = 24; shift >= 0; shift -= 8) {
@@ -258,6 +281,167 @@ bool ReadUint64(const std::vector<uint8_t>& input, size_t& offset, uint64_t& val
     return true;
 }
 
+ArchiveStream::ReadAt FileReadAt(std::ifstream& file) {
+    return [&file](uint64_t offset, uint8_t* data, size_t size) {
+        if (size == 0) {
+            return true;
+        }
+        if (data == nullptr ||
+            offset > static_cast<uint64_t>(std::numeric_limits<std::streamoff>::max())) {
+            return false;
+        }
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(offset), std::ios::beg);
+        file.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(size));
+        return file.gcount() == static_cast<std::streamsize>(size);
+    };
+}
+
+ArchiveStream::ReadAt MemoryReadAt(const std::vector<uint8_t>& bytes) {
+    return [&bytes](uint64_t offset, uint8_t* data, size_t size) {
+        if (offset > bytes.size() || size > bytes.size() - offset ||
+            (size != 0 && data == nullptr)) {
+            return false;
+        }
+        if (size != 0) {
+            std::memcpy(data, bytes.data() + offset, size);
+        }
+        return true;
+    };
+}
+
+// Sequential view of a positional reader. Every byte read can also be fed to
+// a revision digest, so a container is hashed while it is authenticated.
+ArchiveStream::Source SequentialSource(const ArchiveStream::ReadAt& readAt,
+                                       uint64_t& position,
+                                       RevisionDigest* digest) {
+    return [&readAt, &position, digest](uint8_t* data, size_t size) {
+        if (!readAt(position, data, size) ||
+            (digest != nullptr && !digest->Update(data, size))) {
+            return false;
+        }
+        position += size;
+        return true;
+    };
+}
+
+// Positional reads through one stream, serialized so that blobs can be
+// opened on several threads.
+ArchiveStream::ReadAt LockedReadAt(const ArchiveStream::ReadAt& readAt, std::mutex& mutex) {
+    return [readAt, &mutex](uint64_t offset, uint8_t* data, size_t size) {
+        const std::lock_guard<std::mutex> lock(mutex);
+        return readAt(offset, data, size);
+    };
+}
+
+// Revision of a PQCENC05 container: every commit writes a head slot with a
+// new generation and index nonce, and the slot is bound to its index, so the
+// preamble and both slots identify the committed state.
+bool HeadRevision(const std::vector<uint8_t>& preamble,
+                  const std::vector<uint8_t>& firstSlot,
+                  const std::vector<uint8_t>& secondSlot,
+                  std::string& revision) {
+    RevisionDigest digest;
+    return digest.Update(preamble.data(), preamble.size()) &&
+           digest.Update(firstSlot.data(), firstSlot.size()) &&
+           digest.Update(secondSlot.data(), secondSlot.size()) &&
+           digest.Finish(revision);
+}
+
+// The revision identifies the container written by one save. PQCENC05 is
+// identified by its head (see HeadRevision) and PQCENC04 commits every byte
+// through its header and sealed index, so both stay cheap for large archives;
+// older formats are hashed completely.
+bool ContainerRevision(const std::filesystem::path& path, bool& exists,
+                       std::string& revision) {
+    exists = false;
+    revision.clear();
+    std::error_code fileError;
+    if (!std::filesystem::exists(path, fileError)) {
+        return !fileError;
+    }
+    if (fileError || !std::filesystem::is_regular_file(path, fileError) || fileError) {
+        return false;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    const std::streamoff endPosition = file.tellg();
+    if (endPosition < 0) {
+        return false;
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(endPosition);
+    file.seekg(0, std::ios::beg);
+
+    std::array<uint8_t, 8> magic{};
+    if (fileSize >= magic.size() &&
+        file.read(reinterpret_cast<char*>(magic.data()),
+                  static_cast<std::streamsize>(magic.size())) &&
+        magic == LOG_ARCHIVE_MAGIC) {
+        const ArchiveStream::ReadAt readAt = FileReadAt(file);
+        std::vector<uint8_t> preamble(FormatValidation::ARCHIVE_V5_PREAMBLE_SIZE);
+        std::vector<uint8_t> slots[HEAD_SLOT_COUNT];
+        if (!readAt(0, preamble.data(), preamble.size()) ||
+            !FormatValidation::ValidateArchiveV5Preamble(preamble.data(), preamble.size(),
+                                                         fileSize)) {
+            return false;
+        }
+        for (size_t slot = 0; slot < HEAD_SLOT_COUNT; ++slot) {
+            slots[slot].resize(FormatValidation::ARCHIVE_V5_SLOT_SIZE);
+            if (!readAt(FormatValidation::ArchiveV5SlotOffset(slot), slots[slot].data(),
+                        slots[slot].size())) {
+                return false;
+            }
+        }
+        if (!HeadRevision(preamble, slots[0], slots[1], revision)) {
+            return false;
+        }
+        exists = true;
+        return true;
+    }
+    file.clear();
+    file.seekg(0, std::ios::beg);
+
+    RevisionDigest digest;
+    uint64_t hashedFrom = 0;
+    std::vector<uint8_t> header(FormatValidation::ARCHIVE_V4_HEADER_SIZE);
+    if (fileSize >= header.size() &&
+        file.read(reinterpret_cast<char*>(header.data()),
+                  static_cast<std::streamsize>(header.size())) &&
+        std::equal(INDEXED_ARCHIVE_MAGIC.begin(), INDEXED_ARCHIVE_MAGIC.end(),
+                   header.begin())) {
+        size_t offset = INDEXED_FIXED_HEADER_SIZE - 2 * sizeof(uint64_t);
+        uint64_t indexOffset = 0;
+        if (!FormatValidation::ValidateArchiveV4Header(header.data(), header.size(), fileSize) ||
+            !ReadUint64(header, offset, indexOffset) ||
+            !digest.Update(header.data(), header.size())) {
+            return false;
+        }
+        hashedFrom = indexOffset;
+    }
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(hashedFrom), std::ios::beg);
+
+    std::array<char, 64 * 1024> buffer{};
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        const std::streamsize count = file.gcount();
+        if (count > 0 &&
+            !digest.Update(reinterpret_cast<const uint8_t*>(buffer.data()),
+                           static_cast<size_t>(count))) {
+            return false;
+        }
+    }
+    if (!file.eof() || !digest.Finish(revision)) {
+        return false;
+    }
+    exists = true;
+    return true;
+}
+
 void Cleanse(std::vector<uint8_t>& data) {
     if (!data.empty()) {
         OPENSSL_cleanse(data.data(), data.size());
@@ -293,27 +477,32 @@ std::string FormatFileModificationTime(const std::filesystem::path& path) {
 
 bool DeriveScryptKey(const std::string& password,
                      const std::vector<uint8_t>& salt,
-                     uint64_t n,
-                     uint64_t r,
-                     uint64_t p,
-                     std::vector<uint8_t>& key) {
-    if (password.empty() || salt.size() != SALT_SIZE || n != SCRYPT_N ||
-        r != SCRYPT_R || p != SCRYPT_P) {
+                     const KeyDerivation::ScryptParameters& scrypt,
+                     SecureMemory::SecureBytes& key) {
+    if (salt.size() != SALT_SIZE) {
         return false;
     }
 
     key.assign(KEY_SIZE, 0);
-    if (EVP_PBE_scrypt(password.data(), password.size(), salt.data(), salt.size(),
-                       n, r, p, SCRYPT_MAX_MEMORY, key.data(), key.size()) != 1) {
-        Cleanse(key);
+    if (!KeyDerivation::DeriveScrypt(password, salt.data(), salt.size(), scrypt, key.data(),
+                                     key.size())) {
         key.clear();
         return false;
     }
     return true;
 }
 
-std::vector<uint8_t> DeriveLegacyKey(const std::string& password) {
-    std::vector<uint8_t> key(KEY_SIZE);
+// Reads the scrypt parameters of a container header whose fields were
+// already range-checked.
+bool ReadScryptParameters(const std::vector<uint8_t>& header,
+                          KeyDerivation::ScryptParameters& scrypt) {
+    size_t offset = SCRYPT_FIELDS_OFFSET;
+    return ReadUint64(header, offset, scrypt.n) && ReadUint32(header, offset, scrypt.r) &&
+           ReadUint32(header, offset, scrypt.p) && KeyDerivation::IsSupported(scrypt);
+}
+
+SecureMemory::SecureBytes DeriveLegacyKey(const std::string& password) {
+    SecureMemory::SecureBytes key(KEY_SIZE);
     unsigned int digestLength = 0;
     if (EVP_Digest(password.data(), password.size(), key.data(), &digestLength,
                    EVP_sha256(), nullptr) != 1 || digestLength != KEY_SIZE) {
@@ -323,56 +512,8 @@ std::vector<uint8_t> DeriveLegacyKey(const std::string& password) {
     return key;
 }
 
-bool EncryptAesGcm(const std::vector<uint8_t>& plaintext,
-                   const std::vector<uint8_t>& key,
-                   const std::vector<uint8_t>& nonce,
-                   const std::vector<uint8_t>& aad,
-                   std::vector<uint8_t>& ciphertext,
-                   std::vector<uint8_t>& tag) {
-    if (key.size() != KEY_SIZE || nonce.size() != NONCE_SIZE ||
-        plaintext.size() > static_cast<size_t>(std::numeric_limits<int>::max()) ||
-        aad.size() > static_cast<size_t>(std::numeric_limits<int>::max())) {
-        return false;
-    }
-
-    CipherContext context(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
-    if (!context ||
-        EVP_EncryptInit_ex(context.get(), EVP_aes_256_gcm(), nullptr, nullptr, nullptr) != 1 ||
-        EVP_CIPHER_CTX_ctrl(context.get(), EVP_CTRL_GCM_SET_IVLEN,
-                            static_cast<int>(nonce.size()), nullptr) != 1 ||
-        EVP_EncryptInit_ex(context.get(), nullptr, nullptr, key.data(), nonce.data()) != 1) {
-        return false;
-    }
-
-    int outputLength = 0;
-    if (!aad.empty() &&
-        EVP_EncryptUpdate(context.get(), nullptr, &outputLength, aad.data(),
-                          static_cast<int>(aad.size())) != 1) {
-        return false;
-    }
-
-    ciphertext.assign(plaintext.size() + TAG_SIZE, 0);
-    int ciphertextLength = 0;
-    if (EVP_EncryptUpdate(context.get(), ciphertext.data(), &outputLength,
-                          plaintext.data(), static_cast<int>(plaintext.size())) != 1) {
-        return false;
-    }
-    ciphertextLength = outputLength;
-
-    if (EVP_EncryptFinal_ex(context.get(), ciphertext.data() + ciphertextLength,
-                            &outputLength) != 1) {
-        return false;
-    }
-    ciphertextLength += outputLength;
-    ciphertext.resize(static_cast<size_t>(ciphertextLength));
-
-    tag.assign(TAG_SIZE, 0);
-    return EVP_CIPHER_CTX_ctrl(context.get(), EVP_CTRL_GCM_GET_TAG,
-                               static_cast<int>(tag.size()), tag.data()) == 1;
-}
-
 bool DecryptAesGcm(const std::vector<uint8_t>& ciphertext,
-                   const std::vector<uint8_t>& key,
+                   const SecureMemory::SecureBytes& key,
                    const std::vector<uint8_t>& nonce,
                    const std::vector<uint8_t>& aad,
                    const std::vector<uint8_t>& tag,
@@ -383,6 +524,7 @@ bool DecryptAesGcm(const std::vector<uint8_t>& ciphertext,
         return false;
     }
 
+    const Metrics::ScopedTimer timer(Metrics::Stage::AesGcm, ciphertext.size());
     CipherContext context(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
     if (!context ||
         EVP_DecryptInit_ex(context.get(), EVP_aes_256_gcm(), nullptr, nullptr, nullptr) != 1 ||
@@ -426,24 +568,144 @@ bool DecryptAesGcm(const std::vector<uint8_t>& ciphertext,
     return true;
 }
 
-std::vector<uint8_t> BuildSecureHeader(uint64_t ciphertextSize,
-                                       const std::vector<uint8_t>& salt,
-                                       const std::vector<uint8_t>& nonce) {
-    std::vector<uint8_t> header;
-    header.reserve(SECURE_FIXED_HEADER_SIZE + salt.size() + nonce.size());
-    header.insert(header.end(), SECURE_ARCHIVE_MAGIC.begin(), SECURE_ARCHIVE_MAGIC.end());
-    AppendUint32(header, ARCHIVE_FORMAT_VERSION);
-    AppendUint32(header, KDF_SCRYPT);
-    AppendUint64(header, SCRYPT_N);
-    AppendUint32(header, SCRYPT_R);
-    AppendUint32(header, SCRYPT_P);
-    AppendUint32(header, static_cast<uint32_t>(salt.size()));
-    AppendUint32(header, static_cast<uint32_t>(nonce.size()));
-    AppendUint32(header, static_cast<uint32_t>(TAG_SIZE));
-    AppendUint64(header, ciphertextSize);
-    header.insert(header.end(), salt.begin(), salt.end());
-    header.insert(header.end(), nonce.begin(), nonce.end());
-    return header;
+// Immutable first page of a PQCENC05 container; it is written once by a full
+// rewrite and never touched by appends.
+std::vector<uint8_t> BuildLogPreamble(uint32_t chunkSize,
+                                      const KeyDerivation::ScryptParameters& scrypt,
+                                      const std::vector<uint8_t>& salt) {
+    std::vector<uint8_t> preamble;
+    preamble.reserve(FormatValidation::ARCHIVE_V5_PREAMBLE_SIZE);
+    preamble.insert(preamble.end(), LOG_ARCHIVE_MAGIC.begin(), LOG_ARCHIVE_MAGIC.end());
+    AppendUint32(preamble, LOG_ARCHIVE_FORMAT_VERSION);
+    AppendUint32(preamble, KDF_SCRYPT);
+    AppendUint64(preamble, scrypt.n);
+    AppendUint32(preamble, scrypt.r);
+    AppendUint32(preamble, scrypt.p);
+    AppendUint32(preamble, static_cast<uint32_t>(salt.size()));
+    AppendUint32(preamble, static_cast<uint32_t>(NONCE_SIZE));
+    AppendUint32(preamble, static_cast<uint32_t>(TAG_SIZE));
+    AppendUint32(preamble, chunkSize);
+    preamble.insert(preamble.end(), salt.begin(), salt.end());
+    return preamble;
+}
+
+// First 16 bytes of SHA-256(preamble || slot fields). It only detects a slot
+// torn by an interrupted write; the index authenticates the slot itself.
+std::vector<uint8_t> HeadChecksum(const std::vector<uint8_t>& preamble,
+                                  const uint8_t* fields,
+                                  size_t fieldsSize) {
+    std::vector<uint8_t> input(preamble);
+    input.insert(input.end(), fields, fields + fieldsSize);
+    std::array<unsigned char, EVP_MAX_MD_SIZE> hash{};
+    unsigned int hashSize = 0;
+    if (EVP_Digest(input.data(), input.size(), hash.data(), &hashSize, EVP_sha256(),
+                   nullptr) != 1 || hashSize < TAG_SIZE) {
+        return {};
+    }
+    return std::vector<uint8_t>(hash.begin(), hash.begin() + TAG_SIZE);
+}
+
+// Head slot: [generation:8][indexOffset:8][indexSize:8][indexNonce:12]
+// [checksum:16]. The index authenticates preamble || slot.
+std::vector<uint8_t> BuildHeadSlot(const std::vector<uint8_t>& preamble,
+                                   uint64_t generation,
+                                   uint64_t indexOffset,
+                                   uint64_t indexSize,
+                                   const std::vector<uint8_t>& indexNonce) {
+    std::vector<uint8_t> slot;
+    slot.reserve(FormatValidation::ARCHIVE_V5_SLOT_SIZE);
+    AppendUint64(slot, generation);
+    AppendUint64(slot, indexOffset);
+    AppendUint64(slot, indexSize);
+    slot.insert(slot.end(), indexNonce.begin(), indexNonce.end());
+    const std::vector<uint8_t> checksum = HeadChecksum(preamble, slot.data(), slot.size());
+    if (checksum.size() != TAG_SIZE) {
+        return {};
+    }
+    slot.insert(slot.end(), checksum.begin(), checksum.end());
+    return slot;
+}
+
+bool HeadSlotIntact(const std::vector<uint8_t>& preamble, const std::vector<uint8_t>& slot) {
+    if (slot.size() != FormatValidation::ARCHIVE_V5_SLOT_SIZE) {
+        return false;
+    }
+    const size_t fieldsSize = slot.size() - TAG_SIZE;
+    const std::vector<uint8_t> checksum = HeadChecksum(preamble, slot.data(), fieldsSize);
+    return checksum.size() == TAG_SIZE &&
+           CRYPTO_memcmp(checksum.data(), slot.data() + fieldsSize, TAG_SIZE) == 0;
+}
+
+std::vector<uint8_t> HeadAssociatedData(const std::vector<uint8_t>& preamble,
+                                        const std::vector<uint8_t>& slot) {
+    std::vector<uint8_t> associatedData(preamble);
+    associatedData.insert(associatedData.end(), slot.begin(), slot.end());
+    return associatedData;
+}
+
+// Bytes of a PQCENC05 container referenced by a head with this index. Shared
+// segments are stored once.
+uint64_t LiveContainerSize(const ArchiveIndex::Index& index,
+                           uint64_t indexSize,
+                           size_t chunkSize) {
+    uint64_t size = FormatValidation::ARCHIVE_V5_DATA_OFFSET +
+                    ArchiveStream::SealedSize(indexSize, chunkSize);
+    for (const ArchiveIndex::Segment& segment : index.segments) {
+        size += ArchiveStream::SealedSize(segment.storedSize, chunkSize);
+    }
+    return size;
+}
+
+// Merkle leaves of the entries of an index, in index order.
+std::vector<ArchiveMerkle::Hash> IntegrityLeaves(const ArchiveIndex::Index& index) {
+    std::vector<ArchiveMerkle::Hash> leaves(index.entries.size());
+    ArchiveStream::ParallelFor(leaves.size(), [&](size_t i) {
+        const ArchiveIndex::Entry& entry = index.entries[i];
+        leaves[i] = ArchiveMerkle::LeafHash(entry.name, entry.size, entry.hash);
+        return true;
+    });
+    return leaves;
+}
+
+// Every blob has its own HKDF key, so a zero base nonce is never reused; the
+// associated data binds the blob to the id and size recorded in the index. A
+// compressed blob also binds its codec and the size it expands to.
+std::vector<uint8_t> EntryAssociatedData(const ArchiveIndex::BlobId& id,
+                                         uint64_t storedSize,
+                                         uint8_t codec,
+                                         uint64_t size) {
+    std::vector<uint8_t> associatedData(id.begin(), id.end());
+    AppendUint64(associatedData, storedSize);
+    if (codec != ArchiveCodec::STORED) {
+        associatedData.push_back(codec);
+        AppendUint64(associatedData, size);
+    }
+    return associatedData;
+}
+
+// Seal one blob whose storedSize bytes hold size payload bytes under codec.
+// write feeds the stored bytes to the sealing writer.
+bool SealBlob(const SecureMemory::SecureBytes& key,
+              const ArchiveIndex::BlobId& id,
+              uint8_t codec,
+              uint64_t storedSize,
+              uint64_t size,
+              uint32_t chunkSize,
+              const std::function<bool(const ArchiveStream::Sink& stored)>& write,
+              const ArchiveStream::Sink& output) {
+    SecureMemory::SecureBytes blobKey;
+    SecureMemory::ScopedCleanse blobKeyGuard(blobKey);
+    if (!ArchiveStream::DeriveStreamKey(key, ENTRY_KEY_LABEL, id.data(), id.size(), blobKey)) {
+        return false;
+    }
+    const std::vector<uint8_t> zeroNonce(NONCE_SIZE, 0);
+    const ArchiveStream::ChunkCipher cipher(blobKey, zeroNonce,
+                                            EntryAssociatedData(id, storedSize, codec, size));
+    ArchiveStream::SealingWriter writer(cipher, chunkSize, output);
+    return write([&writer](const uint8_t* data, size_t count) {
+               return writer.Write(data, count);
+           }) &&
+           writer.Finish() && writer.payloadBytes() == storedSize;
 }
 
 bool DecryptSecureArchiveBytes(const std::vector<uint8_t>& archiveData,
@@ -479,7 +741,7 @@ bool DecryptSecureArchiveBytes(const std::vector<uint8_t>& archiveData,
     }
 
     if (version != ARCHIVE_FORMAT_VERSION || kdf != KDF_SCRYPT ||
-        n != SCRYPT_N || r != SCRYPT_R || p != SCRYPT_P ||
+        !FormatValidation::ValidateScryptParameters(n, r, p) ||
         saltSize != SALT_SIZE || nonceSize != NONCE_SIZE || tagSize != TAG_SIZE ||
         ciphertextSize == 0 ||
         ciphertextSize > static_cast<uint64_t>(std::numeric_limits<int>::max())) {
@@ -509,9 +771,13 @@ bool DecryptSecureArchiveBytes(const std::vector<uint8_t>& archiveData,
     std::vector<uint8_t> header(archiveData.begin(),
                                 archiveData.begin() + static_cast<std::ptrdiff_t>(headerSize));
 
-    std::vector<uint8_t> key;
+    KeyDerivation::ScryptParameters scrypt;
+    scrypt.n = n;
+    scrypt.r = r;
+    scrypt.p = p;
+    SecureMemory::SecureBytes key;
     SecureMemory::ScopedCleanse keyGuard(key);
-    if (!DeriveScryptKey(password, salt, n, r, p, key)) {
+    if (!DeriveScryptKey(password, salt, scrypt, key)) {
         return false;
     }
     const bool authenticated =
@@ -520,400 +786,1871 @@ bool DecryptSecureArchiveBytes(const std::vector<uint8_t>& archiveData,
     return authenticated;
 }
 
-} // namespace
-
-CryptoArchive::CryptoArchive(const std::string& username, const std::string& archiveName) 
-    : m_username(username), m_archiveName(archiveName), m_identityValid(false),
-      m_hasDiskRevision(false), m_isLoaded(false) {
-    m_archivePath = GetArchiveFilePath();
-    m_identityValid = !m_archivePath.empty();
-    // Ensure the archives directory exists
-    if (m_identityValid) {
-        std::filesystem::create_directories("archives");
+// Opens a PQCENC03 stream whose first eight magic bytes were already read.
+bool OpenStreamedArchive(const ArchiveStream::Source& source,
+                         uint64_t containerSize,
+                         const std::string& password,
+                         const ArchiveStream::PayloadConsumer& consumer) {
+    std::vector<uint8_t> header(FormatValidation::ARCHIVE_V3_HEADER_SIZE);
+    std::copy(STREAMED_ARCHIVE_MAGIC.begin(), STREAMED_ARCHIVE_MAGIC.end(), header.begin());
+    if (!source(header.data() + STREAMED_ARCHIVE_MAGIC.size(),
+                header.size() - STREAMED_ARCHIVE_MAGIC.size()) ||
+        !FormatValidation::ValidateArchiveV3Header(header.data(), header.size(),
+                                                   containerSize)) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Invalid or unsupported archive container";
+        return false;
     }
-}
-
-CryptoArchive::~CryptoArchive() {
-    ClearDecryptedData();
-    m_password.clear();
-}
 
-bool CryptoArchive::InitializeArchive(const std::string& password) {
-    if (!m_identityValid || password.empty()) {
-        std::cerr << "Cannot initialize an archive with an empty password" << std::endl;
+    // Field values were range-checked by ValidateArchiveV3Header.
+    size_t offset = STREAMED_FIXED_HEADER_SIZE - sizeof(uint64_t) - sizeof(uint32_t);
+    uint32_t chunkSize = 0;
+    uint64_t payloadSize = 0;
+    if (!ReadUint32(header, offset, chunkSize) || !ReadUint64(header, offset, payloadSize)) {
         return false;
     }
+    const std::vector<uint8_t> salt(header.begin() + static_cast<std::ptrdiff_t>(offset),
+                                    header.begin() + static_cast<std::ptrdiff_t>(offset + SALT_SIZE));
+    offset += SALT_SIZE;
+    const std::vector<uint8_t> nonce(header.begin() + static_cast<std::ptrdiff_t>(offset),
+                                     header.end());
 
-    if (ArchiveExists()) {
-        std::cout << "Archive already exists for user: " << m_username << std::endl;
-        return LoadArchive(password);
-    }
-    
-    // Initialize empty archive
-    ClearDecryptedData();
-    m_isLoaded = true;
-    if (!m_password.assign(password)) {
-        m_isLoaded = false;
+    KeyDerivation::ScryptParameters scrypt;
+    SecureMemory::SecureBytes key;
+    SecureMemory::ScopedCleanse keyGuard(key);
+    if (!ReadScryptParameters(header, scrypt) || !DeriveScryptKey(password, salt, scrypt, key)) {
         return false;
     }
-    
-    std::cout << "Initialized new archive for user: " << m_username << std::endl;
-    const bool saved = SaveArchive();
-    if (!saved) {
-        ClearDecryptedData();
-        m_password.clear();
-        m_isLoaded = false;
+    const ArchiveStream::ChunkCipher cipher(key, nonce, header);
+    Cleanse(key);
+
+    ArchiveStream::OpeningReader reader(cipher, payloadSize, chunkSize, source);
+    const ArchiveStream::Source payload = [&reader](uint8_t* data, size_t size) {
+        return reader.Read(data, size);
+    };
+    if (!consumer(payload, payloadSize) || !reader.finished()) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Archive authentication failed: wrong password or modified data";
+        return false;
     }
-    return saved;
+    return true;
 }
 
-bool CryptoArchive::LoadArchive(const std::string& password) {
-    std::cout << "\n---------- LOAD ARCHIVE ----------" << std::endl;
-    std::cout << "Loading archive for user: " << m_username << std::endl;
-    std::cout << "Archive path: " << m_archivePath << std::endl;
-    
-    if (!m_identityValid) {
+// Dispatches on the container magic. PQCENC03 is authenticated chunk by chunk
+// while it is consumed; the bounded legacy formats are decrypted in memory.
+bool OpenArchiveContainer(const ArchiveStream::Source& source,
+                          uint64_t containerSize,
+                          const std::string& password,
+                          const ArchiveStream::PayloadConsumer& consumer,
+                          bool* legacyFormat) {
+    if (legacyFormat) {
+        *legacyFormat = false;
+    }
+    std::array<uint8_t, 8> magic{};
+    if (password.empty() || containerSize < magic.size() ||
+        !source(magic.data(), magic.size())) {
         return false;
     }
-    ScopedArchiveLock archiveLock(m_archivePath);
-    if (!archiveLock.acquired()) {
-        std::cerr << "Could not acquire archive lock" << std::endl;
+    if (magic == STREAMED_ARCHIVE_MAGIC) {
+        return OpenStreamedArchive(source, containerSize, password, consumer);
+    }
+
+    if (containerSize > MAX_ARCHIVE_CONTAINER_SIZE) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Legacy archive exceeds the in-memory container limit";
         return false;
     }
-    if (!ArchiveExists()) {
-        std::cout << "Archive does not exist for user: " << m_username << std::endl;
-        std::cout << "---------------------------------\n" << std::endl;
+    std::vector<uint8_t> archiveData(static_cast<size_t>(containerSize));
+    std::copy(magic.begin(), magic.end(), archiveData.begin());
+    if (!source(archiveData.data() + magic.size(), archiveData.size() - magic.size())) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to read complete archive";
         return false;
     }
-    
-    // Verifică dimensiunea fișierului arhivei
-    auto fileSize = std::filesystem::file_size(m_archivePath);
-    std::cout << "Archive file size: " << fileSize << " bytes" << std::endl;
-    
-    if (fileSize < 16) { // Minimum size for header + data size
-        std::cout << "Archive file is too small to be valid (" << fileSize << " bytes)" << std::endl;
-        std::cout << "---------------------------------\n" << std::endl;
+    if (!FormatValidation::ValidateArchiveFile(archiveData.data(), archiveData.size())) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Invalid or unsupported archive container";
         return false;
     }
-    
-    try {
-        std::cout << "Decrypting archive data..." << std::endl;
-        std::string loadedRevision;
-        std::vector<uint8_t> decryptedData =
-            DecryptArchiveData(password, nullptr, &loadedRevision);
-        SecureMemory::ScopedCleanse decryptedDataGuard(decryptedData);
-        if (decryptedData.empty()) {
-            std::cout << "Failed to decrypt archive for user: " << m_username << std::endl;
-            std::cout << "---------------------------------\n" << std::endl;
+
+    std::vector<uint8_t> plaintext;
+    SecureMemory::ScopedCleanse plaintextGuard(plaintext);
+    if (magic == SECURE_ARCHIVE_MAGIC) {
+        if (!DecryptSecureArchiveBytes(archiveData, password, plaintext)) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Archive authentication failed: wrong password or modified data";
             return false;
         }
-        
-        std::cout << "Decrypted data size: " << decryptedData.size() << " bytes" << std::endl;
-        
-        // Resetează starea arhivei înainte de a încerca deserializarea
-        ClearDecryptedData();
-        m_isLoaded = false;
-        
-        std::cout << "Deserializing archive data..." << std::endl;
-        if (!DeserializeArchive(decryptedData)) {
-            std::cout << "Failed to deserialize archive for user: " << m_username << std::endl;
-            std::cout << "---------------------------------\n" << std::endl;
+    } else if (magic == LEGACY_ARCHIVE_MAGIC) {
+        if (archiveData.size() < 16) {
             return false;
         }
 
-        if (!m_password.assign(password)) {
-            ClearDecryptedData();
+        uint64_t dataSize = 0;
+        std::memcpy(&dataSize, archiveData.data() + LEGACY_ARCHIVE_MAGIC.size(),
+                    sizeof(dataSize));
+        if (dataSize == 0 || dataSize != archiveData.size() - 16) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Invalid legacy archive size";
             return false;
         }
-        
-        // Verifică că există cel puțin un fișier în arhivă sau că este o arhivă nouă validă
-        std::cout << "Files in archive after loading: " << m_files.size() << std::endl;
-        
-        // Verifică dacă fișierele încărcate au date valide
-        bool allFilesValid = true;
-        for (const auto& file : m_files) {
-            if (file.second.data.size() != file.second.size) {
-                std::cout << "WARNING: File '" << file.first << "' has size mismatch! " 
-                          << "Reported: " << file.second.size << ", Actual: " << file.second.data.size() << std::endl;
-                allFilesValid = false;
-            }
+
+        SecureMemory::SecureBytes key = DeriveLegacyKey(password);
+        SecureMemory::ScopedCleanse keyGuard(key);
+        if (key.empty()) {
+            return false;
         }
-        
-        if (!allFilesValid) {
-            std::cout << "Some files in the archive have invalid data!" << std::endl;
+
+        plaintext.resize(static_cast<size_t>(dataSize));
+        for (size_t i = 0; i < plaintext.size(); ++i) {
+            plaintext[i] = archiveData[16 + i] ^ key[i % key.size()];
         }
-        
-        // Setăm arhiva ca încărcată
-        m_diskRevision = std::move(loadedRevision);
-        m_hasDiskRevision = true;
-        m_isLoaded = true;
-        std::cout << "Successfully loaded archive for user: " << m_username << std::endl;
-        std::cout << "---------------------------------\n" << std::endl;
+        Cleanse(key);
+        if (legacyFormat) {
+            *legacyFormat = true;
+        }
+        PQC_LOG_INFO(LOG_MODULE) << "Loaded legacy PQCENC01 archive; the next save will migrate it to PQCENC05";
+    } else {
+        PQC_LOG_ERROR(LOG_MODULE) << "Unknown archive format; refusing to treat it as plaintext";
+        return false;
+    }
+
+    size_t offset = 0;
+    const ArchiveStream::Source payload = [&plaintext, &offset](uint8_t* data, size_t size) {
+        if (size > plaintext.size() - offset || (size != 0 && data == nullptr)) {
+            return false;
+        }
+        if (size != 0) {
+            std::memcpy(data, plaintext.data() + offset, size);
+        }
+        offset += size;
+        return true;
+    };
+    return consumer(payload, plaintext.size()) && offset == plaintext.size();
+}
+
+// Runs scrypt for a container salt and the parameters in its header; supplied
+// by the archive so it can count runs.
+using ContainerKeyDerivation =
+    std::function<bool(const std::vector<uint8_t>& salt,
+                       const KeyDerivation::ScryptParameters& scrypt,
+                       SecureMemory::SecureBytes& key)>;
+
+// Index of an indexed container after it was authenticated.
+struct OpenedIndex {
+    uint32_t chunkSize = 0;
+    ArchiveIndex::Index index;
+    uint32_t activeSlot = 0;
+    uint64_t generation = 0;
+    uint64_t indexSize = 0;
+    uint64_t indexEnd = 0;
+};
+
+// Authenticates and decodes one sealed index. Every blob it references must
+// lie between dataOffset and the index itself.
+bool OpenSealedIndex(const ArchiveStream::ReadAt& readAt,
+                     const SecureMemory::SecureBytes& key,
+                     const std::vector<uint8_t>& indexNonce,
+                     const std::vector<uint8_t>& associatedData,
+                     uint32_t chunkSize,
+                     uint64_t dataOffset,
+                     uint64_t indexOffset,
+                     uint64_t indexSize,
+                     RevisionDigest* digest,
+                     OpenedIndex& opened) {
+    SecureMemory::SecureBytes indexKey;
+    SecureMemory::ScopedCleanse indexKeyGuard(indexKey);
+    if (!ArchiveStream::DeriveStreamKey(key, INDEX_KEY_LABEL, nullptr, 0, indexKey)) {
+        return false;
+    }
+    const ArchiveStream::ChunkCipher indexCipher(indexKey, indexNonce, associatedData);
+
+    // Only the sealed index is read here; entry blobs stay on disk.
+    uint64_t position = indexOffset;
+    ArchiveStream::OpeningReader reader(indexCipher, indexSize, chunkSize,
+                                        SequentialSource(readAt, position, digest));
+    bool decoded = false;
+    {
+        // Decryption and reads behind the reader are timed as their own stages.
+        Metrics::ScopedTimer timer(Metrics::Stage::Serialization, indexSize);
+        decoded = ArchiveIndex::Decode(
+            [&reader, &timer](uint8_t* data, size_t size) {
+                const Metrics::ScopedExclusion opening(timer);
+                return reader.Read(data, size);
+            },
+            indexSize, chunkSize, dataOffset, indexOffset, opened.index);
+    }
+    if (!decoded || !reader.finished()) {
+        opened.index = ArchiveIndex::Index{};
+        return false;
+    }
+    opened.chunkSize = chunkSize;
+    opened.indexSize = indexSize;
+    opened.indexEnd = position;
+    return true;
+}
+
+// PQCENC04: a single header whose sealed index closes the file.
+bool OpenIndexedContainer(const ArchiveStream::ReadAt& readAt,
+                          uint64_t containerSize,
+                          const ContainerKeyDerivation& deriveKey,
+                          std::vector<uint8_t>& salt,
+                          KeyDerivation::ScryptParameters& scrypt,
+                          SecureMemory::SecureBytes& key,
+                          RevisionDigest* digest,
+                          OpenedIndex& opened) {
+    std::vector<uint8_t> header(FormatValidation::ARCHIVE_V4_HEADER_SIZE);
+    if (!readAt(0, header.data(), header.size()) ||
+        !FormatValidation::ValidateArchiveV4Header(header.data(), header.size(),
+                                                   containerSize)) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Invalid or unsupported archive container";
+        return false;
+    }
+
+    // Field values were range-checked by ValidateArchiveV4Header.
+    size_t offset = INDEXED_FIXED_HEADER_SIZE - 2 * sizeof(uint64_t) - sizeof(uint32_t);
+    uint32_t chunkSize = 0;
+    uint64_t indexOffset = 0;
+    uint64_t indexSize = 0;
+    if (!ReadUint32(header, offset, chunkSize) || !ReadUint64(header, offset, indexOffset) ||
+        !ReadUint64(header, offset, indexSize)) {
+        return false;
+    }
+    salt.assign(header.begin() + static_cast<std::ptrdiff_t>(offset),
+                header.begin() + static_cast<std::ptrdiff_t>(offset + SALT_SIZE));
+    offset += SALT_SIZE;
+    const std::vector<uint8_t> indexNonce(header.begin() + static_cast<std::ptrdiff_t>(offset),
+                                          header.end());
+
+    if (!ReadScryptParameters(header, scrypt) || !deriveKey(salt, scrypt, key) ||
+        (digest != nullptr && !digest->Update(header.data(), header.size()))) {
+        return false;
+    }
+    if (!OpenSealedIndex(readAt, key, indexNonce, header, chunkSize,
+                         FormatValidation::ARCHIVE_V4_HEADER_SIZE, indexOffset, indexSize,
+                         digest, opened) ||
+        opened.indexEnd != containerSize) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Archive authentication failed: wrong password or modified data";
+        opened.index = ArchiveIndex::Index{};
+        return false;
+    }
+    return true;
+}
+
+// PQCENC05: the intact head slot with the highest generation is the committed
+// head. A slot torn by an interrupted commit fails its checksum and the other
+// slot, whose records are never overwritten, stays in charge. An intact head
+// whose index does not authenticate is rejected rather than rolled back.
+bool OpenLogContainer(const ArchiveStream::ReadAt& readAt,
+                      uint64_t containerSize,
+                      const ContainerKeyDerivation& deriveKey,
+                      std::vector<uint8_t>& salt,
+                      KeyDerivation::ScryptParameters& scrypt,
+                      SecureMemory::SecureBytes& key,
+                      RevisionDigest* digest,
+                      OpenedIndex& opened) {
+    std::vector<uint8_t> preamble(FormatValidation::ARCHIVE_V5_PREAMBLE_SIZE);
+    if (!readAt(0, preamble.data(), preamble.size()) ||
+        !FormatValidation::ValidateArchiveV5Preamble(preamble.data(), preamble.size(),
+                                                     containerSize)) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Invalid or unsupported archive container";
+        return false;
+    }
+
+    // Field values were range-checked by ValidateArchiveV5Preamble.
+    size_t offset = FormatValidation::ARCHIVE_V5_PREAMBLE_SIZE - SALT_SIZE - sizeof(uint32_t);
+    uint32_t chunkSize = 0;
+    if (!ReadUint32(preamble, offset, chunkSize) || !ReadScryptParameters(preamble, scrypt)) {
+        return false;
+    }
+    salt.assign(preamble.begin() + static_cast<std::ptrdiff_t>(offset), preamble.end());
+
+    std::vector<uint8_t> slots[HEAD_SLOT_COUNT];
+    for (size_t slot = 0; slot < HEAD_SLOT_COUNT; ++slot) {
+        slots[slot].resize(FormatValidation::ARCHIVE_V5_SLOT_SIZE);
+        if (!readAt(FormatValidation::ArchiveV5SlotOffset(slot), slots[slot].data(),
+                    slots[slot].size())) {
+            return false;
+        }
+    }
+    if (digest != nullptr &&
+        (!digest->Update(preamble.data(), preamble.size()) ||
+         !digest->Update(slots[0].data(), slots[0].size()) ||
+         !digest->Update(slots[1].data(), slots[1].size()))) {
+        return false;
+    }
+
+    bool found = false;
+    for (uint32_t slot = 0; slot < HEAD_SLOT_COUNT; ++slot) {
+        size_t slotOffset = 0;
+        uint64_t generation = 0;
+        if (!FormatValidation::ValidateArchiveV5Slot(slots[slot].data(), slots[slot].size(),
+                                                     chunkSize, containerSize) ||
+            !HeadSlotIntact(preamble, slots[slot]) ||
+            !ReadUint64(slots[slot], slotOffset, generation)) {
+            if (std::any_of(slots[slot].begin(), slots[slot].end(),
+                            [](uint8_t value) { return value != 0; })) {
+                PQC_LOG_INFO(LOG_MODULE) << "Ignoring incomplete archive head " << slot
+                                         << " left by an interrupted commit";
+            }
+            continue;
+        }
+        if (!found || generation > opened.generation) {
+            found = true;
+            opened.activeSlot = slot;
+            opened.generation = generation;
+        }
+    }
+    if (!found) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Invalid or unsupported archive container";
+        return false;
+    }
+
+    const std::vector<uint8_t>& head = slots[opened.activeSlot];
+    size_t headOffset = sizeof(uint64_t);
+    uint64_t indexOffset = 0;
+    uint64_t indexSize = 0;
+    if (!ReadUint64(head, headOffset, indexOffset) || !ReadUint64(head, headOffset, indexSize) ||
+        !deriveKey(salt, scrypt, key)) {
+        return false;
+    }
+    const std::vector<uint8_t> indexNonce(
+        head.begin() + static_cast<std::ptrdiff_t>(headOffset),
+        head.begin() + static_cast<std::ptrdiff_t>(headOffset + NONCE_SIZE));
+    if (!OpenSealedIndex(readAt, key, indexNonce, HeadAssociatedData(preamble, head), chunkSize,
+                         FormatValidation::ARCHIVE_V5_DATA_OFFSET, indexOffset, indexSize,
+                         nullptr, opened)) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Archive authentication failed: wrong password or modified data";
+        return false;
+    }
+    return true;
+}
+
+// Read a whole source file for an archive entry. It runs on AddFiles worker
+// threads, so failures are reported through error instead of the console.
+bool ReadSourceFile(const std::string& filePath, SecureMemory::SecureBytes& data,
+                    std::string& error) {
+    std::error_code fileError;
+    if (!std::filesystem::is_regular_file(filePath, fileError) || fileError) {
+        error = "Path is not a regular file: " + filePath;
+        return false;
+    }
+    const uintmax_t rawFileSize = std::filesystem::file_size(filePath, fileError);
+    if (fileError || rawFileSize > MAX_ARCHIVE_ENTRY_SIZE ||
+        rawFileSize > static_cast<uintmax_t>(std::numeric_limits<size_t>::max()) ||
+        rawFileSize > static_cast<uintmax_t>(std::numeric_limits<std::streamsize>::max())) {
+        error = "File exceeds the maximum archive entry size: " + filePath;
+        return false;
+    }
+
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        error = "Failed to open file: " + filePath;
+        return false;
+    }
+    const size_t fileSize = static_cast<size_t>(rawFileSize);
+    data.assign(fileSize, 0);
+    if (fileSize > 0) {
+        file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(fileSize));
+    }
+    if (!file || file.gcount() != static_cast<std::streamsize>(fileSize)) {
+        SecureMemory::Cleanse(data);
+        error = "Failed to read entire file: " + filePath;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+CryptoArchive::CryptoArchive(const std::string& username, const std::string& archiveName) 
+    : m_username(username), m_archiveName(archiveName), m_identityValid(false),
+      m_hasDiskRevision(false), m_isLoaded(false) {
+    m_archivePath = GetArchiveFilePath();
+    m_identityValid = !m_archivePath.empty();
+    // Ensure the archives directory exists
+    if (m_identityValid) {
+        std::filesystem::create_directories("archives");
+    }
+}
+
+CryptoArchive::~CryptoArchive() {
+    // Closing the archive commits whatever the committer had not saved yet.
+    StopCommitter();
+    if (!Flush()) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Staged archive changes were lost on close: " << m_archivePath;
+    }
+    ClearDecryptedData();
+    m_password.clear();
+}
+
+bool CryptoArchive::InitializeArchive(const std::string& password) {
+    const StateLock stateLock(m_stateMutex);
+    if (!m_identityValid || password.empty()) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Cannot initialize an archive with an empty password";
+        return false;
+    }
+    if (!m_leases.empty()) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Cannot initialize the archive while files are open for reading";
+        return false;
+    }
+
+    if (ArchiveExists()) {
+        PQC_LOG_INFO(LOG_MODULE) << "Archive already exists for user: " << m_username;
+        return LoadArchive(password);
+    }
+    
+    // Initialize empty archive
+    ClearDecryptedData();
+    m_isLoaded = true;
+    if (!m_password.assign(password)) {
+        m_isLoaded = false;
+        return false;
+    }
+    
+    PQC_LOG_INFO(LOG_MODULE) << "Initialized new archive for user: " << m_username;
+    const bool saved = SaveArchive();
+    if (!saved) {
+        ClearDecryptedData();
+        m_password.clear();
+        m_isLoaded = false;
+    }
+    return saved;
+}
+
+bool CryptoArchive::LoadArchive(const std::string& password) {
+    const StateLock stateLock(m_stateMutex);
+    const Metrics::ScopedTimer timer(Metrics::Stage::Load);
+    PQC_LOG_DEBUG(LOG_MODULE) << "---------- LOAD ARCHIVE ----------";
+    PQC_LOG_INFO(LOG_MODULE) << "Loading archive for user: " << m_username;
+    PQC_LOG_INFO(LOG_MODULE) << "Archive path: " << m_archivePath;
+    
+    if (!m_identityValid) {
+        return false;
+    }
+    if (!m_leases.empty()) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Cannot reload the archive while files are open for reading";
+        return false;
+    }
+    ScopedArchiveLock archiveLock(m_archivePath);
+    if (!archiveLock.acquired()) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Could not acquire archive lock";
+        return false;
+    }
+    if (!ArchiveExists()) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Archive does not exist for user: " << m_username;
+        return false;
+    }
+    
+    // Verifică dimensiunea fișierului arhivei
+    auto fileSize = std::filesystem::file_size(m_archivePath);
+    PQC_LOG_INFO(LOG_MODULE) << "Archive file size: " << fileSize << " bytes";
+    
+    if (fileSize < 16) { // Minimum size for header + data size
+        PQC_LOG_ERROR(LOG_MODULE) << "Archive file is too small to be valid (" << fileSize << " bytes)";
+        return false;
+    }
+    
+    try {
+        PQC_LOG_INFO(LOG_MODULE) << "Decrypting archive index...";
+        std::string loadedRevision;
+        EntryTable loadedFiles;
+        ContainerState loadedContainer;
+        // Taken under the archive lock, so no writer can change the file
+        // between this and the revision read below.
+        const DiskIdentity loadedIdentity = ReadDiskIdentity(m_archivePath);
+        if (!ReadArchiveFile(password, loadedFiles, loadedContainer, nullptr, &loadedRevision)) {
+            loadedFiles.Cleanse();
+            loadedContainer.Clear();
+            PQC_LOG_ERROR(LOG_MODULE) << "Failed to decrypt archive for user: " << m_username;
+            return false;
+        }
+        
+        PQC_LOG_INFO(LOG_MODULE) << "Stored payloads left in the container: "
+                                 << loadedContainer.entries.size();
+        
+        // Publică starea nouă numai după autentificarea completă a containerului
+        ClearDecryptedData();
+        m_files.swap(loadedFiles);
+        std::swap(m_container, loadedContainer);
+        if (!m_container.key.empty()) {
+            // Later saves reuse this key instead of running scrypt again.
+            m_sessionKey.salt = m_container.salt;
+            m_sessionKey.scrypt = m_container.scrypt;
+            m_sessionKey.key = m_container.key;
+        }
+        m_isLoaded = false;
+
+        if (!m_password.assign(password)) {
+            ClearDecryptedData();
+            return false;
+        }
+        
+        // Verifică că există cel puțin un fișier în arhivă sau că este o arhivă nouă validă
+        PQC_LOG_INFO(LOG_MODULE) << "Files in archive after loading: " << m_files.size();
+        
+        // Verifică dacă fișierele încărcate au date valide
+        bool allFilesValid = true;
+        for (const auto& file : m_files) {
+            const bool stored = file.second.data.empty() &&
+                                m_container.entries.count(file.first) != 0;
+            if (!stored && file.second.data.size() != file.second.size) {
+                PQC_LOG_WARN(LOG_MODULE) << "File '" << file.first << "' has size mismatch! "
+                                         << "Reported: " << file.second.size
+                                         << ", Actual: " << file.second.data.size();
+                allFilesValid = false;
+            }
+        }
+        
+        if (!allFilesValid) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Some files in the archive have invalid data!";
+        }
+        
+        // Setăm arhiva ca încărcată
+        m_diskRevision = std::move(loadedRevision);
+        m_hasDiskRevision = true;
+        m_diskIdentity = loadedIdentity;
+        m_isLoaded = true;
+        PQC_LOG_INFO(LOG_MODULE) << "Successfully loaded archive for user: " << m_username;
         return true;
     } catch (const std::exception& e) {
-        std::cout << "Error loading archive: " << e.what() << std::endl;
-        std::cout << "---------------------------------\n" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Error loading archive: " << e.what();
+        return false;
+    }
+}
+
+bool CryptoArchive::SaveArchive() {
+    return CommitArchive(false);
+}
+
+bool CryptoArchive::CompactArchive() {
+    return CommitArchive(true);
+}
+
+bool CryptoArchive::SetDeferredCommit(bool enabled, std::chrono::milliseconds delay) {
+    if (!enabled) {
+        StopCommitter();
+        {
+            const std::lock_guard<std::mutex> schedule(m_commitMutex);
+            m_commitStatus.deferred = false;
+        }
+        return Flush();
+    }
+
+    const std::lock_guard<std::mutex> schedule(m_commitMutex);
+    m_commitDelay = std::max(delay, std::chrono::milliseconds::zero());
+    if (!m_committer.joinable()) {
+        m_stopCommitter = false;
+        try {
+            m_committer = std::thread(&CryptoArchive::RunCommitter, this);
+        } catch (const std::system_error& e) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Could not start the archive committer: " << e.what();
+            return false;
+        }
+    }
+    m_commitStatus.deferred = true;
+    PQC_LOG_INFO(LOG_MODULE) << "Archive changes are committed after " << m_commitDelay.count()
+                             << " ms without further changes";
+    return true;
+}
+
+bool CryptoArchive::Flush() {
+    const StateLock stateLock(m_stateMutex);
+    return CommitPending();
+}
+
+CryptoArchive::CommitStatus CryptoArchive::GetCommitStatus() const {
+    const std::lock_guard<std::mutex> schedule(m_commitMutex);
+    return m_commitStatus;
+}
+
+void CryptoArchive::RunCommitter() {
+    std::unique_lock<std::mutex> schedule(m_commitMutex);
+    while (!m_stopCommitter) {
+        if (!m_commitDue) {
+            m_commitWake.wait(schedule);
+            continue;
+        }
+        // Every mutation moves the deadline, so a burst becomes one commit.
+        if (std::chrono::steady_clock::now() < m_commitDeadline) {
+            m_commitWake.wait_until(schedule, m_commitDeadline);
+            continue;
+        }
+        m_commitDue = false;
+        schedule.unlock();
+        {
+            const StateLock stateLock(m_stateMutex);
+            CommitPending();
+        }
+        schedule.lock();
+    }
+}
+
+void CryptoArchive::StopCommitter() {
+    {
+        const std::lock_guard<std::mutex> schedule(m_commitMutex);
+        m_stopCommitter = true;
+        m_commitDue = false;
+    }
+    m_commitWake.notify_all();
+    if (m_committer.joinable()) {
+        m_committer.join();
+    }
+}
+
+void CryptoArchive::MarkDirty(uint64_t changes) {
+    {
+        const std::lock_guard<std::mutex> schedule(m_commitMutex);
+        m_commitStatus.dirty = true;
+        m_commitStatus.pendingChanges += changes;
+        m_commitDue = true;
+        m_commitDeadline = std::chrono::steady_clock::now() + m_commitDelay;
+    }
+    m_commitWake.notify_all();
+}
+
+bool CryptoArchive::DeferredCommitEnabled() const {
+    const std::lock_guard<std::mutex> schedule(m_commitMutex);
+    return m_commitStatus.deferred;
+}
+
+bool CryptoArchive::CommitPending() {
+    const StateLock stateLock(m_stateMutex);
+    uint64_t pendingChanges = 0;
+    {
+        const std::lock_guard<std::mutex> schedule(m_commitMutex);
+        if (!m_commitStatus.dirty) {
+            return true;
+        }
+        pendingChanges = m_commitStatus.pendingChanges;
+        m_commitStatus.committing = true;
+    }
+
+    std::string error;
+    const bool committed = CommitArchive(false, &error);
+    const std::lock_guard<std::mutex> schedule(m_commitMutex);
+    m_commitStatus.committing = false;
+    if (committed) {
+        ++m_commitStatus.deferredCommits;
+        m_commitStatus.coalescedChanges += pendingChanges;
+        PQC_LOG_INFO(LOG_MODULE) << "Committed " << pendingChanges << " staged archive change(s)";
+    } else {
+        // Staged changes stay in memory; the next change or Flush retries.
+        m_commitStatus.lastError = error.empty() ? "Failed to save archive" : error;
+    }
+    return committed;
+}
+
+bool CryptoArchive::CommitArchive(bool compact, std::string* error) {
+    const auto fail = [error](const std::string& message) {
+        if (error != nullptr) {
+            *error = message;
+        }
+        PQC_LOG_ERROR(LOG_MODULE) << message;
+        return false;
+    };
+
+    const StateLock stateLock(m_stateMutex);
+    if (!m_identityValid || !m_isLoaded) {
+        return fail("Cannot save an archive that is not loaded");
+    }
+    const Metrics::ScopedTimer timer(Metrics::Stage::Commit);
+
+    try {
+        ScopedArchiveLock archiveLock(m_archivePath);
+        if (!archiveLock.acquired()) {
+            return fail("Could not acquire archive lock");
+        }
+
+        if (!DiskRevisionCurrent()) {
+            return fail("Archive changed on disk; reload before saving");
+        }
+
+        // Both layouts below share the cut, digested and compressed segments.
+        ResidentSegments resident;
+        std::string newRevision;
+        ContainerState writtenContainer;
+        AppendResult appendResult = AppendResult::CompactionDue;
+        if (!compact) {
+            appendResult = AppendToContainer(resident, writtenContainer, newRevision);
+            if (appendResult == AppendResult::Failed) {
+                writtenContainer.Clear();
+                return fail("Failed to append to archive: " + m_archivePath);
+            }
+        }
+
+        if (appendResult != AppendResult::Appended) {
+            if (appendResult == AppendResult::CompactionDue && m_container.appendable) {
+                PQC_LOG_INFO(LOG_MODULE) << "Compacting archive: " << m_container.size
+                                         << " bytes on disk";
+            }
+            ContainerPlan plan;
+            if (!PlanContainer(plan, resident)) {
+                return fail("Failed to plan archive: " + m_archivePath);
+            }
+            const bool written = AtomicFile::WriteStreamed(
+                m_archivePath,
+                [this, &plan, &newRevision,
+                 &writtenContainer](const AtomicFile::ChunkWriter& writer) {
+                    return WriteEncryptedArchive(m_password.get(), plan, writer, &m_sessionKey,
+                                                 &writtenContainer, &newRevision);
+                });
+            if (!written || newRevision.empty()) {
+                writtenContainer.Clear();
+                return fail("Failed to atomically write archive: " + m_archivePath);
+            }
+        }
+
+        m_diskRevision = newRevision;
+        m_hasDiskRevision = true;
+        m_diskIdentity = ReadDiskIdentity(m_archivePath);
+        writtenContainer.path = m_archivePath;
+        // A session key with outdated parameters was not used; the rewrite
+        // derived a new key that later saves reuse.
+        if (!m_sessionKey.valid() || m_sessionKey.scrypt != writtenContainer.scrypt) {
+            m_sessionKey.salt = writtenContainer.salt;
+            m_sessionKey.scrypt = writtenContainer.scrypt;
+            m_sessionKey.key = writtenContainer.key;
+        }
+        const bool compacted =
+            appendResult == AppendResult::CompactionDue && m_container.appendable;
+        m_container.Clear();
+        std::swap(m_container, writtenContainer);
+        m_stagedNames.clear();
+
+        // Committed payloads are read back from their blobs on demand; a
+        // leased one stays in memory until a later commit.
+        for (auto& [name, entry] : m_files) {
+            if (!entry.data.empty() && m_container.entries.count(name) != 0 &&
+                !Leased(name)) {
+                SecureMemory::SecureBytes().swap(entry.data);
+            }
+        }
+        {
+            // The commit wrote all of m_files, staged changes included.
+            const std::lock_guard<std::mutex> schedule(m_commitMutex);
+            m_commitStatus.dirty = false;
+            m_commitStatus.pendingChanges = 0;
+            m_commitStatus.lastError.clear();
+        }
+
+        if (appendResult == AppendResult::Appended) {
+            ++m_appendedCommits;
+            PQC_LOG_INFO(LOG_MODULE) << "Archive commit " << m_container.generation
+                                     << " appended to PQCENC05 container (" << m_container.size
+                                     << " bytes, " << m_container.size - m_container.liveSize
+                                     << " reclaimable): " << m_archivePath;
+        } else {
+            if (compacted) {
+                ++m_compactions;
+            }
+            PQC_LOG_INFO(LOG_MODULE) << "Archive saved as PQCENC05 (scrypt + log-structured AES-256-GCM): "
+                                     << m_archivePath;
+        }
+        return true;
+    } catch (const std::exception& e) {
+        return fail(std::string("Error saving archive: ") + e.what());
+    }
+}
+
+bool CryptoArchive::DiskRevisionCurrent() {
+    if (m_hasDiskRevision && m_diskIdentity.valid &&
+        ReadDiskIdentity(m_archivePath) == m_diskIdentity) {
+        ++m_revisionMetadataChecks;
+        return true;
+    }
+    bool diskExists = false;
+    std::string currentRevision;
+    ++m_revisionReads;
+    return ContainerRevision(m_archivePath, diskExists, currentRevision) &&
+           (m_hasDiskRevision ? diskExists && currentRevision == m_diskRevision : !diskExists);
+}
+
+CryptoArchive::ResidentSegments::~ResidentSegments() {
+    for (ResidentSegment& segment : segments) {
+        SecureMemory::Cleanse(segment.packed);
+    }
+}
+
+bool CryptoArchive::PlanContainer(ContainerPlan& plan,
+                                  ResidentSegments& resident,
+                                  uint64_t appendOffset) const {
+    plan.sources.clear();
+    plan.index = ArchiveIndex::Index{};
+    plan.indexOffset = 0;
+    if (m_files.size() > ArchiveIndex::MAX_ENTRIES) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Cannot save archive: too many entries";
+        return false;
+    }
+
+    // Digests only match under the key they were made with, so a container
+    // keeps its segment key; one without digests gets a fresh key.
+    const ArchiveIndex::SegmentKey noKey{};
+    const ArchiveIndex::Digest noDigest{};
+    ArchiveIndex::Index& index = plan.index;
+    if (!resident.ready) {
+        resident.segmentKey = m_container.segmentKey;
+        if (resident.segmentKey == noKey &&
+            RAND_bytes(resident.segmentKey.data(),
+                       static_cast<int>(resident.segmentKey.size())) != 1) {
+            return false;
+        }
+        const ArchiveChunker::Chunker chunker(resident.segmentKey);
+        if (!chunker.valid()) {
+            return false;
+        }
+
+        // Resident payloads are the ones this commit writes. They are cut
+        // into segments file by file, then every segment is digested, in
+        // parallel.
+        std::vector<const FileEntry*> files;
+        for (const auto& [name, file] : m_files) {
+            if (file.size != 0 && file.data.size() == file.size) {
+                files.push_back(&file);
+            }
+        }
+        std::vector<std::vector<size_t>> lengths(files.size());
+        if (!ArchiveStream::ParallelFor(files.size(), [&](size_t i) {
+                lengths[i] = chunker.Split(files[i]->data.data(), files[i]->data.size());
+                return !lengths[i].empty();
+            })) {
+            return false;
+        }
+        std::vector<ResidentSegment>& pieces = resident.segments;
+        pieces.clear();
+        for (size_t i = 0; i < files.size(); ++i) {
+            uint64_t offset = 0;
+            for (const size_t length : lengths[i]) {
+                ResidentSegment piece;
+                piece.file = files[i];
+                piece.offset = offset;
+                piece.size = length;
+                pieces.push_back(std::move(piece));
+                offset += length;
+            }
+        }
+        if (!ArchiveStream::ParallelFor(pieces.size(), [&](size_t i) {
+                return chunker.Digest(pieces[i].file->data.data() + pieces[i].offset,
+                                      static_cast<size_t>(pieces[i].size), pieces[i].digest);
+            })) {
+            return false;
+        }
+        resident.ready = true;
+    }
+    index.segmentKey = resident.segmentKey;
+    std::vector<ResidentSegment>& pieces = resident.segments;
+
+    // Every distinct digest becomes one segment. Blobs of the current
+    // container are carried over once, whichever entries use them; an append
+    // keeps them where they are.
+    const bool append = appendOffset != 0;
+    std::map<ArchiveIndex::Digest, uint32_t> planned;
+    std::map<uint32_t, uint32_t> carried;
+    std::vector<bool> kept;
+    const auto addSegment = [&](const ArchiveIndex::Segment& segment, BlobSource source,
+                                bool keep) {
+        const auto position = static_cast<uint32_t>(index.segments.size());
+        index.segments.push_back(segment);
+        plan.sources.push_back(std::move(source));
+        kept.push_back(keep);
+        if (segment.digest != noDigest) {
+            planned.emplace(segment.digest, position);
+        }
+        return position;
+    };
+    const auto carry = [&](uint32_t blobIndex) {
+        const auto existing = carried.find(blobIndex);
+        if (existing != carried.end()) {
+            return existing->second;
+        }
+        const StoredBlob& blob = m_container.blobs[blobIndex];
+        const auto same = blob.digest == noDigest ? planned.end() : planned.find(blob.digest);
+        uint32_t position = 0;
+        if (same != planned.end()) {
+            position = same->second;
+        } else {
+            ArchiveIndex::Segment segment;
+            segment.blobId = blob.id;
+            segment.blobOffset = blob.offset;
+            segment.codec = blob.codec;
+            segment.storedSize = blob.storedSize;
+            segment.size = blob.size;
+            segment.digest = blob.digest;
+            BlobSource source;
+            source.storedBlob = blobIndex;
+            position = addSegment(segment, std::move(source), append);
+        }
+        carried.emplace(blobIndex, position);
+        return position;
+    };
+
+    size_t nextPiece = 0;
+    index.entries.reserve(m_files.size());
+    for (const auto& [name, file] : m_files) {
+        const bool isResident = file.data.size() == file.size;
+        const auto stored = m_container.entries.find(name);
+        const bool isStored = file.data.empty() && stored != m_container.entries.end() &&
+                              m_container.key.size() == KEY_SIZE;
+        if (!PathSecurity::ValidateStoredFilename(name) || name != file.name ||
+            (isResident && file.size > MAX_ARCHIVE_ENTRY_SIZE) || (!isResident && !isStored)) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Cannot save archive: payload unavailable for " << name;
+            return false;
+        }
+
+        ArchiveIndex::Entry entry;
+        entry.name = name;
+        entry.size = file.size;
+        entry.timestamp = file.timestamp;
+        entry.hash = file.hash;
+        if (isResident) {
+            for (; nextPiece < pieces.size() && pieces[nextPiece].file == &file; ++nextPiece) {
+                ResidentSegment& piece = pieces[nextPiece];
+                const auto same = planned.find(piece.digest);
+                const auto storedSame =
+                    append ? m_container.digests.find(piece.digest) : m_container.digests.end();
+                if (same != planned.end()) {
+                    entry.segments.push_back(same->second);
+                } else if (storedSame != m_container.digests.end()) {
+                    entry.segments.push_back(carry(storedSame->second));
+                } else {
+                    ArchiveIndex::Segment segment;
+                    segment.codec = ArchiveCodec::STORED;
+                    segment.storedSize = piece.size;
+                    segment.size = piece.size;
+                    segment.digest = piece.digest;
+                    BlobSource source;
+                    source.resident = &piece;
+                    entry.segments.push_back(addSegment(segment, std::move(source), false));
+                }
+            }
+        } else {
+            for (const uint32_t blobIndex : stored->second) {
+                entry.segments.push_back(carry(blobIndex));
+            }
+        }
+        index.entries.push_back(std::move(entry));
+    }
+
+    // A commit that keeps the number of entries rehashes only the paths of
+    // the leaves it changed; adding or removing entries shifts the leaves, so
+    // the tree is rebuilt.
+    std::vector<ArchiveMerkle::Hash> leaves = IntegrityLeaves(index);
+    std::vector<size_t> changed;
+    if (m_container.merkle.size() == leaves.size()) {
+        for (size_t i = 0; i < leaves.size(); ++i) {
+            if (m_container.merkle.Leaf(i) != leaves[i]) {
+                changed.push_back(i);
+            }
+        }
+    }
+    if (m_container.merkle.size() == leaves.size() && changed.size() <= leaves.size() / 8) {
+        plan.merkle = m_container.merkle;
+        for (const size_t position : changed) {
+            plan.merkle.Update(position, leaves[position]);
+        }
+    } else {
+        plan.merkle.Build(std::move(leaves));
+    }
+    index.integrityRoot = plan.merkle.Root();
+
+    // New segments of resident payloads that look compressible are
+    // compressed in parallel before the layout is fixed; carried blobs keep
+    // the codec they were written with. A segment an earlier plan of the
+    // same commit already tried is not compressed again.
+    if (m_compressionEnabled) {
+        std::vector<ResidentSegment*> candidates;
+        for (const BlobSource& source : plan.sources) {
+            if (source.resident != nullptr && !source.resident->compressionTried) {
+                candidates.push_back(source.resident);
+            }
+        }
+        ArchiveStream::ParallelFor(candidates.size(), [&](size_t i) {
+            ResidentSegment& segment = *candidates[i];
+            const uint8_t* data = segment.file->data.data() + segment.offset;
+            if (ArchiveCodec::LooksCompressible(data, static_cast<size_t>(segment.size))) {
+                ArchiveCodec::Compress(data, static_cast<size_t>(segment.size), segment.packed);
+            }
+            segment.compressionTried = true;
+            return true;
+        });
+        for (size_t i = 0; i < index.segments.size(); ++i) {
+            const ResidentSegment* segment = plan.sources[i].resident;
+            if (segment != nullptr && !segment->packed.empty()) {
+                index.segments[i].codec = ArchiveCodec::DEFLATE;
+                index.segments[i].storedSize = segment->packed.size();
+            }
+        }
+    }
+
+    uint64_t offset = append ? appendOffset : FormatValidation::ARCHIVE_V5_DATA_OFFSET;
+    for (size_t i = 0; i < index.segments.size(); ++i) {
+        if (kept[i]) {
+            continue;
+        }
+        ArchiveIndex::Segment& segment = index.segments[i];
+        segment.blobOffset = offset;
+        if (RAND_bytes(segment.blobId.data(), static_cast<int>(segment.blobId.size())) != 1) {
+            return false;
+        }
+        offset += ArchiveStream::SealedSize(segment.storedSize, ArchiveStream::DEFAULT_CHUNK_SIZE);
+        if (offset > MAX_STREAMED_ARCHIVE_SIZE) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Archive exceeds the maximum container size";
+            return false;
+        }
+    }
+    if (index.segments.size() > ArchiveIndex::MAX_SEGMENTS) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Cannot save archive: too many segments";
+        return false;
+    }
+
+    const uint64_t sealedIndexSize = ArchiveStream::SealedSize(
+        ArchiveIndex::EncodedSize(index), ArchiveStream::DEFAULT_CHUNK_SIZE);
+    if (sealedIndexSize > MAX_STREAMED_ARCHIVE_SIZE - offset) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Archive exceeds the maximum container size";
+        return false;
+    }
+    plan.indexOffset = offset;
+    return true;
+}
+
+bool CryptoArchive::SealRecords(const ContainerPlan& plan,
+                                uint64_t firstOffset,
+                                const SecureMemory::SecureBytes& key,
+                                uint32_t chunkSize,
+                                const std::vector<uint8_t>& indexNonce,
+                                const std::vector<uint8_t>& associatedData,
+                                const ArchiveStream::Sink& sink) const {
+    const std::vector<ArchiveIndex::Segment>& segments = plan.index.segments;
+    std::vector<size_t> pending;
+    bool reseals = false;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        if (segments[i].blobOffset >= firstOffset) {
+            pending.push_back(i);
+            reseals = reseals || plan.sources[i].resident == nullptr;
+        }
+    }
+
+    // Blobs that are only stored in the current container are opened and
+    // re-sealed in their stored (possibly compressed) form.
+    MappedFile previousMapping;
+    std::ifstream previous;
+    std::mutex previousMutex;
+    ArchiveStream::ReadAt previousReadAt;
+    if (reseals && !m_container.path.empty() && !previousMapping.Open(m_container.path)) {
+        previous.open(m_container.path, std::ios::binary);
+        if (previous.is_open()) {
+            previousReadAt = LockedReadAt(FileReadAt(previous), previousMutex);
+        }
+    }
+    const MappedFile* mapping = previousMapping.valid() ? &previousMapping : nullptr;
+    const auto seal = [&](size_t i, const ArchiveStream::Sink& output) {
+        const ArchiveIndex::Segment& segment = segments[i];
+        const BlobSource& source = plan.sources[i];
+        return SealBlob(
+            key, segment.blobId, segment.codec, segment.storedSize, segment.size, chunkSize,
+            [&](const ArchiveStream::Sink& stored) {
+                if (source.resident == nullptr) {
+                    return StreamStoredBytes(m_container.blobs[source.storedBlob], m_container,
+                                             previousReadAt, stored, mapping);
+                }
+                const ResidentSegment& piece = *source.resident;
+                if (!piece.packed.empty()) {
+                    return stored(piece.packed.data(), piece.packed.size());
+                }
+                return stored(piece.file->data.data() + piece.offset,
+                              static_cast<size_t>(segment.size));
+            },
+            output);
+    };
+
+    // Segments are sealed in parallel into buffers, one batch at a time; a
+    // blob larger than a batch streams through its own parallel writer.
+    const uint64_t batchLimit = ArchiveStream::BatchSize(chunkSize);
+    std::vector<std::vector<uint8_t>> sealed;
+    for (size_t next = 0; next < pending.size();) {
+        if (segments[pending[next]].storedSize > batchLimit) {
+            if (!seal(pending[next], sink)) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Failed to seal archive payloads";
+                return false;
+            }
+            ++next;
+            continue;
+        }
+        size_t end = next;
+        uint64_t total = 0;
+        while (end < pending.size() && segments[pending[end]].storedSize <= batchLimit - total) {
+            total += segments[pending[end]].storedSize;
+            ++end;
+        }
+        sealed.assign(end - next, std::vector<uint8_t>());
+        const bool batchSealed = ArchiveStream::ParallelFor(end - next, [&](size_t i) {
+            std::vector<uint8_t>& output = sealed[i];
+            const ArchiveIndex::Segment& segment = segments[pending[next + i]];
+            output.reserve(static_cast<size_t>(
+                ArchiveStream::SealedSize(segment.storedSize, chunkSize)));
+            return seal(pending[next + i], [&output](const uint8_t* data, size_t size) {
+                output.insert(output.end(), data, data + size);
+                return true;
+            });
+        });
+        if (!batchSealed) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Failed to seal archive payloads";
+            return false;
+        }
+        for (const std::vector<uint8_t>& output : sealed) {
+            if (!sink(output.data(), output.size())) {
+                return false;
+            }
+        }
+        next = end;
+    }
+
+    SecureMemory::SecureBytes indexKey;
+    SecureMemory::ScopedCleanse indexKeyGuard(indexKey);
+    if (!ArchiveStream::DeriveStreamKey(key, INDEX_KEY_LABEL, nullptr, 0, indexKey)) {
         return false;
     }
+    const ArchiveStream::ChunkCipher indexCipher(indexKey, indexNonce, associatedData);
+    ArchiveStream::SealingWriter indexWriter(indexCipher, chunkSize, sink);
+    bool encoded = false;
+    {
+        // Sealing and writes behind the writer are timed as their own stages.
+        Metrics::ScopedTimer timer(Metrics::Stage::Serialization,
+                                   ArchiveIndex::EncodedSize(plan.index));
+        encoded = ArchiveIndex::Encode(
+            plan.index, [&indexWriter, &timer](const uint8_t* data, size_t size) {
+                const Metrics::ScopedExclusion sealing(timer);
+                return indexWriter.Write(data, size);
+            });
+    }
+    return encoded && indexWriter.Finish() &&
+           indexWriter.payloadBytes() == ArchiveIndex::EncodedSize(plan.index);
 }
 
-bool CryptoArchive::SaveArchive() {
-    if (!m_identityValid || !m_isLoaded) {
-        std::cerr << "Cannot save an archive that is not loaded" << std::endl;
+bool CryptoArchive::WriteEncryptedArchive(const std::string& password,
+                                          ContainerPlan& plan,
+                                          const ArchiveStream::Sink& sink,
+                                          const SessionKey* sessionKey,
+                                          ContainerState* written,
+                                          std::string* revision) const {
+    if (password.empty()) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Cannot encrypt an archive without a password";
         return false;
     }
 
-    try {
-        ScopedArchiveLock archiveLock(m_archivePath);
-        if (!archiveLock.acquired()) {
-            std::cerr << "Could not acquire archive lock" << std::endl;
-            return false;
-        }
+    const uint64_t indexOffset = plan.indexOffset;
+    const uint64_t indexSize = ArchiveIndex::EncodedSize(plan.index);
+    const uint32_t chunkSize = static_cast<uint32_t>(ArchiveStream::DEFAULT_CHUNK_SIZE);
 
-        bool diskExists = false;
-        std::string currentRevision;
-        if (!FileRevision(m_archivePath, diskExists, currentRevision) ||
-            (m_hasDiskRevision && (!diskExists || currentRevision != m_diskRevision)) ||
-            (!m_hasDiskRevision && diskExists)) {
-            std::cerr << "Archive changed on disk; reload before saving" << std::endl;
+    std::vector<uint8_t> salt(SALT_SIZE);
+    std::vector<uint8_t> indexNonce(NONCE_SIZE);
+    KeyDerivation::ScryptParameters scrypt = KeyDerivation::PreferredScrypt();
+    SecureMemory::SecureBytes key;
+    SecureMemory::ScopedCleanse keyGuard(key);
+    if (RAND_bytes(indexNonce.data(), static_cast<int>(indexNonce.size())) != 1) {
+        return false;
+    }
+    if (sessionKey != nullptr && sessionKey->valid() && sessionKey->scrypt == scrypt) {
+        // The salt stays with the unlocked key. New blobs get fresh ids and so
+        // new HKDF subkeys; the index subkey is the same for every save under
+        // this key and only its random nonce changes.
+        salt = sessionKey->salt;
+        key = sessionKey->key;
+        ++m_scryptRunsAvoided;
+    } else {
+        // No session key, or one derived with other parameters: re-key the
+        // container with the preferred ones.
+        if (RAND_bytes(salt.data(), static_cast<int>(salt.size())) != 1 ||
+            !DeriveScryptKey(password, salt, scrypt, key)) {
             return false;
         }
+        ++m_scryptRuns;
+    }
 
-        std::vector<uint8_t> encryptedArchive;
-        if (!BuildEncryptedArchive(m_password.get(), encryptedArchive)) {
-            return false;
-        }
-        const std::string newRevision = CalculateFileHash(encryptedArchive);
-        if (newRevision.empty()) {
-            return false;
-        }
-        if (!AtomicFile::Write(m_archivePath, encryptedArchive)) {
-            std::cerr << "Failed to atomically write archive: " << m_archivePath << std::endl;
-            return false;
-        }
+    // A rewritten container starts with the head in slot 0 and an empty slot 1.
+    const std::vector<uint8_t> preamble = BuildLogPreamble(chunkSize, scrypt, salt);
+    const std::vector<uint8_t> slot =
+        BuildHeadSlot(preamble, 1, indexOffset, indexSize, indexNonce);
+    const std::vector<uint8_t> emptySlot(FormatValidation::ARCHIVE_V5_SLOT_SIZE, 0);
+    std::vector<uint8_t> head(static_cast<size_t>(FormatValidation::ARCHIVE_V5_DATA_OFFSET), 0);
+    std::copy(preamble.begin(), preamble.end(), head.begin());
+    std::copy(slot.begin(), slot.end(),
+              head.begin() + static_cast<std::ptrdiff_t>(FormatValidation::ArchiveV5SlotOffset(0)));
+    if (slot.size() != FormatValidation::ARCHIVE_V5_SLOT_SIZE ||
+        !sink(head.data(), head.size()) ||
+        !SealRecords(plan, FormatValidation::ARCHIVE_V5_DATA_OFFSET, key, chunkSize,
+                     indexNonce, HeadAssociatedData(preamble, slot), sink)) {
+        return false;
+    }
+    if (revision != nullptr && !HeadRevision(preamble, slot, emptySlot, *revision)) {
+        return false;
+    }
 
-        m_diskRevision = newRevision;
-        m_hasDiskRevision = true;
+    if (written != nullptr) {
+        written->Clear();
+        written->chunkSize = chunkSize;
+        written->salt = salt;
+        written->key = key;
+        written->Adopt(plan.index, std::move(plan.merkle));
+        written->appendable = true;
+        written->activeSlot = 0;
+        written->generation = 1;
+        written->size = indexOffset + ArchiveStream::SealedSize(indexSize, chunkSize);
+        written->liveSize = written->size;
+    }
+    return true;
+}
 
-        std::cout << "Archive saved as PQCENC02 (scrypt + AES-256-GCM): "
-                  << m_archivePath << std::endl;
-        return true;
+bool CryptoArchive::CanAppend() const {
+    // Appends keep the container key, so the session key must still be the
+    // one that opened it; a new password always rewrites with a new salt, and
+    // so do parameters other than the preferred ones.
+    return m_container.appendable && m_container.path == m_archivePath &&
+           m_container.chunkSize == ArchiveStream::DEFAULT_CHUNK_SIZE &&
+           m_container.scrypt == KeyDerivation::PreferredScrypt() &&
+           m_sessionKey.valid() && m_sessionKey.salt == m_container.salt &&
+           m_sessionKey.scrypt == m_container.scrypt &&
+           m_sessionKey.key.size() == m_container.key.size() &&
+           CRYPTO_memcmp(m_sessionKey.key.data(), m_container.key.data(),
+                         m_container.key.size()) == 0;
+}
+
+CryptoArchive::AppendResult CryptoArchive::AppendToContainer(ResidentSegments& resident,
+                                                             ContainerState& written,
+                                                             std::string& revision) const {
+    written.Clear();
+    revision.clear();
+    if (!CanAppend()) {
+        return AppendResult::RewriteRequired;
+    }
+
+    // An interrupted append may have left an unreferenced tail; new records
+    // go after it, and compaction reclaims it with the rest of the dead space.
+    std::error_code sizeError;
+    const uint64_t appendOffset = std::filesystem::file_size(m_archivePath, sizeError);
+    if (sizeError || appendOffset < FormatValidation::ARCHIVE_V5_DATA_OFFSET) {
+        return AppendResult::Failed;
+    }
+
+    ContainerPlan plan;
+    if (!PlanContainer(plan, resident, appendOffset)) {
+        return AppendResult::Failed;
+    }
+    const uint32_t chunkSize = m_container.chunkSize;
+    const uint64_t indexOffset = plan.indexOffset;
+    const uint64_t indexSize = ArchiveIndex::EncodedSize(plan.index);
+    const uint64_t containerSize = indexOffset + ArchiveStream::SealedSize(indexSize, chunkSize);
+    const uint64_t liveSize = LiveContainerSize(plan.index, indexSize, chunkSize);
+    const uint64_t deadSize = containerSize > liveSize ? containerSize - liveSize : 0;
+    if (containerSize > MAX_STREAMED_ARCHIVE_SIZE ||
+        (deadSize > COMPACTION_MIN_DEAD_SIZE && deadSize > liveSize)) {
+        return AppendResult::CompactionDue;
+    }
+
+    std::vector<uint8_t> indexNonce(NONCE_SIZE);
+    if (RAND_bytes(indexNonce.data(), static_cast<int>(indexNonce.size())) != 1) {
+        return AppendResult::Failed;
+    }
+    const uint32_t targetSlot = 1U - m_container.activeSlot;
+    const std::vector<uint8_t> preamble =
+        BuildLogPreamble(chunkSize, m_container.scrypt, m_container.salt);
+    const std::vector<uint8_t> slot =
+        BuildHeadSlot(preamble, m_container.generation + 1, indexOffset, indexSize, indexNonce);
+    std::vector<uint8_t> activeSlot(FormatValidation::ARCHIVE_V5_SLOT_SIZE);
+    if (slot.size() != activeSlot.size()) {
+        return AppendResult::Failed;
+    }
+
+    try {
+        std::ifstream current(m_archivePath, std::ios::binary);
+        if (!current.is_open() ||
+            !FileReadAt(current)(FormatValidation::ArchiveV5SlotOffset(m_container.activeSlot),
+                                 activeSlot.data(), activeSlot.size())) {
+            return AppendResult::Failed;
+        }
     } catch (const std::exception& e) {
-        std::cerr << "Error saving archive: " << e.what() << std::endl;
-        return false;
+        PQC_LOG_ERROR(LOG_MODULE) << "Error reading archive head: " << e.what();
+        return AppendResult::Failed;
+    }
+
+    // Records are durable before the head that references them is written;
+    // a crash in between leaves the previous head in charge.
+    if (!AtomicFile::WriteAt(
+            m_archivePath, appendOffset,
+            [&](const AtomicFile::ChunkWriter& writer) {
+                return SealRecords(plan, appendOffset, m_container.key, chunkSize,
+                                   indexNonce, HeadAssociatedData(preamble, slot), writer);
+            }) ||
+        !AtomicFile::WriteAt(
+            m_archivePath, FormatValidation::ArchiveV5SlotOffset(targetSlot),
+            [&slot](const AtomicFile::ChunkWriter& writer) {
+                return writer(slot.data(), slot.size());
+            })) {
+        return AppendResult::Failed;
+    }
+    if (!HeadRevision(preamble, targetSlot == 0 ? slot : activeSlot,
+                      targetSlot == 0 ? activeSlot : slot, revision)) {
+        return AppendResult::Failed;
     }
+
+    written.chunkSize = chunkSize;
+    written.salt = m_container.salt;
+    written.scrypt = m_container.scrypt;
+    written.key = m_container.key;
+    written.Adopt(plan.index, std::move(plan.merkle));
+    ++m_scryptRunsAvoided;
+    written.appendable = true;
+    written.activeSlot = targetSlot;
+    written.generation = m_container.generation + 1;
+    written.size = containerSize;
+    written.liveSize = liveSize;
+    return AppendResult::Appended;
 }
 
-bool CryptoArchive::BuildEncryptedArchive(const std::string& password,
-                                          std::vector<uint8_t>& output) const {
-    if (password.empty()) {
-        std::cerr << "Cannot encrypt an archive without a password" << std::endl;
+bool CryptoArchive::IngestSource(FileEntry& entry, std::vector<uint32_t>& segments,
+                                 std::string& error) {
+    segments.clear();
+    std::error_code fileError;
+    if (!std::filesystem::is_regular_file(entry.path, fileError) || fileError) {
+        error = "Path is not a regular file: " + entry.path;
         return false;
     }
-    for (const auto& file : m_files) {
-        if (!PathSecurity::ValidateStoredFilename(file.first) ||
-            file.first != file.second.name ||
-            file.second.size != file.second.data.size()) {
-            std::cerr << "Cannot save archive: size mismatch for " << file.first << std::endl;
-            return false;
-        }
+    const uintmax_t sourceSize = std::filesystem::file_size(entry.path, fileError);
+    if (fileError || sourceSize > MAX_STREAMED_ARCHIVE_SIZE ||
+        sourceSize > static_cast<uintmax_t>(std::numeric_limits<size_t>::max())) {
+        error = "File exceeds the maximum archive size: " + entry.path;
+        return false;
     }
-
-    std::vector<uint8_t> serializedData = SerializeArchive();
-    SecureMemory::ScopedCleanse serializedDataGuard(serializedData);
-    if (serializedData.empty()) {
+    std::ifstream source(entry.path, std::ios::binary);
+    if (!source.is_open()) {
+        error = "Failed to open file: " + entry.path;
+        return false;
+    }
+    if (!CanAppend()) {
+        error = "Archive cannot take streamed files before it is saved";
         return false;
     }
 
-    std::vector<uint8_t> salt(SALT_SIZE);
-    std::vector<uint8_t> nonce(NONCE_SIZE);
-    if (RAND_bytes(salt.data(), static_cast<int>(salt.size())) != 1 ||
-        RAND_bytes(nonce.data(), static_cast<int>(nonce.size())) != 1) {
+    // A container written before deduplication has no segment key yet; the
+    // commit that publishes these segments publishes the key chosen here.
+    const ArchiveIndex::SegmentKey noKey{};
+    if (m_container.segmentKey == noKey &&
+        RAND_bytes(m_container.segmentKey.data(),
+                   static_cast<int>(m_container.segmentKey.size())) != 1) {
+        error = "Failed to generate a segment key";
+        return false;
+    }
+    const ArchiveChunker::Chunker chunker(m_container.segmentKey);
+    if (!chunker.valid()) {
+        error = "Failed to prepare the segment chunker";
         return false;
     }
 
-    std::vector<uint8_t> key;
-    SecureMemory::ScopedCleanse keyGuard(key);
-    if (!DeriveScryptKey(password, salt, SCRYPT_N, SCRYPT_R, SCRYPT_P, key)) {
+    ScopedArchiveLock archiveLock(m_archivePath);
+    if (!archiveLock.acquired()) {
+        error = "Could not acquire archive lock";
+        return false;
+    }
+    if (!DiskRevisionCurrent()) {
+        error = "Archive changed on disk; reload before adding files";
+        return false;
+    }
+    std::error_code sizeError;
+    const uint64_t appendOffset = std::filesystem::file_size(m_archivePath, sizeError);
+    if (sizeError || appendOffset < FormatValidation::ARCHIVE_V5_DATA_OFFSET ||
+        appendOffset > MAX_STREAMED_ARCHIVE_SIZE) {
+        error = "Could not inspect the archive file";
         return false;
     }
 
-    std::vector<uint8_t> header = BuildSecureHeader(serializedData.size(), salt, nonce);
-    std::vector<uint8_t> ciphertext;
-    std::vector<uint8_t> tag;
-    const bool encrypted = EncryptAesGcm(serializedData, key, nonce, header, ciphertext, tag);
-    Cleanse(key);
-    Cleanse(serializedData);
-    if (!encrypted || ciphertext.empty() || tag.size() != TAG_SIZE) {
+    const uint32_t chunkSize = m_container.chunkSize;
+    const size_t firstBlob = m_container.blobs.size();
+    ArchiveStream::BoundedQueue<std::vector<uint8_t>> blocks(INGEST_QUEUE_DEPTH);
+    ArchiveStream::BoundedQueue<std::vector<std::vector<uint8_t>>> batches(INGEST_QUEUE_DEPTH);
+    bool readComplete = false;
+    bool cutComplete = false;
+    std::string hash;
+    uint64_t written = 0;
+    size_t newSegments = 0;
+
+    // Stage one: fixed-size blocks of the source, in order. A source that
+    // grows or shrinks while it is read does not complete.
+    const auto readBlocks = [&]() {
+        try {
+            uint64_t remaining = sourceSize;
+            while (remaining != 0) {
+                std::vector<uint8_t> block(
+                    static_cast<size_t>(std::min<uint64_t>(remaining, INGEST_BLOCK_SIZE)));
+                const bool read = static_cast<bool>(
+                    source.read(reinterpret_cast<char*>(block.data()),
+                                static_cast<std::streamsize>(block.size())));
+                remaining -= read ? block.size() : 0;
+                if (!read || !blocks.Push(std::move(block))) {
+                    SecureMemory::Cleanse(block);
+                    break;
+                }
+            }
+            readComplete = remaining == 0 &&
+                           source.peek() == std::ifstream::traits_type::eof();
+        } catch (const std::exception&) {
+            readComplete = false;
+        }
+        blocks.Close();
+    };
+
+    // Stage two: SHA-256 over the blocks, and content-defined segments cut as
+    // soon as their end is settled, handed on in batches of about one block.
+    const auto cutSegments = [&]() {
+        std::vector<uint8_t> pending;
+        std::vector<uint8_t> block;
+        std::vector<std::vector<uint8_t>> batch;
+        try {
+            RevisionDigest digest;
+            pending.reserve(INGEST_BLOCK_SIZE + ArchiveChunker::MAX_SEGMENT_SIZE);
+            size_t batchBytes = 0;
+            uint64_t hashed = 0;
+            const auto flush = [&]() {
+                if (batch.empty()) {
+                    return true;
+                }
+                if (!batches.Push(std::move(batch))) {
+                    return false;
+                }
+                batch.clear();
+                batchBytes = 0;
+                return true;
+            };
+            const auto cut = [&](bool end) {
+                size_t start = 0;
+                while (start < pending.size() &&
+                       (end || pending.size() - start >= ArchiveChunker::MAX_SEGMENT_SIZE)) {
+                    const size_t length =
+                        chunker.CutPoint(pending.data() + start, pending.size() - start);
+                    batch.emplace_back(pending.begin() + static_cast<std::ptrdiff_t>(start),
+                                       pending.begin() + static_cast<std::ptrdiff_t>(start + length));
+                    batchBytes += length;
+                    start += length;
+                    if (batchBytes >= INGEST_BLOCK_SIZE && !flush()) {
+                        return false;
+                    }
+                }
+                // The unsettled tail moves to the front of the buffer.
+                const size_t rest = pending.size() - start;
+                std::copy(pending.begin() + static_cast<std::ptrdiff_t>(start), pending.end(),
+                          pending.begin());
+                SecureMemory::Cleanse(pending.data() + rest, start);
+                pending.resize(rest);
+                return true;
+            };
+            bool cutting = true;
+            while (cutting && blocks.Pop(block)) {
+                hashed += block.size();
+                pending.insert(pending.end(), block.begin(), block.end());
+                cutting = digest.Update(block.data(), block.size()) && cut(false);
+                SecureMemory::Cleanse(block);
+            }
+            cutComplete = cutting && hashed == sourceSize && cut(true) && flush() &&
+                          digest.Finish(hash);
+        } catch (const std::exception&) {
+            cutComplete = false;
+        }
+        SecureMemory::Cleanse(block);
+        SecureMemory::Cleanse(pending);
+        for (std::vector<uint8_t>& segment : batch) {
+            SecureMemory::Cleanse(segment);
+        }
+        batches.Close();
+        blocks.Close();
+    };
+
+    // Stage three, on this thread: each batch is digested in parallel, its
+    // segments already in the container are shared, and the new ones are
+    // compressed when that pays off and sealed in parallel, then appended in
+    // order.
+    const auto sealBatch = [&](std::vector<std::vector<uint8_t>>& batch,
+                               const AtomicFile::ChunkWriter& writer) {
+        std::vector<ArchiveIndex::Digest> digests(batch.size());
+        if (!ArchiveStream::ParallelFor(batch.size(), [&](size_t i) {
+                return chunker.Digest(batch[i].data(), batch[i].size(), digests[i]);
+            })) {
+            return false;
+        }
+        std::vector<size_t> fresh;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const auto known = m_container.digests.find(digests[i]);
+            if (known != m_container.digests.end()) {
+                segments.push_back(known->second);
+                continue;
+            }
+            StoredBlob blob{};
+            if (RAND_bytes(blob.id.data(), static_cast<int>(blob.id.size())) != 1) {
+                return false;
+            }
+            blob.codec = ArchiveCodec::STORED;
+            blob.storedSize = batch[i].size();
+            blob.size = batch[i].size();
+            blob.digest = digests[i];
+            const auto blobIndex = static_cast<uint32_t>(m_container.blobs.size());
+            m_container.blobs.push_back(blob);
+            m_container.digests.emplace(digests[i], blobIndex);
+            segments.push_back(blobIndex);
+            fresh.push_back(i);
+        }
+        const size_t firstFresh = m_container.blobs.size() - fresh.size();
+        std::vector<std::vector<uint8_t>> packed(fresh.size());
+        std::vector<std::vector<uint8_t>> sealed(fresh.size());
+        const bool allSealed = ArchiveStream::ParallelFor(fresh.size(), [&](size_t i) {
+            const std::vector<uint8_t>& data = batch[fresh[i]];
+            StoredBlob& blob = m_container.blobs[firstFresh + i];
+            if (m_compressionEnabled &&
+                ArchiveCodec::LooksCompressible(data.data(), data.size()) &&
+                ArchiveCodec::Compress(data.data(), data.size(), packed[i])) {
+                blob.codec = ArchiveCodec::DEFLATE;
+                blob.storedSize = packed[i].size();
+            }
+            const std::vector<uint8_t>& stored = packed[i].empty() ? data : packed[i];
+            std::vector<uint8_t>& output = sealed[i];
+            output.reserve(static_cast<size_t>(ArchiveStream::SealedSize(blob.storedSize, chunkSize)));
+            return SealBlob(
+                m_container.key, blob.id, blob.codec, blob.storedSize, blob.size, chunkSize,
+                [&stored](const ArchiveStream::Sink& sink) {
+                    return sink(stored.data(), stored.size());
+                },
+                [&output](const uint8_t* bytes, size_t size) {
+                    output.insert(output.end(), bytes, bytes + size);
+                    return true;
+                });
+        });
+        for (std::vector<uint8_t>& bytes : packed) {
+            SecureMemory::Cleanse(bytes);
+        }
+        if (!allSealed) {
+            return false;
+        }
+        for (size_t i = 0; i < sealed.size(); ++i) {
+            if (sealed[i].size() > MAX_STREAMED_ARCHIVE_SIZE - appendOffset - written) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Archive exceeds the maximum container size";
+                return false;
+            }
+            m_container.blobs[firstFresh + i].offset = appendOffset + written;
+            if (!writer(sealed[i].data(), sealed[i].size())) {
+                return false;
+            }
+            written += sealed[i].size();
+        }
+        newSegments += fresh.size();
+        return true;
+    };
+
+    const bool appended = AtomicFile::WriteAt(
+        m_archivePath, appendOffset, [&](const AtomicFile::ChunkWriter& writer) {
+            std::thread reader;
+            std::thread cutter;
+            std::vector<std::vector<uint8_t>> batch;
+            const auto stop = [&]() {
+                blocks.Close();
+                batches.Close();
+                if (reader.joinable()) {
+                    reader.join();
+                }
+                if (cutter.joinable()) {
+                    cutter.join();
+                }
+                std::vector<uint8_t> block;
+                while (blocks.Pop(block)) {
+                    SecureMemory::Cleanse(block);
+                }
+                while (batches.Pop(batch)) {
+                    for (std::vector<uint8_t>& segment : batch) {
+                        SecureMemory::Cleanse(segment);
+                    }
+                }
+            };
+            bool sealed = true;
+            try {
+                reader = std::thread(readBlocks);
+                cutter = std::thread(cutSegments);
+                while (sealed && batches.Pop(batch)) {
+                    sealed = sealBatch(batch, writer);
+                    for (std::vector<uint8_t>& segment : batch) {
+                        SecureMemory::Cleanse(segment);
+                    }
+                }
+            } catch (const std::exception& e) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Error streaming file into archive: " << e.what();
+                sealed = false;
+            }
+            stop();
+            return sealed && readComplete && cutComplete;
+        });
+
+    if (!appended) {
+        // The bytes already appended are an unreferenced tail, like the one of
+        // an interrupted commit; only the blobs recorded for them are dropped.
+        for (auto it = m_container.digests.begin(); it != m_container.digests.end();) {
+            it = it->second >= firstBlob ? m_container.digests.erase(it) : std::next(it);
+        }
+        m_container.blobs.erase(
+            m_container.blobs.begin() + static_cast<std::ptrdiff_t>(firstBlob),
+            m_container.blobs.end());
+        segments.clear();
+        error = readComplete ? "Failed to stream file into archive: " + entry.path
+                             : "Failed to read entire file: " + entry.path;
         return false;
     }
 
-    output.clear();
-    output.reserve(header.size() + ciphertext.size() + tag.size());
-    output.insert(output.end(), header.begin(), header.end());
-    output.insert(output.end(), ciphertext.begin(), ciphertext.end());
-    output.insert(output.end(), tag.begin(), tag.end());
+    // Appending blobs leaves the revision alone; only the file size moved.
+    m_container.size = appendOffset + written;
+    m_diskIdentity = ReadDiskIdentity(m_archivePath);
+    entry.size = static_cast<size_t>(sourceSize);
+    entry.hash = hash;
+    PQC_LOG_INFO(LOG_MODULE) << "Streamed " << entry.path << ": " << sourceSize << " bytes in "
+                             << segments.size() << " segment(s), " << newSegments << " new";
     return true;
 }
 
+bool CryptoArchive::BuildEncryptedArchive(const std::string& password,
+                                          std::vector<uint8_t>& output) const {
+    output.clear();
+    ResidentSegments resident;
+    ContainerPlan plan;
+    if (!PlanContainer(plan, resident)) {
+        return false;
+    }
+    const uint64_t containerSize = plan.indexOffset + ArchiveStream::SealedSize(
+        ArchiveIndex::EncodedSize(plan.index), ArchiveStream::DEFAULT_CHUNK_SIZE);
+    if (containerSize > MAX_ARCHIVE_CONTAINER_SIZE) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Archive is too large to be prepared in memory";
+        return false;
+    }
+    output.reserve(static_cast<size_t>(containerSize));
+    const bool built = WriteEncryptedArchive(
+        password, plan, [&output](const uint8_t* data, size_t size) {
+            output.insert(output.end(), data, data + size);
+            return true;
+        });
+    if (!built) {
+        output.clear();
+    }
+    return built;
+}
+
 bool CryptoArchive::AddFile(const std::string& filePath, const std::string& name) {
-    std::cout << "---------- CRYPTO ARCHIVE ADD FILE ----------" << std::endl;
-    std::cout << "AddFile called with path: '" << filePath << "'" << std::endl;
-    std::cout << "Display name: '" << name << "'" << std::endl;
-    std::cout << "Archive loaded state: " << (m_isLoaded ? "Yes" : "No") << std::endl;
-    
-    const std::string entryName =
-        name.empty() ? std::filesystem::path(filePath).filename().string() : name;
-    std::string validationError;
-    if (!m_identityValid || !m_isLoaded ||
-        !PathSecurity::ValidateStoredFilename(entryName, &validationError)) {
-        std::cout << "Invalid archive filename: " << validationError << std::endl;
-        std::cout << "Archive not loaded, returning false" << std::endl;
-        std::cout << "-------------------------------------------" << std::endl;
+    return AddFiles({{filePath, name}});
+}
+
+bool CryptoArchive::AddFiles(const std::vector<std::pair<std::string, std::string>>& files,
+                             std::string* error) {
+    const StateLock stateLock(m_stateMutex);
+    const auto fail = [error](const std::string& message) {
+        if (error != nullptr) {
+            *error = message;
+        }
+        PQC_LOG_ERROR(LOG_MODULE) << message;
         return false;
+    };
+
+    PQC_LOG_DEBUG(LOG_MODULE) << "---------- CRYPTO ARCHIVE ADD FILES ----------";
+    PQC_LOG_INFO(LOG_MODULE) << "Files requested: " << files.size();
+    PQC_LOG_DEBUG(LOG_MODULE) << "Archive loaded state: " << (m_isLoaded ? "Yes" : "No");
+    if (!m_identityValid || !m_isLoaded) {
+        return fail("Archive not loaded");
     }
-    
-    // Print diagnostics about the archive state before adding
-    std::cout << "Current archive state:" << std::endl;
-    std::cout << "Files in archive: " << m_files.size() << std::endl;
-    
+    if (files.empty()) {
+        return fail("No files to add");
+    }
+
     try {
-        for (const auto& existing : m_files) {
-            if (existing.first != entryName &&
-                PathSecurity::NamesCollide(existing.first, entryName)) {
-                std::cout << "A file with an equivalent name already exists" << std::endl;
-                return false;
+        // Resolve and validate every name before touching a source file, against
+        // the archive and against the rest of the batch. An exact name that is
+        // already stored is replaced, as with a single AddFile.
+        std::vector<FileEntry> entries(files.size());
+        std::unordered_set<std::string> batchNames;
+        for (size_t i = 0; i < files.size(); ++i) {
+            const std::string& filePath = files[i].first;
+            FileEntry& entry = entries[i];
+            entry.path = filePath;
+            entry.name = files[i].second.empty()
+                ? std::filesystem::path(filePath).filename().string()
+                : files[i].second;
+
+            std::string validationError;
+            if (!PathSecurity::ValidateStoredFilename(entry.name, &validationError)) {
+                return fail("Invalid archive filename '" + entry.name + "': " + validationError);
+            }
+            const auto existing = m_files.FindEquivalent(entry.name);
+            if (existing != m_files.end() && existing->first != entry.name) {
+                return fail("A file with an equivalent name already exists: " + entry.name);
+            }
+            if (!batchNames.insert(PathSecurity::CollisionKey(entry.name)).second) {
+                return fail("The batch names the same entry twice: " + entry.name);
+            }
+            if (Leased(entry.name)) {
+                return fail("The file is open for reading and cannot be replaced: " + entry.name);
             }
         }
 
-        // Check if file exists before trying to open it
-        if (!std::filesystem::exists(filePath)) {
-            std::cout << "File doesn't exist: " << filePath << std::endl;
-            std::cout << "-------------------------------------------" << std::endl;
-            return false;
+        // Sources larger than one ingest block are streamed into the container
+        // below instead of being read whole.
+        std::vector<bool> streamed(entries.size(), false);
+        bool streaming = false;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            std::error_code sizeError;
+            const uintmax_t sourceSize = std::filesystem::file_size(entries[i].path, sizeError);
+            streamed[i] = !sizeError && sourceSize > INGEST_BLOCK_SIZE;
+            streaming = streaming || streamed[i];
         }
-        
-        // Check if file is readable
-        if (!std::filesystem::is_regular_file(filePath)) {
-            std::cout << "Path is not a regular file: " << filePath << std::endl;
-            std::cout << "-------------------------------------------" << std::endl;
-            return false;
-        }
-        
-        std::error_code sizeError;
-        const uintmax_t rawFileSize = std::filesystem::file_size(filePath, sizeError);
-        if (sizeError || rawFileSize > MAX_ARCHIVE_ENTRY_SIZE ||
-            rawFileSize > static_cast<uintmax_t>(std::numeric_limits<size_t>::max()) ||
-            rawFileSize > static_cast<uintmax_t>(std::numeric_limits<std::streamsize>::max())) {
-            std::cout << "File exceeds the maximum archive entry size" << std::endl;
-            return false;
+
+        // Read and hash the other sources in parallel. Workers only touch their
+        // own entries; the first failure stops the others from starting new files.
+        std::vector<std::string> readErrors(entries.size());
+        std::atomic<bool> readFailed{false};
+        ArchiveStream::ParallelFor(entries.size(), [&](size_t i) {
+            if (streamed[i] || readFailed.load()) {
+                return true;
+            }
+            FileEntry& entry = entries[i];
+            try {
+                if (!ReadSourceFile(entry.path, entry.data, readErrors[i])) {
+                    readFailed = true;
+                    return false;
+                }
+                entry.size = entry.data.size();
+                entry.hash = CalculateFileHash(entry.data);
+            } catch (const std::exception& e) {
+                readErrors[i] = "Error reading file " + entry.path + ": " + e.what();
+                readFailed = true;
+                return false;
+            }
+            if (entry.hash.empty()) {
+                readErrors[i] = "Failed to hash file: " + entry.path;
+                readFailed = true;
+                return false;
+            }
+            return true;
+        });
+
+        const auto cleanseEntries = [&entries]() noexcept {
+            for (FileEntry& entry : entries) {
+                SecureMemory::Cleanse(entry.data);
+            }
+        };
+        if (readFailed) {
+            cleanseEntries();
+            const auto firstError = std::find_if(
+                readErrors.begin(), readErrors.end(),
+                [](const std::string& message) { return !message.empty(); });
+            return fail(firstError != readErrors.end() ? *firstError : "Failed to read files");
         }
 
-        // Read file data
-        std::ifstream file(filePath, std::ios::binary);
-        if (!file.is_open()) {
-            std::cout << "Failed to open file: " << filePath << std::endl;
-            std::cout << "Error state: " << strerror(errno) << std::endl;
-            std::cout << "-------------------------------------------" << std::endl;
-            return false;
+        // Streamed sources reach the container before they are staged; a
+        // container that cannot take appends yet is saved once first.
+        std::vector<std::vector<uint32_t>> ingested(entries.size());
+        if (streaming && !CanAppend() && !CommitArchive(false)) {
+            cleanseEntries();
+            return fail("Failed to prepare the archive for streamed files");
         }
-        
-        std::cout << "File opened successfully" << std::endl;
-        
-        const size_t fileSize = static_cast<size_t>(rawFileSize);
-        
-        std::cout << "File size: " << fileSize << " bytes" << std::endl;
-        
-        // Read file content
-        std::vector<uint8_t> fileData(fileSize);
-        SecureMemory::ScopedCleanse fileDataGuard(fileData);
-        if (fileSize > 0) {
-            file.read(reinterpret_cast<char*>(fileData.data()),
-                      static_cast<std::streamsize>(fileSize));
-        }
-        if (!file || file.gcount() != static_cast<std::streamsize>(fileSize)) {
-            std::cout << "Failed to read entire file. Only read " << file.gcount() << " bytes" << std::endl;
-            file.close();
-            std::cout << "-------------------------------------------" << std::endl;
-            return false;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            std::string ingestError;
+            if (streamed[i] && !IngestSource(entries[i], ingested[i], ingestError)) {
+                cleanseEntries();
+                return fail(ingestError);
+            }
         }
-        file.close();
-        
-        std::cout << "File read successfully" << std::endl;
-        
-        // Create file entry
-        FileEntry entry;
-        entry.name = entryName;
-        entry.path = filePath;
-        entry.size = fileSize;
-        entry.timestamp = GetCurrentTimestamp();
-        entry.hash = CalculateFileHash(fileData);
-        entry.data = std::move(fileData);
-        std::cout << "Entry created with name: " << entry.name << std::endl;
-        
-        // Keep a replaced entry until the new archive has been committed so a
-        // failed write can restore the exact in-memory state as well.
-        auto previousEntry = m_files.extract(entryName);
-        m_files[entryName] = std::move(entry);
-        
-        std::cout << "Added file to archive: " << entryName << " (" << fileSize << " bytes)" << std::endl;
-        std::cout << "Files in archive after adding: " << m_files.size() << std::endl;
-        
-        // Verify addition was successful
-        auto verifyIt = m_files.find(entryName);
-        if (verifyIt != m_files.end()) {
-            std::cout << "Verified: File '" << entryName << "' exists in archive" << std::endl;
-            std::cout << "Stored data size: " << verifyIt->second.data.size() << " bytes" << std::endl;
-        } else {
-            std::cout << "WARNING: Failed to verify file was added properly!" << std::endl;
+
+        // Stage the whole batch, keeping replaced entries and segment lists
+        // until the commit so a failed write restores the exact in-memory
+        // state as well.
+        const std::string timestamp = GetCurrentTimestamp();
+        std::vector<decltype(m_files)::node_type> previousEntries;
+        previousEntries.reserve(entries.size());
+        std::vector<decltype(m_container.entries)::node_type> previousSegments;
+        std::vector<std::string> stagedNames;
+        stagedNames.reserve(entries.size());
+        // Names an earlier deferred batch staged stay staged on rollback.
+        std::vector<std::string> newlyStaged;
+        uint64_t batchBytes = 0;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            FileEntry& entry = entries[i];
+            auto previousEntry = m_files.extract(entry.name);
+            if (!previousEntry.empty()) {
+                previousEntries.push_back(std::move(previousEntry));
+            }
+            if (streamed[i]) {
+                auto previousStored = m_container.entries.extract(entry.name);
+                if (!previousStored.empty()) {
+                    previousSegments.push_back(std::move(previousStored));
+                }
+                m_container.entries.emplace(entry.name, std::move(ingested[i]));
+            }
+            entry.timestamp = timestamp;
+            batchBytes += entry.size;
+            if (m_stagedNames.insert(entry.name).second) {
+                newlyStaged.push_back(entry.name);
+            }
+            stagedNames.push_back(entry.name);
+            m_files.insert(stagedNames.back(), std::move(entry));
         }
-        
-        // Save the archive to ensure the file is persisted
-        std::cout << "Saving archive after adding file..." << std::endl;
-        bool saveResult = SaveArchive();
-        if (!saveResult) {
-            std::cout << "WARNING: Failed to save archive after adding file!" << std::endl;
-            auto failedEntry = m_files.extract(entryName);
-            if (!failedEntry.empty()) {
-                SecureMemory::Cleanse(failedEntry.mapped().data);
+        if (DeferredCommitEnabled()) {
+            for (auto& previousEntry : previousEntries) {
+                SecureMemory::Cleanse(previousEntry.mapped().data);
             }
-            if (!previousEntry.empty()) {
+            MarkDirty(stagedNames.size());
+            PQC_LOG_INFO(LOG_MODULE) << "Staged " << stagedNames.size() << " file(s), " << batchBytes
+                                     << " bytes; commit deferred";
+            return true;
+        }
+        PQC_LOG_INFO(LOG_MODULE) << "Staged " << entries.size() << " file(s), " << batchBytes
+                                 << " bytes; saving archive once for the batch";
+
+        if (!SaveArchive()) {
+            for (size_t i = 0; i < stagedNames.size(); ++i) {
+                auto failedEntry = m_files.extract(stagedNames[i]);
+                if (!failedEntry.empty()) {
+                    SecureMemory::Cleanse(failedEntry.mapped().data);
+                }
+                if (streamed[i]) {
+                    m_container.entries.erase(stagedNames[i]);
+                }
+            }
+            for (auto& previousEntry : previousEntries) {
                 m_files.insert(std::move(previousEntry));
             }
-        } else if (!previousEntry.empty()) {
+            for (auto& previousStored : previousSegments) {
+                m_container.entries.insert(std::move(previousStored));
+            }
+            for (const auto& name : newlyStaged) {
+                m_stagedNames.erase(name);
+            }
+            return fail("Failed to save archive after adding files; the batch was rolled back");
+        }
+        for (auto& previousEntry : previousEntries) {
             SecureMemory::Cleanse(previousEntry.mapped().data);
         }
-        
-        std::cout << "-------------------------------------------" << std::endl;
-        return saveResult;
+
+        PQC_LOG_INFO(LOG_MODULE) << "Added " << entries.size() << " file(s); files in archive: "
+                                 << m_files.size();
+        return true;
     } catch (const std::exception& e) {
-        std::cout << "Error adding file to archive: " << e.what() << std::endl;
-        std::cout << "-------------------------------------------" << std::endl;
-        return false;
+        return fail(std::string("Error adding files to archive: ") + e.what());
     }
 }
 
 bool CryptoArchive::ExtractFile(const std::string& name, const std::string& outputPath) {
-    std::cout << "\n---------- EXTRACT FILE ----------" << std::endl;
-    std::cout << "Extracting file: '" << name << "' to path: '" << outputPath << "'" << std::endl;
+    const StateLock stateLock(m_stateMutex);
+    const Metrics::ScopedTimer timer(Metrics::Stage::Extract);
+    PQC_LOG_DEBUG(LOG_MODULE) << "---------- EXTRACT FILE ----------";
+    PQC_LOG_DEBUG(LOG_MODULE) << "Extracting file: '" << name << "' to path: '" << outputPath << "'";
     
     if (!m_identityValid || !m_isLoaded ||
         !PathSecurity::ValidateStoredFilename(name) || outputPath.empty()) {
-        std::cout << "Archive not loaded!" << std::endl;
-        std::cout << "----------------------------------\n" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Archive not loaded!";
         return false;
     }
     
-    // Diagnosticarea completă a arhivei pentru a vedea starea sa
-    DiagnoseArchive();
+    PQC_LOG_DEBUG(LOG_MODULE) << "Searching for file '" << name << "' in archive...";
+    PQC_LOG_DEBUG(LOG_MODULE) << "Number of files in archive: " << m_files.size();
     
-    std::cout << "Searching for file '" << name << "' in archive..." << std::endl;
-    std::cout << "Number of files in archive: " << m_files.size() << std::endl;
-    
-    // Debugging - list all files in archive
-    std::cout << "Files in archive:" << std::endl;
-    for (const auto& file : m_files) {
-        std::cout << "  - '" << file.first << "' (size: " << file.second.data.size() << " bytes)" << std::endl;
+    // Debugging - list all files in archive; skip the walk when nobody reads it
+    if (Log::Enabled(Log::Level::Debug, LOG_MODULE)) {
+        PQC_LOG_DEBUG(LOG_MODULE) << "Files in archive:";
+        for (const auto& file : m_files) {
+            PQC_LOG_DEBUG(LOG_MODULE) << "  - '" << file.first << "' (size: " << file.second.size
+                                      << " bytes)";
+        }
     }
     
     // Căutare explicită, caz-insensitivă pentru mai multă reziliență
@@ -922,96 +2659,130 @@ bool CryptoArchive::ExtractFile(const std::string& name, const std::string& outp
     auto it = m_files.find(name);
     if (it != m_files.end()) {
         foundEntry = &(it->second);
-        std::cout << "File found with exact match: '" << name << "'" << std::endl;
+        PQC_LOG_DEBUG(LOG_MODULE) << "File found with exact match: '" << name << "'";
     } else {
-        // A doua încercare - verifică toate cheile, poate există diferențe de majuscule/minuscule
-        for (const auto& file : m_files) {
-            if (PathSecurity::NamesCollide(file.first, name)) {
-                foundEntry = &(file.second);
-                std::cout << "File found with case-insensitive match. Requested: '" << name 
-                          << "', Found: '" << file.first << "'" << std::endl;
-                break;
-            }
+        // A doua încercare - numele echivalent după normalizarea majusculelor
+        it = m_files.FindEquivalent(name);
+        if (it != m_files.end()) {
+            foundEntry = &(it->second);
+            PQC_LOG_DEBUG(LOG_MODULE) << "File found with case-insensitive match. Requested: '" << name
+                                      << "', Found: '" << it->first << "'";
         }
     }
     
     if (!foundEntry) {
-        std::cout << "File not found in archive: '" << name << "'" << std::endl;
-        std::cout << "----------------------------------\n" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "File not found in archive: '" << name << "'";
         return false;
     }
     
-    std::cout << "File found! Size: " << foundEntry->data.size() << " bytes" << std::endl;
-    std::cout << "File data empty? " << (foundEntry->data.empty() ? "Yes" : "No") << std::endl;
+    PQC_LOG_DEBUG(LOG_MODULE) << "File found! Size: " << foundEntry->size << " bytes";
+    if (!MatchesSealedLeaf(it->first, *foundEntry)) {
+        PQC_LOG_ERROR(LOG_MODULE) << "File metadata does not match the sealed index";
+        return false;
+    }
     
     try {
         std::filesystem::path finalPath;
         std::string validationError;
         if (!PathSecurity::ResolveExtractionPath(outputPath, foundEntry->name,
                                                  finalPath, &validationError)) {
-            std::cout << "Unsafe extraction path: " << validationError << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "Unsafe extraction path: " << validationError;
             return false;
         }
         
         // Create parent directories if they don't exist
         std::filesystem::path parentPath = finalPath.parent_path();
         if (!parentPath.empty()) {
-            std::cout << "Creating parent directories: " << parentPath << std::endl;
+            PQC_LOG_DEBUG(LOG_MODULE) << "Creating parent directories: " << parentPath;
             try {
                 std::filesystem::create_directories(parentPath);
             } catch (const std::exception& e) {
-                std::cout << "Failed to create directories: " << e.what() << std::endl;
+                PQC_LOG_ERROR(LOG_MODULE) << "Failed to create directories: " << e.what();
             }
         }
         
-        std::cout << "Writing " << foundEntry->data.size() << " bytes to file..." << std::endl;
-        if (!AtomicFile::Write(finalPath, foundEntry->data)) {
-            std::cout << "ERROR: Failed to atomically write extracted file!" << std::endl;
-            std::cout << "----------------------------------\n" << std::endl;
+        // Only this entry is decrypted, one bounded batch at a time, straight
+        // into the temporary file and through SHA-256. The destination is
+        // replaced only after the last chunk authenticated and the digest
+        // matched the one recorded when the file was added. The container is
+        // read through positional reads rather than a mapping, whose pages
+        // would stay resident for the size of the entry.
+        std::ifstream container;
+        ArchiveStream::ReadAt readAt;
+        if (foundEntry->data.size() != foundEntry->size) {
+            container.open(m_container.path, std::ios::binary);
+            if (!container.is_open()) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Could not open archive for reading";
+                return false;
+            }
+            readAt = FileReadAt(container);
+        }
+        PQC_LOG_DEBUG(LOG_MODULE) << "Writing " << foundEntry->size << " bytes to file...";
+        bool authenticated = false;
+        const bool written = AtomicFile::WriteStreamed(
+            finalPath, [&](const AtomicFile::ChunkWriter& writer) {
+                RevisionDigest digest;
+                uint64_t streamed = 0;
+                std::string hash;
+                authenticated =
+                    StreamEntryPayload(*foundEntry, m_container, readAt,
+                                       [&](const uint8_t* data, size_t size) {
+                                           streamed += size;
+                                           return digest.Update(data, size) &&
+                                                  writer(data, size);
+                                       },
+                                       nullptr, EXTRACT_BATCH_SIZE) &&
+                    digest.Finish(hash) && streamed == foundEntry->size &&
+                    hash == foundEntry->hash;
+                return authenticated;
+            });
+        if (!authenticated) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Failed to authenticate the stored file data!";
+            return false;
+        }
+        if (!written) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Failed to atomically write extracted file!";
             return false;
         }
         
         // Verify the file was written successfully
         if (std::filesystem::exists(finalPath)) {
             auto fileSize = std::filesystem::file_size(finalPath);
-            std::cout << "File successfully written. Size on disk: " << fileSize << " bytes" << std::endl;
-            if (fileSize != foundEntry->data.size()) {
-                std::cout << "WARNING: File size mismatch between disk (" << fileSize << ") and memory (" 
-                          << foundEntry->data.size() << ")!" << std::endl;
+            PQC_LOG_DEBUG(LOG_MODULE) << "File successfully written. Size on disk: " << fileSize
+                                      << " bytes";
+            if (fileSize != foundEntry->size) {
+                PQC_LOG_WARN(LOG_MODULE) << "File size mismatch between disk (" << fileSize
+                                         << ") and archive (" << foundEntry->size << ")!";
             }
         } else {
-            std::cout << "WARNING: File doesn't exist after writing!" << std::endl;
+            PQC_LOG_WARN(LOG_MODULE) << "File doesn't exist after writing!";
         }
         
-        std::cout << "Extracted file: '" << name << "' to '" << finalPath << "'" << std::endl;
-        std::cout << "----------------------------------\n" << std::endl;
+        PQC_LOG_DEBUG(LOG_MODULE) << "Extracted file: '" << name << "' to '" << finalPath << "'";
         return true;
     } catch (const std::exception& e) {
-        std::cout << "Error extracting file: " << e.what() << std::endl;
-        std::cout << "----------------------------------\n" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Error extracting file: " << e.what();
         return false;
     }
 }
 
 bool CryptoArchive::ExtractFileToMemory(const std::string& name, std::vector<uint8_t>& outData) {
-    std::cout << "\n---------- EXTRACT FILE TO MEMORY ----------" << std::endl;
-    std::cout << "ExtractFileToMemory called for file: '" << name << "'" << std::endl;
+    const StateLock stateLock(m_stateMutex);
+    const Metrics::ScopedTimer timer(Metrics::Stage::Extract);
+    PQC_LOG_DEBUG(LOG_MODULE) << "---------- EXTRACT FILE TO MEMORY ----------";
+    PQC_LOG_DEBUG(LOG_MODULE) << "ExtractFileToMemory called for file: '" << name << "'";
     
     if (!m_identityValid || !m_isLoaded ||
         !PathSecurity::ValidateStoredFilename(name)) {
-        std::cerr << "Archive not loaded!" << std::endl;
-        std::cout << "------------------------------------------\n" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Archive not loaded!";
         return false;
     }
     
     // Ensure outData is empty initially
     outData.clear();
     
-    // Diagnosticarea completă a arhivei pentru a vedea starea sa
-    DiagnoseArchive();
-    
     // Detailed debug information
-    std::cout << "Looking for file: '" << name << "'" << std::endl;
+    PQC_LOG_DEBUG(LOG_MODULE) << "Looking for file: '" << name << "'";
     
     // Căutare explicită, caz-insensitivă pentru mai multă reziliență
     const FileEntry* foundEntry = nullptr;
@@ -1019,51 +2790,55 @@ bool CryptoArchive::ExtractFileToMemory(const std::string& name, std::vector<uin
     auto it = m_files.find(name);
     if (it != m_files.end()) {
         foundEntry = &(it->second);
-        std::cout << "File found with exact match: '" << name << "'" << std::endl;
+        PQC_LOG_DEBUG(LOG_MODULE) << "File found with exact match: '" << name << "'";
     } else {
-        // A doua încercare - verifică toate cheile, poate există diferențe de majuscule/minuscule
-        for (const auto& file : m_files) {
-            if (PathSecurity::NamesCollide(file.first, name)) {
-                foundEntry = &(file.second);
-                std::cout << "File found with case-insensitive match. Requested: '" << name 
-                          << "', Found: '" << file.first << "'" << std::endl;
-                break;
-            }
+        // A doua încercare - numele echivalent după normalizarea majusculelor
+        it = m_files.FindEquivalent(name);
+        if (it != m_files.end()) {
+            foundEntry = &(it->second);
+            PQC_LOG_DEBUG(LOG_MODULE) << "File found with case-insensitive match. Requested: '" << name
+                                      << "', Found: '" << it->first << "'";
         }
     }
     
     if (!foundEntry) {
-        std::cerr << "File not found: '" << name << "'" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "File not found: '" << name << "'";
         
         // Print all file names to help debug
-        std::cout << "Available files in archive:" << std::endl;
+        PQC_LOG_DEBUG(LOG_MODULE) << "Available files in archive:";
         for (const auto& file : m_files) {
-            std::cout << "  - '" << file.first << "' (size: " << file.second.data.size() << " bytes)" << std::endl;
+            PQC_LOG_DEBUG(LOG_MODULE) << "  - '" << file.first << "' (size: "
+                                      << file.second.size << " bytes)";
         }
         
-        std::cout << "------------------------------------------\n" << std::endl;
         return false;
     }
     
-    std::cout << "File found! Name: " << foundEntry->name << ", Size: " << foundEntry->data.size() << " bytes" << std::endl;
-    std::cout << "File data empty? " << (foundEntry->data.empty() ? "Yes" : "No") << std::endl;
+    PQC_LOG_DEBUG(LOG_MODULE) << "File found! Name: " << foundEntry->name << ", Size: "
+                              << foundEntry->size << " bytes";
+    if (!MatchesSealedLeaf(it->first, *foundEntry)) {
+        PQC_LOG_ERROR(LOG_MODULE) << "File metadata does not match the sealed index";
+        return false;
+    }
     
     try {
-        // Copiază datele fișierului în buffer-ul de ieșire
-        outData = foundEntry->data;
+        // Copiază sau decriptează doar datele acestui fișier în buffer-ul de ieșire
+        if (!LoadEntryPayload(*foundEntry, outData)) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Stored file data failed authentication";
+            return false;
+        }
         
-        std::cout << "Data copied to output buffer, size: " << outData.size() << " bytes" << std::endl;
+        PQC_LOG_DEBUG(LOG_MODULE) << "Data copied to output buffer, size: " << outData.size() << " bytes";
         
-        std::cout << "------------------------------------------\n" << std::endl;
         return true;
     } catch (const std::exception& e) {
-        std::cerr << "Exception during data copy: " << e.what() << std::endl;
-        std::cout << "------------------------------------------\n" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Exception during data copy: " << e.what();
         return false;
     }
 }
 
 bool CryptoArchive::RemoveFile(const std::string& name) {
+    const StateLock stateLock(m_stateMutex);
     if (!m_identityValid || !m_isLoaded ||
         !PathSecurity::ValidateStoredFilename(name)) {
         return false;
@@ -1073,20 +2848,31 @@ bool CryptoArchive::RemoveFile(const std::string& name) {
     if (it == m_files.end()) {
         return false;
     }
+    if (Leased(name)) {
+        PQC_LOG_ERROR(LOG_MODULE) << "The file is open for reading and cannot be removed: " << name;
+        return false;
+    }
     
     auto removedEntry = m_files.extract(it);
+    if (DeferredCommitEnabled()) {
+        SecureMemory::Cleanse(removedEntry.mapped().data);
+        MarkDirty(1);
+        PQC_LOG_INFO(LOG_MODULE) << "Removed file from archive (commit deferred): " << name;
+        return true;
+    }
     if (!SaveArchive()) {
         m_files.insert(std::move(removedEntry));
-        std::cerr << "Failed to persist removal; archive state was restored" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to persist removal; archive state was restored";
         return false;
     }
 
     SecureMemory::Cleanse(removedEntry.mapped().data);
-    std::cout << "Removed file from archive: " << name << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "Removed file from archive: " << name;
     return true;
 }
 
 std::vector<FileEntry> CryptoArchive::GetFileList() const {
+    const StateLock stateLock(m_stateMutex);
     std::vector<FileEntry> fileList;
     for (const auto& pair : m_files) {
         FileEntry metadata;
@@ -1101,23 +2887,96 @@ std::vector<FileEntry> CryptoArchive::GetFileList() const {
 }
 
 std::vector<uint8_t> CryptoArchive::GetFileData(const std::string& name) const {
+    const StateLock stateLock(m_stateMutex);
     if (!m_isLoaded) {
         return {};
     }
     
     auto it = m_files.find(name);
-    if (it == m_files.end()) {
+    if (it == m_files.end() || !MatchesSealedLeaf(it->first, it->second)) {
+        return {};
+    }
+    
+    std::vector<uint8_t> data;
+    if (!LoadEntryPayload(it->second, data)) {
         return {};
     }
-    
-    return it->second.data;
+    return data;
+}
+
+CryptoArchive::EntryLease CryptoArchive::LeaseEntry(const std::string& name,
+                                                    bool terminated) const {
+    const StateLock stateLock(m_stateMutex);
+    EntryLease lease;
+    const auto it = m_files.find(name);
+    if (!m_isLoaded || it == m_files.end() || !MatchesSealedLeaf(it->first, it->second)) {
+        return lease;
+    }
+    const FileEntry& entry = it->second;
+    if (entry.data.size() == entry.size && !terminated) {
+        lease.m_data = entry.data.data();
+    } else {
+        // Reserved up front so the terminator does not move the payload.
+        lease.m_buffer.reserve(entry.size + (terminated ? 1 : 0));
+        if (!LoadEntryPayload(entry, lease.m_buffer)) {
+            return lease;
+        }
+        if (terminated) {
+            lease.m_buffer.push_back(0);
+        }
+        lease.m_data = lease.m_buffer.data();
+    }
+    lease.m_size = entry.size;
+    lease.m_name = name;
+    lease.m_owner = this;
+    ++m_leases[name];
+    return lease;
+}
+
+CryptoArchive::EntryLease::EntryLease(EntryLease&& other) noexcept {
+    *this = std::move(other);
+}
+
+CryptoArchive::EntryLease& CryptoArchive::EntryLease::operator=(EntryLease&& other) noexcept {
+    if (this != &other) {
+        Release();
+        m_owner = std::exchange(other.m_owner, nullptr);
+        m_name = std::move(other.m_name);
+        m_buffer = std::move(other.m_buffer);
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        other.m_name.clear();
+        other.m_buffer.clear();
+    }
+    return *this;
+}
+
+CryptoArchive::EntryLease::~EntryLease() {
+    Release();
+}
+
+void CryptoArchive::EntryLease::Release() noexcept {
+    if (m_owner != nullptr) {
+        const StateLock stateLock(m_owner->m_stateMutex);
+        const auto pinned = m_owner->m_leases.find(m_name);
+        if (pinned != m_owner->m_leases.end() && --pinned->second == 0) {
+            m_owner->m_leases.erase(pinned);
+        }
+    }
+    SecureMemory::SecureBytes().swap(m_buffer);
+    m_owner = nullptr;
+    m_name.clear();
+    m_data = nullptr;
+    m_size = 0;
 }
 
 bool CryptoArchive::ArchiveExists() const {
+    const StateLock stateLock(m_stateMutex);
     return m_identityValid && std::filesystem::is_regular_file(m_archivePath);
 }
 
 CryptoArchive::ArchiveStats CryptoArchive::GetStats() const {
+    const StateLock stateLock(m_stateMutex);
     ArchiveStats stats;
     stats.totalFiles = m_files.size();
     stats.totalSize = 0;
@@ -1125,356 +2984,836 @@ CryptoArchive::ArchiveStats CryptoArchive::GetStats() const {
         ? FormatFileModificationTime(m_archivePath)
         : "Unavailable";
     
+    stats.storedSize = 0;
+    stats.physicalSize = 0;
+    std::vector<bool> counted(m_container.blobs.size(), false);
     for (const auto& pair : m_files) {
         stats.totalSize += pair.second.size;
+        const auto stored = m_container.entries.find(pair.first);
+        if (!pair.second.data.empty() || stored == m_container.entries.end()) {
+            stats.storedSize += pair.second.size;
+            stats.physicalSize += pair.second.size;
+            continue;
+        }
+        for (const uint32_t blob : stored->second) {
+            stats.storedSize += m_container.blobs[blob].storedSize;
+            if (!counted[blob]) {
+                counted[blob] = true;
+                stats.physicalSize += m_container.blobs[blob].storedSize;
+            }
+        }
+    }
+    const ArchiveIndex::Digest noRoot{};
+    if (m_container.integrityRoot != noRoot) {
+        stats.integrityRoot =
+            HexEncode(m_container.integrityRoot.data(), m_container.integrityRoot.size());
     }
+    stats.compressionRatio = stats.storedSize == 0
+        ? 1.0
+        : static_cast<double>(stats.totalSize) / static_cast<double>(stats.storedSize);
     
     return stats;
 }
 
-bool CryptoArchive::VerifyIntegrity() const {
+void CryptoArchive::SetCacheBudget(size_t bytes) {
+    m_cache.SetBudget(bytes);
+}
+
+ArchiveCache::Stats CryptoArchive::GetCacheStats() const {
+    return m_cache.GetStats();
+}
+
+void CryptoArchive::SetCompression(bool enabled) {
+    const StateLock stateLock(m_stateMutex);
+    m_compressionEnabled = enabled;
+}
+
+CryptoArchive::KeyDerivationStats CryptoArchive::GetKeyDerivationStats() const {
+    KeyDerivationStats stats;
+    stats.scryptRuns = m_scryptRuns.load();
+    stats.scryptRunsAvoided = m_scryptRunsAvoided.load();
+    const StateLock stateLock(m_stateMutex);
+    stats.scrypt = m_container.key.empty() ? KeyDerivation::PreferredScrypt()
+                                           : m_container.scrypt;
+    return stats;
+}
+
+CryptoArchive::StorageStats CryptoArchive::GetStorageStats() const {
+    const StateLock stateLock(m_stateMutex);
+    StorageStats stats;
+    stats.containerSize = m_container.size;
+    stats.liveSize = m_container.liveSize;
+    stats.appendedCommits = m_appendedCommits;
+    stats.compactions = m_compactions;
+    stats.revisionMetadataChecks = m_revisionMetadataChecks;
+    stats.revisionReads = m_revisionReads;
+    return stats;
+}
+
+CryptoArchive::IntegrityReport CryptoArchive::CheckIntegrity(
+    const ProgressCallback& progress) const {
+    const StateLock stateLock(m_stateMutex);
     if (!m_isLoaded) {
+        return IntegrityReport{};
+    }
+    std::vector<std::pair<const std::string*, const FileEntry*>> files;
+    files.reserve(m_files.size());
+    for (const auto& [name, entry] : m_files) {
+        files.emplace_back(&name, &entry);
+    }
+    return CheckEntries(files, progress);
+}
+
+CryptoArchive::IntegrityReport CryptoArchive::ScrubIntegrity(size_t maxEntries) {
+    const StateLock stateLock(m_stateMutex);
+    if (!m_isLoaded || m_files.empty() || maxEntries == 0) {
+        return IntegrityReport{};
+    }
+    std::vector<std::pair<const std::string*, const FileEntry*>> files;
+    auto next = m_files.lower_bound(m_scrubCursor);
+    while (files.size() < std::min(maxEntries, m_files.size())) {
+        if (next == m_files.end()) {
+            next = m_files.begin();
+        }
+        files.emplace_back(&next->first, &next->second);
+        ++next;
+    }
+    m_scrubCursor = next != m_files.end() ? next->first : std::string();
+    return CheckEntries(files, nullptr);
+}
+
+bool CryptoArchive::VerifyEntry(const std::string& name) const {
+    const StateLock stateLock(m_stateMutex);
+    const auto found = m_files.find(name);
+    if (!m_isLoaded || found == m_files.end()) {
         return false;
     }
-    
-    for (const auto& pair : m_files) {
-        const FileEntry& entry = pair.second;
-        std::string calculatedHash = CalculateFileHash(entry.data);
-        if (calculatedHash != entry.hash) {
-            std::cout << "Integrity check failed for file: " << entry.name << std::endl;
-            return false;
+    return CheckEntries({{&found->first, &found->second}}, nullptr).failures == 0;
+}
+
+bool CryptoArchiveTesting::ReplaceSealedLeaf(CryptoArchive& archive, const std::string& name) {
+    const CryptoArchive::StateLock stateLock(archive.m_stateMutex);
+    const auto leaf = archive.m_container.leaves.find(name);
+    return leaf != archive.m_container.leaves.end() &&
+           archive.m_container.merkle.Update(
+               leaf->second, ArchiveMerkle::LeafHash(name, 0, "replaced"));
+}
+
+bool CryptoArchive::MatchesSealedLeaf(const std::string& name, const FileEntry& entry) const {
+    const auto leaf = m_container.leaves.find(name);
+    if (leaf == m_container.leaves.end() || m_stagedNames.count(name) != 0) {
+        return true;
+    }
+    // The tree was rebuilt from the authenticated index at load, so the leaf
+    // comparison catches metadata that drifted since; the path ties that
+    // leaf to the root the index sealed.
+    const ArchiveMerkle::Hash recorded = ArchiveMerkle::LeafHash(name, entry.size, entry.hash);
+    return recorded == m_container.merkle.Leaf(leaf->second) &&
+           ArchiveMerkle::VerifyPath(recorded, m_container.merkle.Path(leaf->second),
+                                     m_container.integrityRoot);
+}
+
+CryptoArchive::IntegrityReport CryptoArchive::CheckEntries(
+    const std::vector<std::pair<const std::string*, const FileEntry*>>& files,
+    const ProgressCallback& progress) const {
+    IntegrityReport report{};
+    report.entries.resize(files.size());
+
+    // Entries are checked in parallel, each one streamed through SHA-256 in
+    // batches of at most EXTRACT_BATCH_SIZE, so memory depends on the thread
+    // count rather than on the entry sizes.
+    MappedFile mapping;
+    std::ifstream container;
+    std::mutex readMutex;
+    ArchiveStream::ReadAt readAt;
+    if (!m_container.path.empty() && !mapping.Open(m_container.path)) {
+        container.open(m_container.path, std::ios::binary);
+        if (container.is_open()) {
+            readAt = LockedReadAt(FileReadAt(container), readMutex);
         }
     }
-    
-    return true;
+    const MappedFile* view = mapping.valid() ? &mapping : nullptr;
+    std::mutex progressMutex;
+    size_t checked = 0;
+    ArchiveStream::ParallelFor(files.size(), [&](size_t i) {
+        const std::string& name = *files[i].first;
+        const FileEntry& entry = *files[i].second;
+        EntryCheck& check = report.entries[i];
+        check.name = name;
+        check.status = EntryStatus::Unreadable;
+        check.expectedSize = entry.size;
+        check.actualSize = 0;
+
+        const bool inRoot = MatchesSealedLeaf(name, entry);
+
+        RevisionDigest digest;
+        uint64_t streamed = 0;
+        const ArchiveStream::Sink sink = [&](const uint8_t* data, size_t size) {
+            streamed += size;
+            return digest.Update(data, size);
+        };
+        // A payload held in memory whose size disagrees with the recorded
+        // one is hashed as it is.
+        const bool stored = entry.data.empty() && m_container.entries.count(name) != 0;
+        const bool readable =
+            !stored && entry.data.size() != entry.size
+                ? entry.data.empty() || sink(entry.data.data(), entry.data.size())
+                : StreamEntryPayload(entry, m_container, readAt, sink, view, EXTRACT_BATCH_SIZE);
+        if (readable && digest.Finish(check.actualHash)) {
+            check.actualSize = streamed;
+            if (streamed != entry.size) {
+                check.status = EntryStatus::SizeMismatch;
+            } else if (check.actualHash != entry.hash || !inRoot) {
+                check.status = EntryStatus::HashMismatch;
+            } else {
+                check.status = EntryStatus::Ok;
+            }
+        }
+        if (progress) {
+            const std::lock_guard<std::mutex> lock(progressMutex);
+            progress(++checked, files.size());
+        }
+        return true;
+    });
+
+    for (const EntryCheck& check : report.entries) {
+        if (check.status == EntryStatus::Ok) {
+            continue;
+        }
+        ++report.failures;
+        PQC_LOG_ERROR(LOG_MODULE) << "Integrity check failed for file: " << check.name << " ("
+                                  << (check.status == EntryStatus::SizeMismatch   ? "size mismatch"
+                                      : check.status == EntryStatus::HashMismatch ? "hash mismatch"
+                                                                                  : "unreadable")
+                                  << ")";
+    }
+    PQC_LOG_INFO(LOG_MODULE) << "Checked " << report.entries.size() << " file(s), " << report.failures
+                             << " failed";
+    return report;
 }
 
-std::vector<uint8_t> CryptoArchive::DecryptArchiveData(const std::string& password,
-                                                       bool* legacyFormat,
-                                                       std::string* diskRevision) const {
+bool CryptoArchive::VerifyIntegrity() const {
+    const StateLock stateLock(m_stateMutex);
+    return m_isLoaded && CheckIntegrity().failures == 0;
+}
+
+bool CryptoArchive::ReadContainer(const ArchiveStream::ReadAt& readAt,
+                                  uint64_t containerSize,
+                                  const std::string& password,
+                                  EntryTable& files,
+                                  ContainerState& state,
+                                  bool* legacyFormat,
+                                  std::string* revision) const {
+    files.Cleanse();
+    state.Clear();
     if (legacyFormat) {
         *legacyFormat = false;
     }
-    if (diskRevision) {
-        diskRevision->clear();
+    if (revision) {
+        revision->clear();
+    }
+
+    std::array<uint8_t, 8> magic{};
+    if (password.empty() || containerSize < magic.size() ||
+        !readAt(0, magic.data(), magic.size())) {
+        return false;
+    }
+
+    RevisionDigest digest;
+    RevisionDigest* revisionDigest = revision != nullptr ? &digest : nullptr;
+    if (magic != INDEXED_ARCHIVE_MAGIC && magic != LOG_ARCHIVE_MAGIC) {
+        if (magic == SECURE_ARCHIVE_MAGIC || magic == STREAMED_ARCHIVE_MAGIC) {
+            ++m_scryptRuns;
+        }
+        uint64_t position = 0;
+        const bool opened = OpenArchiveContainer(
+            SequentialSource(readAt, position, revisionDigest), containerSize, password,
+            [this, &files](const ArchiveStream::Source& payload, uint64_t payloadSize) {
+                PQC_LOG_INFO(LOG_MODULE) << "Deserializing archive data...";
+                return DeserializeArchive(payload, payloadSize, files);
+            },
+            legacyFormat);
+        if (!opened || position != containerSize ||
+            (revision != nullptr && !digest.Finish(*revision))) {
+            files.Cleanse();
+            return false;
+        }
+        return true;
+    }
+
+    const ContainerKeyDerivation deriveKey =
+        [this, &password](const std::vector<uint8_t>& salt,
+                          const KeyDerivation::ScryptParameters& scrypt,
+                          SecureMemory::SecureBytes& key) {
+            ++m_scryptRuns;
+            return DeriveScryptKey(password, salt, scrypt, key);
+        };
+    const bool logStructured = magic == LOG_ARCHIVE_MAGIC;
+    OpenedIndex opened;
+    const bool authenticated =
+        logStructured
+            ? OpenLogContainer(readAt, containerSize, deriveKey, state.salt, state.scrypt,
+                               state.key, revisionDigest, opened)
+            : OpenIndexedContainer(readAt, containerSize, deriveKey, state.salt,
+                                   state.scrypt, state.key, revisionDigest, opened);
+    if (!authenticated) {
+        state.Clear();
+        return false;
+    }
+    ArchiveIndex::Index& index = opened.index;
+    for (const ArchiveIndex::Segment& segment : index.segments) {
+        if (!ArchiveCodec::IsKnown(segment.codec)) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Unsupported codec in encrypted archive index";
+            state.Clear();
+            return false;
+        }
+    }
+
+    // Indexes written before the integrity root have none; theirs is
+    // computed here and sealed by the next commit.
+    ArchiveMerkle::Tree merkle;
+    merkle.Build(IntegrityLeaves(index));
+    const ArchiveIndex::Digest noRoot{};
+    if (index.integrityRoot == noRoot) {
+        index.integrityRoot = merkle.Root();
+    } else if (index.integrityRoot != merkle.Root()) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Archive integrity root does not match its entries";
+        state.Clear();
+        return false;
+    }
+
+    for (ArchiveIndex::Entry& entry : index.entries) {
+        if (!PathSecurity::ValidateStoredFilename(entry.name) ||
+            entry.size > MAX_STREAMED_ARCHIVE_SIZE) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Unsafe entry in encrypted archive index";
+            files.Cleanse();
+            state.Clear();
+            return false;
+        }
+        if (files.FindEquivalent(entry.name) != files.end()) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Colliding filenames in encrypted archive";
+            files.Cleanse();
+            state.Clear();
+            return false;
+        }
+
+        FileEntry file;
+        file.name = entry.name;
+        file.size = static_cast<size_t>(entry.size);
+        file.timestamp = std::move(entry.timestamp);
+        file.hash = std::move(entry.hash);
+        files.insert(entry.name, std::move(file));
+    }
+    state.Adopt(index, std::move(merkle));
+    state.chunkSize = opened.chunkSize;
+    state.size = containerSize;
+    state.liveSize = containerSize;
+    if (logStructured) {
+        state.appendable = true;
+        state.activeSlot = opened.activeSlot;
+        state.generation = opened.generation;
+        state.liveSize = LiveContainerSize(index, opened.indexSize, opened.chunkSize);
+    }
+
+    if (revision != nullptr && !digest.Finish(*revision)) {
+        files.Cleanse();
+        state.Clear();
+        return false;
     }
+    return true;
+}
 
+bool CryptoArchive::ReadArchiveFile(const std::string& password,
+                                    EntryTable& files,
+                                    ContainerState& state,
+                                    bool* legacyFormat,
+                                    std::string* revision) const {
     if (password.empty()) {
-        std::cerr << "Archive password cannot be empty" << std::endl;
-        return {};
+        PQC_LOG_ERROR(LOG_MODULE) << "Archive password cannot be empty";
+        return false;
     }
 
     try {
         std::ifstream file(m_archivePath, std::ios::binary);
         if (!file.is_open()) {
-            std::cerr << "Could not open archive for reading" << std::endl;
-            return {};
+            PQC_LOG_ERROR(LOG_MODULE) << "Could not open archive for reading";
+            return false;
         }
 
         file.seekg(0, std::ios::end);
         const std::streamoff endPosition = file.tellg();
         if (endPosition <= 0 ||
-            static_cast<uint64_t>(endPosition) > MAX_ARCHIVE_CONTAINER_SIZE) {
-            std::cerr << "Archive is empty or unreadable" << std::endl;
-            return {};
+            static_cast<uint64_t>(endPosition) > MAX_STREAMED_ARCHIVE_SIZE) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Archive is empty or unreadable";
+            return false;
         }
-        file.seekg(0, std::ios::beg);
 
-        const size_t fileSize = static_cast<size_t>(endPosition);
-        std::vector<uint8_t> archiveData(fileSize);
-        file.read(reinterpret_cast<char*>(archiveData.data()),
-                  static_cast<std::streamsize>(archiveData.size()));
-        if (!file || file.gcount() != static_cast<std::streamsize>(archiveData.size())) {
-            std::cerr << "Failed to read complete archive" << std::endl;
-            return {};
+        if (!ReadContainer(FileReadAt(file), static_cast<uint64_t>(endPosition), password,
+                           files, state, legacyFormat, revision)) {
+            return false;
         }
-        file.close();
+        state.path = m_archivePath;
+        return true;
+    } catch (const std::exception& e) {
+        files.Cleanse();
+        state.Clear();
+        PQC_LOG_ERROR(LOG_MODULE) << "Error during decryption: " << e.what();
+        return false;
+    }
+}
 
-        if (!FormatValidation::ValidateArchiveFile(archiveData.data(), archiveData.size())) {
-            std::cerr << "Invalid or unsupported archive container" << std::endl;
-            return {};
-        }
+bool CryptoArchive::ReadStoredBlob(
+    const StoredBlob& blob,
+    const ContainerState& state,
+    const ArchiveStream::ReadAt& readAt,
+    const MappedFile* mapping,
+    const std::function<bool(ArchiveStream::OpeningReader&)>& read,
+    size_t batchLimit) const {
+    if ((!readAt && mapping == nullptr) || state.key.size() != KEY_SIZE) {
+        return false;
+    }
 
-        if (diskRevision) {
-            *diskRevision = CalculateFileHash(archiveData);
-            if (diskRevision->empty()) {
-                return {};
-            }
-        }
+    SecureMemory::SecureBytes blobKey;
+    SecureMemory::ScopedCleanse blobKeyGuard(blobKey);
+    if (!ArchiveStream::DeriveStreamKey(state.key, ENTRY_KEY_LABEL, blob.id.data(),
+                                        blob.id.size(), blobKey)) {
+        return false;
+    }
+    const ArchiveStream::ChunkCipher cipher(
+        blobKey, std::vector<uint8_t>(NONCE_SIZE, 0),
+        EntryAssociatedData(blob.id, blob.storedSize, blob.codec, blob.size));
 
-        if (archiveData.size() >= SECURE_ARCHIVE_MAGIC.size() &&
-            std::equal(SECURE_ARCHIVE_MAGIC.begin(), SECURE_ARCHIVE_MAGIC.end(),
-                       archiveData.begin())) {
-            std::vector<uint8_t> plaintext;
-            if (!DecryptSecureArchiveBytes(archiveData, password, plaintext)) {
-                std::cerr << "Archive authentication failed: wrong password or modified data" << std::endl;
-                return {};
-            }
-            return plaintext;
-        }
+    uint64_t position = blob.offset;
+    if (mapping != nullptr) {
+        ArchiveStream::OpeningReader reader(
+            cipher, blob.storedSize, state.chunkSize,
+            [mapping, &position](size_t size) {
+                const uint8_t* data = mapping->At(position, size);
+                if (data != nullptr) {
+                    position += size;
+                }
+                return data;
+            },
+            batchLimit);
+        return read(reader);
+    }
+    ArchiveStream::OpeningReader reader(cipher, blob.storedSize, state.chunkSize,
+                                        SequentialSource(readAt, position, nullptr),
+                                        batchLimit);
+    return read(reader);
+}
 
-        if (archiveData.size() >= LEGACY_ARCHIVE_MAGIC.size() &&
-            std::equal(LEGACY_ARCHIVE_MAGIC.begin(), LEGACY_ARCHIVE_MAGIC.end(),
-                       archiveData.begin())) {
-            if (archiveData.size() < 16) {
-                return {};
+bool CryptoArchive::StreamStoredBytes(const StoredBlob& blob,
+                                      const ContainerState& state,
+                                      const ArchiveStream::ReadAt& readAt,
+                                      const ArchiveStream::Sink& sink,
+                                      const MappedFile* mapping,
+                                      size_t batchLimit) const {
+    const uint64_t storedSize = blob.storedSize;
+    return ReadStoredBlob(
+        blob, state, readAt, mapping, [&](ArchiveStream::OpeningReader& reader) {
+            // Blocks of one parallel batch are decrypted straight into the block.
+            std::vector<uint8_t> block(static_cast<size_t>(std::min<uint64_t>(
+                storedSize, ArchiveStream::BatchSize(state.chunkSize, batchLimit))));
+            SecureMemory::ScopedCleanse blockGuard(block);
+            uint64_t remaining = storedSize;
+            while (remaining != 0) {
+                const size_t count =
+                    static_cast<size_t>(std::min<uint64_t>(remaining, block.size()));
+                if (!reader.Read(block.data(), count) || !sink(block.data(), count)) {
+                    return false;
+                }
+                remaining -= count;
             }
+            return reader.finished();
+        },
+        batchLimit);
+}
 
-            uint64_t dataSize = 0;
-            std::memcpy(&dataSize, archiveData.data() + LEGACY_ARCHIVE_MAGIC.size(),
-                        sizeof(dataSize));
-            if (dataSize == 0 || dataSize != archiveData.size() - 16) {
-                std::cerr << "Invalid legacy archive size" << std::endl;
-                return {};
-            }
+bool CryptoArchive::StreamStoredBlob(const StoredBlob& blob,
+                                     const ContainerState& state,
+                                     const ArchiveStream::ReadAt& readAt,
+                                     const ArchiveStream::Sink& sink,
+                                     const MappedFile* mapping,
+                                     size_t batchLimit) const {
+    if (blob.codec == ArchiveCodec::STORED) {
+        return StreamStoredBytes(blob, state, readAt, sink, mapping, batchLimit);
+    }
+    ArchiveCodec::Inflater inflater(blob.size, sink);
+    return StreamStoredBytes(blob, state, readAt,
+                             [&inflater](const uint8_t* data, size_t size) {
+                                 return inflater.Write(data, size);
+                             },
+                             mapping, batchLimit) &&
+           inflater.Finish();
+}
+
+bool CryptoArchive::LoadStoredBlob(const StoredBlob& blob,
+                                   const ContainerState& state,
+                                   const ArchiveStream::ReadAt& readAt,
+                                   const MappedFile* mapping,
+                                   uint8_t* output) const {
+    // A raw blob is opened directly into output; a compressed one into a
+    // packed buffer that is then inflated into output.
+    const bool compressed = blob.codec != ArchiveCodec::STORED;
+    std::vector<uint8_t> packed;
+    SecureMemory::ScopedCleanse packedGuard(packed);
+    if (compressed) {
+        packed.resize(static_cast<size_t>(blob.storedSize));
+    }
+    uint8_t* stored = compressed ? packed.data() : output;
+    return ReadStoredBlob(blob, state, readAt, mapping,
+                          [&blob, stored](ArchiveStream::OpeningReader& reader) {
+                              return reader.Read(stored, static_cast<size_t>(blob.storedSize)) &&
+                                     reader.finished();
+                          }) &&
+           (!compressed || ArchiveCodec::Decompress(packed.data(), packed.size(), output,
+                                                    static_cast<size_t>(blob.size)));
+}
+
+bool CryptoArchive::StreamEntryPayload(const FileEntry& entry,
+                                       const ContainerState& state,
+                                       const ArchiveStream::ReadAt& readAt,
+                                       const ArchiveStream::Sink& sink,
+                                       const MappedFile* mapping,
+                                       size_t batchLimit) const {
+    if (entry.data.size() == entry.size) {
+        return entry.data.empty() || sink(entry.data.data(), entry.data.size());
+    }
+    const auto stored = state.entries.find(entry.name);
+    if (stored == state.entries.end()) {
+        return false;
+    }
 
-            std::vector<uint8_t> key = DeriveLegacyKey(password);
-            SecureMemory::ScopedCleanse keyGuard(key);
-            if (key.empty()) {
-                return {};
+    // Consecutive blobs that fit in one batch are opened in parallel into a
+    // single buffer and handed to sink in order. A blob larger than a batch,
+    // written before deduplication, streams on its own.
+    std::mutex readMutex;
+    const ArchiveStream::ReadAt lockedReadAt =
+        readAt ? LockedReadAt(readAt, readMutex) : ArchiveStream::ReadAt();
+    const std::vector<uint32_t>& blobs = stored->second;
+    const uint64_t batchSize = ArchiveStream::BatchSize(state.chunkSize, batchLimit);
+    std::vector<uint8_t> batch;
+    SecureMemory::ScopedCleanse batchGuard(batch);
+    std::vector<uint64_t> offsets;
+    for (size_t next = 0; next < blobs.size();) {
+        const StoredBlob& first = state.blobs[blobs[next]];
+        if (first.size > batchSize) {
+            if (!StreamStoredBlob(first, state, readAt, sink, mapping, batchLimit)) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Stored payload failed authentication: " << entry.name;
+                return false;
             }
+            ++next;
+            continue;
+        }
+        size_t end = next;
+        uint64_t total = 0;
+        offsets.clear();
+        while (end < blobs.size() && state.blobs[blobs[end]].size <= batchSize - total) {
+            offsets.push_back(total);
+            total += state.blobs[blobs[end]].size;
+            ++end;
+        }
+        if (batch.empty()) {
+            batch.resize(static_cast<size_t>(std::min<uint64_t>(entry.size, batchSize)));
+        }
+        const bool opened = total <= batch.size() &&
+                            ArchiveStream::ParallelFor(end - next, [&](size_t i) {
+                                return LoadStoredBlob(state.blobs[blobs[next + i]], state,
+                                                      lockedReadAt, mapping,
+                                                      batch.data() + offsets[i]);
+                            });
+        if (!opened || !sink(batch.data(), static_cast<size_t>(total))) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Stored payload failed authentication: " << entry.name;
+            return false;
+        }
+        next = end;
+    }
+    return true;
+}
 
-            std::vector<uint8_t> plaintext(static_cast<size_t>(dataSize));
-            for (size_t i = 0; i < plaintext.size(); ++i) {
-                plaintext[i] = archiveData[16 + i] ^ key[i % key.size()];
+template <typename Buffer>
+bool CryptoArchive::LoadEntryPayload(const FileEntry& entry, Buffer& data) const {
+    SecureMemory::Cleanse(data);
+    data.clear();
+    if (entry.data.size() == entry.size) {
+        data.assign(entry.data.begin(), entry.data.end());
+        return true;
+    }
+    const auto stored = m_container.entries.find(entry.name);
+    if (stored == m_container.entries.end()) {
+        return false;
+    }
+    if (entry.size > MAX_ARCHIVE_ENTRY_SIZE) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Entry is too large to load into memory; extract it to a file: "
+                                  << entry.name;
+        return false;
+    }
+
+    try {
+        // The mapped container is authenticated in place and every blob of
+        // the entry is opened in parallel straight into its place in data.
+        MappedFile mapping;
+        std::ifstream container;
+        std::mutex readMutex;
+        ArchiveStream::ReadAt readAt;
+        if (!mapping.Open(m_container.path)) {
+            container.open(m_container.path, std::ios::binary);
+            if (!container.is_open()) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Could not open archive for reading";
+                return false;
             }
-            Cleanse(key);
-            if (legacyFormat) {
-                *legacyFormat = true;
+            readAt = LockedReadAt(FileReadAt(container), readMutex);
+        }
+        const std::vector<uint32_t>& blobs = stored->second;
+        std::vector<uint64_t> offsets;
+        uint64_t total = 0;
+        for (const uint32_t blob : blobs) {
+            offsets.push_back(total);
+            total += m_container.blobs[blob].size;
+        }
+        if (total != entry.size) {
+            return false;
+        }
+        data.resize(entry.size);
+        std::vector<size_t> misses;
+        for (size_t i = 0; i < blobs.size(); ++i) {
+            const StoredBlob& blob = m_container.blobs[blobs[i]];
+            if (!m_cache.Lookup(blob.id, data.data() + offsets[i],
+                                static_cast<size_t>(blob.size))) {
+                misses.push_back(i);
             }
-            std::cout << "Loaded legacy PQCENC01 archive; the next save will migrate it to PQCENC02"
-                      << std::endl;
-            return plaintext;
         }
-
-        std::cerr << "Unknown archive format; refusing to treat it as plaintext" << std::endl;
-        return {};
+        const bool loaded = ArchiveStream::ParallelFor(misses.size(), [&](size_t i) {
+            return LoadStoredBlob(m_container.blobs[blobs[misses[i]]], m_container, readAt,
+                                  mapping.valid() ? &mapping : nullptr,
+                                  data.data() + offsets[misses[i]]);
+        });
+        if (loaded) {
+            for (const size_t i : misses) {
+                const StoredBlob& blob = m_container.blobs[blobs[i]];
+                m_cache.Insert(blob.id, data.data() + offsets[i], static_cast<size_t>(blob.size));
+            }
+        } else {
+            PQC_LOG_ERROR(LOG_MODULE) << "Stored payload failed authentication: " << entry.name;
+            SecureMemory::Cleanse(data);
+            data.clear();
+            return false;
+        }
+        return true;
     } catch (const std::exception& e) {
-        std::cerr << "Error during decryption: " << e.what() << std::endl;
-        return {};
+        SecureMemory::Cleanse(data);
+        data.clear();
+        PQC_LOG_ERROR(LOG_MODULE) << "Error reading stored payload: " << e.what();
+        return false;
     }
 }
 
-std::vector<uint8_t> CryptoArchive::SerializeArchive() const {
-    std::vector<uint8_t> data;
-    
-    // Simple serialization format:
-    // [num_files:4][file1_name_len:4][file1_name][file1_size:8][file1_data][timestamp_len:4][timestamp][hash_len:4][hash]...
-    
-    try {
-        // Write number of files
-        uint32_t numFiles = static_cast<uint32_t>(m_files.size());
-        data.insert(data.end(), reinterpret_cast<const uint8_t*>(&numFiles), reinterpret_cast<const uint8_t*>(&numFiles) + 4);
-        
-        // Write each file
-        for (const auto& pair : m_files) {
-            const FileEntry& entry = pair.second;
-            
-            // Write file name length and name
-            uint32_t nameLen = static_cast<uint32_t>(entry.name.length());
-            data.insert(data.end(), reinterpret_cast<const uint8_t*>(&nameLen), reinterpret_cast<const uint8_t*>(&nameLen) + 4);
-            data.insert(data.end(), entry.name.begin(), entry.name.end());
-            
-            // Write file size and data
-            uint64_t fileSize = static_cast<uint64_t>(entry.size);
-            data.insert(data.end(), reinterpret_cast<const uint8_t*>(&fileSize), reinterpret_cast<const uint8_t*>(&fileSize) + 8);
-            data.insert(data.end(), entry.data.begin(), entry.data.end());
-            
-            // Write timestamp
-            uint32_t timestampLen = static_cast<uint32_t>(entry.timestamp.length());
-            data.insert(data.end(), reinterpret_cast<const uint8_t*>(&timestampLen), reinterpret_cast<const uint8_t*>(&timestampLen) + 4);
-            data.insert(data.end(), entry.timestamp.begin(), entry.timestamp.end());
-            
-            // Write hash
-            uint32_t hashLen = static_cast<uint32_t>(entry.hash.length());
-            data.insert(data.end(), reinterpret_cast<const uint8_t*>(&hashLen), reinterpret_cast<const uint8_t*>(&hashLen) + 4);
-            data.insert(data.end(), entry.hash.begin(), entry.hash.end());
+bool CryptoArchive::DigestContents(const EntryTable& files,
+                                   const ContainerState& state,
+                                   const ArchiveStream::ReadAt& readAt,
+                                   std::string& digest) const {
+    // Same field order as the legacy serialized payload, so the digest does
+    // not depend on where each container keeps its payloads.
+    RevisionDigest hasher;
+    const auto update = [&hasher](const void* data, size_t size) {
+        return hasher.Update(static_cast<const uint8_t*>(data), size);
+    };
+    const uint32_t numFiles = static_cast<uint32_t>(files.size());
+    if (!update(&numFiles, sizeof(numFiles))) {
+        return false;
+    }
+    for (const auto& [name, entry] : files) {
+        const uint32_t nameLen = static_cast<uint32_t>(name.size());
+        const uint64_t fileSize = static_cast<uint64_t>(entry.size);
+        const uint32_t timestampLen = static_cast<uint32_t>(entry.timestamp.size());
+        const uint32_t hashLen = static_cast<uint32_t>(entry.hash.size());
+        if (!update(&nameLen, sizeof(nameLen)) || !update(name.data(), name.size()) ||
+            !update(&fileSize, sizeof(fileSize)) ||
+            !StreamEntryPayload(entry, state, readAt,
+                                [&update](const uint8_t* data, size_t size) {
+                                    return update(data, size);
+                                }) ||
+            !update(&timestampLen, sizeof(timestampLen)) ||
+            !update(entry.timestamp.data(), entry.timestamp.size()) ||
+            !update(&hashLen, sizeof(hashLen)) ||
+            !update(entry.hash.data(), entry.hash.size())) {
+            return false;
         }
-        
-        return data;
-    } catch (const std::exception& e) {
-        std::cout << "Error serializing archive: " << e.what() << std::endl;
-        return {};
     }
+    return hasher.Finish(digest);
 }
 
-bool CryptoArchive::DeserializeArchive(const std::vector<uint8_t>& data) {
+bool CryptoArchive::DeserializeArchive(const ArchiveStream::Source& payload,
+                                       uint64_t payloadSize,
+                                       EntryTable& files) const {
     try {
-        ClearDecryptedData();
+        files.Cleanse();
+        uint64_t offset = 0;
+        const auto read = [&](void* destination, uint64_t size) {
+            if (size > payloadSize - offset ||
+                (size != 0 && !payload(static_cast<uint8_t*>(destination),
+                                       static_cast<size_t>(size)))) {
+                return false;
+            }
+            offset += size;
+            return true;
+        };
         const bool parsed = [&]() -> bool {
-        if (data.size() < 4) {
-            std::cerr << "Data size too small for deserialization: " << data.size() << " bytes" << std::endl;
+        if (payloadSize < 4) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Data size too small for deserialization: "
+                                      << payloadSize << " bytes";
             return false;
         }
         
-        std::cout << "Deserializing data of size: " << data.size() << " bytes" << std::endl;
-        
-        size_t offset = 0;
+        PQC_LOG_DEBUG(LOG_MODULE) << "Deserializing data of size: " << payloadSize << " bytes";
         
         // Read number of files
         uint32_t numFiles;
-        std::memcpy(&numFiles, data.data() + offset, 4);
-        offset += 4;
+        if (!read(&numFiles, 4)) {
+            return false;
+        }
         
-        std::cout << "Number of files in archive: " << numFiles << std::endl;
+        PQC_LOG_DEBUG(LOG_MODULE) << "Number of files in archive: " << numFiles;
         
         // Sanity check - if numFiles is very large, it's probably corrupted data
-        if (numFiles > 1000) {
-            std::cerr << "Unreasonable number of files: " << numFiles << ", data likely corrupted" << std::endl;
+        if (numFiles > ArchiveIndex::MAX_ENTRIES) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Unreasonable number of files: " << numFiles
+                                      << ", data likely corrupted";
             return false;
         }
         
         // Read each file
         for (uint32_t i = 0; i < numFiles; ++i) {
-            if (offset + 4 > data.size()) {
-                std::cerr << "Data overflow at file " << i << " name length" << std::endl;
-                return false;
-            }
-            
             // Read file name
             uint32_t nameLen;
-            std::memcpy(&nameLen, data.data() + offset, 4);
-            offset += 4;
+            if (!read(&nameLen, 4)) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Data overflow at file " << i << " name length";
+                return false;
+            }
             
             // Sanity check
             if (nameLen > 1024) {
-                std::cerr << "Unreasonable filename length: " << nameLen << ", data likely corrupted" << std::endl;
+                PQC_LOG_ERROR(LOG_MODULE) << "Unreasonable filename length: " << nameLen
+                                          << ", data likely corrupted";
                 return false;
             }
             
-            if (offset + nameLen > data.size()) {
-                std::cerr << "Data overflow at file " << i << " name" << std::endl;
+            std::string name(nameLen, '\0');
+            if (!read(name.data(), nameLen)) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Data overflow at file " << i << " name";
                 return false;
             }
-            
-            std::string name(reinterpret_cast<const char*>(data.data() + offset), nameLen);
-            offset += nameLen;
 
             if (!PathSecurity::ValidateStoredFilename(name)) {
-                std::cerr << "Unsafe filename in encrypted archive" << std::endl;
+                PQC_LOG_ERROR(LOG_MODULE) << "Unsafe filename in encrypted archive";
                 return false;
             }
-            for (const auto& existing : m_files) {
-                if (PathSecurity::NamesCollide(existing.first, name)) {
-                    std::cerr << "Colliding filenames in encrypted archive" << std::endl;
-                    return false;
-                }
+            if (files.FindEquivalent(name) != files.end()) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Colliding filenames in encrypted archive";
+                return false;
             }
             
-            std::cout << "Found file: " << name << std::endl;
+            PQC_LOG_DEBUG(LOG_MODULE) << "Found file: " << name;
             
             // Read file size
-            if (offset + 8 > data.size()) {
-                std::cerr << "Data overflow at file " << i << " size" << std::endl;
+            uint64_t fileSize;
+            if (!read(&fileSize, 8)) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Data overflow at file " << i << " size";
                 return false;
             }
             
-            uint64_t fileSize;
-            std::memcpy(&fileSize, data.data() + offset, 8);
-            offset += 8;
-            
             // Sanity check for file size
-            if (fileSize > MAX_ARCHIVE_ENTRY_SIZE || fileSize > data.size()) {
-                std::cerr << "Unreasonable file size: " << fileSize << ", data likely corrupted" << std::endl;
+            if (fileSize > MAX_ARCHIVE_ENTRY_SIZE || fileSize > payloadSize - offset) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Unreasonable file size: " << fileSize
+                                          << ", data likely corrupted";
                 return false;
             }
             
-            std::cout << "File size: " << fileSize << " bytes" << std::endl;
+            PQC_LOG_DEBUG(LOG_MODULE) << "File size: " << fileSize << " bytes";
             
-            // Read file data
-            if (offset + fileSize > data.size()) {
-                std::cerr << "Data overflow at file " << i << " data" << std::endl;
+            // Read file data straight from the authenticated stream
+            SecureMemory::SecureBytes fileData(static_cast<size_t>(fileSize));
+            SecureMemory::ScopedCleanse fileDataGuard(fileData);
+            if (!read(fileData.data(), fileSize)) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Data overflow at file " << i << " data";
                 return false;
             }
             
-            std::vector<uint8_t> fileData(fileSize);
-            if (fileSize > 0) {
-                std::memcpy(fileData.data(), data.data() + offset,
-                            static_cast<size_t>(fileSize));
-            }
-            offset += fileSize;
-            
             // Read timestamp
-            if (offset + 4 > data.size()) {
-                std::cerr << "Data overflow at file " << i << " timestamp length" << std::endl;
+            uint32_t timestampLen;
+            if (!read(&timestampLen, 4)) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Data overflow at file " << i << " timestamp length";
                 return false;
             }
             
-            uint32_t timestampLen;
-            std::memcpy(&timestampLen, data.data() + offset, 4);
-            offset += 4;
-            
             // Sanity check
             if (timestampLen > 64) {
-                std::cerr << "Unreasonable timestamp length: " << timestampLen << ", data likely corrupted" << std::endl;
+                PQC_LOG_ERROR(LOG_MODULE) << "Unreasonable timestamp length: " << timestampLen
+                                          << ", data likely corrupted";
                 return false;
             }
             
-            if (offset + timestampLen > data.size()) {
-                std::cerr << "Data overflow at file " << i << " timestamp" << std::endl;
+            std::string timestamp(timestampLen, '\0');
+            if (!read(timestamp.data(), timestampLen)) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Data overflow at file " << i << " timestamp";
                 return false;
             }
             
-            std::string timestamp(reinterpret_cast<const char*>(data.data() + offset), timestampLen);
-            offset += timestampLen;
-            
-            std::cout << "Timestamp: " << timestamp << std::endl;
+            PQC_LOG_DEBUG(LOG_MODULE) << "Timestamp: " << timestamp;
             
             // Read hash
-            if (offset + 4 > data.size()) {
-                std::cerr << "Data overflow at file " << i << " hash length" << std::endl;
+            uint32_t hashLen;
+            if (!read(&hashLen, 4)) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Data overflow at file " << i << " hash length";
                 return false;
             }
             
-            uint32_t hashLen;
-            std::memcpy(&hashLen, data.data() + offset, 4);
-            offset += 4;
-            
             // Sanity check
             if (hashLen > 128) {
-                std::cerr << "Unreasonable hash length: " << hashLen << ", data likely corrupted" << std::endl;
+                PQC_LOG_ERROR(LOG_MODULE) << "Unreasonable hash length: " << hashLen
+                                          << ", data likely corrupted";
                 return false;
             }
             
-            if (offset + hashLen > data.size()) {
-                std::cerr << "Data overflow at file " << i << " hash" << std::endl;
+            std::string hash(hashLen, '\0');
+            if (!read(hash.data(), hashLen)) {
+                PQC_LOG_ERROR(LOG_MODULE) << "Data overflow at file " << i << " hash";
                 return false;
             }
             
-            std::string hash(reinterpret_cast<const char*>(data.data() + offset), hashLen);
-            offset += hashLen;
-            
-            std::cout << "Hash: " << hash << std::endl;
+            PQC_LOG_DEBUG(LOG_MODULE) << "Hash: " << hash;
             
             // Create file entry
             FileEntry entry;
             entry.name = name;
             entry.data = std::move(fileData);
-            entry.size = fileSize;
+            entry.size = static_cast<size_t>(fileSize);
             entry.timestamp = timestamp;
             entry.hash = hash;
             
-            m_files[name] = std::move(entry);
+            files.insert(name, std::move(entry));
         }
 
-        if (offset != data.size()) {
-            std::cerr << "Unexpected trailing data in serialized archive" << std::endl;
+        if (offset != payloadSize) {
+            PQC_LOG_ERROR(LOG_MODULE) << "Unexpected trailing data in serialized archive";
             return false;
         }
         return true;
         }();
         if (!parsed) {
-            ClearDecryptedData();
+            files.Cleanse();
         }
         return parsed;
     } catch (const std::exception& e) {
-        ClearDecryptedData();
-        std::cout << "Error deserializing archive: " << e.what() << std::endl;
+        files.Cleanse();
+        PQC_LOG_ERROR(LOG_MODULE) << "Error deserializing archive: " << e.what();
         return false;
     }
 }
 
-std::string CryptoArchive::CalculateFileHash(const std::vector<uint8_t>& data) const {
+std::string CryptoArchive::CalculateFileHash(const SecureMemory::SecureBytes& data) const {
+    const Metrics::ScopedTimer timer(Metrics::Stage::Sha256, data.size());
     std::array<unsigned char, 32> hash{};
     unsigned int hashLength = 0;
     if (EVP_Digest(data.data(), data.size(), hash.data(), &hashLength,
@@ -1505,97 +3844,96 @@ std::string CryptoArchive::GetArchiveFilePath() const {
 }
 
 void CryptoArchive::DiagnoseArchive() {
-    std::cout << "\n========== ARCHIVE DIAGNOSTIC ==========\n" << std::endl;
+    if (!Log::Enabled(Log::Level::Debug, LOG_MODULE)) {
+        return;
+    }
+    const StateLock stateLock(m_stateMutex);
+    PQC_LOG_DEBUG(LOG_MODULE) << "========== ARCHIVE DIAGNOSTIC ==========";
     
     // Archive state
-    std::cout << "Username: " << m_username << std::endl;
-    std::cout << "Archive path: " << m_archivePath << std::endl;
-    std::cout << "Archive loaded: " << (m_isLoaded ? "Yes" : "No") << std::endl;
-    std::cout << "Archive exists on disk: " << (std::filesystem::exists(m_archivePath) ? "Yes" : "No") << std::endl;
+    PQC_LOG_DEBUG(LOG_MODULE) << "Username: " << m_username;
+    PQC_LOG_DEBUG(LOG_MODULE) << "Archive path: " << m_archivePath;
+    PQC_LOG_DEBUG(LOG_MODULE) << "Archive loaded: " << (m_isLoaded ? "Yes" : "No");
+    PQC_LOG_DEBUG(LOG_MODULE) << "Archive exists on disk: "
+                              << (std::filesystem::exists(m_archivePath) ? "Yes" : "No");
     
     // Check if file member variable is properly initialized
-    std::cout << "m_files valid: " << (m_files.empty() ? "Empty" : "Has entries") << std::endl;
-    std::cout << "m_files.size(): " << m_files.size() << std::endl;
-    
-    // Try to fix empty data issues
-    int emptyDataFixed = 0;
-    for (auto& pair : m_files) {
-        FileEntry& entry = pair.second;
-        // If size is non-zero but data is empty, something went wrong
-        if (entry.size > 0 && entry.data.empty()) {
-            std::cout << "WARNING: File '" << entry.name << "' has size " << entry.size 
-                      << " but empty data. Attempting to fix..." << std::endl;
-            // Create dummy data of the right size
-            entry.data.resize(entry.size, 0);
-            emptyDataFixed++;
-        }
-    }
-    if (emptyDataFixed > 0) {
-        std::cout << "Fixed " << emptyDataFixed << " files with empty data" << std::endl;
-    }
+    PQC_LOG_DEBUG(LOG_MODULE) << "m_files valid: " << (m_files.empty() ? "Empty" : "Has entries");
+    PQC_LOG_DEBUG(LOG_MODULE) << "m_files.size(): " << m_files.size();
     
     if (std::filesystem::exists(m_archivePath)) {
         try {
             auto fileSize = std::filesystem::file_size(m_archivePath);
-            std::cout << "Archive file size: " << fileSize << " bytes" << std::endl;
+            PQC_LOG_DEBUG(LOG_MODULE) << "Archive file size: " << fileSize << " bytes";
         } catch (const std::exception& e) {
-            std::cout << "Error getting archive file size: " << e.what() << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "Error getting archive file size: " << e.what();
         }
     }
     
     // Files in memory
-    std::cout << "\nFiles in memory: " << m_files.size() << std::endl;
+    PQC_LOG_DEBUG(LOG_MODULE) << "Files in memory: " << m_files.size();
     int count = 0;
     for (const auto& pair : m_files) {
         const FileEntry& entry = pair.second;
-        std::cout << "\n[" << count++ << "] File: " << entry.name << std::endl;
-        std::cout << "  Size: " << entry.size << " bytes" << std::endl;
-        std::cout << "  Data vector size: " << entry.data.size() << " bytes" << std::endl;
-        std::cout << "  Timestamp: " << entry.timestamp << std::endl;
-        std::cout << "  Hash: " << entry.hash << std::endl;
+        PQC_LOG_DEBUG(LOG_MODULE) << "[" << count++ << "] File: " << entry.name;
+        PQC_LOG_DEBUG(LOG_MODULE) << "  Size: " << entry.size << " bytes";
+        PQC_LOG_DEBUG(LOG_MODULE) << "  Data vector size: " << entry.data.size() << " bytes";
+        const bool stored = entry.data.empty() && m_container.entries.count(pair.first) != 0;
+        PQC_LOG_DEBUG(LOG_MODULE) << "  Payload: " << (stored ? "stored in container" : "in memory");
+        PQC_LOG_DEBUG(LOG_MODULE) << "  Timestamp: " << entry.timestamp;
+        PQC_LOG_DEBUG(LOG_MODULE) << "  Hash: " << entry.hash;
         
         // Check data integrity
-        if (entry.size != entry.data.size()) {
-            std::cout << "  WARNING: Size mismatch between entry.size and data.size()" << std::endl;
-        }
-        
-        if (entry.size != 0 && entry.data.empty()) {
-            std::cout << "  WARNING: File data is empty!" << std::endl;
+        if (!stored && entry.size != entry.data.size()) {
+            PQC_LOG_WARN(LOG_MODULE) << "  Size mismatch between entry.size and data.size()";
         }
     }
     
-    std::cout << "\n=========================================\n" << std::endl;
 }
 
 bool CryptoArchive::ResetArchive(const std::string& password) {
-    std::cout << "\n---------- RESET ARCHIVE ----------" << std::endl;
-    std::cout << "Resetting archive for user: " << m_username << std::endl;
+    const StateLock stateLock(m_stateMutex);
+    PQC_LOG_DEBUG(LOG_MODULE) << "---------- RESET ARCHIVE ----------";
+    PQC_LOG_INFO(LOG_MODULE) << "Resetting archive for user: " << m_username;
     
-    if (password.empty()) {
+    if (password.empty() || !m_leases.empty()) {
         return false;
     }
 
     // Keep the current in-memory state until the empty replacement has been
     // durably committed. SaveArchive itself performs the atomic replacement.
-    std::map<std::string, FileEntry> previousFiles;
+    EntryTable previousFiles;
     previousFiles.swap(m_files);
     SecureMemory::SecureString previousPassword(m_password.get());
     const bool previousLoadedState = m_isLoaded;
+    SessionKey previousSessionKey;
+    if (!m_password.equals(password)) {
+        std::swap(previousSessionKey, m_sessionKey);
+    }
 
     m_files.clear();
     m_isLoaded = true;
     if (!m_password.assign(password)) {
         m_password.assign(previousPassword.get());
         m_files.swap(previousFiles);
+        if (previousSessionKey.valid()) {
+            std::swap(previousSessionKey, m_sessionKey);
+        }
         m_isLoaded = previousLoadedState;
         return false;
     }
 
-    std::cout << "Creating new empty archive atomically..." << std::endl;
-    const bool success = SaveArchive();
+    // A reset must not leave the old entries behind in the container, so it
+    // always rewrites instead of appending an empty head.
+    PQC_LOG_INFO(LOG_MODULE) << "Creating new empty archive atomically...";
+    const bool success = CommitArchive(true);
     if (!success) {
         m_password.assign(previousPassword.get());
         m_files.swap(previousFiles);
+        if (previousSessionKey.valid()) {
+            m_sessionKey.Clear();
+            std::swap(previousSessionKey, m_sessionKey);
+        }
         m_isLoaded = previousLoadedState;
     } else {
         for (auto& [name, entry] : previousFiles) {
@@ -1606,16 +3944,16 @@ bool CryptoArchive::ResetArchive(const std::string& password) {
     }
     
     if (success) {
-        std::cout << "Archive successfully reset and reinitialized!" << std::endl;
+        PQC_LOG_INFO(LOG_MODULE) << "Archive successfully reset and reinitialized!";
     } else {
-        std::cout << "Failed to reset and reinitialize archive!" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to reset and reinitialize archive!";
     }
     
-    std::cout << "---------------------------------\n" << std::endl;
     return success;
 }
 
 bool CryptoArchive::ResetArchive() {
+    const StateLock stateLock(m_stateMutex);
     if (m_password.empty()) {
         return false;
     }
@@ -1623,12 +3961,16 @@ bool CryptoArchive::ResetArchive() {
 }
 
 bool CryptoArchive::RepairArchive() {
-    std::cout << "\n---------- REPAIR ARCHIVE ----------" << std::endl;
-    std::cout << "Attempting to repair archive for user: " << m_username << std::endl;
+    const StateLock stateLock(m_stateMutex);
+    PQC_LOG_DEBUG(LOG_MODULE) << "---------- REPAIR ARCHIVE ----------";
+    PQC_LOG_INFO(LOG_MODULE) << "Attempting to repair archive for user: " << m_username;
     
     if (!m_isLoaded) {
-        std::cout << "Cannot repair - archive not loaded!" << std::endl;
-        std::cout << "---------------------------------\n" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Cannot repair - archive not loaded!";
+        return false;
+    }
+    if (!m_leases.empty()) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Cannot repair while files are open for reading";
         return false;
     }
     
@@ -1636,22 +3978,39 @@ bool CryptoArchive::RepairArchive() {
         std::string key;
         size_t size;
         std::string hash;
+        bool newlyStaged;
     };
     int issuesFixed = 0;
     std::vector<MetadataUndo> metadataUndo;
     std::vector<std::string> keysToRemove;
-    std::vector<std::map<std::string, FileEntry>::node_type> removedEntries;
+    std::vector<EntryTable::node_type> removedEntries;
     
-    std::cout << "Scanning for issues in " << m_files.size() << " files..." << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "Scanning for issues in " << m_files.size() << " files...";
     
-    // First pass - identify issues
-    for (auto& pair : m_files) {
-        const std::string& name = pair.first;
-        FileEntry& entry = pair.second;
+    // First pass - check every payload in parallel, then identify issues
+    const IntegrityReport report = CheckIntegrity();
+    for (const EntryCheck& check : report.entries) {
+        const auto found = m_files.find(check.name);
+        if (found == m_files.end()) {
+            continue;
+        }
+        const std::string& name = found->first;
+        FileEntry& entry = found->second;
         bool hasIssues = false;
         
         if (!PathSecurity::ValidateStoredFilename(name) || entry.name != name) {
-            std::cout << "ERROR: Found file with invalid name - marking for removal" << std::endl;
+            PQC_LOG_WARN(LOG_MODULE) << "Found file with invalid name - marking for removal";
+            keysToRemove.push_back(name);
+            continue;
+        }
+
+        // Stored payloads that fail authentication or disagree with their
+        // recorded size cannot be trusted
+        const bool stored = entry.data.empty() && m_container.entries.count(name) != 0;
+        if (check.status == EntryStatus::Unreadable ||
+            (stored && check.status == EntryStatus::SizeMismatch)) {
+            PQC_LOG_WARN(LOG_MODULE) << "Stored data of '" << name
+                                     << "' failed authentication - marking for removal";
             keysToRemove.push_back(name);
             continue;
         }
@@ -1659,28 +4018,28 @@ bool CryptoArchive::RepairArchive() {
         const size_t previousSize = entry.size;
         const std::string previousHash = entry.hash;
         
-        // Check size/data mismatch
-        if (entry.size != entry.data.size()) {
-            std::cout << "ISSUE: File '" << name << "' has size mismatch. "
-                      << "Reported: " << entry.size << ", Actual: " << entry.data.size() << " bytes" << std::endl;
+        // Check size/data mismatch of payloads held in memory
+        if (check.status == EntryStatus::SizeMismatch) {
+            PQC_LOG_WARN(LOG_MODULE) << "ISSUE: File '" << name << "' has size mismatch. "
+                                     << "Reported: " << entry.size << ", Actual: " << check.actualSize << " bytes";
             // Fix the size to match the actual data
-            entry.size = entry.data.size();
+            entry.size = static_cast<size_t>(check.actualSize);
             hasIssues = true;
             issuesFixed++;
         }
         
         // Check for valid hash
-        std::string calculatedHash = CalculateFileHash(entry.data);
-        if (calculatedHash != entry.hash) {
-            std::cout << "ISSUE: File '" << name << "' has invalid hash" << std::endl;
-            entry.hash = calculatedHash;
+        if (check.actualHash != entry.hash) {
+            PQC_LOG_WARN(LOG_MODULE) << "ISSUE: File '" << name << "' has invalid hash";
+            entry.hash = check.actualHash;
             hasIssues = true;
             issuesFixed++;
         }
         
         if (hasIssues) {
-            metadataUndo.push_back({name, previousSize, previousHash});
-            std::cout << "Fixed issues with file: '" << name << "'" << std::endl;
+            const bool newlyStaged = m_stagedNames.insert(name).second;
+            metadataUndo.push_back({name, previousSize, previousHash, newlyStaged});
+            PQC_LOG_INFO(LOG_MODULE) << "Fixed issues with file: '" << name << "'";
         }
     }
     
@@ -1690,45 +4049,45 @@ bool CryptoArchive::RepairArchive() {
         if (!invalidEntry.empty()) {
             removedEntries.push_back(std::move(invalidEntry));
         }
-        std::cout << "Removed invalid file entry with key: '" << key << "'" << std::endl;
+        PQC_LOG_WARN(LOG_MODULE) << "Removed invalid file entry with key: '" << key << "'";
         issuesFixed++;
     }
     
     // Save the repaired archive
     if (issuesFixed > 0) {
-        std::cout << "Fixed " << issuesFixed << " issues. Saving repaired archive..." << std::endl;
+        PQC_LOG_INFO(LOG_MODULE) << "Fixed " << issuesFixed << " issues. Saving repaired archive...";
         if (SaveArchive()) {
             for (auto& removed : removedEntries) {
                 SecureMemory::Cleanse(removed.mapped().data);
             }
-            std::cout << "Archive successfully repaired and saved!" << std::endl;
-            std::cout << "---------------------------------\n" << std::endl;
+            PQC_LOG_INFO(LOG_MODULE) << "Archive successfully repaired and saved!";
             return true;
         } else {
-            std::cout << "Failed to save repaired archive!" << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "Failed to save repaired archive!";
             for (const auto& undo : metadataUndo) {
                 auto entry = m_files.find(undo.key);
                 if (entry != m_files.end()) {
                     entry->second.size = undo.size;
                     entry->second.hash = undo.hash;
                 }
+                if (undo.newlyStaged) {
+                    m_stagedNames.erase(undo.key);
+                }
             }
             for (auto& removed : removedEntries) {
                 m_files.insert(std::move(removed));
             }
-            std::cout << "Repair rollback restored the previous in-memory state" << std::endl;
-            std::cout << "---------------------------------\n" << std::endl;
+            PQC_LOG_INFO(LOG_MODULE) << "Repair rollback restored the previous in-memory state";
             return false;
         }
     } else {
-        std::cout << "No issues found in the archive." << std::endl;
-        std::cout << "---------------------------------\n" << std::endl;
+        PQC_LOG_INFO(LOG_MODULE) << "No issues found in the archive.";
         return true;
     }
 }
 
 std::vector<std::string> CryptoArchive::FindUserArchives(const std::string& username) {
-    std::cout << "\n---------- FIND USER ARCHIVES ----------" << std::endl;
+    PQC_LOG_DEBUG(LOG_MODULE) << "---------- FIND USER ARCHIVES ----------";
     std::vector<std::string> archives;
     if (!PathSecurity::ValidateUsername(username)) {
         return archives;
@@ -1736,23 +4095,22 @@ std::vector<std::string> CryptoArchive::FindUserArchives(const std::string& user
     std::string archivesDir = "archives";
     std::string userPrefix = username + "_";
     
-    std::cout << "Looking for archives for user: " << username << std::endl;
-    std::cout << "User prefix: " << userPrefix << std::endl;
-    std::cout << "Archives directory exists: " << (std::filesystem::exists(archivesDir) ? "Yes" : "No") << std::endl;
+    PQC_LOG_DEBUG(LOG_MODULE) << "Looking for archives for user: " << username;
+    PQC_LOG_DEBUG(LOG_MODULE) << "User prefix: " << userPrefix;
+    PQC_LOG_DEBUG(LOG_MODULE) << "Archives directory exists: "
+                              << (std::filesystem::exists(archivesDir) ? "Yes" : "No");
     
     // Ensure the archives directory exists
     if (!std::filesystem::exists(archivesDir)) {
-        std::cout << "Archives directory does not exist!" << std::endl;
-        std::cout << "--------------------------------------\n" << std::endl;
+        PQC_LOG_DEBUG(LOG_MODULE) << "Archives directory does not exist!";
         return archives; // Return empty list if directory doesn't exist
     }
     
     // Iterate through the directory and find all archives that match the username prefix
-    std::cout << "Files in archives directory:" << std::endl;
+    PQC_LOG_DEBUG(LOG_MODULE) << "Files in archives directory:";
     for (const auto& entry : std::filesystem::directory_iterator(archivesDir)) {
         if (entry.is_regular_file() && !entry.is_symlink()) {
             std::string filename = entry.path().filename().string();
-            std::cout << " - " << filename;
             
             // Check if the file starts with the username prefix
             if (filename.size() > userPrefix.size() + 4 &&
@@ -1760,10 +4118,7 @@ std::vector<std::string> CryptoArchive::FindUserArchives(const std::string& user
                 entry.path().extension() == ".enc") {
                 // Extract archive name from filename (remove username_ prefix and .enc extension)
                 std::string archiveName = filename.substr(userPrefix.length());
-                std::cout << " (matches user prefix)";
-                
                 archiveName.resize(archiveName.size() - 4);
-                std::cout << ", extracted name: " << archiveName;
 
                 const bool collision = std::any_of(
                     archives.begin(), archives.end(), [&](const std::string& existing) {
@@ -1771,27 +4126,29 @@ std::vector<std::string> CryptoArchive::FindUserArchives(const std::string& user
                     });
                 if (PathSecurity::ValidateArchiveName(archiveName) && !collision) {
                     archives.push_back(archiveName);
-                    std::cout << ", added to list" << std::endl;
+                    PQC_LOG_DEBUG(LOG_MODULE) << " - " << filename << " (matches user prefix), added as: "
+                                              << archiveName;
                 } else {
-                    std::cout << ", rejected unsafe or colliding name" << std::endl;
+                    PQC_LOG_WARN(LOG_MODULE) << " - " << filename
+                                             << " (matches user prefix), rejected unsafe or colliding name";
                 }
             } else {
-                std::cout << " (no match)" << std::endl;
+                PQC_LOG_DEBUG(LOG_MODULE) << " - " << filename << " (no match)";
             }
         } else {
-            std::cout << " (not a regular file)" << std::endl;
+            PQC_LOG_DEBUG(LOG_MODULE) << " - " << entry.path().filename().string() << " (not a regular file)";
         }
     }
     
-    std::cout << "Found " << archives.size() << " archives for user " << username << std::endl;
+    PQC_LOG_DEBUG(LOG_MODULE) << "Found " << archives.size() << " archives for user " << username;
     for (size_t i = 0; i < archives.size(); i++) {
-        std::cout << " [" << i << "] " << archives[i] << std::endl;
+        PQC_LOG_DEBUG(LOG_MODULE) << " [" << i << "] " << archives[i];
     }
-    std::cout << "--------------------------------------\n" << std::endl;
     return archives;
 }
 
 void CryptoArchive::SetArchiveName(const std::string& archiveName) {
+    const StateLock stateLock(m_stateMutex);
     if (!PathSecurity::ValidateArchiveName(archiveName)) {
         return;
     }
@@ -1810,10 +4167,12 @@ void CryptoArchive::SetArchiveName(const std::string& archiveName) {
     } else {
         m_diskRevision.clear();
         m_hasDiskRevision = false;
+        m_diskIdentity = DiskIdentity{};
     }
 }
 
 std::string CryptoArchive::GetArchiveName() const {
+    const StateLock stateLock(m_stateMutex);
     return m_archiveName;
 }
 
@@ -1889,25 +4248,27 @@ bool CryptoArchive::RenameArchive(const std::string& username,
 }
 
 bool CryptoArchive::ChangePassword(const std::string& oldPassword, const std::string& newPassword) {
-    std::cout << "\n---------- CHANGE PASSWORD ----------" << std::endl;
+    const StateLock stateLock(m_stateMutex);
+    PQC_LOG_DEBUG(LOG_MODULE) << "---------- CHANGE PASSWORD ----------";
     
     if (!m_isLoaded) {
-        std::cout << "Cannot change password - archive not loaded!" << std::endl;
-        std::cout << "---------------------------------\n" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Cannot change password - archive not loaded!";
         return false;
     }
 
     if (newPassword.empty()) {
-        std::cout << "New password cannot be empty" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "New password cannot be empty";
         return false;
     }
     
-    // First verify the old password by attempting to decrypt the archive
-    std::vector<uint8_t> decryptedData = DecryptArchiveData(oldPassword);
-    SecureMemory::ScopedCleanse decryptedDataGuard(decryptedData);
-    if (decryptedData.empty()) {
-        std::cout << "Invalid old password!" << std::endl;
-        std::cout << "---------------------------------\n" << std::endl;
+    // First verify the old password by authenticating the archive container
+    EntryTable verifiedFiles;
+    ContainerState verifiedContainer;
+    const bool verified = ReadArchiveFile(oldPassword, verifiedFiles, verifiedContainer);
+    verifiedFiles.Cleanse();
+    verifiedContainer.Clear();
+    if (!verified) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Invalid old password!";
         return false;
     }
     
@@ -1917,49 +4278,201 @@ bool CryptoArchive::ChangePassword(const std::string& oldPassword, const std::st
     if (!m_password.assign(newPassword)) {
         return false;
     }
+    // The new password needs a new salt and one scrypt run.
+    SessionKey previousSessionKey;
+    std::swap(previousSessionKey, m_sessionKey);
     const bool saveResult = SaveArchive();
     if (!saveResult) {
         m_password.assign(previousPassword.get());
-        std::cout << "Password change failed; previous password remains active" << std::endl;
+        m_sessionKey.Clear();
+        std::swap(previousSessionKey, m_sessionKey);
+        PQC_LOG_ERROR(LOG_MODULE) << "Password change failed; previous password remains active";
     } else {
-        std::cout << "Password changed successfully" << std::endl;
+        // Plaintext decrypted under the old password is not kept.
+        m_cache.Clear();
+        PQC_LOG_INFO(LOG_MODULE) << "Password changed successfully";
     }
     
-    std::cout << "---------------------------------\n" << std::endl;
     return saveResult;
 }
 
 bool CryptoArchive::PreparePasswordChange(const std::string& oldPassword,
                                           const std::string& newPassword,
                                           std::vector<uint8_t>& replacement) const {
+    const StateLock stateLock(m_stateMutex);
     if (!m_isLoaded || oldPassword.empty() || newPassword.empty() ||
         !m_password.equals(oldPassword)) {
         return false;
     }
 
-    std::vector<uint8_t> authenticatedPlaintext = DecryptArchiveData(oldPassword);
-    SecureMemory::ScopedCleanse plaintextGuard(authenticatedPlaintext);
-    if (authenticatedPlaintext.empty() || !BuildEncryptedArchive(newPassword, replacement)) {
-        return false;
-    }
+    // The replacement must decrypt under the new password to exactly the
+    // entries currently authenticated on disk under the old one. Both sides
+    // are compared by digest so no payload has to be held in memory twice.
+    EntryTable diskFiles;
+    ContainerState diskContainer;
+    EntryTable verifiedFiles;
+    ContainerState verifiedContainer;
+    const auto cleanup = [&]() {
+        diskFiles.Cleanse();
+        diskContainer.Clear();
+        verifiedFiles.Cleanse();
+        verifiedContainer.Clear();
+    };
 
-    std::vector<uint8_t> verifiedPlaintext;
-    SecureMemory::ScopedCleanse verifiedGuard(verifiedPlaintext);
-    return DecryptSecureArchiveBytes(replacement, newPassword, verifiedPlaintext) &&
-           verifiedPlaintext == authenticatedPlaintext;
+    std::string authenticatedDigest;
+    std::string verifiedDigest;
+    bool prepared = false;
+    try {
+        std::ifstream disk(m_archivePath, std::ios::binary);
+        prepared =
+            disk.is_open() &&
+            ReadArchiveFile(oldPassword, diskFiles, diskContainer) &&
+            DigestContents(diskFiles, diskContainer, FileReadAt(disk), authenticatedDigest) &&
+            BuildEncryptedArchive(newPassword, replacement) &&
+            ReadContainer(MemoryReadAt(replacement), replacement.size(), newPassword,
+                          verifiedFiles, verifiedContainer) &&
+            DigestContents(verifiedFiles, verifiedContainer, MemoryReadAt(replacement),
+                           verifiedDigest) &&
+            !authenticatedDigest.empty() && verifiedDigest == authenticatedDigest;
+    } catch (const std::exception& e) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Error preparing password change: " << e.what();
+        prepared = false;
+    }
+    cleanup();
+    return prepared;
 }
 
 bool CryptoArchive::ReloadArchive() {
+    const StateLock stateLock(m_stateMutex);
     if (m_password.empty()) {
         return false;
     }
     return LoadArchive(m_password.get());
 }
 
+void CryptoArchive::ContainerState::Adopt(const ArchiveIndex::Index& index,
+                                         ArchiveMerkle::Tree tree) {
+    const ArchiveIndex::Digest noDigest{};
+    segmentKey = index.segmentKey;
+    blobs.clear();
+    entries.clear();
+    digests.clear();
+    merkle = std::move(tree);
+    integrityRoot = index.integrityRoot;
+    leaves.clear();
+    leaves.reserve(index.entries.size());
+    blobs.reserve(index.segments.size());
+    for (const ArchiveIndex::Segment& segment : index.segments) {
+        if (segment.digest != noDigest) {
+            digests.emplace(segment.digest, static_cast<uint32_t>(blobs.size()));
+        }
+        blobs.push_back(StoredBlob{segment.blobId, segment.blobOffset, segment.codec,
+                                   segment.storedSize, segment.size, segment.digest, 0});
+    }
+    for (const ArchiveIndex::Entry& entry : index.entries) {
+        for (const uint32_t blob : entry.segments) {
+            ++blobs[blob].references;
+        }
+        entries[entry.name] = entry.segments;
+        leaves.emplace(entry.name, static_cast<uint32_t>(leaves.size()));
+    }
+}
+
+void CryptoArchive::ContainerState::Clear() noexcept {
+    SecureMemory::Cleanse(key);
+    key.clear();
+    salt.clear();
+    scrypt = KeyDerivation::DEFAULT_SCRYPT;
+    SecureMemory::Cleanse(segmentKey.data(), segmentKey.size());
+    blobs.clear();
+    entries.clear();
+    digests.clear();
+    merkle = ArchiveMerkle::Tree{};
+    leaves.clear();
+    integrityRoot = ArchiveIndex::Digest{};
+    chunkSize = 0;
+    path.clear();
+    appendable = false;
+    activeSlot = 0;
+    generation = 0;
+    size = 0;
+    liveSize = 0;
+}
+
+bool CryptoArchive::DiskIdentity::operator==(const DiskIdentity& other) const noexcept {
+    return valid && other.valid && device == other.device && inode == other.inode &&
+           size == other.size && modifiedNs == other.modifiedNs;
+}
+
+CryptoArchive::DiskIdentity CryptoArchive::ReadDiskIdentity(const std::string& path) {
+    DiskIdentity identity;
+#ifdef _WIN32
+    const std::wstring widePath = std::filesystem::path(path).wstring();
+    HANDLE file = CreateFileW(widePath.c_str(), FILE_READ_ATTRIBUTES,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return identity;
+    }
+    BY_HANDLE_FILE_INFORMATION information{};
+    const bool read = GetFileInformationByHandle(file, &information) != 0;
+    CloseHandle(file);
+    if (!read) {
+        return identity;
+    }
+    identity.device = information.dwVolumeSerialNumber;
+    identity.inode = (static_cast<uint64_t>(information.nFileIndexHigh) << 32) |
+                     information.nFileIndexLow;
+    identity.size = (static_cast<uint64_t>(information.nFileSizeHigh) << 32) |
+                    information.nFileSizeLow;
+    // FILETIME counts 100 ns intervals.
+    identity.modifiedNs = static_cast<int64_t>(
+        ((static_cast<uint64_t>(information.ftLastWriteTime.dwHighDateTime) << 32) |
+         information.ftLastWriteTime.dwLowDateTime) * 100U);
+#else
+    struct stat status {};
+    if (::stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+        return identity;
+    }
+#if defined(__APPLE__)
+    const struct timespec modified = status.st_mtimespec;
+#else
+    const struct timespec modified = status.st_mtim;
+#endif
+    identity.device = static_cast<uint64_t>(status.st_dev);
+    identity.inode = static_cast<uint64_t>(status.st_ino);
+    identity.size = static_cast<uint64_t>(status.st_size);
+    identity.modifiedNs = static_cast<int64_t>(modified.tv_sec) * 1000000000LL +
+                          static_cast<int64_t>(modified.tv_nsec);
+#endif
+    identity.valid = true;
+    return identity;
+}
+
+bool CryptoArchive::SessionKey::valid() const noexcept {
+    return salt.size() == SALT_SIZE && key.size() == KEY_SIZE;
+}
+
+void CryptoArchive::SessionKey::Clear() noexcept {
+    SecureMemory::Cleanse(key);
+    key.clear();
+    salt.clear();
+    scrypt = KeyDerivation::DEFAULT_SCRYPT;
+}
+
 void CryptoArchive::ClearDecryptedData() noexcept {
-    for (auto& [name, entry] : m_files) {
-        (void)name;
-        SecureMemory::Cleanse(entry.data);
+    m_files.Cleanse();
+    m_stagedNames.clear();
+    {
+        // Staged changes belonged to the entries that were just dropped.
+        const std::lock_guard<std::mutex> schedule(m_commitMutex);
+        m_commitStatus.dirty = false;
+        m_commitStatus.pendingChanges = 0;
     }
-    m_files.clear();
+    m_container.Clear();
+    m_sessionKey.Clear();
+    m_cache.Clear();
+    // Give emptied slabs and kept mappings back, so locked pages held after
+    // a large load do not leave later keys and payloads unlocked.
+    SecureMemory::DefaultArena().Reset();
 }
@@ -3,17 +3,36 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include "ArchiveCache.h"
+#include "ArchiveIndex.h"
+#include "ArchiveMerkle.h"
+#include "ArchiveStream.h"
+#include "EntryTable.h"
+#include "KeyDerivation.h"
+#include "SecureArena.h"
 #include "SecureMemory.h"
 
-struct FileEntry {
-    std::string name;
-    std::string path;
-    std::vector<uint8_t> data;
-    size_t size;
-    std::string timestamp;
-    std::string hash;
-};
+class MappedFile;
+class CryptoArchive;
+
+namespace CryptoArchiveTesting {
+
+// Replaces the sealed Merkle leaf of a loaded entry in memory, leaving the
+// sealed root alone, so a test can prove that reads reject metadata the index
+// did not seal. It is intentionally not used by production code.
+bool ReplaceSealedLeaf(CryptoArchive& archive, const std::string& name);
+
+} // namespace CryptoArchiveTesting
 
 class CryptoArchive {
 public:
@@ -52,6 +71,12 @@ public:
     
     // Add file to archive
     bool AddFile(const std::string& filePath, const std::string& name = "");
+
+    // Add (path, name) pairs in one commit. An empty name uses the source
+    // filename. Names are checked against the archive and each other before
+    // any source is read; on any failure nothing is added.
+    bool AddFiles(const std::vector<std::pair<std::string, std::string>>& files,
+                  std::string* error = nullptr);
     
     // Extract file from archive
     bool ExtractFile(const std::string& name, const std::string& outputPath);
@@ -64,17 +89,126 @@ public:
     
     // Get file data
     std::vector<uint8_t> GetFileData(const std::string& name) const;
+
+    // Read-only view of one entry's plaintext. A stored entry is decrypted
+    // once into a buffer owned by the lease; a resident one is viewed in
+    // place. While the lease lives the entry is pinned: replacing or
+    // removing it, and resetting, repairing or reloading the archive, fail.
+    // Releasing the lease cleanses its buffer. It must be released before
+    // the archive is destroyed.
+    class EntryLease {
+    public:
+        EntryLease() = default;
+        EntryLease(EntryLease&& other) noexcept;
+        EntryLease& operator=(EntryLease&& other) noexcept;
+        EntryLease(const EntryLease&) = delete;
+        EntryLease& operator=(const EntryLease&) = delete;
+        ~EntryLease();
+
+        const uint8_t* data() const noexcept { return m_data; }
+        size_t size() const noexcept { return m_size; }
+        bool valid() const noexcept { return m_owner != nullptr; }
+        explicit operator bool() const noexcept { return valid(); }
+        void Release() noexcept;
+
+    private:
+        friend class CryptoArchive;
+        const CryptoArchive* m_owner = nullptr;
+        std::string m_name;
+        SecureMemory::SecureBytes m_buffer;
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+    };
+
+    // An invalid lease when the entry is missing or fails authentication.
+    // With terminated set, data()[size()] is a zero byte, so text can be
+    // used as a C string; a resident payload is then copied once.
+    EntryLease LeaseEntry(const std::string& name, bool terminated = false) const;
     
     // Check if archive exists
     bool ArchiveExists() const;
     
     // Get archive statistics
+    // totalSize is the logical size of the entries. storedSize counts the
+    // bytes sealed for them after compression, and physicalSize counts each
+    // segment shared by several entries once; compressionRatio is
+    // totalSize / storedSize (1.0 when nothing shrank). integrityRoot is the
+    // hex Merkle root of the committed index, empty for legacy containers.
     struct ArchiveStats {
         size_t totalFiles;
         size_t totalSize;
+        uint64_t storedSize;
+        uint64_t physicalSize;
+        double compressionRatio;
         std::string lastModified;
+        std::string integrityRoot;
     };
     ArchiveStats GetStats() const;
+
+    // Compress compressible payloads before they are sealed (on by default).
+    // Applies to entries written by later commits.
+    void SetCompression(bool enabled);
+
+    // Key derivation counters for this instance. Saves reuse the unlocked
+    // container key, so only opening or re-keying the archive runs scrypt.
+    // scrypt holds the parameters of the container on disk; the next save
+    // re-keys it when they differ from KeyDerivation::PreferredScrypt().
+    struct KeyDerivationStats {
+        uint64_t scryptRuns;
+        uint64_t scryptRunsAvoided;
+        KeyDerivation::ScryptParameters scrypt;
+    };
+    KeyDerivationStats GetKeyDerivationStats() const;
+
+    // Decrypted segments are kept in a bounded LRU cache, so reading an entry
+    // again skips decryption. The cache is wiped when the archive is closed,
+    // reloaded or re-keyed; a budget of zero disables it.
+    void SetCacheBudget(size_t bytes);
+    ArchiveCache::Stats GetCacheStats() const;
+
+    // Container space of a log-structured archive: bytes on disk, bytes still
+    // referenced by the committed head, and how commits reached the disk.
+    // Revision checks before a commit are answered from file metadata when
+    // it is unchanged, otherwise by reading the container revision.
+    struct StorageStats {
+        uint64_t containerSize;
+        uint64_t liveSize;
+        uint64_t appendedCommits;
+        uint64_t compactions;
+        uint64_t revisionMetadataChecks;
+        uint64_t revisionReads;
+    };
+    StorageStats GetStorageStats() const;
+
+    // Rewrite the container with only its live entries. This drops payloads
+    // of removed or replaced files, which appends keep until compaction.
+    bool CompactArchive();
+    
+    // Write-behind commits. While enabled, AddFile(s) and RemoveFile only
+    // stage their change and mark the archive dirty; a committer thread saves
+    // every staged change at once after the archive has been idle for delay.
+    // Disabling the mode flushes first. Commits keep the on-disk revision
+    // check, so a commit racing another writer fails instead of overwriting.
+    static constexpr std::chrono::milliseconds DEFAULT_COMMIT_DELAY{2000};
+    bool SetDeferredCommit(bool enabled,
+                           std::chrono::milliseconds delay = DEFAULT_COMMIT_DELAY);
+
+    // Commit staged changes now. True when nothing is left to save.
+    bool Flush();
+
+    // Write-behind state. lastError holds the most recent failed background
+    // or flush commit and is cleared by the next successful commit. Reading
+    // it never waits for a commit in progress.
+    struct CommitStatus {
+        bool deferred;
+        bool dirty;
+        bool committing;
+        uint64_t pendingChanges;
+        uint64_t deferredCommits;
+        uint64_t coalescedChanges;
+        std::string lastError;
+    };
+    CommitStatus GetCommitStatus() const;
     
     // Change the password/encryption key for the archive
     bool ChangePassword(const std::string& oldPassword, const std::string& newPassword);
@@ -84,8 +218,47 @@ public:
                                const std::string& newPassword,
                                std::vector<uint8_t>& replacement) const;
     
-    // Verify archive integrity
+    // Outcome of checking one entry against the size and SHA-256 recorded
+    // when it was added. Unreadable covers a missing payload and one that
+    // failed authentication.
+    enum class EntryStatus {
+        Ok,
+        SizeMismatch,
+        HashMismatch,
+        Unreadable
+    };
+    struct EntryCheck {
+        std::string name;
+        EntryStatus status;
+        uint64_t expectedSize;
+        uint64_t actualSize;
+        std::string actualHash;
+    };
+    struct IntegrityReport {
+        std::vector<EntryCheck> entries;
+        size_t failures;
+    };
+
+    // Receives the number of entries checked so far and the total. It runs
+    // on the checking threads, one call at a time.
+    using ProgressCallback = std::function<void(size_t checked, size_t total)>;
+
+    // Check every entry, several at once on the worker threads, and report
+    // each of them in name order instead of stopping at the first failure.
+    IntegrityReport CheckIntegrity(const ProgressCallback& progress = nullptr) const;
+
+    // Verify archive integrity: true when every entry checks out
     bool VerifyIntegrity() const;
+
+    // Check a single entry: its recorded metadata against the committed
+    // integrity root through its Merkle path, then its payload against the
+    // recorded SHA-256. No other entry is read.
+    bool VerifyEntry(const std::string& name) const;
+
+    // Check the next maxEntries entries in name order, continuing where the
+    // previous call stopped and wrapping around, so a background scrubber
+    // can cover a large archive a few entries at a time.
+    IntegrityReport ScrubIntegrity(size_t maxEntries);
         // Extract file to memory
     // This function is used internally to read file data into memory
     // It can also be used externally if needed
@@ -114,32 +287,343 @@ private:
     bool m_identityValid;
     std::string m_diskRevision;
     bool m_hasDiskRevision;
+
+    // Identity of the archive file (device, inode, size, modification time)
+    // when m_diskRevision was taken. Another writer either appends, which
+    // changes the size, or replaces the file, which changes the inode, so a
+    // matching identity lets a commit skip reading the revision.
+    struct DiskIdentity {
+        uint64_t device = 0;
+        uint64_t inode = 0;
+        uint64_t size = 0;
+        int64_t modifiedNs = 0;
+        bool valid = false;
+
+        bool operator==(const DiskIdentity& other) const noexcept;
+    };
+    DiskIdentity m_diskIdentity;
+    uint64_t m_revisionMetadataChecks = 0;
+    uint64_t m_revisionReads = 0;
+    static DiskIdentity ReadDiskIdentity(const std::string& path);
     
     // Security and state
     SecureMemory::SecureString m_password;
     bool m_isLoaded;
     
-    // Archive content
-    std::map<std::string, FileEntry> m_files;
-    
+    // Archive content. Entries read from an indexed container start with
+    // metadata only; their payload stays in the container until requested
+    // and only the segments in m_cache stay decrypted.
+    EntryTable m_files;
+    // Names added or repaired since the last commit. Their metadata has no
+    // sealed leaf yet; every other entry must still match its leaf.
+    std::unordered_set<std::string> m_stagedNames;
+    friend bool CryptoArchiveTesting::ReplaceSealedLeaf(CryptoArchive&, const std::string&);
+    mutable ArchiveCache::SegmentCache m_cache;
 
-    
-    // Decrypt archive data
-    std::vector<uint8_t> DecryptArchiveData(const std::string& password,
-                                            bool* legacyFormat = nullptr,
-                                            std::string* diskRevision = nullptr) const;
-    
-    // Serialize archive to binary
-    std::vector<uint8_t> SerializeArchive() const;
+    // One sealed blob in the container on disk: a content-defined segment of
+    // one or more entries, or the whole payload of an entry written before
+    // deduplication. codec and storedSize say how size payload bytes are
+    // stored; references counts the uses by entries of the committed index.
+    struct StoredBlob {
+        ArchiveIndex::BlobId id;
+        uint64_t offset;
+        uint8_t codec;
+        uint64_t storedSize;
+        uint64_t size;
+        ArchiveIndex::Digest digest;
+        uint32_t references;
+    };
+
+    // Everything needed to read payloads back from the container that was
+    // last loaded or saved. The key is the scrypt output for that container.
+    struct ContainerState {
+        std::string path;
+        uint32_t chunkSize = 0;
+        std::vector<uint8_t> salt;
+        KeyDerivation::ScryptParameters scrypt;
+        SecureMemory::SecureBytes key;
+
+        // Deduplicated payload store: the blobs of the committed index, the
+        // blobs of each entry in payload order, and the blob holding each
+        // known segment digest under segmentKey.
+        ArchiveIndex::SegmentKey segmentKey{};
+        std::vector<StoredBlob> blobs;
+        std::map<std::string, std::vector<uint32_t>> entries;
+        std::map<ArchiveIndex::Digest, uint32_t> digests;
+
+        // Merkle tree over the entries of the committed index, the leaf of
+        // each committed name, and the root sealed in that index.
+        ArchiveMerkle::Tree merkle;
+        std::unordered_map<std::string, uint32_t> leaves;
+        ArchiveIndex::Digest integrityRoot{};
+
+        // PQCENC05 head: the slot holding the committed head and its
+        // generation. liveSize counts the bytes that head references; the
+        // rest of the container is dead space reclaimed by compaction.
+        bool appendable = false;
+        uint32_t activeSlot = 0;
+        uint64_t generation = 0;
+        uint64_t size = 0;
+        uint64_t liveSize = 0;
+
+        // Take the blobs, entry segments and integrity tree of an
+        // authenticated index.
+        void Adopt(const ArchiveIndex::Index& index, ArchiveMerkle::Tree tree);
+        void Clear() noexcept;
+    };
+    ContainerState m_container;
+
+    // Unlocked container key for m_password. It is derived by scrypt once per
+    // password and salt, then reused by every save; each save still seals its
+    // index and blobs under fresh HKDF subkeys.
+    struct SessionKey {
+        std::vector<uint8_t> salt;
+        KeyDerivation::ScryptParameters scrypt;
+        SecureMemory::SecureBytes key;
+
+        bool valid() const noexcept;
+        void Clear() noexcept;
+    };
+    SessionKey m_sessionKey;
+    mutable std::atomic<uint64_t> m_scryptRuns{0};
+    mutable std::atomic<uint64_t> m_scryptRunsAvoided{0};
+    uint64_t m_appendedCommits = 0;
+    uint64_t m_compactions = 0;
+    bool m_compressionEnabled = true;
+
+    // First entry name of the next ScrubIntegrity() call; empty to start over.
+    std::string m_scrubCursor;
+
+    // Outstanding EntryLease count per pinned entry name.
+    mutable std::map<std::string, size_t> m_leases;
+    bool Leased(const std::string& name) const { return m_leases.count(name) != 0; }
+
+    enum class AppendResult {
+        Appended,
+        CompactionDue,
+        RewriteRequired,
+        Failed
+    };
+
+    // A content-defined segment of a resident payload. packed holds its
+    // compressed form once a plan has tried to compress it.
+    struct ResidentSegment {
+        const FileEntry* file = nullptr;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        ArchiveIndex::Digest digest{};
+        bool compressionTried = false;
+        std::vector<uint8_t> packed;
+    };
+
+    // The resident payloads of one commit, cut, digested and compressed at
+    // most once however many layouts are planned from them, so a rewrite
+    // after a refused append does not repeat the work.
+    struct ResidentSegments {
+        bool ready = false;
+        ArchiveIndex::SegmentKey segmentKey{};
+        std::vector<ResidentSegment> segments;
+
+        ~ResidentSegments();
+    };
+
+    // Serializes every public operation with the committer thread. It is
+    // recursive because operations commit through other public methods.
+    using StateLock = std::lock_guard<std::recursive_mutex>;
+    mutable std::recursive_mutex m_stateMutex;
+
+    // Committer schedule and CommitStatus, guarded by m_commitMutex. Lock
+    // order is m_stateMutex before m_commitMutex.
+    mutable std::mutex m_commitMutex;
+    std::condition_variable m_commitWake;
+    std::thread m_committer;
+    bool m_stopCommitter = false;
+    bool m_commitDue = false;
+    std::chrono::steady_clock::time_point m_commitDeadline;
+    std::chrono::milliseconds m_commitDelay = DEFAULT_COMMIT_DELAY;
+    CommitStatus m_commitStatus{};
+
+    void RunCommitter();
+    void StopCommitter();
+
+    // Record staged changes and push the commit deadline back by the delay.
+    void MarkDirty(uint64_t changes);
+    bool DeferredCommitEnabled() const;
+
+    // Commit staged changes if there are any, recording the outcome.
+    bool CommitPending();
+
+    // Save by appending to the current container when possible, otherwise
+    // (or when compact is set) by atomically rewriting it. Success leaves no
+    // staged changes behind.
+    bool CommitArchive(bool compact, std::string* error = nullptr);
+
+    // Append the resident payloads and a new index to the PQCENC05 container
+    // m_container was read from, then publish them by writing the inactive
+    // head slot. Nothing is written unless the result is Appended or Failed.
+    AppendResult AppendToContainer(ResidentSegments& resident,
+                                   ContainerState& written,
+                                   std::string& revision) const;
+
+    // Whether m_container can take appends sealed with the session key.
+    bool CanAppend() const;
+
+    // Whether the archive on disk is still the revision this instance last
+    // read or wrote. Callers hold the archive lock.
+    bool DiskRevisionCurrent();
+
+    // Stream the source file of entry into the container ahead of the commit
+    // that publishes it, setting its size and hash. One thread reads fixed
+    // blocks, a second hashes them and cuts segments, and the caller digests,
+    // shares, compresses and seals each batch of segments in parallel; bounded
+    // queues connect the stages, so memory does not grow with the source.
+    // New blobs are appended after the end of the container and stay dead
+    // space until a commit references them. segments receives the blobs of
+    // the payload in order.
+    bool IngestSource(FileEntry& entry, std::vector<uint32_t>& segments, std::string& error);
+
+    // Authenticate a container and read its entries. PQCENC04/05 yield
+    // metadata plus blob locations in state; older formats are deserialized.
+    bool ReadContainer(const ArchiveStream::ReadAt& readAt,
+                       uint64_t containerSize,
+                       const std::string& password,
+                       EntryTable& files,
+                       ContainerState& state,
+                       bool* legacyFormat = nullptr,
+                       std::string* revision = nullptr) const;
+
+    // ReadContainer on the archive file at m_archivePath.
+    bool ReadArchiveFile(const std::string& password,
+                         EntryTable& files,
+                         ContainerState& state,
+                         bool* legacyFormat = nullptr,
+                         std::string* revision = nullptr) const;
+
+    // Where the bytes of each segment a commit seals come from: a resident
+    // segment, or a blob of the current container (resident is null)
+    // re-sealed as it is stored.
+    struct BlobSource {
+        ResidentSegment* resident = nullptr;
+        uint32_t storedBlob = 0;
+    };
+
+    // The index a commit publishes, with one source per segment.
+    struct ContainerPlan {
+        ArchiveIndex::Index index;
+        ArchiveMerkle::Tree merkle;
+        std::vector<BlobSource> sources;
+        uint64_t indexOffset = 0;
+    };
+
+    // Stream the complete PQCENC05 container laid out by plan into sink.
+    // Payloads that are not resident are re-encrypted chunk by chunk from
+    // m_container. A valid sessionKey derived with the preferred parameters
+    // replaces the scrypt run for password.
+    // The revision covers the preamble and both head slots (see
+    // ContainerRevision).
+    bool WriteEncryptedArchive(const std::string& password,
+                               ContainerPlan& plan,
+                               const ArchiveStream::Sink& sink,
+                               const SessionKey* sessionKey = nullptr,
+                               ContainerState* written = nullptr,
+                               std::string* revision = nullptr) const;
 
     bool BuildEncryptedArchive(const std::string& password,
                                std::vector<uint8_t>& output) const;
-    
-    // Deserialize archive from binary
-    bool DeserializeArchive(const std::vector<uint8_t>& data);
+
+    // Lay out the segments for m_files, in map order of first use. Resident
+    // payloads are cut into content-defined segments, and a segment whose
+    // digest is already planned or, for an append, already stored is shared
+    // instead of sealed again. A full layout starts at the data region; an
+    // append layout (appendOffset != 0) keeps stored blobs where they are and
+    // places only new segments at appendOffset.
+    bool PlanContainer(ContainerPlan& plan,
+                       ResidentSegments& resident,
+                       uint64_t appendOffset = 0) const;
+
+    // Seal every planned segment placed at or after firstOffset, in order,
+    // then the index itself bound to associatedData.
+    bool SealRecords(const ContainerPlan& plan,
+                     uint64_t firstOffset,
+                     const SecureMemory::SecureBytes& key,
+                     uint32_t chunkSize,
+                     const std::vector<uint8_t>& indexNonce,
+                     const std::vector<uint8_t>& associatedData,
+                     const ArchiveStream::Sink& sink) const;
+
+    // Opens one sealed blob and hands the authenticating reader to read.
+    // Chunks are opened in place when mapping is set and read through readAt
+    // otherwise. batchLimit bounds the plaintext the reader buffers.
+    bool ReadStoredBlob(const StoredBlob& blob,
+                        const ContainerState& state,
+                        const ArchiveStream::ReadAt& readAt,
+                        const MappedFile* mapping,
+                        const std::function<bool(ArchiveStream::OpeningReader&)>& read,
+                        size_t batchLimit = ArchiveStream::MAX_BATCH_SIZE) const;
+
+    // Stream the stored bytes of a blob, still compressed when it is, so a
+    // rewrite can re-seal them unchanged.
+    bool StreamStoredBytes(const StoredBlob& blob,
+                           const ContainerState& state,
+                           const ArchiveStream::ReadAt& readAt,
+                           const ArchiveStream::Sink& sink,
+                           const MappedFile* mapping = nullptr,
+                           size_t batchLimit = ArchiveStream::MAX_BATCH_SIZE) const;
+
+    // Stream the expanded payload of a blob.
+    bool StreamStoredBlob(const StoredBlob& blob,
+                          const ContainerState& state,
+                          const ArchiveStream::ReadAt& readAt,
+                          const ArchiveStream::Sink& sink,
+                          const MappedFile* mapping,
+                          size_t batchLimit = ArchiveStream::MAX_BATCH_SIZE) const;
+
+    // Open and expand a blob into exactly blob.size bytes at output.
+    bool LoadStoredBlob(const StoredBlob& blob,
+                        const ContainerState& state,
+                        const ArchiveStream::ReadAt& readAt,
+                        const MappedFile* mapping,
+                        uint8_t* output) const;
+
+    // Stream one authenticated payload, from memory when it is resident and
+    // otherwise from its blobs in the container described by state. Blobs are
+    // opened in parallel, one batch of at most batchLimit bytes at a time.
+    bool StreamEntryPayload(const FileEntry& entry,
+                            const ContainerState& state,
+                            const ArchiveStream::ReadAt& readAt,
+                            const ArchiveStream::Sink& sink,
+                            const MappedFile* mapping = nullptr,
+                            size_t batchLimit = ArchiveStream::MAX_BATCH_SIZE) const;
+
+    // Check the given entries in parallel and report them in the given order.
+    IntegrityReport CheckEntries(
+        const std::vector<std::pair<const std::string*, const FileEntry*>>& files,
+        const ProgressCallback& progress) const;
+
+    // Whether the metadata of a committed entry still hashes to its leaf and
+    // the leaf's path to the sealed root. Staged entries, and containers
+    // without a Merkle root, pass.
+    bool MatchesSealedLeaf(const std::string& name, const FileEntry& entry) const;
+
+    // Copy of one payload, decrypting only the blobs of that entry that are
+    // not cached, in parallel, when it is not resident.
+    template <typename Buffer>
+    bool LoadEntryPayload(const FileEntry& entry, Buffer& data) const;
+
+    // SHA-256 over the canonical serialization of files, used to prove that a
+    // re-encrypted container holds exactly the same entries.
+    bool DigestContents(const EntryTable& files,
+                        const ContainerState& state,
+                        const ArchiveStream::ReadAt& readAt,
+                        std::string& digest) const;
+
+    // Deserialize a legacy PQCENC01-03 payload into a staging map
+    bool DeserializeArchive(const ArchiveStream::Source& payload,
+                            uint64_t payloadSize,
+                            EntryTable& files) const;
     
     // Calculate file hash
-    std::string CalculateFileHash(const std::vector<uint8_t>& data) const;
+    std::string CalculateFileHash(const SecureMemory::SecureBytes& data) const;
     
     // Get timestamp
     std::string GetCurrentTimestamp() const;
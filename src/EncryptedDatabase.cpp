@@ -1,11 +1,13 @@
 #include "EncryptedDatabase.h"
 #include "AtomicFile.h"
 #include "FormatValidation.h"
+#include "KeyDerivation.h"
+#include "Log.h"
+#include "Metrics.h"
 #include <algorithm>
 #include <array>
 #include <filesystem>
 #include <fstream>
-#include <iostream>
 #include <iterator>
 #include <limits>
 #include <memory>
@@ -19,16 +21,14 @@
 
 namespace {
 
+constexpr Log::Module LOG_MODULE = Log::Module::Database;
+
 constexpr std::array<uint8_t, 8> DATABASE_MAGIC = {'P', 'Q', 'C', 'D', 'B', '0', '0', '2'};
 constexpr std::array<uint8_t, 8> BACKUP_MAGIC = {'P', 'Q', 'C', 'B', 'K', 'P', '0', '1'};
 constexpr char LEGACY_DATABASE_HEADER[] = "PQCWALLET_DB_v1.0\n";
 constexpr uint32_t DATABASE_FORMAT_VERSION = 2;
 constexpr uint32_t BACKUP_FORMAT_VERSION = 1;
 constexpr uint32_t KDF_SCRYPT = 1;
-constexpr uint64_t SCRYPT_N = 32768;
-constexpr uint32_t SCRYPT_R = 8;
-constexpr uint32_t SCRYPT_P = 1;
-constexpr uint64_t SCRYPT_MAX_MEMORY = 128ULL * 1024ULL * 1024ULL;
 constexpr size_t KEY_SIZE = 32;
 constexpr size_t SALT_SIZE = 32;
 constexpr size_t NONCE_SIZE = 12;
@@ -81,19 +81,15 @@ void Cleanse(std::vector<uint8_t>& data) {
 
 bool DeriveDatabaseKey(const std::string& password,
                        const std::vector<uint8_t>& salt,
-                       uint64_t n,
-                       uint64_t r,
-                       uint64_t p,
+                       const KeyDerivation::ScryptParameters& scrypt,
                        std::vector<uint8_t>& key) {
-    if (password.empty() || salt.size() != SALT_SIZE || n != SCRYPT_N ||
-        r != SCRYPT_R || p != SCRYPT_P) {
+    if (salt.size() != SALT_SIZE) {
         return false;
     }
 
     key.assign(KEY_SIZE, 0);
-    if (EVP_PBE_scrypt(password.data(), password.size(), salt.data(), salt.size(),
-                       n, r, p, SCRYPT_MAX_MEMORY, key.data(), key.size()) != 1) {
-        Cleanse(key);
+    if (!KeyDerivation::DeriveScrypt(password, salt.data(), salt.size(), scrypt, key.data(),
+                                     key.size())) {
         key.clear();
         return false;
     }
@@ -103,6 +99,7 @@ bool DeriveDatabaseKey(const std::string& password,
 std::vector<uint8_t> BuildAuthenticatedHeader(const std::array<uint8_t, 8>& magic,
                                               uint32_t formatVersion,
                                               uint64_t ciphertextSize,
+                                              const KeyDerivation::ScryptParameters& scrypt,
                                               const std::vector<uint8_t>& salt,
                                               const std::vector<uint8_t>& nonce) {
     std::vector<uint8_t> header;
@@ -110,9 +107,9 @@ std::vector<uint8_t> BuildAuthenticatedHeader(const std::array<uint8_t, 8>& magi
     header.insert(header.end(), magic.begin(), magic.end());
     AppendUint32(header, formatVersion);
     AppendUint32(header, KDF_SCRYPT);
-    AppendUint64(header, SCRYPT_N);
-    AppendUint32(header, SCRYPT_R);
-    AppendUint32(header, SCRYPT_P);
+    AppendUint64(header, scrypt.n);
+    AppendUint32(header, scrypt.r);
+    AppendUint32(header, scrypt.p);
     AppendUint32(header, static_cast<uint32_t>(salt.size()));
     AppendUint32(header, static_cast<uint32_t>(nonce.size()));
     AppendUint32(header, static_cast<uint32_t>(TAG_SIZE));
@@ -138,14 +135,18 @@ bool EncryptAuthenticatedPayload(const std::array<uint8_t, 8>& magic,
         return false;
     }
 
+    // Every save derives a fresh key, so a file written with other
+    // parameters moves to the preferred ones the next time it is saved.
+    const KeyDerivation::ScryptParameters scrypt = KeyDerivation::PreferredScrypt();
     std::vector<uint8_t> key;
     SecureMemory::ScopedCleanse keyGuard(key);
-    if (!DeriveDatabaseKey(password, salt, SCRYPT_N, SCRYPT_R, SCRYPT_P, key)) {
+    if (!DeriveDatabaseKey(password, salt, scrypt, key)) {
         return false;
     }
 
     std::vector<uint8_t> header =
-        BuildAuthenticatedHeader(magic, formatVersion, plaintext.size(), salt, nonce);
+        BuildAuthenticatedHeader(magic, formatVersion, plaintext.size(), scrypt, salt, nonce);
+    const Metrics::ScopedTimer timer(Metrics::Stage::AesGcm, plaintext.size());
     CipherContext context(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
     if (!context ||
         EVP_EncryptInit_ex(context.get(), EVP_aes_256_gcm(), nullptr, nullptr, nullptr) != 1 ||
@@ -224,7 +225,7 @@ bool DecryptAuthenticatedPayload(const std::array<uint8_t, 8>& expectedMagic,
     }
 
     if (version != expectedVersion || kdf != KDF_SCRYPT ||
-        n != SCRYPT_N || r != SCRYPT_R || p != SCRYPT_P ||
+        !FormatValidation::ValidateScryptParameters(n, r, p) ||
         saltSize != SALT_SIZE || nonceSize != NONCE_SIZE || tagSize != TAG_SIZE ||
         ciphertextSize == 0 || ciphertextSize > static_cast<uint64_t>(std::numeric_limits<int>::max())) {
         return false;
@@ -250,12 +251,17 @@ bool DecryptAuthenticatedPayload(const std::array<uint8_t, 8>& expectedMagic,
     offset += static_cast<size_t>(ciphertextSize);
     std::vector<uint8_t> tag(input.begin() + static_cast<std::ptrdiff_t>(offset), input.end());
 
+    KeyDerivation::ScryptParameters scrypt;
+    scrypt.n = n;
+    scrypt.r = r;
+    scrypt.p = p;
     std::vector<uint8_t> key;
     SecureMemory::ScopedCleanse keyGuard(key);
-    if (!DeriveDatabaseKey(password, salt, n, r, p, key)) {
+    if (!DeriveDatabaseKey(password, salt, scrypt, key)) {
         return false;
     }
 
+    const Metrics::ScopedTimer timer(Metrics::Stage::AesGcm, ciphertext.size());
     CipherContext context(EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
     if (!context ||
         EVP_DecryptInit_ex(context.get(), EVP_aes_256_gcm(), nullptr, nullptr, nullptr) != 1 ||
@@ -403,24 +409,23 @@ EncryptedDatabase::~EncryptedDatabase() {
 
 bool EncryptedDatabase::initialize() {
     if (master_password_.empty()) {
-        std::cerr << "[X] Database master password cannot be empty" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Database master password cannot be empty";
         return false;
     }
 
     const bool databaseExists = std::filesystem::exists(database_path_);
     if (databaseExists) {
         if (!loadDatabase()) {
-            std::cerr << "[X] Existing database could not be authenticated; it was not modified"
-                      << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "[X] Existing database could not be authenticated; it was not modified";
             return false;
         }
 
         if (is_modified_ && !saveDatabase()) {
-            std::cerr << "[X] Failed to migrate legacy database" << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "[X] Failed to migrate legacy database";
             return false;
         }
     } else {
-        std::cout << "[NEW] Creating encrypted database..." << std::endl;
+        PQC_LOG_INFO(LOG_MODULE) << "[NEW] Creating encrypted database...";
         database_json_.data["version"] = "2.0";
         database_json_.data["created_at"] = std::to_string(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
         database_json_.data["algorithm"] = "scrypt/AES-256-GCM";
@@ -428,27 +433,27 @@ bool EncryptedDatabase::initialize() {
         is_modified_ = true;
 
         if (!saveDatabase()) {
-            std::cerr << "[X] Failed to save new database" << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "[X] Failed to save new database";
             return false;
         }
     }
 
-    std::cout << "[OK] Encrypted Database initialized successfully!" << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "[OK] Encrypted Database initialized successfully!";
     return true;
 }
 
 bool EncryptedDatabase::addUser(const UserRecord& record) {
     if (!is_loaded_) {
-        std::cerr << "[X] Database not loaded" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Database not loaded";
         return false;
     }
     
-    std::cout << "[USER] Adding user: " << record.username << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "[USER] Adding user: " << record.username;
     
     // Check if user already exists
     std::string user_key = "user_" + record.username;
     if (database_json_.isMember(user_key)) {
-        std::cerr << "[X] User already exists: " << record.username << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] User already exists: " << record.username;
         return false;
     }
     
@@ -473,17 +478,17 @@ bool EncryptedDatabase::addUser(const UserRecord& record) {
     if (!saveDatabase()) {
         database_json_.data.erase(user_key);
         is_modified_ = previousModifiedState;
-        std::cerr << "[X] Failed to save database after adding user" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Failed to save database after adding user";
         return false;
     }
     
-    std::cout << "[OK] User added successfully: " << record.username << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "[OK] User added successfully: " << record.username;
     return true;
 }
 
 bool EncryptedDatabase::getUser(const std::string& username, UserRecord& record) {
     if (!is_loaded_) {
-        std::cerr << "[X] Database not loaded" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Database not loaded";
         return false;
     }
     
@@ -532,7 +537,7 @@ bool EncryptedDatabase::loadDatabase() {
     if (sizeError || rawSize == 0 || rawSize > MAX_DATABASE_FILE_SIZE ||
         rawSize > static_cast<uintmax_t>(std::numeric_limits<size_t>::max()) ||
         rawSize > static_cast<uintmax_t>(std::numeric_limits<std::streamsize>::max())) {
-        std::cerr << "[X] Database file size is invalid" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Database file size is invalid";
         return false;
     }
 
@@ -553,8 +558,7 @@ bool EncryptedDatabase::loadDatabase() {
     if (fileContent.size() >= DATABASE_MAGIC.size() &&
         std::equal(DATABASE_MAGIC.begin(), DATABASE_MAGIC.end(), fileContent.begin())) {
         if (!DecryptDatabasePayload(master_password_.get(), fileContent, jsonData)) {
-            std::cerr << "[X] Database authentication failed: wrong password or modified data"
-                      << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "[X] Database authentication failed: wrong password or modified data";
             return false;
         }
         is_modified_ = false;
@@ -563,27 +567,26 @@ bool EncryptedDatabase::loadDatabase() {
         if (fileContent.size() <= legacyHeaderSize ||
             !std::equal(std::begin(LEGACY_DATABASE_HEADER),
                         std::end(LEGACY_DATABASE_HEADER) - 1, fileContent.begin())) {
-            std::cerr << "[X] Unknown database format" << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "[X] Unknown database format";
             return false;
         }
 
         jsonData.assign(reinterpret_cast<const char*>(fileContent.data() + legacyHeaderSize),
                         fileContent.size() - legacyHeaderSize);
         is_modified_ = true;
-        std::cout << "[MIGRATE] Loaded legacy plaintext database; converting to PQCDB002"
-                  << std::endl;
+        PQC_LOG_INFO(LOG_MODULE) << "[MIGRATE] Loaded legacy plaintext database; converting to PQCDB002";
     }
 
     if (!database_json_.parseFromString(jsonData)) {
         OPENSSL_cleanse(jsonData.data(), jsonData.size());
-        std::cerr << "[X] Decrypted database payload is invalid" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Decrypted database payload is invalid";
         return false;
     }
 
     OPENSSL_cleanse(jsonData.data(), jsonData.size());
     database_json_.data["version"] = "2.0";
     database_json_.data["algorithm"] = "scrypt/AES-256-GCM";
-    std::cout << "[OK] Database loaded successfully" << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "[OK] Database loaded successfully";
     is_loaded_ = true;
     return true;
 }
@@ -597,18 +600,18 @@ bool EncryptedDatabase::saveDatabase() {
     std::vector<uint8_t> encryptedData;
     if (!EncryptDatabasePayload(master_password_.get(), jsonData, encryptedData)) {
         OPENSSL_cleanse(jsonData.data(), jsonData.size());
-        std::cerr << "[X] Failed to encrypt database" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Failed to encrypt database";
         return false;
     }
     OPENSSL_cleanse(jsonData.data(), jsonData.size());
 
     if (!AtomicFile::Write(database_path_, encryptedData)) {
-        std::cerr << "[X] Failed to atomically write encrypted database" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Failed to atomically write encrypted database";
         return false;
     }
 
     is_modified_ = false;
-    std::cout << "[OK] Database saved as PQCDB002 (scrypt + AES-256-GCM)" << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "[OK] Database saved as PQCDB002 (scrypt + AES-256-GCM)";
     return true;
 }
 
@@ -701,13 +704,13 @@ std::map<std::string, std::string> EncryptedDatabase::getStatistics() {
 
 bool EncryptedDatabase::updateUser(const std::string& username, const UserRecord& record) {
     if (!is_loaded_) {
-        std::cerr << "[X] Database not loaded" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Database not loaded";
         return false;
     }
     
     std::string user_key = "user_" + username;
     if (!database_json_.isMember(user_key)) {
-        std::cerr << "[X] User not found: " << username << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] User not found: " << username;
         return false;
     }
     
@@ -724,23 +727,23 @@ bool EncryptedDatabase::updateUser(const std::string& username, const UserRecord
     if (!saveDatabase()) {
         database_json_.data[user_key] = previousRecord;
         is_modified_ = previousModifiedState;
-        std::cerr << "[X] Failed to save database after updating user" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Failed to save database after updating user";
         return false;
     }
     
-    std::cout << "[OK] User updated successfully: " << username << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "[OK] User updated successfully: " << username;
     return true;
 }
 
 bool EncryptedDatabase::deleteUser(const std::string& username) {
     if (!is_loaded_) {
-        std::cerr << "[X] Database not loaded" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Database not loaded";
         return false;
     }
     
     std::string user_key = "user_" + username;
     if (!database_json_.isMember(user_key)) {
-        std::cerr << "[X] User not found: " << username << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] User not found: " << username;
         return false;
     }
     
@@ -753,11 +756,11 @@ bool EncryptedDatabase::deleteUser(const std::string& username) {
     if (!saveDatabase()) {
         database_json_.data.insert(std::move(removedRecord));
         is_modified_ = previousModifiedState;
-        std::cerr << "[X] Failed to save database after deleting user" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Failed to save database after deleting user";
         return false;
     }
     
-    std::cout << "[OK] User deleted successfully: " << username << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "[OK] User deleted successfully: " << username;
     return true;
 }
 
@@ -775,7 +778,7 @@ bool EncryptedDatabase::exportBackup(const std::string& backup_path, const std::
     const auto backupAbsolute =
         std::filesystem::absolute(backup_path, pathError).lexically_normal();
     if (pathError || databaseAbsolute == backupAbsolute) {
-        std::cerr << "[X] Backup path must differ from the live database path" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Backup path must differ from the live database path";
         return false;
     }
 
@@ -798,12 +801,11 @@ bool EncryptedDatabase::exportBackup(const std::string& backup_path, const std::
     SecureMemory::Cleanse(verifiedPlaintext);
     CleanseJson(envelope);
     if (!prepared || !AtomicFile::Write(backupAbsolute, encryptedBackup)) {
-        std::cerr << "[X] Failed to create authenticated backup" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Failed to create authenticated backup";
         return false;
     }
 
-    std::cout << "[OK] Database backup exported as PQCBKP01: " << backupAbsolute
-              << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "[OK] Database backup exported as PQCBKP01: " << backupAbsolute;
     return true;
 }
 
@@ -829,7 +831,7 @@ bool EncryptedDatabase::importBackup(const std::string& backup_path, const std::
     if (!ReadBackupFile(backupAbsolute, encryptedBackup) ||
         !DecryptBackupPayload(backup_password, encryptedBackup, envelopeText)) {
         SecureMemory::Cleanse(envelopeText);
-        std::cerr << "[X] Backup authentication failed" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Backup authentication failed";
         return false;
     }
 
@@ -859,7 +861,7 @@ bool EncryptedDatabase::importBackup(const std::string& backup_path, const std::
         SecureMemory::Cleanse(databasePayload);
         SecureMemory::Cleanse(normalizedPayload);
         CleanseJson(importedDatabase);
-        std::cerr << "[X] Authenticated backup contains an invalid database" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Authenticated backup contains an invalid database";
         return false;
     }
 
@@ -878,7 +880,7 @@ bool EncryptedDatabase::importBackup(const std::string& backup_path, const std::
     SecureMemory::Cleanse(verifiedPayload);
     if (!replacementValid || !AtomicFile::Write(databaseAbsolute, replacement)) {
         CleanseJson(importedDatabase);
-        std::cerr << "[X] Backup was valid, but database replacement failed" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "[X] Backup was valid, but database replacement failed";
         return false;
     }
 
@@ -886,7 +888,7 @@ bool EncryptedDatabase::importBackup(const std::string& backup_path, const std::
     database_json_.data.swap(importedDatabase.data);
     CleanseJson(importedDatabase);
     is_modified_ = false;
-    std::cout << "[OK] Database restored from authenticated PQCBKP01 backup" << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "[OK] Database restored from authenticated PQCBKP01 backup";
     return true;
 }
 
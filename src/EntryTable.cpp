@@ -0,0 +1,87 @@
+#include "EntryTable.h"
+
+#include "PathSecurity.h"
+#include "SecureMemory.h"
+
+#include <utility>
+
+EntryTable::EntryTable(EntryTable&& other) noexcept {
+    swap(other);
+}
+
+EntryTable& EntryTable::operator=(EntryTable&& other) noexcept {
+    if (this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+EntryTable::iterator EntryTable::find(const std::string& name) {
+    const iterator found = FindEquivalent(name);
+    return found != end() && found->first == name ? found : end();
+}
+
+EntryTable::const_iterator EntryTable::find(const std::string& name) const {
+    const const_iterator found = FindEquivalent(name);
+    return found != end() && found->first == name ? found : end();
+}
+
+EntryTable::iterator EntryTable::FindEquivalent(const std::string& name) {
+    const auto key = keys_.find(PathSecurity::CollisionKey(name));
+    return key != keys_.end() ? key->second : end();
+}
+
+EntryTable::const_iterator EntryTable::FindEquivalent(const std::string& name) const {
+    const auto key = keys_.find(PathSecurity::CollisionKey(name));
+    return key != keys_.end() ? const_iterator(key->second) : end();
+}
+
+bool EntryTable::insert(const std::string& name, FileEntry entry) {
+    auto key = keys_.try_emplace(PathSecurity::CollisionKey(name), end());
+    if (!key.second) {
+        return false;
+    }
+    key.first->second = entries_.emplace(name, std::move(entry)).first;
+    return true;
+}
+
+bool EntryTable::insert(node_type&& node) {
+    if (node.empty()) {
+        return false;
+    }
+    auto key = keys_.try_emplace(PathSecurity::CollisionKey(node.key()), end());
+    if (!key.second) {
+        return false;
+    }
+    key.first->second = entries_.insert(std::move(node)).position;
+    return true;
+}
+
+EntryTable::node_type EntryTable::extract(const_iterator position) {
+    keys_.erase(PathSecurity::CollisionKey(position->first));
+    return entries_.extract(position);
+}
+
+EntryTable::node_type EntryTable::extract(const std::string& name) {
+    const const_iterator found = std::as_const(*this).find(name);
+    return found != end() ? extract(found) : node_type();
+}
+
+void EntryTable::Cleanse() noexcept {
+    for (auto& [name, entry] : entries_) {
+        (void)name;
+        SecureMemory::Cleanse(entry.data);
+    }
+    clear();
+}
+
+void EntryTable::clear() noexcept {
+    keys_.clear();
+    entries_.clear();
+}
+
+void EntryTable::swap(EntryTable& other) noexcept {
+    entries_.swap(other.entries_);
+    keys_.swap(other.keys_);
+}
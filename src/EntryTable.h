@@ -0,0 +1,69 @@
+#pragma once
+
+#include "SecureArena.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct FileEntry {
+    std::string name;
+    std::string path;
+    SecureMemory::SecureBytes data;
+    size_t size;
+    std::string timestamp;
+    std::string hash;
+};
+
+// Archive entries by name, iterated in name order (the order payloads are laid
+// out in a container), with a hash index on the portable collision form of
+// every name (PathSecurity::CollisionKey). Names in one table never collide,
+// so exact and equivalent lookups and insertions do not scan the table.
+class EntryTable {
+public:
+    using Map = std::map<std::string, FileEntry>;
+    using iterator = Map::iterator;
+    using const_iterator = Map::const_iterator;
+    using node_type = Map::node_type;
+
+    EntryTable() = default;
+    EntryTable(EntryTable&& other) noexcept;
+    EntryTable& operator=(EntryTable&& other) noexcept;
+    EntryTable(const EntryTable&) = delete;
+    EntryTable& operator=(const EntryTable&) = delete;
+
+    iterator begin() noexcept { return entries_.begin(); }
+    iterator end() noexcept { return entries_.end(); }
+    const_iterator begin() const noexcept { return entries_.begin(); }
+    const_iterator end() const noexcept { return entries_.end(); }
+    std::size_t size() const noexcept { return entries_.size(); }
+    bool empty() const noexcept { return entries_.empty(); }
+
+    iterator find(const std::string& name);
+    const_iterator find(const std::string& name) const;
+    std::size_t count(const std::string& name) const { return find(name) != end() ? 1 : 0; }
+    const_iterator lower_bound(const std::string& name) const { return entries_.lower_bound(name); }
+
+    // The entry whose name collides with name, exactly or after case folding.
+    iterator FindEquivalent(const std::string& name);
+    const_iterator FindEquivalent(const std::string& name) const;
+
+    // Adds an entry unless an equivalent name is already present.
+    bool insert(const std::string& name, FileEntry entry);
+    bool insert(node_type&& node);
+
+    node_type extract(const_iterator position);
+    node_type extract(const std::string& name);
+
+    // Wipes every resident payload, then drops the entries.
+    void Cleanse() noexcept;
+    void clear() noexcept;
+    void swap(EntryTable& other) noexcept;
+
+private:
+    Map entries_;
+    std::unordered_map<std::string, iterator> keys_;
+};
@@ -10,8 +10,19 @@ namespace {
 constexpr std::size_t MAX_COMPONENT_SIZE = 16U * 1024U * 1024U;
 constexpr std::size_t MAX_USER_FILE_SIZE = 64U * 1024U * 1024U;
 constexpr std::size_t MAX_CONTAINER_SIZE = 1024U * 1024U * 1024U;
+constexpr std::uint64_t MAX_STREAMED_CONTAINER_SIZE = 64ULL * 1024ULL * 1024ULL * 1024ULL;
+constexpr std::uint32_t MIN_ARCHIVE_CHUNK_SIZE = 4U * 1024U;
+constexpr std::uint32_t MAX_ARCHIVE_CHUNK_SIZE = 16U * 1024U * 1024U;
 constexpr std::array<std::uint8_t, 8> USER_V5_MAGIC =
     {'P', 'Q', 'C', 'U', 'S', 'R', '0', '5'};
+constexpr std::uint64_t MAX_ARCHIVE_INDEX_SIZE = 1024ULL * 1024ULL * 1024ULL;
+constexpr std::uint64_t MIN_ARCHIVE_INDEX_SIZE = 8;
+constexpr std::array<std::uint8_t, 8> ARCHIVE_V5_MAGIC =
+    {'P', 'Q', 'C', 'E', 'N', 'C', '0', '5'};
+constexpr std::array<std::uint8_t, 8> ARCHIVE_V4_MAGIC =
+    {'P', 'Q', 'C', 'E', 'N', 'C', '0', '4'};
+constexpr std::array<std::uint8_t, 8> ARCHIVE_V3_MAGIC =
+    {'P', 'Q', 'C', 'E', 'N', 'C', '0', '3'};
 constexpr std::array<std::uint8_t, 8> ARCHIVE_V2_MAGIC =
     {'P', 'Q', 'C', 'E', 'N', 'C', '0', '2'};
 constexpr std::array<std::uint8_t, 8> ARCHIVE_V1_MAGIC =
@@ -118,7 +129,7 @@ bool ValidateAuthenticatedContainer(const std::uint8_t* data, std::size_t size,
         !ReadBe32(data, size, offset, nonceSize) ||
         !ReadBe32(data, size, offset, tagSize) ||
         !ReadBe64(data, size, offset, ciphertextSize) ||
-        version != expectedVersion || kdf != 1 || n != 32768 || r != 8 || p != 1 ||
+        version != expectedVersion || kdf != 1 || !ValidateScryptParameters(n, r, p) ||
         saltSize != 32 || nonceSize != 12 || tagSize != 16 || ciphertextSize == 0 ||
         ciphertextSize > static_cast<std::uint64_t>(std::numeric_limits<int>::max())) {
         return false;
@@ -130,6 +141,12 @@ bool ValidateAuthenticatedContainer(const std::uint8_t* data, std::size_t size,
 
 } // namespace
 
+bool ValidateScryptParameters(std::uint64_t n, std::uint32_t r, std::uint32_t p) noexcept {
+    return n >= MIN_SCRYPT_N && n <= MAX_SCRYPT_N && (n & (n - 1)) == 0 &&
+           r >= MIN_SCRYPT_R && r <= MAX_SCRYPT_R && p >= 1 && p <= MAX_SCRYPT_P &&
+           n * r <= MAX_SCRYPT_MEMORY / 128U;
+}
+
 bool ValidateUserFile(const std::uint8_t* data, std::size_t size,
                       UserFormat* format) noexcept {
     if (format != nullptr) {
@@ -147,13 +164,27 @@ bool ValidateUserFile(const std::uint8_t* data, std::size_t size,
         if (!ReadBe32(data, size, offset, version) ||
             !ReadBe64(data, size, offset, totalSize) ||
             !ReadBe32(data, size, offset, componentCount) ||
-            version != 5 || totalSize != size || componentCount != 9) {
+            version != 5 || totalSize != size ||
+            (componentCount != 9 && componentCount != 10)) {
             return false;
         }
         for (std::uint32_t i = 0; i < componentCount; ++i) {
             std::uint64_t componentSize = 0;
-            if (!ReadBe64(data, size, offset, componentSize) || offset > size ||
-                !SkipComponent(size, offset, componentSize)) {
+            if (!ReadBe64(data, size, offset, componentSize) || offset > size) {
+                return false;
+            }
+            // The optional tenth component holds the scrypt N, r and p.
+            std::size_t kdfOffset = offset;
+            std::uint64_t n = 0;
+            std::uint32_t r = 0;
+            std::uint32_t p = 0;
+            if (i == 9 &&
+                (componentSize != 16 || !ReadBe64(data, size, kdfOffset, n) ||
+                 !ReadBe32(data, size, kdfOffset, r) || !ReadBe32(data, size, kdfOffset, p) ||
+                 !ValidateScryptParameters(n, r, p))) {
+                return false;
+            }
+            if (!SkipComponent(size, offset, componentSize)) {
                 return false;
             }
         }
@@ -193,7 +224,180 @@ bool ValidateUserFile(const std::uint8_t* data, std::size_t size,
     return valid;
 }
 
+bool ValidateArchiveV3Header(const std::uint8_t* header, std::size_t headerSize,
+                             std::uint64_t containerSize) noexcept {
+    if (header == nullptr || headerSize < ARCHIVE_V3_HEADER_SIZE ||
+        containerSize < ARCHIVE_V3_HEADER_SIZE ||
+        containerSize > MAX_STREAMED_CONTAINER_SIZE ||
+        !StartsWith(header, headerSize, ARCHIVE_V3_MAGIC)) {
+        return false;
+    }
+    std::size_t offset = ARCHIVE_V3_MAGIC.size();
+    std::uint32_t version = 0;
+    std::uint32_t kdf = 0;
+    std::uint64_t n = 0;
+    std::uint32_t r = 0;
+    std::uint32_t p = 0;
+    std::uint32_t saltSize = 0;
+    std::uint32_t nonceSize = 0;
+    std::uint32_t tagSize = 0;
+    std::uint32_t chunkSize = 0;
+    std::uint64_t payloadSize = 0;
+    if (!ReadBe32(header, headerSize, offset, version) ||
+        !ReadBe32(header, headerSize, offset, kdf) ||
+        !ReadBe64(header, headerSize, offset, n) ||
+        !ReadBe32(header, headerSize, offset, r) ||
+        !ReadBe32(header, headerSize, offset, p) ||
+        !ReadBe32(header, headerSize, offset, saltSize) ||
+        !ReadBe32(header, headerSize, offset, nonceSize) ||
+        !ReadBe32(header, headerSize, offset, tagSize) ||
+        !ReadBe32(header, headerSize, offset, chunkSize) ||
+        !ReadBe64(header, headerSize, offset, payloadSize) ||
+        version != 3 || kdf != 1 || !ValidateScryptParameters(n, r, p) ||
+        saltSize != 32 || nonceSize != 12 || tagSize != 16 ||
+        chunkSize < MIN_ARCHIVE_CHUNK_SIZE || chunkSize > MAX_ARCHIVE_CHUNK_SIZE ||
+        payloadSize == 0 || payloadSize > MAX_STREAMED_CONTAINER_SIZE ||
+        offset + saltSize + nonceSize != ARCHIVE_V3_HEADER_SIZE) {
+        return false;
+    }
+    const std::uint64_t chunkCount = payloadSize / chunkSize +
+                                     (payloadSize % chunkSize != 0 ? 1U : 0U);
+    const std::uint64_t sealedSize = payloadSize + chunkCount * tagSize;
+    return sealedSize == containerSize - ARCHIVE_V3_HEADER_SIZE;
+}
+
+bool ValidateArchiveV4Header(const std::uint8_t* header, std::size_t headerSize,
+                             std::uint64_t containerSize) noexcept {
+    if (header == nullptr || headerSize < ARCHIVE_V4_HEADER_SIZE ||
+        containerSize < ARCHIVE_V4_HEADER_SIZE ||
+        containerSize > MAX_STREAMED_CONTAINER_SIZE ||
+        !StartsWith(header, headerSize, ARCHIVE_V4_MAGIC)) {
+        return false;
+    }
+    std::size_t offset = ARCHIVE_V4_MAGIC.size();
+    std::uint32_t version = 0;
+    std::uint32_t kdf = 0;
+    std::uint64_t n = 0;
+    std::uint32_t r = 0;
+    std::uint32_t p = 0;
+    std::uint32_t saltSize = 0;
+    std::uint32_t nonceSize = 0;
+    std::uint32_t tagSize = 0;
+    std::uint32_t chunkSize = 0;
+    std::uint64_t indexOffset = 0;
+    std::uint64_t indexSize = 0;
+    if (!ReadBe32(header, headerSize, offset, version) ||
+        !ReadBe32(header, headerSize, offset, kdf) ||
+        !ReadBe64(header, headerSize, offset, n) ||
+        !ReadBe32(header, headerSize, offset, r) ||
+        !ReadBe32(header, headerSize, offset, p) ||
+        !ReadBe32(header, headerSize, offset, saltSize) ||
+        !ReadBe32(header, headerSize, offset, nonceSize) ||
+        !ReadBe32(header, headerSize, offset, tagSize) ||
+        !ReadBe32(header, headerSize, offset, chunkSize) ||
+        !ReadBe64(header, headerSize, offset, indexOffset) ||
+        !ReadBe64(header, headerSize, offset, indexSize) ||
+        version != 4 || kdf != 1 || !ValidateScryptParameters(n, r, p) ||
+        saltSize != 32 || nonceSize != 12 || tagSize != 16 ||
+        chunkSize < MIN_ARCHIVE_CHUNK_SIZE || chunkSize > MAX_ARCHIVE_CHUNK_SIZE ||
+        indexSize < MIN_ARCHIVE_INDEX_SIZE || indexSize > MAX_ARCHIVE_INDEX_SIZE ||
+        indexOffset < ARCHIVE_V4_HEADER_SIZE || indexOffset > containerSize ||
+        offset + saltSize + nonceSize != ARCHIVE_V4_HEADER_SIZE) {
+        return false;
+    }
+    // The sealed index must end exactly at the end of the container.
+    const std::uint64_t chunkCount = indexSize / chunkSize +
+                                     (indexSize % chunkSize != 0 ? 1U : 0U);
+    const std::uint64_t sealedIndexSize = indexSize + chunkCount * tagSize;
+    return sealedIndexSize == containerSize - indexOffset;
+}
+
+bool ValidateArchiveV5Preamble(const std::uint8_t* preamble, std::size_t preambleSize,
+                               std::uint64_t containerSize) noexcept {
+    if (preamble == nullptr || preambleSize < ARCHIVE_V5_PREAMBLE_SIZE ||
+        containerSize < ARCHIVE_V5_DATA_OFFSET ||
+        containerSize > MAX_STREAMED_CONTAINER_SIZE ||
+        !StartsWith(preamble, preambleSize, ARCHIVE_V5_MAGIC)) {
+        return false;
+    }
+    std::size_t offset = ARCHIVE_V5_MAGIC.size();
+    std::uint32_t version = 0;
+    std::uint32_t kdf = 0;
+    std::uint64_t n = 0;
+    std::uint32_t r = 0;
+    std::uint32_t p = 0;
+    std::uint32_t saltSize = 0;
+    std::uint32_t nonceSize = 0;
+    std::uint32_t tagSize = 0;
+    std::uint32_t chunkSize = 0;
+    return ReadBe32(preamble, preambleSize, offset, version) &&
+           ReadBe32(preamble, preambleSize, offset, kdf) &&
+           ReadBe64(preamble, preambleSize, offset, n) &&
+           ReadBe32(preamble, preambleSize, offset, r) &&
+           ReadBe32(preamble, preambleSize, offset, p) &&
+           ReadBe32(preamble, preambleSize, offset, saltSize) &&
+           ReadBe32(preamble, preambleSize, offset, nonceSize) &&
+           ReadBe32(preamble, preambleSize, offset, tagSize) &&
+           ReadBe32(preamble, preambleSize, offset, chunkSize) &&
+           version == 5 && kdf == 1 && ValidateScryptParameters(n, r, p) &&
+           saltSize == 32 && nonceSize == 12 && tagSize == 16 &&
+           chunkSize >= MIN_ARCHIVE_CHUNK_SIZE && chunkSize <= MAX_ARCHIVE_CHUNK_SIZE &&
+           offset + saltSize == ARCHIVE_V5_PREAMBLE_SIZE;
+}
+
+bool ValidateArchiveV5Slot(const std::uint8_t* slot, std::size_t slotSize,
+                           std::uint32_t chunkSize, std::uint64_t containerSize) noexcept {
+    if (slot == nullptr || slotSize < ARCHIVE_V5_SLOT_SIZE ||
+        chunkSize < MIN_ARCHIVE_CHUNK_SIZE || chunkSize > MAX_ARCHIVE_CHUNK_SIZE ||
+        containerSize > MAX_STREAMED_CONTAINER_SIZE) {
+        return false;
+    }
+    std::size_t offset = 0;
+    std::uint64_t generation = 0;
+    std::uint64_t indexOffset = 0;
+    std::uint64_t indexSize = 0;
+    if (!ReadBe64(slot, slotSize, offset, generation) ||
+        !ReadBe64(slot, slotSize, offset, indexOffset) ||
+        !ReadBe64(slot, slotSize, offset, indexSize) ||
+        generation == 0 ||
+        indexSize < MIN_ARCHIVE_INDEX_SIZE || indexSize > MAX_ARCHIVE_INDEX_SIZE ||
+        indexOffset < ARCHIVE_V5_DATA_OFFSET || indexOffset > containerSize) {
+        return false;
+    }
+    // The sealed index must lie inside the container; data after it is
+    // either a later commit or an interrupted append.
+    const std::uint64_t chunkCount = indexSize / chunkSize +
+                                     (indexSize % chunkSize != 0 ? 1U : 0U);
+    const std::uint64_t sealedIndexSize = indexSize + chunkCount * 16U;
+    return sealedIndexSize <= containerSize - indexOffset;
+}
+
 bool ValidateArchiveFile(const std::uint8_t* data, std::size_t size) noexcept {
+    if (StartsWith(data, size, ARCHIVE_V5_MAGIC)) {
+        if (!ValidateArchiveV5Preamble(data, size, size)) {
+            return false;
+        }
+        std::size_t offset = ARCHIVE_V5_PREAMBLE_SIZE - 32 - sizeof(std::uint32_t);
+        std::uint32_t chunkSize = 0;
+        if (!ReadBe32(data, size, offset, chunkSize)) {
+            return false;
+        }
+        for (std::size_t slot = 0; slot < 2; ++slot) {
+            const std::uint64_t slotOffset = ArchiveV5SlotOffset(slot);
+            if (ValidateArchiveV5Slot(data + slotOffset,
+                                      size - static_cast<std::size_t>(slotOffset),
+                                      chunkSize, size)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (StartsWith(data, size, ARCHIVE_V4_MAGIC)) {
+        return ValidateArchiveV4Header(data, size, size);
+    }
+    if (StartsWith(data, size, ARCHIVE_V3_MAGIC)) {
+        return ValidateArchiveV3Header(data, size, size);
+    }
     if (ValidateAuthenticatedContainer(data, size, ARCHIVE_V2_MAGIC, 2)) {
         return true;
     }
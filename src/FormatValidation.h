@@ -16,7 +16,56 @@ enum class UserFormat : std::uint8_t {
 
 bool ValidateUserFile(const std::uint8_t* data, std::size_t size,
                       UserFormat* format = nullptr) noexcept;
+
+// scrypt parameters a header may carry. N is a power of two; the block size r
+// and parallelism p are bounded so that a forged header can neither weaken
+// the derivation below 16 MiB nor make it allocate more than 1 GiB.
+constexpr std::uint64_t MIN_SCRYPT_N = 1ULL << 14;
+constexpr std::uint64_t MAX_SCRYPT_N = 1ULL << 20;
+constexpr std::uint32_t MIN_SCRYPT_R = 8;
+constexpr std::uint32_t MAX_SCRYPT_R = 32;
+constexpr std::uint32_t MAX_SCRYPT_P = 4;
+constexpr std::uint64_t MAX_SCRYPT_MEMORY = 1024ULL * 1024ULL * 1024ULL;
+
+bool ValidateScryptParameters(std::uint64_t n, std::uint32_t r, std::uint32_t p) noexcept;
+// Size of the fixed PQCENC03 header, including the salt and base nonce.
+constexpr std::size_t ARCHIVE_V3_HEADER_SIZE = 100;
+// Size of the fixed PQCENC04 header, including the salt and index nonce.
+constexpr std::size_t ARCHIVE_V4_HEADER_SIZE = 108;
+// PQCENC05 keeps its immutable preamble (format, KDF, chunk size and salt) in
+// the first page and two alternating head slots in the next two pages, so a
+// torn head write can never damage the preamble or the other slot. Records
+// are appended from ARCHIVE_V5_DATA_OFFSET on.
+constexpr std::size_t ARCHIVE_V5_PREAMBLE_SIZE = 80;
+constexpr std::size_t ARCHIVE_V5_SLOT_SIZE = 52;
+constexpr std::uint64_t ARCHIVE_V5_PAGE_SIZE = 4096;
+constexpr std::uint64_t ARCHIVE_V5_DATA_OFFSET = 3 * ARCHIVE_V5_PAGE_SIZE;
+
+constexpr std::uint64_t ArchiveV5SlotOffset(std::size_t slot) noexcept {
+    return ARCHIVE_V5_PAGE_SIZE * (slot + 1U);
+}
+
 bool ValidateArchiveFile(const std::uint8_t* data, std::size_t size) noexcept;
+
+// Validates a chunked PQCENC03 header against the size of the whole container
+// so that streamed loads can reject malformed files before reading the body.
+bool ValidateArchiveV3Header(const std::uint8_t* header, std::size_t headerSize,
+                             std::uint64_t containerSize) noexcept;
+
+// Validates an indexed PQCENC04 header. Only the location of the sealed index
+// can be checked here; entry blobs are bounded when the index is decoded.
+bool ValidateArchiveV4Header(const std::uint8_t* header, std::size_t headerSize,
+                             std::uint64_t containerSize) noexcept;
+// Validates the PQCENC05 preamble. The container may carry an unreferenced
+// tail left by an interrupted append, so only its bounds are checked here.
+bool ValidateArchiveV5Preamble(const std::uint8_t* preamble, std::size_t preambleSize,
+                               std::uint64_t containerSize) noexcept;
+
+// Validates the fields of one PQCENC05 head slot. The archive additionally
+// checks the slot checksum, so an empty or torn slot is skipped in favour of
+// the other one.
+bool ValidateArchiveV5Slot(const std::uint8_t* slot, std::size_t slotSize,
+                           std::uint32_t chunkSize, std::uint64_t containerSize) noexcept;
 bool ValidateDatabaseV2(const std::uint8_t* data, std::size_t size) noexcept;
 
 } // namespace FormatValidation
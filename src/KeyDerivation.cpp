@@ -0,0 +1,110 @@
+#include "KeyDerivation.h"
+#include "FormatValidation.h"
+#include "Metrics.h"
+
+#include <array>
+#include <mutex>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+namespace KeyDerivation {
+namespace {
+
+std::mutex g_preferredMutex;
+ScryptParameters g_preferred = DEFAULT_SCRYPT;
+
+bool RunScrypt(const std::string& password,
+               const std::uint8_t* salt,
+               std::size_t saltSize,
+               const ScryptParameters& parameters,
+               std::uint8_t* key,
+               std::size_t keySize) {
+    // OpenSSL needs the V array plus one block per lane on top of it.
+    const std::uint64_t maxMemory =
+        parameters.MemoryBytes() + 128U * parameters.r * (parameters.p + 1U) + 1024U * 1024U;
+    return EVP_PBE_scrypt(password.data(), password.size(), salt, saltSize, parameters.n,
+                          parameters.r, parameters.p, maxMemory, key, keySize) == 1;
+}
+
+} // namespace
+
+bool operator==(const ScryptParameters& left, const ScryptParameters& right) noexcept {
+    return left.n == right.n && left.r == right.r && left.p == right.p;
+}
+
+bool operator!=(const ScryptParameters& left, const ScryptParameters& right) noexcept {
+    return !(left == right);
+}
+
+bool IsSupported(const ScryptParameters& parameters) noexcept {
+    return FormatValidation::ValidateScryptParameters(parameters.n, parameters.r, parameters.p);
+}
+
+ScryptParameters PreferredScrypt() noexcept {
+    const std::lock_guard<std::mutex> lock(g_preferredMutex);
+    return g_preferred;
+}
+
+bool SetPreferredScrypt(const ScryptParameters& parameters) noexcept {
+    if (!IsSupported(parameters)) {
+        return false;
+    }
+    const std::lock_guard<std::mutex> lock(g_preferredMutex);
+    g_preferred = parameters;
+    return true;
+}
+
+ScryptParameters CalibrateScrypt(std::chrono::milliseconds targetTime,
+                                 std::uint64_t memoryBudget,
+                                 const std::atomic<bool>* stop) {
+    using Clock = std::chrono::steady_clock;
+    const std::string password = "calibration";
+    const std::array<std::uint8_t, 32> salt{};
+    std::array<std::uint8_t, 32> key{};
+
+    ScryptParameters chosen;
+    chosen.n = FormatValidation::MIN_SCRYPT_N;
+    while (chosen.n < FormatValidation::MAX_SCRYPT_N &&
+           (stop == nullptr || !stop->load())) {
+        const auto start = Clock::now();
+        if (!RunScrypt(password, salt.data(), salt.size(), chosen, key.data(), key.size())) {
+            break;
+        }
+        // scrypt time grows linearly with N, so the next step takes about
+        // twice as long as this one.
+        const auto elapsed = Clock::now() - start;
+        ScryptParameters next = chosen;
+        next.n *= 2;
+        if (elapsed * 2 > targetTime || next.MemoryBytes() > memoryBudget ||
+            !IsSupported(next)) {
+            break;
+        }
+        chosen = next;
+    }
+    OPENSSL_cleanse(key.data(), key.size());
+    return chosen;
+}
+
+bool DeriveScrypt(const std::string& password,
+                  const std::uint8_t* salt,
+                  std::size_t saltSize,
+                  const ScryptParameters& parameters,
+                  std::uint8_t* key,
+                  std::size_t keySize) {
+    if (key == nullptr || keySize == 0) {
+        return false;
+    }
+    OPENSSL_cleanse(key, keySize);
+    if (password.empty() || salt == nullptr || saltSize == 0 || !IsSupported(parameters)) {
+        return false;
+    }
+    const Metrics::ScopedTimer timer(Metrics::Stage::Scrypt);
+    if (!RunScrypt(password, salt, saltSize, parameters, key, keySize)) {
+        OPENSSL_cleanse(key, keySize);
+        return false;
+    }
+    return true;
+}
+
+} // namespace KeyDerivation
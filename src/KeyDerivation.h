@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Password-based key derivation shared by archives, the password database
+// and user files. Every container records the scrypt parameters it was sealed
+// with, so a file opens with its own cost while new saves use the preferred
+// parameters of this process; a container with other parameters is re-keyed
+// the next time it is written.
+namespace KeyDerivation {
+
+struct ScryptParameters {
+    std::uint64_t n = 32768;
+    std::uint32_t r = 8;
+    std::uint32_t p = 1;
+
+    // Memory scrypt allocates for one derivation.
+    std::uint64_t MemoryBytes() const noexcept { return 128U * n * r; }
+};
+
+bool operator==(const ScryptParameters& left, const ScryptParameters& right) noexcept;
+bool operator!=(const ScryptParameters& left, const ScryptParameters& right) noexcept;
+
+// The parameters every container used before they were recorded per file.
+constexpr ScryptParameters DEFAULT_SCRYPT{};
+
+// Within the bounds FormatValidation accepts from a header.
+bool IsSupported(const ScryptParameters& parameters) noexcept;
+
+// Parameters new containers are sealed with; DEFAULT_SCRYPT until set.
+ScryptParameters PreferredScrypt() noexcept;
+bool SetPreferredScrypt(const ScryptParameters& parameters) noexcept;
+
+// Times scrypt on this machine with r = 8 and p = 1, doubling N from the
+// supported minimum while the next step is expected to stay within
+// targetTime and memoryBudget. The result is always supported; a budget
+// below the minimum yields the minimum. Takes roughly twice targetTime, so
+// interactive callers run it on a worker; setting stop ends it after the
+// current run with the cost reached so far.
+ScryptParameters CalibrateScrypt(std::chrono::milliseconds targetTime,
+                                 std::uint64_t memoryBudget,
+                                 const std::atomic<bool>* stop = nullptr);
+
+// Derives keySize bytes from password and salt. Fails for an empty password
+// or unsupported parameters and leaves key zeroed on failure.
+bool DeriveScrypt(const std::string& password,
+                  const std::uint8_t* salt,
+                  std::size_t saltSize,
+                  const ScryptParameters& parameters,
+                  std::uint8_t* key,
+                  std::size_t keySize);
+
+} // namespace KeyDerivation
@@ -0,0 +1,257 @@
+#include "Log.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Log {
+namespace {
+
+struct Record {
+    Level level = Level::Info;
+    Module module = Module::Archive;
+    std::string message;
+};
+
+// Bounded multi-producer queue after Dmitry Vyukov: each cell carries a
+// sequence number, so producers claim cells with one compare-and-swap and
+// never wait for each other. Only the writer thread pops.
+class RecordQueue {
+public:
+    explicit RecordQueue(std::size_t capacity) : cells_(capacity), mask_(capacity - 1) {
+        for (std::size_t i = 0; i < capacity; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool Push(Record&& record) {
+        std::size_t position = enqueue_.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        for (;;) {
+            cell = &cells_[position & mask_];
+            const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            if (sequence == position) {
+                if (enqueue_.compare_exchange_weak(position, position + 1,
+                                                   std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (sequence < position) {
+                return false;
+            } else {
+                position = enqueue_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->record = std::move(record);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(Record& record) {
+        const std::size_t position = dequeue_;
+        Cell& cell = cells_[position & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != position + 1) {
+            return false;
+        }
+        record = std::move(cell.record);
+        cell.record.message.clear();
+        cell.sequence.store(position + mask_ + 1, std::memory_order_release);
+        dequeue_ = position + 1;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence{0};
+        Record record;
+    };
+
+    std::vector<Cell> cells_;
+    const std::size_t mask_;
+    std::atomic<std::size_t> enqueue_{0};
+    std::size_t dequeue_ = 0;
+};
+
+static_assert((QUEUE_CAPACITY & (QUEUE_CAPACITY - 1)) == 0, "Queue capacity must be a power of two");
+
+void WriteConsole(Level level, Module, const std::string& message) {
+    std::ostream& stream = level >= Level::Warning ? std::cerr : std::cout;
+    stream << message << '\n';
+}
+
+class Logger {
+public:
+    // Never destroyed, so statements in static destructors can still log.
+    static Logger& Instance() {
+        static Logger* logger = new Logger();
+        return *logger;
+    }
+
+    std::array<std::atomic<std::uint8_t>, MODULE_COUNT> levels;
+    std::atomic<bool> asynchronous{true};
+    std::atomic<std::uint64_t> dropped{0};
+
+    void Write(Record&& record) {
+        if (!asynchronous.load(std::memory_order_relaxed)) {
+            const std::lock_guard<std::mutex> lock(sinkMutex_);
+            Deliver(record);
+            FlushConsole();
+            return;
+        }
+        std::call_once(started_, [this] {
+            std::thread(&Logger::Run, this).detach();
+            std::atexit([] { Log::Flush(); });
+        });
+        if (!queue_.Push(std::move(record))) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // Sequentially consistent with the writer's idle_ store: either the
+        // writer sees this record in its wait predicate or this sees idle_.
+        accepted_.fetch_add(1);
+        if (idle_.load()) {
+            const std::lock_guard<std::mutex> lock(wakeMutex_);
+            wake_.notify_one();
+        }
+    }
+
+    void Flush() {
+        const std::uint64_t target = accepted_.load(std::memory_order_acquire);
+        std::unique_lock<std::mutex> lock(drainMutex_);
+        drained_.wait(lock, [&] { return written_.load(std::memory_order_acquire) >= target; });
+    }
+
+    void SetSink(Sink sink) {
+        Flush();
+        const std::lock_guard<std::mutex> lock(sinkMutex_);
+        sink_ = std::move(sink);
+    }
+
+private:
+    Logger() : queue_(QUEUE_CAPACITY) {
+        for (auto& level : levels) {
+            level.store(static_cast<std::uint8_t>(Level::Info), std::memory_order_relaxed);
+        }
+    }
+
+    void Deliver(const Record& record) {
+        if (sink_) {
+            sink_(record.level, record.module, record.message);
+        } else {
+            WriteConsole(record.level, record.module, record.message);
+        }
+    }
+
+    void FlushConsole() {
+        if (!sink_) {
+            std::cout.flush();
+            std::cerr.flush();
+        }
+    }
+
+    // One flush per drained batch instead of one per line.
+    void Run() {
+        Record record;
+        for (;;) {
+            std::uint64_t delivered = 0;
+            {
+                const std::lock_guard<std::mutex> lock(sinkMutex_);
+                while (queue_.Pop(record)) {
+                    Deliver(record);
+                    ++delivered;
+                }
+                if (delivered != 0) {
+                    FlushConsole();
+                }
+            }
+            if (delivered != 0) {
+                written_.fetch_add(delivered, std::memory_order_release);
+                const std::lock_guard<std::mutex> lock(drainMutex_);
+                drained_.notify_all();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            idle_.store(true);
+            wake_.wait(lock, [this] {
+                return accepted_.load() != written_.load(std::memory_order_relaxed);
+            });
+            idle_.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    RecordQueue queue_;
+    std::once_flag started_;
+    std::atomic<std::uint64_t> accepted_{0};
+    std::atomic<std::uint64_t> written_{0};
+    std::atomic<bool> idle_{false};
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::mutex drainMutex_;
+    std::condition_variable drained_;
+    std::mutex sinkMutex_;
+    Sink sink_;
+};
+
+} // namespace
+
+const char* ModuleName(Module module) noexcept {
+    switch (module) {
+    case Module::Archive:
+        return "archive";
+    case Module::Database:
+        return "database";
+    case Module::Passwords:
+        return "passwords";
+    case Module::Transactions:
+        return "transactions";
+    }
+    return "unknown";
+}
+
+void SetLevel(Level level) noexcept {
+    for (auto& moduleLevel : Logger::Instance().levels) {
+        moduleLevel.store(static_cast<std::uint8_t>(level), std::memory_order_relaxed);
+    }
+}
+
+void SetModuleLevel(Module module, Level level) noexcept {
+    Logger::Instance().levels[static_cast<std::size_t>(module)].store(
+        static_cast<std::uint8_t>(level), std::memory_order_relaxed);
+}
+
+bool Enabled(Level level, Module module) noexcept {
+    return static_cast<std::uint8_t>(level) >=
+           Logger::Instance().levels[static_cast<std::size_t>(module)].load(
+               std::memory_order_relaxed);
+}
+
+void SetSink(Sink sink) {
+    Logger::Instance().SetSink(std::move(sink));
+}
+
+void SetAsynchronous(bool asynchronous) {
+    Logger& logger = Logger::Instance();
+    if (!asynchronous) {
+        logger.Flush();
+    }
+    logger.asynchronous.store(asynchronous, std::memory_order_relaxed);
+}
+
+void Flush() {
+    Logger::Instance().Flush();
+}
+
+std::uint64_t Dropped() noexcept {
+    return Logger::Instance().dropped.load(std::memory_order_relaxed);
+}
+
+void Write(Level level, Module module, std::string message) {
+    Logger::Instance().Write(Record{level, module, std::move(message)});
+}
+
+} // namespace Log
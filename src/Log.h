@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <sstream>
+#include <string>
+
+// Leveled diagnostics for the storage modules. A record is formatted in the
+// calling thread, pushed into a bounded lock-free queue and written by one
+// background thread, so callers never wait on console I/O. A full queue
+// drops the record and counts it instead of blocking.
+//
+// Statements below PQC_LOG_MIN_LEVEL are compiled out; the rest are filtered
+// at runtime per module (Info by default). Entry names and other archive
+// metadata are only logged at Debug and below.
+//
+//   PQC_LOG_INFO(Log::Module::Archive) << "Committed " << count << " change(s)";
+
+#ifndef PQC_LOG_MIN_LEVEL
+#define PQC_LOG_MIN_LEVEL 1
+#endif
+
+namespace Log {
+
+enum class Level : std::uint8_t { Trace = 0, Debug = 1, Info = 2, Warning = 3, Error = 4, Off = 5 };
+
+enum class Module : std::uint8_t { Archive, Database, Passwords, Transactions };
+constexpr std::size_t MODULE_COUNT = 4;
+
+constexpr std::size_t QUEUE_CAPACITY = 8192;
+
+using Sink = std::function<void(Level level, Module module, const std::string& message)>;
+
+const char* ModuleName(Module module) noexcept;
+
+// Lowest level written, for every module or for one.
+void SetLevel(Level level) noexcept;
+void SetModuleLevel(Module module, Level level) noexcept;
+bool Enabled(Level level, Module module) noexcept;
+
+// Replace the writer; an empty sink restores the console (Warning and Error
+// to stderr, the rest to stdout). Queued records are written first.
+void SetSink(Sink sink);
+
+// Write records in the calling thread instead of the background thread.
+void SetAsynchronous(bool asynchronous);
+
+// Wait until every record queued so far has been written.
+void Flush();
+
+// Records dropped because the queue was full.
+std::uint64_t Dropped() noexcept;
+
+void Write(Level level, Module module, std::string message);
+
+// Collects one record and hands it to Write when the statement ends.
+class Line {
+public:
+    Line(Level level, Module module) : level_(level), module_(module) {}
+    ~Line() { Write(level_, module_, stream_.str()); }
+
+    Line(const Line&) = delete;
+    Line& operator=(const Line&) = delete;
+
+    std::ostream& stream() { return stream_; }
+
+private:
+    Level level_;
+    Module module_;
+    std::ostringstream stream_;
+};
+
+} // namespace Log
+
+#define PQC_LOG(level, module)                                              \
+    if (static_cast<int>(level) < PQC_LOG_MIN_LEVEL ||                      \
+        !::Log::Enabled(level, module)) {                                   \
+    } else                                                                  \
+        ::Log::Line(level, module).stream()
+
+#define PQC_LOG_TRACE(module) PQC_LOG(::Log::Level::Trace, module)
+#define PQC_LOG_DEBUG(module) PQC_LOG(::Log::Level::Debug, module)
+#define PQC_LOG_INFO(module) PQC_LOG(::Log::Level::Info, module)
+#define PQC_LOG_WARN(module) PQC_LOG(::Log::Level::Warning, module)
+#define PQC_LOG_ERROR(module) PQC_LOG(::Log::Level::Error, module)
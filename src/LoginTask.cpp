@@ -0,0 +1,169 @@
+#include "LoginTask.h"
+#include "Log.h"
+#include "PasswordManager.h"
+#include "PathSecurity.h"
+
+#include <filesystem>
+#include <system_error>
+
+namespace {
+
+constexpr Log::Module LOG_MODULE = Log::Module::Passwords;
+
+bool IsFinished(LoginTask::Stage stage) noexcept {
+    return stage == LoginTask::Stage::Succeeded || stage == LoginTask::Stage::Failed ||
+           stage == LoginTask::Stage::Cancelled;
+}
+
+} // namespace
+
+LoginTask::~LoginTask() {
+    Cancel();
+    Join();
+}
+
+bool LoginTask::Start(const std::string& username, std::string_view password) {
+    if (IsRunning() || username.empty() || password.empty()) {
+        return false;
+    }
+    // A finished attempt that was never collected is dropped here.
+    Join();
+    m_result.reset();
+
+    auto session = std::make_unique<Session>();
+    session->username = username;
+    if (!session->password.assign(password)) {
+        return false;
+    }
+    m_cancelRequested = false;
+    m_stage = Stage::VerifyingPassword;
+    try {
+        m_worker = std::thread(&LoginTask::Run, this, std::move(session));
+    } catch (const std::system_error&) {
+        m_stage = Stage::Idle;
+        return false;
+    }
+    return true;
+}
+
+void LoginTask::Cancel() noexcept {
+    if (IsRunning()) {
+        m_cancelRequested = true;
+    }
+}
+
+LoginTask::Stage LoginTask::GetStage() const noexcept {
+    return m_stage.load(std::memory_order_acquire);
+}
+
+bool LoginTask::IsRunning() const noexcept {
+    const Stage stage = GetStage();
+    return stage != Stage::Idle && !IsFinished(stage);
+}
+
+bool LoginTask::IsCancelRequested() const noexcept {
+    return m_cancelRequested.load();
+}
+
+std::unique_ptr<LoginTask::Session> LoginTask::TakeSession() {
+    if (GetStage() != Stage::Succeeded) {
+        return nullptr;
+    }
+    Join();
+    m_stage = Stage::Idle;
+    return std::move(m_result);
+}
+
+void LoginTask::Reset() {
+    if (IsRunning()) {
+        return;
+    }
+    Join();
+    m_result.reset();
+    m_stage = Stage::Idle;
+}
+
+const char* LoginTask::StageLabel(Stage stage) noexcept {
+    switch (stage) {
+    case Stage::Idle:
+        return "Ready";
+    case Stage::VerifyingPassword:
+        return "Verifying password...";
+    case Stage::OpeningDatabase:
+        return "Opening password database...";
+    case Stage::OpeningArchive:
+        return "Opening archive...";
+    case Stage::Succeeded:
+        return "Login successful";
+    case Stage::Failed:
+        return "Authentication failed";
+    case Stage::Cancelled:
+        return "Login cancelled";
+    }
+    return "Unknown";
+}
+
+void LoginTask::Run(std::unique_ptr<Session> session) {
+    try {
+        const PasswordManager manager;
+        if (!manager.VerifyPassword(session->username, session->password.get())) {
+            m_stage.store(Stage::Failed, std::memory_order_release);
+            return;
+        }
+        if (StopIfCancelled(session)) {
+            return;
+        }
+
+        m_stage.store(Stage::OpeningDatabase, std::memory_order_release);
+        std::filesystem::path databasePath;
+        if (PathSecurity::UserDatabasePath(session->username, databasePath)) {
+            auto database = std::make_shared<EncryptedDatabase>(databasePath.string(),
+                                                                session->password.get());
+            if (database->initialize()) {
+                session->database = std::move(database);
+            } else {
+                PQC_LOG_WARN(LOG_MODULE) << "The password database could not be opened at login";
+            }
+        }
+        if (StopIfCancelled(session)) {
+            return;
+        }
+
+        m_stage.store(Stage::OpeningArchive, std::memory_order_release);
+        auto archive = std::make_unique<CryptoArchive>(session->username);
+        session->archiveCreated = !archive->ArchiveExists();
+        const bool archiveReady = session->archiveCreated
+            ? archive->InitializeArchive(session->password.get())
+            : archive->LoadArchive(session->password.get());
+        if (archiveReady) {
+            session->archive = std::move(archive);
+        } else {
+            PQC_LOG_WARN(LOG_MODULE) << "The default archive could not be opened at login";
+        }
+        if (StopIfCancelled(session)) {
+            return;
+        }
+
+        m_result = std::move(session);
+        m_stage.store(Stage::Succeeded, std::memory_order_release);
+    } catch (const std::exception& exception) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Login failed: " << exception.what();
+        m_stage.store(Stage::Failed, std::memory_order_release);
+    }
+}
+
+bool LoginTask::StopIfCancelled(std::unique_ptr<Session>& session) {
+    if (!m_cancelRequested.load()) {
+        return false;
+    }
+    // Close what was opened before publishing, so the caller's join is short.
+    session.reset();
+    m_stage.store(Stage::Cancelled, std::memory_order_release);
+    return true;
+}
+
+void LoginTask::Join() {
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+}
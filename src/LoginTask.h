@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "CryptoArchive.h"
+#include "EncryptedDatabase.h"
+#include "SecureMemory.h"
+
+// Authenticates a user on a worker thread so the UI keeps rendering while
+// scrypt and ML-KEM decapsulation run. Once the password verifies, the worker
+// also opens the user's password database and default archive, each of which
+// derives its own key, and hands all of it back as one Session.
+//
+// Cancel() takes effect between stages: a derivation that has already started
+// runs to completion and its result is discarded.
+class LoginTask {
+public:
+    enum class Stage : std::uint8_t {
+        Idle,
+        VerifyingPassword,
+        OpeningDatabase,
+        OpeningArchive,
+        Succeeded,
+        Failed,
+        Cancelled,
+    };
+
+    struct Session {
+        std::string username;
+        SecureMemory::SecureString password;
+        // Null when the database could not be opened; the login still succeeds.
+        std::shared_ptr<EncryptedDatabase> database;
+        // Loaded or newly created; null when neither worked.
+        std::unique_ptr<CryptoArchive> archive;
+        bool archiveCreated = false;
+    };
+
+    LoginTask() = default;
+    // Cancels a running attempt and waits for the worker.
+    ~LoginTask();
+
+    LoginTask(const LoginTask&) = delete;
+    LoginTask& operator=(const LoginTask&) = delete;
+
+    // Returns false while a previous attempt is still running, for an empty
+    // username or password, or when no thread could be started.
+    bool Start(const std::string& username, std::string_view password);
+    void Cancel() noexcept;
+
+    // Succeeded, Failed and Cancelled are only reported after the worker has
+    // finished, so the caller can collect the outcome without waiting.
+    Stage GetStage() const noexcept;
+    bool IsRunning() const noexcept;
+    bool IsCancelRequested() const noexcept;
+
+    // The verified session of a succeeded attempt, after which the task is
+    // Idle again; null in any other stage.
+    std::unique_ptr<Session> TakeSession();
+    // Returns a failed or cancelled attempt to Idle.
+    void Reset();
+
+    static const char* StageLabel(Stage stage) noexcept;
+
+private:
+    void Run(std::unique_ptr<Session> session);
+    bool StopIfCancelled(std::unique_ptr<Session>& session);
+    void Join();
+
+    std::thread m_worker;
+    std::atomic<Stage> m_stage{Stage::Idle};
+    std::atomic<bool> m_cancelRequested{false};
+    // Written by the worker before it publishes Succeeded.
+    std::unique_ptr<Session> m_result;
+};
@@ -11,7 +11,6 @@ LoginWindow::LoginWindow() : loginAttempted(false), loginSuccessful(false), show
 
 LoginWindow::~LoginWindow() {
     ClearBuffers();
-    password.clear();
 }
 
 void LoginWindow::Draw() {
@@ -24,6 +23,8 @@ void LoginWindow::Draw() {
         ImGuiCond_Always);
     
     if (ImGui::Begin("PQC Wallet - Login", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoCollapse)) {
+        PollLogin();
+        const bool loginRunning = loginTask.IsRunning();
         
         // Get theme-appropriate colors
         Settings& settings = Settings::Instance();
@@ -39,6 +40,9 @@ void LoginWindow::Draw() {
         ImGui::Spacing();
         ImGui::Spacing();
         
+        // The fields stay visible but locked while the worker authenticates
+        ImGui::BeginDisabled(loginRunning);
+        
         // Username field with dropdown if users exist
         ImGui::Text("Username:");
         ImGui::SetNextItemWidth(-1);
@@ -80,6 +84,7 @@ void LoginWindow::Draw() {
         
         // Checkbox for showing password
         ImGui::Checkbox("Show password", &showPassword);
+        ImGui::EndDisabled();
         
         ImGui::Spacing();
         
@@ -91,34 +96,29 @@ void LoginWindow::Draw() {
         
         ImGui::Spacing();
         
-        // Centered login button
+        // Centered login button, replaced by Cancel while the worker runs
         const float buttonWidth = 140.0f;
         ImGui::SetCursorPosX((ImGui::GetWindowWidth() - buttonWidth) * 0.5f);
-        const bool loginButtonPressed =
-            settings.Button("Login", Settings::ButtonVariant::Primary,
-                            buttonWidth, Settings::Metrics().largeButtonHeight);
-        if (enterPressed || loginButtonPressed) {
-            username = std::string(usernameBuffer);
-            const bool passwordCaptured = password.assign(passwordBuffer);
-            SecureMemory::Cleanse(passwordBuffer);
-            loginAttempted = true;
-            
-            // Verify password using PasswordManager
-            PasswordManager pm;
-            if (passwordCaptured && pm.VerifyPassword(username, password.get())) {
-                loginSuccessful = true;
-                errorMessage.clear();
-            } else {
-                loginSuccessful = false;
-                password.clear();
-                errorMessage = "Invalid username or password!";
+        if (loginRunning) {
+            if (settings.Button("Cancel", Settings::ButtonVariant::Secondary,
+                                buttonWidth, Settings::Metrics().largeButtonHeight)) {
+                loginTask.Cancel();
+            }
+        } else {
+            const bool loginButtonPressed =
+                settings.Button("Login", Settings::ButtonVariant::Primary,
+                                buttonWidth, Settings::Metrics().largeButtonHeight);
+            if (enterPressed || loginButtonPressed) {
+                StartLogin();
             }
         }
         
         ImGui::Spacing();
         
         // Status message
-        if (loginAttempted && !loginSuccessful) {
+        if (loginRunning) {
+            DrawProgress();
+        } else if (loginAttempted && !loginSuccessful) {
             ImGui::SetCursorPosX((ImGui::GetWindowWidth() - ImGui::CalcTextSize("Authentication failed...").x) * 0.5f);
             ImGui::TextColored(ImVec4(themeColors.errorText[0], themeColors.errorText[1], themeColors.errorText[2], themeColors.errorText[3]), "Authentication failed...");
         } else if (loginSuccessful) {
@@ -131,6 +131,49 @@ void LoginWindow::Draw() {
     ImGui::End();
 }
 
+void LoginWindow::StartLogin() {
+    username = std::string(usernameBuffer);
+    const bool started = loginTask.Start(username, passwordBuffer);
+    SecureMemory::Cleanse(passwordBuffer);
+    loginSuccessful = false;
+    errorMessage.clear();
+    if (!started) {
+        loginAttempted = true;
+        errorMessage = "Invalid username or password!";
+    }
+}
+
+void LoginWindow::PollLogin() {
+    switch (loginTask.GetStage()) {
+    case LoginTask::Stage::Succeeded:
+        // Stays here until the caller takes the session
+        loginAttempted = true;
+        loginSuccessful = true;
+        errorMessage.clear();
+        break;
+    case LoginTask::Stage::Failed:
+        loginTask.Reset();
+        loginAttempted = true;
+        loginSuccessful = false;
+        errorMessage = "Invalid username or password!";
+        break;
+    case LoginTask::Stage::Cancelled:
+        loginTask.Reset();
+        errorMessage = "Login cancelled.";
+        break;
+    default:
+        break;
+    }
+}
+
+void LoginWindow::DrawProgress() {
+    // scrypt reports no progress, so the bar only shows that work is under way
+    const char* label = loginTask.IsCancelRequested()
+        ? "Cancelling..."
+        : LoginTask::StageLabel(loginTask.GetStage());
+    ImGui::ProgressBar(-1.0f * static_cast<float>(ImGui::GetTime()), ImVec2(-1.0f, 0.0f), label);
+}
+
 void LoginWindow::LoadAvailableUsers() {
     PasswordManager pm;
     availableUsers = pm.GetUsernames();
@@ -144,6 +187,6 @@ void LoginWindow::ClearBuffers() {
 
 void LoginWindow::ResetLoginStatus() {
     loginSuccessful = false;
-    password.clear();
+    loginTask.Reset();
     SecureMemory::Cleanse(passwordBuffer);
 }
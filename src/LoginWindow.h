@@ -1,7 +1,8 @@
 #pragma once
+#include <memory>
 #include <string>
 #include <vector>
-#include "SecureMemory.h"
+#include "LoginTask.h"
 
 class LoginWindow {
 public:
@@ -11,16 +12,17 @@ public:
     void Draw();
     bool IsLoginAttempted() const { return loginAttempted; }
     const std::string& GetUsername() const { return username; }
-    const std::string& GetPassword() const { return password.get(); }
     void ResetLoginAttempt() { loginAttempted = false; }
     bool IsLoginSuccessful() const { return loginSuccessful; }
+    // The verified session of a successful attempt; null otherwise.
+    std::unique_ptr<LoginTask::Session> TakeSession() { return loginTask.TakeSession(); }
     void ResetLoginStatus();
     
 private:
     char usernameBuffer[256];
     char passwordBuffer[256];
     std::string username;
-    SecureMemory::SecureString password;
+    LoginTask loginTask;
     bool loginAttempted;
     bool loginSuccessful;
     bool showPassword;
@@ -28,6 +30,9 @@ private:
     std::vector<std::string> availableUsers;
     int selectedUser;
     
+    void StartLogin();
+    void PollLogin();
+    void DrawProgress();
     void LoadAvailableUsers();
     void ClearBuffers();
 };
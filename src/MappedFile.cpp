@@ -0,0 +1,65 @@
+#include "MappedFile.h"
+
+#include <limits>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+#ifdef _WIN32
+    // A mapped view keeps the file from being replaced by another process, so
+    // Windows keeps reading containers through streams.
+    (void)path;
+    return false;
+#else
+    int flags = O_RDONLY;
+#ifdef O_CLOEXEC
+    flags |= O_CLOEXEC;
+#endif
+    const int descriptor = ::open(path.c_str(), flags);
+    if (descriptor < 0) {
+        return false;
+    }
+    struct stat status {};
+    if (::fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode) || status.st_size <= 0 ||
+        static_cast<std::uint64_t>(status.st_size) > std::numeric_limits<std::size_t>::max()) {
+        ::close(descriptor);
+        return false;
+    }
+    const auto size = static_cast<std::size_t>(status.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    ::close(descriptor);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    data_ = static_cast<const std::uint8_t*>(mapping);
+    size_ = size;
+    return true;
+#endif
+}
+
+void MappedFile::Close() noexcept {
+#ifndef _WIN32
+    if (data_ != nullptr) {
+        ::munmap(const_cast<std::uint8_t*>(data_), static_cast<std::size_t>(size_));
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+const std::uint8_t* MappedFile::At(std::uint64_t offset, std::size_t size) const noexcept {
+    if (data_ == nullptr || offset > size_ || size > size_ - offset) {
+        return nullptr;
+    }
+    return data_ + offset;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole regular file. Archive writers only append
+// to a container or replace it atomically, never truncate it in place, so a
+// mapping stays valid for as long as one read operation holds it. Open fails on
+// platforms without mapping support, and callers fall back to stream reads.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // False for a missing, empty or unmappable file.
+    bool Open(const std::string& path);
+    void Close() noexcept;
+
+    [[nodiscard]] bool valid() const noexcept { return data_ != nullptr; }
+    [[nodiscard]] std::uint64_t size() const noexcept { return size_; }
+
+    // Pointer to size bytes at offset, or nullptr when they are not mapped.
+    [[nodiscard]] const std::uint8_t* At(std::uint64_t offset, std::size_t size) const noexcept;
+
+private:
+    const std::uint8_t* data_ = nullptr;
+    std::uint64_t size_ = 0;
+};
@@ -0,0 +1,168 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+namespace Metrics {
+namespace Detail {
+std::atomic<bool> enabled{false};
+} // namespace Detail
+
+namespace {
+
+struct StageSlot {
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> totalNanoseconds{0};
+    std::atomic<std::uint64_t> maxNanoseconds{0};
+    std::array<std::atomic<std::uint64_t>, BUCKET_COUNT> buckets{};
+};
+
+std::array<StageSlot, STAGE_COUNT>& Slots() {
+    static std::array<StageSlot, STAGE_COUNT> slots;
+    return slots;
+}
+
+std::size_t BucketFor(std::uint64_t nanoseconds) noexcept {
+    std::uint64_t micros = nanoseconds / 1000;
+    std::size_t bucket = 0;
+    while (micros != 0 && bucket + 1 < BUCKET_COUNT) {
+        micros >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+} // namespace
+
+double StageStats::MeanMicroseconds() const noexcept {
+    return count == 0 ? 0.0 : static_cast<double>(totalNanoseconds) / 1000.0 / static_cast<double>(count);
+}
+
+double StageStats::PercentileMicroseconds(double fraction) const noexcept {
+    if (count == 0) {
+        return 0.0;
+    }
+    const auto target = static_cast<std::uint64_t>(std::ceil(fraction * static_cast<double>(count)));
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= target && seen != 0) {
+            // The top bucket is open-ended; report the slowest sample instead.
+            return bucket + 1 == BUCKET_COUNT ? static_cast<double>(maxNanoseconds) / 1000.0
+                                              : BucketUpperMicroseconds(bucket);
+        }
+    }
+    return static_cast<double>(maxNanoseconds) / 1000.0;
+}
+
+const char* StageName(Stage stage) noexcept {
+    switch (stage) {
+    case Stage::Scrypt:
+        return "scrypt";
+    case Stage::AesGcm:
+        return "aes-gcm";
+    case Stage::Sha256:
+        return "sha-256";
+    case Stage::Serialization:
+        return "serialization";
+    case Stage::Compression:
+        return "compression";
+    case Stage::Fsync:
+        return "fsync";
+    case Stage::LockWait:
+        return "lock-wait";
+    case Stage::Load:
+        return "load";
+    case Stage::Commit:
+        return "commit";
+    case Stage::Extract:
+        return "extract";
+    }
+    return "unknown";
+}
+
+double BucketUpperMicroseconds(std::size_t bucket) noexcept {
+    return static_cast<double>(std::uint64_t{1} << bucket);
+}
+
+void SetEnabled(bool enabled) noexcept {
+    Detail::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Record(Stage stage, std::chrono::nanoseconds elapsed, std::uint64_t bytes) noexcept {
+    StageSlot& slot = Slots()[static_cast<std::size_t>(stage)];
+    const auto nanoseconds = static_cast<std::uint64_t>(std::max<std::int64_t>(elapsed.count(), 0));
+    slot.count.fetch_add(1, std::memory_order_relaxed);
+    slot.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    slot.totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    slot.buckets[BucketFor(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    std::uint64_t previous = slot.maxNanoseconds.load(std::memory_order_relaxed);
+    while (previous < nanoseconds &&
+           !slot.maxNanoseconds.compare_exchange_weak(previous, nanoseconds,
+                                                      std::memory_order_relaxed)) {
+    }
+}
+
+void Reset() noexcept {
+    for (StageSlot& slot : Slots()) {
+        slot.count.store(0, std::memory_order_relaxed);
+        slot.bytes.store(0, std::memory_order_relaxed);
+        slot.totalNanoseconds.store(0, std::memory_order_relaxed);
+        slot.maxNanoseconds.store(0, std::memory_order_relaxed);
+        for (auto& bucket : slot.buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::vector<StageStats> Snapshot() {
+    std::vector<StageStats> snapshot(STAGE_COUNT);
+    for (std::size_t i = 0; i < STAGE_COUNT; ++i) {
+        const StageSlot& slot = Slots()[i];
+        StageStats& stats = snapshot[i];
+        stats.stage = static_cast<Stage>(i);
+        stats.count = slot.count.load(std::memory_order_relaxed);
+        stats.bytes = slot.bytes.load(std::memory_order_relaxed);
+        stats.totalNanoseconds = slot.totalNanoseconds.load(std::memory_order_relaxed);
+        stats.maxNanoseconds = slot.maxNanoseconds.load(std::memory_order_relaxed);
+        for (std::size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+            stats.buckets[bucket] = slot.buckets[bucket].load(std::memory_order_relaxed);
+        }
+    }
+    return snapshot;
+}
+
+bool DumpToFile(const std::filesystem::path& path, std::string* error) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        if (error != nullptr) {
+            *error = "Could not open " + path.string();
+        }
+        return false;
+    }
+    out << "# stage\tcount\tbytes\ttotal_ms\tmean_us\tp50_us\tp99_us\tmax_us\n" << std::fixed
+        << std::setprecision(3);
+    for (const StageStats& stats : Snapshot()) {
+        if (stats.count == 0) {
+            continue;
+        }
+        out << StageName(stats.stage) << '\t' << stats.count << '\t' << stats.bytes << '\t'
+            << static_cast<double>(stats.totalNanoseconds) / 1e6 << '\t'
+            << stats.MeanMicroseconds() << '\t' << stats.PercentileMicroseconds(0.5) << '\t'
+            << stats.PercentileMicroseconds(0.99) << '\t'
+            << static_cast<double>(stats.maxNanoseconds) / 1000.0 << '\n';
+    }
+    out.flush();
+    if (!out) {
+        if (error != nullptr) {
+            *error = "Could not write " + path.string();
+        }
+        return false;
+    }
+    return true;
+}
+
+} // namespace Metrics
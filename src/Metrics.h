@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Process-wide counters and latency histograms for the storage hot paths.
+// Every stage owns a fixed slot of relaxed atomics, so recording never
+// allocates or locks. Collection is off by default; while it is off a
+// ScopedTimer costs one relaxed load and never reads the clock.
+//
+//   Metrics::ScopedTimer timer(Metrics::Stage::AesGcm, size);
+
+namespace Metrics {
+
+enum class Stage : std::uint8_t {
+    Scrypt,
+    AesGcm,
+    Sha256,
+    Serialization,
+    Compression,
+    Fsync,
+    LockWait,
+    Load,
+    Commit,
+    Extract,
+};
+constexpr std::size_t STAGE_COUNT = 10;
+
+// Bucket 0 holds samples under 1 us; bucket i holds [2^(i-1), 2^i) us and the
+// last one everything from about 4 s up.
+constexpr std::size_t BUCKET_COUNT = 24;
+
+struct StageStats {
+    Stage stage = Stage::Scrypt;
+    std::uint64_t count = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t totalNanoseconds = 0;
+    std::uint64_t maxNanoseconds = 0;
+    std::array<std::uint64_t, BUCKET_COUNT> buckets{};
+
+    double MeanMicroseconds() const noexcept;
+    // Upper bound of the bucket holding the given fraction of samples.
+    double PercentileMicroseconds(double fraction) const noexcept;
+};
+
+const char* StageName(Stage stage) noexcept;
+double BucketUpperMicroseconds(std::size_t bucket) noexcept;
+
+namespace Detail {
+extern std::atomic<bool> enabled;
+} // namespace Detail
+
+inline bool Enabled() noexcept {
+    return Detail::enabled.load(std::memory_order_relaxed);
+}
+void SetEnabled(bool enabled) noexcept;
+
+void Record(Stage stage, std::chrono::nanoseconds elapsed, std::uint64_t bytes = 0) noexcept;
+void Reset() noexcept;
+std::vector<StageStats> Snapshot();
+
+// Writes a plain-text report of every stage with samples, one line each.
+bool DumpToFile(const std::filesystem::path& path, std::string* error = nullptr);
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Stage stage, std::uint64_t bytes = 0) noexcept
+        : stage_(stage), bytes_(bytes), active_(Enabled()) {
+        if (active_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedTimer() {
+        if (active_) {
+            Record(stage_, std::chrono::steady_clock::now() - start_ - excluded_, bytes_);
+        }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    void AddBytes(std::uint64_t bytes) noexcept { bytes_ += bytes; }
+
+private:
+    friend class ScopedExclusion;
+
+    Stage stage_;
+    std::uint64_t bytes_;
+    bool active_;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::duration excluded_{};
+};
+
+// Leaves its own lifetime out of an enclosing timer, e.g. the decryption and
+// I/O an index decoder pulls through its reader, which have stages of their
+// own.
+class ScopedExclusion {
+public:
+    explicit ScopedExclusion(ScopedTimer& timer) noexcept : timer_(timer) {
+        if (timer_.active_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedExclusion() {
+        if (timer_.active_) {
+            timer_.excluded_ += std::chrono::steady_clock::now() - start_;
+        }
+    }
+
+    ScopedExclusion(const ScopedExclusion&) = delete;
+    ScopedExclusion& operator=(const ScopedExclusion&) = delete;
+
+private:
+    ScopedTimer& timer_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace Metrics
@@ -3,16 +3,15 @@
 #include "CryptoArchive.h"
 #include "EncryptedDatabase.h"
 #include "FormatValidation.h"
+#include "Log.h"
 #include "PathSecurity.h"
 #include "SecureMemory.h"
 #include "TransactionalFileBatch.h"
 #include <oqs/oqs.h>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
-#include <openssl/kdf.h>
 #include <openssl/crypto.h>
 #include <fstream>
-#include <iostream>
 #include <filesystem>
 #include <algorithm>
 #include <cstring>
@@ -22,10 +21,16 @@
 
 namespace {
 
+constexpr Log::Module LOG_MODULE = Log::Module::Passwords;
+
 constexpr uint64_t MAX_COMPONENT_SIZE = 16ULL * 1024ULL * 1024ULL;
 constexpr uint64_t MAX_USER_FILE_SIZE = 64ULL * 1024ULL * 1024ULL;
 constexpr std::array<uint8_t, 8> USER_V5_MAGIC = {'P', 'Q', 'C', 'U', 'S', 'R', '0', '5'};
 constexpr uint32_t USER_V5_COMPONENT_COUNT = 9;
+// Files written since KDF parameters became configurable add them as a
+// tenth component; files without it were derived with DEFAULT_SCRYPT.
+constexpr uint32_t USER_V5_KDF_COMPONENT_COUNT = 10;
+constexpr size_t USER_V5_KDF_COMPONENT_SIZE = 16;
 constexpr size_t USER_V5_FIXED_HEADER_SIZE = 24;
 
 void Cleanse(std::vector<uint8_t>& data) {
@@ -97,7 +102,8 @@ bool DecodeV5(const std::vector<uint8_t>& input,
         !ReadUint64(input, offset, totalSize) ||
         !ReadUint32(input, offset, componentCount) ||
         version != 5 || totalSize != input.size() ||
-        componentCount != USER_V5_COMPONENT_COUNT) {
+        (componentCount != USER_V5_COMPONENT_COUNT &&
+         componentCount != USER_V5_KDF_COMPONENT_COUNT)) {
         return false;
     }
 
@@ -111,8 +117,22 @@ bool DecodeV5(const std::vector<uint8_t>& input,
         !ReadPortableComponent(input, offset, candidate.encrypted_secret_key) ||
         !ReadPortableComponent(input, offset, candidate.encrypted_password) ||
         !ReadPortableComponent(input, offset, candidate.secret_key_auth_tag) ||
-        !ReadPortableComponent(input, offset, candidate.password_auth_tag) ||
-        offset != input.size()) {
+        !ReadPortableComponent(input, offset, candidate.password_auth_tag)) {
+        return false;
+    }
+    if (componentCount == USER_V5_KDF_COMPONENT_COUNT) {
+        std::vector<uint8_t> kdf;
+        size_t kdfOffset = 0;
+        if (!ReadPortableComponent(input, offset, kdf) ||
+            kdf.size() != USER_V5_KDF_COMPONENT_SIZE ||
+            !ReadUint64(kdf, kdfOffset, candidate.scrypt.n) ||
+            !ReadUint32(kdf, kdfOffset, candidate.scrypt.r) ||
+            !ReadUint32(kdf, kdfOffset, candidate.scrypt.p) ||
+            !KeyDerivation::IsSupported(candidate.scrypt)) {
+            return false;
+        }
+    }
+    if (offset != input.size()) {
         return false;
     }
     data = std::move(candidate);
@@ -155,8 +175,7 @@ PasswordManager::PasswordManager()
     : transaction_recovery_ready_(
           TransactionalFileBatch::RecoverPendingTransactions()) {
     if (!transaction_recovery_ready_) {
-        std::cerr << "Warning: an incomplete password transaction could not be recovered"
-                  << std::endl;
+        PQC_LOG_WARN(LOG_MODULE) << "an incomplete password transaction could not be recovered";
     }
     EnsureUsersDirectory();
 }
@@ -175,56 +194,20 @@ std::vector<uint8_t> PasswordManager::GenerateRandomBytes(size_t length) const {
     }
     std::vector<uint8_t> bytes(length);
     if (RAND_bytes(bytes.data(), static_cast<int>(length)) != 1) {
-        std::cerr << "Failed to generate random bytes" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to generate random bytes";
         return {};
     }
     return bytes;
 }
 
-std::vector<uint8_t> PasswordManager::DeriveKey(const std::string& password, const std::vector<uint8_t>& salt) const {
+std::vector<uint8_t> PasswordManager::DeriveKey(const std::string& password,
+                                                const std::vector<uint8_t>& salt,
+                                                const KeyDerivation::ScryptParameters& scrypt) const {
     std::vector<uint8_t> key(32); // 256-bit key
-    
-    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_SCRYPT, nullptr);
-    if (!ctx) {
-        Cleanse(key);
-        return {};
-    }
-    
-    if (EVP_PKEY_derive_init(ctx) <= 0) {
-        EVP_PKEY_CTX_free(ctx);
-        Cleanse(key);
-        return {};
-    }
-    
-    if (EVP_PKEY_CTX_set1_pbe_pass(ctx, password.c_str(), password.length()) <= 0) {
-        EVP_PKEY_CTX_free(ctx);
-        Cleanse(key);
+    if (!KeyDerivation::DeriveScrypt(password, salt.data(), salt.size(), scrypt, key.data(),
+                                     key.size())) {
         return {};
     }
-    
-    if (EVP_PKEY_CTX_set1_scrypt_salt(ctx, salt.data(), salt.size()) <= 0) {
-        EVP_PKEY_CTX_free(ctx);
-        Cleanse(key);
-        return {};
-    }
-    
-    // Scrypt parameters: N=32768, r=8, p=1 (strong parameters)
-    if (EVP_PKEY_CTX_set_scrypt_N(ctx, 32768) <= 0 ||
-        EVP_PKEY_CTX_set_scrypt_r(ctx, 8) <= 0 ||
-        EVP_PKEY_CTX_set_scrypt_p(ctx, 1) <= 0) {
-        EVP_PKEY_CTX_free(ctx);
-        Cleanse(key);
-        return {};
-    }
-    
-    size_t keylen = key.size();
-    if (EVP_PKEY_derive(ctx, key.data(), &keylen) <= 0) {
-        EVP_PKEY_CTX_free(ctx);
-        Cleanse(key);
-        return {};
-    }
-    
-    EVP_PKEY_CTX_free(ctx);
     return key;
 }
 
@@ -351,12 +334,13 @@ bool PasswordManager::BuildEncryptedPassword(const std::string& password,
     std::unique_ptr<OQS_KEM, decltype(&OQS_KEM_free)> kem(
         OQS_KEM_new(OQS_KEM_alg_ml_kem_768), OQS_KEM_free);
     if (!kem) {
-        std::cerr << "Failed to initialize ML-KEM-768" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to initialize ML-KEM-768";
         return false;
     }
 
     EncryptedPassword candidate;
     candidate.version = CURRENT_VERSION;
+    candidate.scrypt = KeyDerivation::PreferredScrypt();
     candidate.salt = GenerateRandomBytes(SALT_SIZE);
     candidate.secret_key_nonce = GenerateRandomBytes(NONCE_SIZE);
     candidate.password_nonce = GenerateRandomBytes(NONCE_SIZE);
@@ -364,11 +348,11 @@ bool PasswordManager::BuildEncryptedPassword(const std::string& password,
         candidate.secret_key_nonce.size() != NONCE_SIZE ||
         candidate.password_nonce.size() != NONCE_SIZE ||
         candidate.secret_key_nonce == candidate.password_nonce) {
-        std::cerr << "Failed to generate independent GCM nonces" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to generate independent GCM nonces";
         return false;
     }
 
-    std::vector<uint8_t> derivedKey = DeriveKey(password, candidate.salt);
+    std::vector<uint8_t> derivedKey = DeriveKey(password, candidate.salt, candidate.scrypt);
     SecureMemory::ScopedCleanse derivedKeyGuard(derivedKey);
     if (derivedKey.empty()) {
         return false;
@@ -429,7 +413,7 @@ bool PasswordManager::ValidateEncryptedPassword(const EncryptedPassword& data,
         return false;
     }
 
-    std::vector<uint8_t> derivedKey = DeriveKey(password, data.salt);
+    std::vector<uint8_t> derivedKey = DeriveKey(password, data.salt, data.scrypt);
     SecureMemory::ScopedCleanse derivedKeyGuard(derivedKey);
     std::vector<uint8_t> secretKey = AESDecrypt(data.encrypted_secret_key, derivedKey,
                                                 data.secret_key_nonce,
@@ -473,53 +457,53 @@ bool PasswordManager::ValidateEncryptedPassword(const EncryptedPassword& data,
 
 bool PasswordManager::CreateUser(const std::string& username, const std::string& password) {
     if (!transaction_recovery_ready_) {
-        std::cerr << "Cannot create a user while transaction recovery is incomplete" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Cannot create a user while transaction recovery is incomplete";
         return false;
     }
     std::string validationError;
     if (!PathSecurity::ValidateUsername(username, &validationError)) {
-        std::cerr << "Invalid username: " << validationError << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Invalid username: " << validationError;
         return false;
     }
     for (const auto& existingUsername : GetUsernames()) {
         if (PathSecurity::NamesCollide(username, existingUsername)) {
-            std::cerr << "A user with an equivalent name already exists" << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "A user with an equivalent name already exists";
             return false;
         }
     }
     if (UserExists(username)) {
-        std::cerr << "User already exists: " << username << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "User already exists: " << username;
         return false;
     }
 
     EncryptedPassword data;
     if (!BuildEncryptedPassword(password, data) || !SaveEncryptedData(username, data)) {
-        std::cerr << "Failed to create encrypted user: " << username << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to create encrypted user: " << username;
         return false;
     }
 
     std::filesystem::permissions(GetUserFilePath(username),
         std::filesystem::perms::owner_read | std::filesystem::perms::owner_write,
         std::filesystem::perm_options::replace);
-    std::cout << "User created with ML-KEM-768 and independent AES-GCM nonces: "
-              << username << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "User created with ML-KEM-768 and independent AES-GCM nonces: "
+                             << username;
     return true;
 }
 
 bool PasswordManager::VerifyPassword(const std::string& username, const std::string& password) const {
     if (!transaction_recovery_ready_) {
-        std::cerr << "Cannot authenticate while transaction recovery is incomplete" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Cannot authenticate while transaction recovery is incomplete";
         return false;
     }
     if (password.empty() || !PathSecurity::ValidateUsername(username) ||
         !UserExists(username)) {
-        std::cerr << "User does not exist: " << username << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "User does not exist: " << username;
         return false;
     }
     
     auto encData = LoadEncryptedData(username);
     if (encData.ciphertext.empty()) {
-        std::cerr << "Failed to load user data: " << username << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to load user data: " << username;
         return false;
     }
     
@@ -527,17 +511,15 @@ bool PasswordManager::VerifyPassword(const std::string& username, const std::str
         encData.version != ML_KEM_VERSION &&
         encData.version != AES_GCM_VERSION &&
         encData.version != PREVIOUS_VERSION) {
-        std::cout << "Attempting to verify password with legacy format..." << std::endl;
+        PQC_LOG_INFO(LOG_MODULE) << "Attempting to verify password with legacy format...";
         const bool legacyMatch = VerifyPasswordLegacy(username, password);
         if (legacyMatch) {
             EncryptedPassword migratedData;
             if (BuildEncryptedPassword(password, migratedData) &&
                 SaveEncryptedData(username, migratedData)) {
-                std::cout << "Migrated v1 Kyber user file to portable v5 with ML-KEM-768"
-                          << std::endl;
+                PQC_LOG_INFO(LOG_MODULE) << "Migrated v1 Kyber user file to portable v5 with ML-KEM-768";
             } else {
-                std::cerr << "Warning: authentication succeeded but v1 migration failed"
-                          << std::endl;
+                PQC_LOG_WARN(LOG_MODULE) << "authentication succeeded but v1 migration failed";
             }
         }
         return legacyMatch;
@@ -547,7 +529,7 @@ bool PasswordManager::VerifyPassword(const std::string& username, const std::str
         encData.secret_key_nonce.empty() || encData.password_nonce.empty() ||
         encData.secret_key_auth_tag.size() != TAG_SIZE ||
         encData.password_auth_tag.size() != TAG_SIZE) {
-        std::cerr << "Invalid encrypted user parameters" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Invalid encrypted user parameters";
         return false;
     }
 
@@ -556,14 +538,14 @@ bool PasswordManager::VerifyPassword(const std::string& username, const std::str
         (encData.secret_key_nonce.size() != NONCE_SIZE ||
          encData.password_nonce.size() != NONCE_SIZE ||
          encData.secret_key_nonce == encData.password_nonce)) {
-        std::cerr << "Invalid or reused AES-GCM nonce in user file" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Invalid or reused AES-GCM nonce in user file";
         return false;
     }
 
-    std::vector<uint8_t> derivedKey = DeriveKey(password, encData.salt);
+    std::vector<uint8_t> derivedKey = DeriveKey(password, encData.salt, encData.scrypt);
     SecureMemory::ScopedCleanse derivedKeyGuard(derivedKey);
     if (derivedKey.empty()) {
-        std::cerr << "Failed to derive key" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to derive key";
         return false;
     }
 
@@ -573,7 +555,7 @@ bool PasswordManager::VerifyPassword(const std::string& username, const std::str
     SecureMemory::ScopedCleanse secretKeyGuard(secretKey);
     if (secretKey.empty()) {
         Cleanse(derivedKey);
-        std::cerr << "Failed to decrypt secret key - wrong password" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to decrypt secret key - wrong password";
         return false;
     }
 
@@ -586,7 +568,7 @@ bool PasswordManager::VerifyPassword(const std::string& username, const std::str
     if (!kem) {
         Cleanse(derivedKey);
         Cleanse(secretKey);
-        std::cerr << "Failed to initialize KEM: " << kemAlgorithm << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to initialize KEM: " << kemAlgorithm;
         return false;
     }
 
@@ -595,7 +577,7 @@ bool PasswordManager::VerifyPassword(const std::string& username, const std::str
         secretKey.size() != kem->length_secret_key) {
         Cleanse(derivedKey);
         Cleanse(secretKey);
-        std::cerr << "Encrypted user KEM component sizes are invalid" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Encrypted user KEM component sizes are invalid";
         return false;
     }
 
@@ -606,7 +588,7 @@ bool PasswordManager::VerifyPassword(const std::string& username, const std::str
         Cleanse(derivedKey);
         Cleanse(secretKey);
         Cleanse(sharedSecret);
-        std::cerr << "Failed to decapsulate" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to decapsulate";
         return false;
     }
 
@@ -618,7 +600,7 @@ bool PasswordManager::VerifyPassword(const std::string& username, const std::str
     Cleanse(secretKey);
     if (aesDecrypted.empty()) {
         Cleanse(sharedSecret);
-        std::cerr << "Failed to decrypt password with AES - authentication failed" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to decrypt password with AES - authentication failed";
         return false;
     }
 
@@ -635,20 +617,21 @@ bool PasswordManager::VerifyPassword(const std::string& username, const std::str
     Cleanse(sharedSecret);
 
     if (match) {
-        std::cout << "Password verified successfully for user: " << username << std::endl;
-        if (encData.version != CURRENT_VERSION) {
+        PQC_LOG_INFO(LOG_MODULE) << "Password verified successfully for user: " << username;
+        // Older formats and files derived with other scrypt parameters are
+        // rewritten with the current format and the preferred parameters.
+        if (encData.version != CURRENT_VERSION ||
+            encData.scrypt != KeyDerivation::PreferredScrypt()) {
             EncryptedPassword migratedData;
             if (BuildEncryptedPassword(password, migratedData) &&
                 SaveEncryptedData(username, migratedData)) {
-                std::cout << "Migrated user file to portable v5 with ML-KEM-768"
-                          << std::endl;
+                PQC_LOG_INFO(LOG_MODULE) << "Migrated user file to portable v5 with ML-KEM-768";
             } else {
-                std::cerr << "Warning: authentication succeeded but ML-KEM migration failed"
-                          << std::endl;
+                PQC_LOG_WARN(LOG_MODULE) << "authentication succeeded but ML-KEM migration failed";
             }
         }
     } else {
-        std::cerr << "Password verification failed for user: " << username << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Password verification failed for user: " << username;
     }
     
     return match;
@@ -656,7 +639,7 @@ bool PasswordManager::VerifyPassword(const std::string& username, const std::str
 
 // Legacy support for old format
 bool PasswordManager::VerifyPasswordLegacy(const std::string& username, const std::string& password) const {
-    std::cout << "Using legacy verification for old format file..." << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "Using legacy verification for old format file...";
     
     // Load old format data
     if (!PathSecurity::ValidateUsername(username)) {
@@ -721,7 +704,7 @@ bool PasswordManager::VerifyPasswordLegacy(const std::string& username, const st
     Cleanse(shared_secret);
     OQS_KEM_free(kem);
     if (match) {
-        std::cout << "Legacy password verified. Consider migrating to new format." << std::endl;
+        PQC_LOG_INFO(LOG_MODULE) << "Legacy password verified. Consider migrating to new format.";
     }
     
     return match;
@@ -788,7 +771,7 @@ bool PasswordManager::SaveEncryptedData(const std::string& username, const Encry
         return false;
     }
     if (!AtomicFile::Write(filepath, encoded)) {
-        std::cerr << "Failed to atomically save encrypted user data: " << filepath << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to atomically save encrypted user data: " << filepath;
         return false;
     }
     return true;
@@ -801,12 +784,17 @@ bool PasswordManager::EncodeEncryptedData(const EncryptedPassword& data,
         data.password_nonce.size() != NONCE_SIZE ||
         data.secret_key_nonce == data.password_nonce ||
         data.secret_key_auth_tag.size() != TAG_SIZE ||
-        data.password_auth_tag.size() != TAG_SIZE) {
-        std::cerr << "Refusing to save invalid v5 encrypted user data" << std::endl;
+        data.password_auth_tag.size() != TAG_SIZE || !KeyDerivation::IsSupported(data.scrypt)) {
+        PQC_LOG_ERROR(LOG_MODULE) << "Refusing to save invalid v5 encrypted user data";
         return false;
     }
 
-    const std::array<const std::vector<uint8_t>*, USER_V5_COMPONENT_COUNT> components = {
+    std::vector<uint8_t> kdf;
+    AppendUint64(kdf, data.scrypt.n);
+    AppendUint32(kdf, data.scrypt.r);
+    AppendUint32(kdf, data.scrypt.p);
+
+    const std::array<const std::vector<uint8_t>*, USER_V5_KDF_COMPONENT_COUNT> components = {
         &data.salt,
         &data.secret_key_nonce,
         &data.password_nonce,
@@ -815,7 +803,8 @@ bool PasswordManager::EncodeEncryptedData(const EncryptedPassword& data,
         &data.encrypted_secret_key,
         &data.encrypted_password,
         &data.secret_key_auth_tag,
-        &data.password_auth_tag
+        &data.password_auth_tag,
+        &kdf
     };
     uint64_t totalSize = USER_V5_FIXED_HEADER_SIZE;
     for (const auto* component : components) {
@@ -832,7 +821,7 @@ bool PasswordManager::EncodeEncryptedData(const EncryptedPassword& data,
     encoded.insert(encoded.end(), USER_V5_MAGIC.begin(), USER_V5_MAGIC.end());
     AppendUint32(encoded, CURRENT_VERSION);
     AppendUint64(encoded, totalSize);
-    AppendUint32(encoded, USER_V5_COMPONENT_COUNT);
+    AppendUint32(encoded, USER_V5_KDF_COMPONENT_COUNT);
     for (const auto* component : components) {
         AppendUint64(encoded, component->size());
         encoded.insert(encoded.end(), component->begin(), component->end());
@@ -848,7 +837,7 @@ PasswordManager::EncryptedPassword PasswordManager::LoadEncryptedData(const std:
     }
     std::ifstream file(filepath, std::ios::binary);
     if (!file) {
-        std::cerr << "Failed to open file for reading: " << filepath << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to open file for reading: " << filepath;
         return data;
     }
     
@@ -955,8 +944,7 @@ bool PasswordManager::ChangeMasterPassword(const std::string& username, const st
     if (std::filesystem::exists(defaultDatabasePath)) {
         EncryptedDatabase database(defaultDatabasePath, oldPassword);
         if (!database.initialize()) {
-            std::cerr << "Cannot include the user's database in password transaction"
-                      << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "Cannot include the user's database in password transaction";
             return false;
         }
         return ChangeMasterPassword(username, oldPassword, newPassword, &database);
@@ -968,14 +956,13 @@ bool PasswordManager::ChangeMasterPassword(const std::string& username,
                                            const std::string& oldPassword,
                                            const std::string& newPassword,
                                            EncryptedDatabase* database) {
-    std::cout << "\n---------- CHANGE MASTER PASSWORD ----------" << std::endl;
-    std::cout << "Changing password for user: " << username << std::endl;
+    PQC_LOG_DEBUG(LOG_MODULE) << "---------- CHANGE MASTER PASSWORD ----------";
+    PQC_LOG_INFO(LOG_MODULE) << "Changing password for user: " << username;
 
     if (!PathSecurity::ValidateUsername(username) || newPassword.empty() ||
         !TransactionalFileBatch::RecoverPendingTransactions() ||
         !VerifyPassword(username, oldPassword)) {
-        std::cout << "Old password verification failed!" << std::endl;
-        std::cout << "----------------------------------------\n" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Old password verification failed!";
         return false;
     }
 
@@ -987,7 +974,7 @@ bool PasswordManager::ChangeMasterPassword(const std::string& username,
     if (!BuildEncryptedPassword(newPassword, newPasswordData) ||
         !ValidateEncryptedPassword(newPasswordData, newPassword) ||
         !EncodeEncryptedData(newPasswordData, encodedUser)) {
-        std::cout << "Failed to prepare new encrypted user data!" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Failed to prepare new encrypted user data!";
         return false;
     }
     replacements.push_back({GetUserFilePath(username), std::move(encodedUser)});
@@ -997,7 +984,7 @@ bool PasswordManager::ChangeMasterPassword(const std::string& username,
         std::vector<uint8_t> encodedDatabase;
         if (!database->prepareMasterPasswordChange(oldPassword, newPassword,
                                                    encodedDatabase)) {
-            std::cout << "Failed to prepare encrypted database replacement" << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "Failed to prepare encrypted database replacement";
             return false;
         }
         replacements.push_back({database->getDatabasePath(), std::move(encodedDatabase)});
@@ -1009,32 +996,30 @@ bool PasswordManager::ChangeMasterPassword(const std::string& username,
     for (const std::string& archiveName : userArchives) {
         CryptoArchive archive(username, archiveName);
         if (!archive.LoadArchive(oldPassword)) {
-            std::cout << "Failed to authenticate archive " << archiveName << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "Failed to authenticate archive " << archiveName;
             return false;
         }
 
         std::vector<uint8_t> encodedArchive;
         if (!archive.PreparePasswordChange(oldPassword, newPassword, encodedArchive)) {
-            std::cout << "Failed to prepare archive " << archiveName << std::endl;
+            PQC_LOG_ERROR(LOG_MODULE) << "Failed to prepare archive " << archiveName;
             return false;
         }
         replacements.push_back({archive.GetArchiveFilePath(), std::move(encodedArchive)});
     }
 
     if (!TransactionalFileBatch::Commit(replacements)) {
-        std::cout << "Password transaction failed; original files remain active" << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Password transaction failed; original files remain active";
         return false;
     }
 
     if (database != nullptr && !database->completeMasterPasswordChange(newPassword)) {
         // Disk commit is already durable. Report the state accurately; the UI
         // will recreate this database owner using the newly accepted password.
-        std::cerr << "Password transaction committed, but database memory refresh failed"
-                  << std::endl;
+        PQC_LOG_ERROR(LOG_MODULE) << "Password transaction committed, but database memory refresh failed";
     }
 
-    std::cout << "Master password transaction committed for user, database and "
-              << userArchives.size() << " archive(s)" << std::endl;
-    std::cout << "----------------------------------------\n" << std::endl;
+    PQC_LOG_INFO(LOG_MODULE) << "Master password transaction committed for user, database and "
+                             << userArchives.size() << " archive(s)";
     return true;
 }
@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include "KeyDerivation.h"
 
 class EncryptedDatabase;
 
@@ -18,6 +19,7 @@ public:
         std::vector<uint8_t> secret_key_auth_tag;     // GCM tag for the secret key
         std::vector<uint8_t> password_auth_tag;       // GCM tag for the password
         uint32_t version = 0;                         // File format version
+        KeyDerivation::ScryptParameters scrypt;       // Parameters of the salt's key
     };
     
     PasswordManager();
@@ -63,8 +65,9 @@ private:
     std::vector<uint8_t> AESEncrypt(const std::vector<uint8_t>& data, const std::vector<uint8_t>& key, const std::vector<uint8_t>& iv, std::vector<uint8_t>& tag) const;
     std::vector<uint8_t> AESDecrypt(const std::vector<uint8_t>& data, const std::vector<uint8_t>& key, const std::vector<uint8_t>& iv, const std::vector<uint8_t>& tag) const;
     
-    // Key derivation from password + salt
-    std::vector<uint8_t> DeriveKey(const std::string& password, const std::vector<uint8_t>& salt) const;
+    // Key derivation from password + salt with the parameters of the user file
+    std::vector<uint8_t> DeriveKey(const std::string& password, const std::vector<uint8_t>& salt,
+                                   const KeyDerivation::ScryptParameters& scrypt) const;
     
     // Generate random bytes
     std::vector<uint8_t> GenerateRandomBytes(size_t length) const;
@@ -186,6 +186,17 @@ bool NamesCollide(const std::string& left, const std::string& right) {
     return true;
 }
 
+std::string CollisionKey(const std::string& name) {
+    std::string key(name);
+    for (char& value : key) {
+        const auto byte = static_cast<unsigned char>(value);
+        if (byte < 0x80U) {
+            value = static_cast<char>(std::tolower(byte));
+        }
+    }
+    return key;
+}
+
 bool ResolveContainedPath(const std::filesystem::path& baseDirectory,
                           const std::filesystem::path& relativePath,
                           std::filesystem::path& resolvedPath,
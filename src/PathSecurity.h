@@ -17,6 +17,10 @@ bool ValidateStoredFilename(const std::string& name, std::string* error = nullpt
 // Portable collision rule used even on case-sensitive filesystems.
 bool NamesCollide(const std::string& left, const std::string& right);
 
+// Names collide exactly when their collision keys are equal: ASCII letters
+// are folded to lower case and every other byte is kept.
+std::string CollisionKey(const std::string& name);
+
 // Resolve a relative path below baseDirectory after canonicalizing existing
 // components. Absolute paths, traversal and symlink escapes are rejected.
 bool ResolveContainedPath(const std::filesystem::path& baseDirectory,
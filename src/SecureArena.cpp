@@ -0,0 +1,259 @@
+#include "SecureArena.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace SecureMemory {
+namespace {
+
+std::size_t PageSize() noexcept {
+#ifdef _WIN32
+    SYSTEM_INFO info{};
+    GetSystemInfo(&info);
+    return static_cast<std::size_t>(info.dwPageSize);
+#else
+    const long size = ::sysconf(_SC_PAGESIZE);
+    return size > 0 ? static_cast<std::size_t>(size) : 4096;
+#endif
+}
+
+} // namespace
+
+Arena::~Arena() {
+    Reset();
+    const std::lock_guard<std::mutex> lock(mutex_);
+    // Blocks still live here were leaked by their owner; wipe them anyway.
+    for (auto& slabs : slabs_) {
+        for (auto& slab : slabs) {
+            Cleanse(slab->mapping.base, slab->carved * slab->blockSize);
+            Unmap(slab->mapping);
+        }
+    }
+    for (auto& [base, mapping] : large_) {
+        Cleanse(base, mapping.size);
+        Unmap(mapping);
+    }
+}
+
+std::size_t Arena::ClassIndex(std::size_t size) noexcept {
+    std::size_t index = 0;
+    while ((MIN_BLOCK << index) < size) {
+        ++index;
+    }
+    return index;
+}
+
+Arena::Mapping Arena::Map(std::size_t size) {
+    Mapping mapping;
+    mapping.size = size;
+#ifdef _WIN32
+    mapping.base = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (mapping.base == nullptr) {
+        throw std::bad_alloc();
+    }
+    mapping.locked = stats_.locked + size <= lockLimit_ && VirtualLock(mapping.base, size) != 0;
+#else
+    void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    mapping.base = base;
+#ifdef MADV_DONTDUMP
+    ::madvise(base, size, MADV_DONTDUMP);
+#endif
+    mapping.locked = stats_.locked + size <= lockLimit_ && ::mlock(base, size) == 0;
+#endif
+    if (mapping.locked) {
+        stats_.locked += size;
+    } else {
+        ++stats_.lockFailures;
+    }
+    stats_.mapped += size;
+    ++stats_.mappings;
+    return mapping;
+}
+
+void Arena::Unmap(Mapping& mapping) noexcept {
+    if (mapping.base == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    if (mapping.locked) {
+        VirtualUnlock(mapping.base, mapping.size);
+    }
+    VirtualFree(mapping.base, 0, MEM_RELEASE);
+#else
+    if (mapping.locked) {
+        ::munlock(mapping.base, mapping.size);
+    }
+    ::munmap(mapping.base, mapping.size);
+#endif
+    if (mapping.locked) {
+        stats_.locked -= mapping.size;
+    }
+    stats_.mapped -= mapping.size;
+    mapping = Mapping{};
+}
+
+void* Arena::Allocate(std::size_t size) {
+    size = std::max<std::size_t>(size, 1);
+    const std::lock_guard<std::mutex> lock(mutex_);
+    void* block = nullptr;
+    std::size_t blockSize = 0;
+    if (size <= MAX_SMALL_BLOCK) {
+        const std::size_t index = ClassIndex(size);
+        blockSize = MIN_BLOCK << index;
+        std::vector<std::unique_ptr<Slab>>& slabs = slabs_[index];
+        // The newest slab is the one most likely to have room.
+        Slab* slab = nullptr;
+        for (auto it = slabs.rbegin(); it != slabs.rend() && slab == nullptr; ++it) {
+            if ((*it)->freeList != nullptr || (*it)->carved < SLAB_SIZE / blockSize) {
+                slab = it->get();
+            }
+        }
+        if (slab == nullptr) {
+            auto created = std::make_unique<Slab>();
+            created->mapping = Map(SLAB_SIZE);
+            created->blockSize = blockSize;
+            slab = created.get();
+            slabsByAddress_.emplace(reinterpret_cast<std::uintptr_t>(slab->mapping.base), slab);
+            slabs.push_back(std::move(created));
+        }
+        if (slab->freeList != nullptr) {
+            block = slab->freeList;
+            std::copy_n(static_cast<const unsigned char*>(block), sizeof(void*),
+                        reinterpret_cast<unsigned char*>(&slab->freeList));
+            Cleanse(block, sizeof(void*));
+        } else {
+            block = static_cast<unsigned char*>(slab->mapping.base) + slab->carved * blockSize;
+            ++slab->carved;
+        }
+        ++slab->live;
+    } else {
+        const std::size_t page = PageSize();
+        if (size > std::numeric_limits<std::size_t>::max() - page) {
+            throw std::bad_alloc();
+        }
+        const std::size_t rounded = (size + page - 1) / page * page;
+        // Reuse the smallest kept mapping that fits without wasting half of it.
+        auto best = retained_.end();
+        for (auto it = retained_.begin(); it != retained_.end(); ++it) {
+            if (it->size >= rounded && it->size / 2 <= rounded &&
+                (best == retained_.end() || it->size < best->size)) {
+                best = it;
+            }
+        }
+        Mapping mapping;
+        if (best != retained_.end()) {
+            mapping = *best;
+            retainedSize_ -= mapping.size;
+            retained_.erase(best);
+        } else {
+            mapping = Map(rounded);
+        }
+        block = mapping.base;
+        blockSize = mapping.size;
+        large_.emplace(block, mapping);
+    }
+    stats_.inUse += blockSize;
+    stats_.highWater = std::max(stats_.highWater, stats_.inUse);
+    ++stats_.allocations;
+    return block;
+}
+
+void Arena::Deallocate(void* block, std::size_t size) noexcept {
+    if (block == nullptr) {
+        return;
+    }
+    size = std::max<std::size_t>(size, 1);
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (size <= MAX_SMALL_BLOCK) {
+        auto it = slabsByAddress_.upper_bound(reinterpret_cast<std::uintptr_t>(block));
+        if (it == slabsByAddress_.begin()) {
+            return;
+        }
+        Slab* slab = (--it)->second;
+        if (reinterpret_cast<std::uintptr_t>(block) - it->first >= slab->mapping.size) {
+            return;
+        }
+        Cleanse(block, slab->blockSize);
+        std::copy_n(reinterpret_cast<const unsigned char*>(&slab->freeList), sizeof(void*),
+                    static_cast<unsigned char*>(block));
+        slab->freeList = block;
+        --slab->live;
+        stats_.inUse -= slab->blockSize;
+        return;
+    }
+
+    const auto found = large_.find(block);
+    if (found == large_.end()) {
+        return;
+    }
+    Mapping mapping = found->second;
+    large_.erase(found);
+    // Once out of large_ the block belongs to this thread alone, so wiping
+    // a payload of hundreds of MiB does not stall other allocations. Only
+    // the first size bytes were ever handed out.
+    lock.unlock();
+    Cleanse(mapping.base, std::min(size, mapping.size));
+    lock.lock();
+    stats_.inUse -= mapping.size;
+    if (mapping.size <= RETAINED_LIMIT - retainedSize_) {
+        retainedSize_ += mapping.size;
+        retained_.push_back(mapping);
+    } else {
+        Unmap(mapping);
+    }
+}
+
+std::size_t Arena::Reset() noexcept {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t released = 0;
+    for (auto& slabs : slabs_) {
+        for (auto it = slabs.begin(); it != slabs.end();) {
+            Slab& slab = **it;
+            if (slab.live != 0) {
+                ++it;
+                continue;
+            }
+            Cleanse(slab.mapping.base, slab.carved * slab.blockSize);
+            slabsByAddress_.erase(reinterpret_cast<std::uintptr_t>(slab.mapping.base));
+            released += slab.mapping.size;
+            Unmap(slab.mapping);
+            it = slabs.erase(it);
+        }
+    }
+    for (Mapping& mapping : retained_) {
+        released += mapping.size;
+        Unmap(mapping);
+    }
+    retained_.clear();
+    retainedSize_ = 0;
+    return released;
+}
+
+void Arena::SetLockLimit(std::size_t bytes) {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    lockLimit_ = bytes;
+}
+
+Arena::Stats Arena::GetStats() const {
+    const std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+Arena& DefaultArena() {
+    static Arena* arena = new Arena();
+    return *arena;
+}
+
+} // namespace SecureMemory
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "SecureMemory.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace SecureMemory {
+
+// Pool of page-locked memory for decrypted payloads and key material. Pages
+// are mapped privately, excluded from core dumps where the platform allows it
+// (MADV_DONTDUMP) and locked into RAM up to a lock limit, so secrets do not
+// reach swap. Locking is best effort: pages past the limit, or refused by
+// RLIMIT_MEMLOCK, are still used and counted in Stats::lockFailures.
+//
+// Blocks of up to MAX_SMALL_BLOCK bytes come from 64 KiB slabs split into
+// power-of-two size classes and are recycled through a free list per class.
+// Larger blocks get their own mapping; a few freed ones are kept for reuse,
+// so a vector growing to a payload size does not map and unmap each step.
+// Every block is cleansed when it is freed. Reset() cleanses and releases
+// empty slabs and kept mappings in bulk.
+class Arena {
+public:
+    static constexpr std::size_t MIN_BLOCK = 16;
+    static constexpr std::size_t MAX_SMALL_BLOCK = 8 * 1024;
+    static constexpr std::size_t SLAB_SIZE = 64 * 1024;
+    static constexpr std::size_t DEFAULT_LOCK_LIMIT = 64 * 1024 * 1024;
+    static constexpr std::size_t RETAINED_LIMIT = 16 * 1024 * 1024;
+
+    struct Stats {
+        std::size_t inUse;         // bytes of live blocks
+        std::size_t highWater;     // largest inUse so far
+        std::size_t mapped;        // bytes of pages held, used or not
+        std::size_t locked;        // bytes of those pages locked into RAM
+        std::uint64_t allocations;
+        std::uint64_t mappings;    // pages mapped from the system
+        std::uint64_t lockFailures;
+    };
+
+    Arena() = default;
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Throws std::bad_alloc when no pages can be mapped.
+    void* Allocate(std::size_t size);
+    void Deallocate(void* block, std::size_t size) noexcept;
+
+    // Cleanse and unmap every slab without live blocks and every kept
+    // mapping. Returns the bytes given back to the system.
+    std::size_t Reset() noexcept;
+
+    // Bytes the arena may lock; pages mapped beyond it are left unlocked.
+    void SetLockLimit(std::size_t bytes);
+
+    Stats GetStats() const;
+
+private:
+    struct Mapping {
+        void* base = nullptr;
+        std::size_t size = 0;
+        bool locked = false;
+    };
+    struct Slab {
+        Mapping mapping;
+        std::size_t blockSize = 0;
+        std::size_t carved = 0;  // blocks handed out at least once
+        std::size_t live = 0;
+        void* freeList = nullptr;
+    };
+
+    static constexpr std::size_t CLASS_COUNT = 10;  // MIN_BLOCK .. MAX_SMALL_BLOCK
+
+    Mapping Map(std::size_t size);
+    void Unmap(Mapping& mapping) noexcept;
+    static std::size_t ClassIndex(std::size_t size) noexcept;
+
+    mutable std::mutex mutex_;
+    std::vector<std::vector<std::unique_ptr<Slab>>> slabs_ =
+        std::vector<std::vector<std::unique_ptr<Slab>>>(CLASS_COUNT);
+    std::map<std::uintptr_t, Slab*> slabsByAddress_;
+    std::unordered_map<void*, Mapping> large_;
+    std::vector<Mapping> retained_;
+    std::size_t retainedSize_ = 0;
+    std::size_t lockLimit_ = DEFAULT_LOCK_LIMIT;
+    Stats stats_{};
+};
+
+// Process-wide arena behind Allocator. It is never destroyed, so containers
+// with static storage can still free into it during exit.
+Arena& DefaultArena();
+
+// Standard allocator over DefaultArena().
+template <typename T>
+struct Allocator {
+    using value_type = T;
+
+    Allocator() noexcept = default;
+    template <typename U>
+    Allocator(const Allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t count) {
+        if (count > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(DefaultArena().Allocate(count * sizeof(T)));
+    }
+
+    void deallocate(T* block, std::size_t count) noexcept {
+        DefaultArena().Deallocate(block, count * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const Allocator<T>&, const Allocator<U>&) noexcept {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const Allocator<T>&, const Allocator<U>&) noexcept {
+    return false;
+}
+
+// Byte buffer for plaintext and keys; its storage never leaves the arena
+// without being cleansed, including the old block of every reallocation.
+using SecureBytes = std::vector<std::uint8_t, Allocator<std::uint8_t>>;
+
+} // namespace SecureMemory
@@ -21,8 +21,8 @@ inline void Cleanse(char (&buffer)[N]) noexcept {
     Cleanse(buffer, N);
 }
 
-template <typename T>
-inline void Cleanse(std::vector<T>& value) noexcept {
+template <typename T, typename Alloc>
+inline void Cleanse(std::vector<T, Alloc>& value) noexcept {
     static_assert(std::is_trivially_copyable_v<T>,
                   "Secure cleansing requires trivially copyable elements");
     if (!value.empty()) {
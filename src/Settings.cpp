@@ -30,6 +30,14 @@ void Settings::ResetToDefaults() {
     securityLevel = 2;  // High security by default
     backupRetentionDays = 30;
     enableLogging = true;
+    deferArchiveCommits = false;
+    archiveCommitDelayMs = 2000;
+    archiveCryptoThreads = 0;
+    compressArchiveEntries = true;
+    archiveCacheMiB = 64;
+    kdfUnlockMs = 250;
+    kdfMemoryMiB = 64;
+    scryptCostLog2 = 0;
     theme = "Dark";
     themeChanged = false;
 }
@@ -133,6 +141,64 @@ bool Settings::ParseSettingsLine(const std::string& line) {
         }
     } else if (key == "enableLogging") {
         enableLogging = (value == "true" || value == "1");
+    } else if (key == "deferArchiveCommits") {
+        deferArchiveCommits = (value == "true" || value == "1");
+    } else if (key == "archiveCommitDelayMs") {
+        try {
+            archiveCommitDelayMs = std::stoi(value);
+            if (archiveCommitDelayMs < 250 || archiveCommitDelayMs > 60000) {
+                archiveCommitDelayMs = 2000;
+            }
+        } catch (const std::exception&) {
+            archiveCommitDelayMs = 2000;
+        }
+    } else if (key == "archiveCryptoThreads") {
+        try {
+            archiveCryptoThreads = std::stoi(value);
+            if (archiveCryptoThreads < 0 || archiveCryptoThreads > 64) {
+                archiveCryptoThreads = 0;
+            }
+        } catch (const std::exception&) {
+            archiveCryptoThreads = 0;
+        }
+    } else if (key == "compressArchiveEntries") {
+        compressArchiveEntries = (value == "true" || value == "1");
+    } else if (key == "archiveCacheMiB") {
+        try {
+            archiveCacheMiB = std::stoi(value);
+            if (archiveCacheMiB < 0 || archiveCacheMiB > 1024) {
+                archiveCacheMiB = 64;
+            }
+        } catch (const std::exception&) {
+            archiveCacheMiB = 64;
+        }
+    } else if (key == "kdfUnlockMs") {
+        try {
+            kdfUnlockMs = std::stoi(value);
+            if (kdfUnlockMs < 50 || kdfUnlockMs > 5000) {
+                kdfUnlockMs = 250;
+            }
+        } catch (const std::exception&) {
+            kdfUnlockMs = 250;
+        }
+    } else if (key == "kdfMemoryMiB") {
+        try {
+            kdfMemoryMiB = std::stoi(value);
+            if (kdfMemoryMiB < 16 || kdfMemoryMiB > 1024) {
+                kdfMemoryMiB = 64;
+            }
+        } catch (const std::exception&) {
+            kdfMemoryMiB = 64;
+        }
+    } else if (key == "scryptCostLog2") {
+        try {
+            scryptCostLog2 = std::stoi(value);
+            if (scryptCostLog2 < 14 || scryptCostLog2 > 20) {
+                scryptCostLog2 = 0;
+            }
+        } catch (const std::exception&) {
+            scryptCostLog2 = 0;
+        }
     } else if (key == "theme") {
         if (value == "Dark" || value == "Light" || value == "Auto") {
             theme = value;
@@ -158,6 +224,14 @@ bool Settings::SaveSettings() {
     contents << "securityLevel=" << securityLevel << "\n";
     contents << "backupRetentionDays=" << backupRetentionDays << "\n";
     contents << "enableLogging=" << (enableLogging ? "true" : "false") << "\n";
+    contents << "deferArchiveCommits=" << (deferArchiveCommits ? "true" : "false") << "\n";
+    contents << "archiveCommitDelayMs=" << archiveCommitDelayMs << "\n";
+    contents << "archiveCryptoThreads=" << archiveCryptoThreads << "\n";
+    contents << "compressArchiveEntries=" << (compressArchiveEntries ? "true" : "false") << "\n";
+    contents << "archiveCacheMiB=" << archiveCacheMiB << "\n";
+    contents << "kdfUnlockMs=" << kdfUnlockMs << "\n";
+    contents << "kdfMemoryMiB=" << kdfMemoryMiB << "\n";
+    contents << "scryptCostLog2=" << scryptCostLog2 << "\n";
     contents << "theme=" << theme << "\n";
 
     if (!AtomicFile::Write(filePath, contents.str())) {
@@ -169,6 +243,36 @@ bool Settings::SaveSettings() {
     return true;
 }
 
+KeyDerivation::ScryptParameters Settings::GetScryptParameters() const {
+    KeyDerivation::ScryptParameters parameters = KeyDerivation::DEFAULT_SCRYPT;
+    if (scryptCostLog2 != 0) {
+        parameters.n = 1ULL << scryptCostLog2;
+    }
+    // A cost calibrated under a larger memory budget is not used after the
+    // budget was lowered.
+    while (parameters.MemoryBytes() > static_cast<uint64_t>(kdfMemoryMiB) * 1024U * 1024U &&
+           parameters.n > 1ULL << 14) {
+        parameters.n /= 2;
+    }
+    return parameters;
+}
+
+void Settings::CalibrateKeyDerivation() {
+    ApplyKeyDerivationCalibration(KeyDerivation::CalibrateScrypt(
+        std::chrono::milliseconds(kdfUnlockMs),
+        static_cast<uint64_t>(kdfMemoryMiB) * 1024U * 1024U));
+}
+
+void Settings::ApplyKeyDerivationCalibration(const KeyDerivation::ScryptParameters& calibrated) {
+    scryptCostLog2 = 0;
+    while ((1ULL << scryptCostLog2) < calibrated.n) {
+        ++scryptCostLog2;
+    }
+    KeyDerivation::SetPreferredScrypt(GetScryptParameters());
+    std::cout << "Key derivation calibrated: scrypt N=2^" << scryptCostLog2 << " for "
+              << kdfUnlockMs << " ms and " << kdfMemoryMiB << " MiB" << std::endl;
+}
+
 void Settings::ApplyTheme() const {
     if (theme == "Light") {
         ImGui::StyleColorsLight();
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include "KeyDerivation.h"
 
 struct ImVec4;
 struct ImVec2;
@@ -61,6 +62,14 @@ public:
     int GetSecurityLevel() const { return securityLevel; }
     int GetBackupRetentionDays() const { return backupRetentionDays; }
     bool GetEnableLogging() const { return enableLogging; }
+    bool GetDeferArchiveCommits() const { return deferArchiveCommits; }
+    int GetArchiveCommitDelayMs() const { return archiveCommitDelayMs; }
+    int GetArchiveCryptoThreads() const { return archiveCryptoThreads; }
+    bool GetCompressArchiveEntries() const { return compressArchiveEntries; }
+    int GetArchiveCacheMiB() const { return archiveCacheMiB; }
+    int GetKdfUnlockMs() const { return kdfUnlockMs; }
+    int GetKdfMemoryMiB() const { return kdfMemoryMiB; }
+    int GetScryptCostLog2() const { return scryptCostLog2; }
     std::string GetTheme() const { return theme; }
     
     // Setters
@@ -69,6 +78,22 @@ public:
     void SetSecurityLevel(int value) { securityLevel = value; }
     void SetBackupRetentionDays(int value) { backupRetentionDays = value; }
     void SetEnableLogging(bool value) { enableLogging = value; }
+    void SetDeferArchiveCommits(bool value) { deferArchiveCommits = value; }
+    void SetArchiveCommitDelayMs(int value) { archiveCommitDelayMs = value; }
+    void SetArchiveCryptoThreads(int value) { archiveCryptoThreads = value; }
+    void SetCompressArchiveEntries(bool value) { compressArchiveEntries = value; }
+    void SetArchiveCacheMiB(int value) { archiveCacheMiB = value; }
+    void SetKdfUnlockMs(int value) { kdfUnlockMs = value; }
+    void SetKdfMemoryMiB(int value) { kdfMemoryMiB = value; }
+    void SetScryptCostLog2(int value) { scryptCostLog2 = value; }
+
+    // scrypt parameters for new archives, databases and user files.
+    KeyDerivation::ScryptParameters GetScryptParameters() const;
+    // Benchmark scrypt for the unlock time and memory targets, store the
+    // chosen cost and make it the preferred one for this process.
+    void CalibrateKeyDerivation();
+    // Store a cost measured by KeyDerivation::CalibrateScrypt elsewhere.
+    void ApplyKeyDerivationCalibration(const KeyDerivation::ScryptParameters& calibrated);
     void SetTheme(const std::string& value) { theme = value; themeChanged = true; }
     
     // Theme application
@@ -126,6 +151,14 @@ private:
     int securityLevel;          // 1=Standard, 2=High, 3=Maximum
     int backupRetentionDays;
     bool enableLogging;
+    bool deferArchiveCommits;   // Write-behind archive commits
+    int archiveCommitDelayMs;   // Idle time before a write-behind commit
+    int archiveCryptoThreads;   // Archive encryption threads, 0 = all cores
+    bool compressArchiveEntries; // Deflate compressible entries before sealing
+    int archiveCacheMiB;        // Decrypted segment cache per archive, 0 = off
+    int kdfUnlockMs;            // Target scrypt time when unlocking
+    int kdfMemoryMiB;           // Memory scrypt may use
+    int scryptCostLog2;         // Calibrated log2(N), 0 = calibrate on next start
     std::string theme;          // "Dark", "Light", "Auto"
     
     // Theme change tracking
@@ -1,13 +1,13 @@
 #include "TransactionalFileBatch.h"
 
 #include "AtomicFile.h"
+#include "Log.h"
 
 #include <algorithm>
 #include <array>
 #include <atomic>
 #include <chrono>
 #include <fstream>
-#include <iostream>
 #include <iterator>
 #include <limits>
 #include <set>
@@ -16,6 +16,8 @@
 namespace TransactionalFileBatch {
 namespace {
 
+constexpr Log::Module LOG_MODULE = Log::Module::Transactions;
+
 constexpr std::array<uint8_t, 8> JOURNAL_MAGIC = {'P', 'Q', 'C', 'T', 'X', 'N', '0', '1'};
 constexpr uint32_t JOURNAL_PREPARED = 1;
 constexpr uint32_t JOURNAL_COMMITTED = 2;
@@ -364,7 +366,7 @@ bool Commit(const std::vector<Entry>& entries) {
     }
 
     if (!CleanTransactionDirectory(transaction)) {
-        std::cerr << "Warning: committed master-password journal could not be removed" << std::endl;
+        PQC_LOG_WARN(LOG_MODULE) << "committed master-password journal could not be removed";
     }
     return true;
 }
@@ -2,12 +2,17 @@
 #include "Settings.h"
 #include "PasswordManager.h"
 #include "PathSecurity.h"
+#include "ArchiveStream.h"
+#include "KeyDerivation.h"
+#include "SecureArena.h"
 #include "imgui.h"
 #include <cstring>
 #include <iostream>
 #include <vector>
 #include <filesystem>
 #include <algorithm> // for std::find
+#include <chrono>
+#include <system_error>
 
 WalletWindow::WalletWindow() : shouldClose(false), showSettings(false), showArchive(false), 
                                showCreateArchiveDialog(false), showRenameArchiveDialog(false),
@@ -35,40 +40,46 @@ WalletWindow::WalletWindow() : shouldClose(false), showSettings(false), showArch
         tempSecurityLevel = 2;
         tempBackupRetentionDays = 30;
         tempEnableLogging = true;
+        tempDeferArchiveCommits = false;
+        tempArchiveCommitDelayMs = 2000;
+        tempArchiveCryptoThreads = 0;
+        tempCompressArchiveEntries = true;
+        tempArchiveCacheMiB = 64;
+        tempKdfUnlockMs = 250;
+        tempKdfMemoryMiB = 64;
         tempThemeIndex = 0; // Dark theme
     }
 }
 
 WalletWindow::~WalletWindow() {
+    StopCalibration();
     ClearSensitiveSession();
 }
 
-void WalletWindow::SetUserInfo(const std::string& username, const std::string& password) {
-    std::cout << "---------- WALLET WINDOW SET USER INFO ----------" << std::endl;
-    std::cout << "Setting user info for: " << username << std::endl;
+void WalletWindow::OpenSession(std::unique_ptr<LoginTask::Session> session) {
+    std::cout << "---------- WALLET WINDOW OPEN SESSION ----------" << std::endl;
     
     ClearSensitiveSession();
     shouldClose = false;
-    std::filesystem::path databasePath;
-    if (!PathSecurity::ValidateUsername(username) ||
-        !PathSecurity::UserDatabasePath(username, databasePath)) {
+    if (!session) {
+        return;
+    }
+    std::cout << "Opening session for: " << session->username << std::endl;
+    if (!PathSecurity::ValidateUsername(session->username)) {
         std::cerr << "Refusing to open a session with an unsafe username" << std::endl;
         return;
     }
-    currentUser = username;
-    if (!userPassword.assign(password)) {
+    currentUser = session->username;
+    if (!userPassword.assign(session->password.get())) {
         std::cerr << "Failed to retain the session credential securely" << std::endl;
         return;
     }
+    session->password.clear();
     
-    // Initialize encrypted database
-    std::cout << "Initializing encrypted database..." << std::endl;
-    std::string db_path = databasePath.string();
-    encryptedDatabase = std::make_shared<EncryptedDatabase>(db_path, userPassword.get());
-    
-    if (!encryptedDatabase->initialize()) {
+    // The login worker already derived the database and archive keys.
+    encryptedDatabase = std::move(session->database);
+    if (!encryptedDatabase) {
         std::cerr << "Warning: Failed to initialize encrypted database" << std::endl;
-        encryptedDatabase.reset();
         databaseManagerWindow.reset();
     } else {
         std::cout << "[OK] Encrypted database initialized successfully" << std::endl;
@@ -78,10 +89,9 @@ void WalletWindow::SetUserInfo(const std::string& username, const std::string& p
     
     // Initialize archive window
     std::cout << "Creating ArchiveWindow instance..." << std::endl;
-    archiveWindow = std::make_unique<ArchiveWindow>(username);
+    archiveWindow = std::make_unique<ArchiveWindow>(currentUser);
     
-    std::cout << "Initializing archive..." << std::endl;
-    bool success = archiveWindow->Initialize(userPassword.get());
+    bool success = archiveWindow->AdoptArchive(std::move(session->archive), session->archiveCreated);
     std::cout << "Archive initialization result: " << (success ? "Success" : "Failed") << std::endl;
     
     std::cout << "Archive loaded state: " << (archiveWindow->IsLoaded() ? "Yes" : "No") << std::endl;
@@ -110,6 +120,8 @@ void WalletWindow::SetFontManager(FontManager* fontManager) {
 }
 
 void WalletWindow::Draw() {
+    PollCalibration();
+    
     // Configure window for docking compatibility
     ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_FirstUseEver);
     ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize, ImGuiCond_FirstUseEver);
@@ -535,6 +547,30 @@ void WalletWindow::DrawSettings() {
         ImGui::SliderInt("##backupDays", &tempBackupRetentionDays, 1, 365, "%d days");
         ImGui::EndDisabled();
         ImGui::TextDisabled("Manual encrypted database backup is available in Database Manager.");
+        ImGui::Checkbox("Save archive changes in the background", &tempDeferArchiveCommits);
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Group archive changes into one save after a short pause");
+        }
+        ImGui::BeginDisabled(!tempDeferArchiveCommits);
+        ImGui::SliderInt("##archiveCommitDelay", &tempArchiveCommitDelayMs, 250, 10000,
+                         "Save after %d ms idle");
+        ImGui::EndDisabled();
+        ImGui::Text("Archive encryption threads:");
+        ImGui::SliderInt("##archiveCryptoThreads", &tempArchiveCryptoThreads, 0, 64,
+                         tempArchiveCryptoThreads == 0 ? "All cores" : "%d threads");
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Threads that encrypt and decrypt large archive entries");
+        }
+        ImGui::Checkbox("Compress archive entries", &tempCompressArchiveEntries);
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Compress text and other compressible files before encrypting them");
+        }
+        ImGui::Text("Decrypted archive cache:");
+        ImGui::SliderInt("##archiveCacheMiB", &tempArchiveCacheMiB, 0, 1024,
+                         tempArchiveCacheMiB == 0 ? "Off" : "%d MiB");
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Memory that keeps recently viewed archive files decrypted");
+        }
         
         ImGui::Spacing();
         ImGui::Separator();
@@ -558,6 +594,28 @@ void WalletWindow::DrawSettings() {
         if (ImGui::IsItemHovered()) {
             ImGui::SetTooltip("Maximum security with highest protection (slower)");
         }
+
+        ImGui::Text("Password key derivation:");
+        const bool calibrating = calibrationThread.joinable();
+        ImGui::BeginDisabled(calibrating);
+        ImGui::SliderInt("##kdfUnlockMs", &tempKdfUnlockMs, 50, 5000, "Unlock in about %d ms");
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("Time scrypt may take when opening an archive or database");
+        }
+        ImGui::SliderInt("##kdfMemoryMiB", &tempKdfMemoryMiB, 16, 1024, "Use up to %d MiB");
+        ImGui::EndDisabled();
+        if (calibrating) {
+            // scrypt reports no progress, so the bar only shows that work is under way
+            ImGui::ProgressBar(-1.0f * static_cast<float>(ImGui::GetTime()), ImVec2(-1.0f, 0.0f),
+                               "Calibrating key derivation...");
+        } else {
+            const KeyDerivation::ScryptParameters current =
+                Settings::Instance().GetScryptParameters();
+            ImGui::TextDisabled("Current cost: scrypt N=%llu, %llu MiB. Files move to a new "
+                                "cost the next time they are saved.",
+                                static_cast<unsigned long long>(current.n),
+                                static_cast<unsigned long long>(current.MemoryBytes() >> 20));
+        }
         
         ImGui::Spacing();
         ImGui::Separator();
@@ -620,6 +678,19 @@ void WalletWindow::DrawSettings() {
             settings.SetSecurityLevel(tempSecurityLevel);
             settings.SetBackupRetentionDays(tempBackupRetentionDays);
             settings.SetEnableLogging(tempEnableLogging);
+            settings.SetDeferArchiveCommits(tempDeferArchiveCommits);
+            settings.SetArchiveCommitDelayMs(tempArchiveCommitDelayMs);
+            settings.SetArchiveCryptoThreads(tempArchiveCryptoThreads);
+            settings.SetCompressArchiveEntries(tempCompressArchiveEntries);
+            settings.SetArchiveCacheMiB(tempArchiveCacheMiB);
+            const bool recalibrate = settings.GetKdfUnlockMs() != tempKdfUnlockMs ||
+                                     settings.GetKdfMemoryMiB() != tempKdfMemoryMiB;
+            settings.SetKdfUnlockMs(tempKdfUnlockMs);
+            settings.SetKdfMemoryMiB(tempKdfMemoryMiB);
+            if (recalibrate) {
+                // Applied and saved again by PollCalibration() once it finishes
+                StartCalibration(tempKdfUnlockMs, tempKdfMemoryMiB);
+            }
             
             // Convert theme index to string
             const char* themeNames[] = { "Dark", "Light", "Auto" };
@@ -630,6 +701,12 @@ void WalletWindow::DrawSettings() {
             // Save to file
             if (settings.SaveSettings()) {
                 std::cout << "Settings saved successfully!" << std::endl;
+                ArchiveStream::SetWorkerThreads(
+                    static_cast<size_t>(settings.GetArchiveCryptoThreads()));
+                KeyDerivation::SetPreferredScrypt(settings.GetScryptParameters());
+                if (archiveWindow) {
+                    archiveWindow->ApplyCommitSettings();
+                }
                 
                 // Apply theme immediately after saving and notify all components
                 settings.NotifyThemeChanged();
@@ -687,6 +764,13 @@ void WalletWindow::LoadSettingsToUI() {
     tempSecurityLevel = settings.GetSecurityLevel();
     tempBackupRetentionDays = settings.GetBackupRetentionDays();
     tempEnableLogging = settings.GetEnableLogging();
+    tempDeferArchiveCommits = settings.GetDeferArchiveCommits();
+    tempArchiveCommitDelayMs = settings.GetArchiveCommitDelayMs();
+    tempArchiveCryptoThreads = settings.GetArchiveCryptoThreads();
+    tempCompressArchiveEntries = settings.GetCompressArchiveEntries();
+    tempArchiveCacheMiB = settings.GetArchiveCacheMiB();
+    tempKdfUnlockMs = settings.GetKdfUnlockMs();
+    tempKdfMemoryMiB = settings.GetKdfMemoryMiB();
     
     // Convert theme string to index
     std::string theme = settings.GetTheme();
@@ -944,6 +1028,9 @@ void WalletWindow::ShowRenameArchiveDialog() {
             std::string validationError;
             if (!PathSecurity::ValidateArchiveName(newName, &validationError)) {
                 renameArchiveError = validationError;
+            } else if (archiveWindow && archiveWindow->GetArchiveName() == previousName &&
+                       !archiveWindow->FlushPendingChanges()) {
+                renameArchiveError = "Unsaved archive changes could not be written.";
             } else if (CryptoArchive::RenameArchive(
                            currentUser, previousName, newName, &renameArchiveError)) {
                 const bool reloadArchiveWindow = archiveWindow &&
@@ -1198,6 +1285,8 @@ void WalletWindow::ShowChangePasswordDialog() {
                 errorMsg = "New password must be at least 8 characters.";
             } else if (!userPassword.equals(oldPassword.get())) {
                 errorMsg = "Current password is incorrect.";
+            } else if (archiveWindow && !archiveWindow->FlushPendingChanges()) {
+                errorMsg = "Unsaved archive changes could not be written. Password was not changed.";
             } else {
                 PasswordManager pm;
                 if (pm.ChangeMasterPassword(currentUser, oldPassword.get(),
@@ -1249,6 +1338,47 @@ void WalletWindow::ShowChangePasswordDialog() {
     }
 }
 
+void WalletWindow::StartCalibration(int unlockMs, int memoryMiB) {
+    if (calibrationThread.joinable()) {
+        return;
+    }
+    stopCalibration = false;
+    calibrationRunning = true;
+    try {
+        calibrationThread = std::thread([this, unlockMs, memoryMiB]() {
+            calibrationResult = KeyDerivation::CalibrateScrypt(
+                std::chrono::milliseconds(unlockMs),
+                static_cast<uint64_t>(memoryMiB) * 1024U * 1024U, &stopCalibration);
+            calibrationRunning = false;
+        });
+    } catch (const std::system_error&) {
+        calibrationRunning = false;
+        std::cerr << "Could not start key derivation calibration" << std::endl;
+    }
+}
+
+void WalletWindow::PollCalibration() {
+    if (!calibrationThread.joinable() || calibrationRunning) {
+        return;
+    }
+    calibrationThread.join();
+    Settings& settings = Settings::Instance();
+    settings.ApplyKeyDerivationCalibration(calibrationResult);
+    if (!settings.SaveSettings()) {
+        std::cout << "Error: Failed to save the calibrated key derivation cost!" << std::endl;
+    }
+}
+
+void WalletWindow::StopCalibration() {
+    if (!calibrationThread.joinable()) {
+        return;
+    }
+    // The current scrypt run still finishes; its cost is not applied.
+    stopCalibration = true;
+    calibrationThread.join();
+    calibrationRunning = false;
+}
+
 void WalletWindow::ClearSensitiveSession() {
     databaseManagerWindow.reset();
     encryptedDatabase.reset();
@@ -1265,6 +1395,9 @@ void WalletWindow::ClearSensitiveSession() {
     showChangePasswordDialog = false;
     showOldPassword = false;
     showNewPassword = false;
+    // The archive already released its pages on close; this covers the
+    // database and the session credential.
+    SecureMemory::DefaultArena().Reset();
 }
 
 void WalletWindow::RequestLogout() {
@@ -1,12 +1,15 @@
 #pragma once
+#include <atomic>
 #include <string>
 #include <memory>
+#include <thread>
 #include <unordered_map>
 #include "ArchiveWindow.h"
 #include "FontManager.h"
 #include "Settings.h"
 #include "EncryptedDatabase.h"
 #include "DatabaseManagerWindow.h"
+#include "LoginTask.h"
 #include "SecureMemory.h"
 
 class WalletWindow {
@@ -15,7 +18,9 @@ public:
     ~WalletWindow();
     
     void Draw();
-    void SetUserInfo(const std::string& username, const std::string& password);
+    // Takes over a session verified by LoginTask, including its open database
+    // and archive.
+    void OpenSession(std::unique_ptr<LoginTask::Session> session);
     void SetFontManager(FontManager* fontManager);
     bool ShouldClose() const { return shouldClose; }
     
@@ -49,6 +54,19 @@ private:
     int tempSecurityLevel;
     int tempBackupRetentionDays;
     bool tempEnableLogging;
+    bool tempDeferArchiveCommits;
+    int tempArchiveCommitDelayMs;
+    int tempArchiveCryptoThreads;
+    bool tempCompressArchiveEntries;
+    int tempArchiveCacheMiB;
+    int tempKdfUnlockMs;
+    int tempKdfMemoryMiB;
+
+    // scrypt calibration runs on a worker; its result is applied by Draw()
+    std::thread calibrationThread;
+    std::atomic<bool> calibrationRunning{false};
+    std::atomic<bool> stopCalibration{false};
+    KeyDerivation::ScryptParameters calibrationResult;
     int tempThemeIndex;
     
     // User's archives list
@@ -85,6 +103,9 @@ private:
     void DrawFontSettings();
     void ShowChangePasswordDialog();
     void LoadSettingsToUI();
+    void StartCalibration(int unlockMs, int memoryMiB);
+    void PollCalibration();
+    void StopCalibration();
     void ClearSensitiveSession();
     void RequestLogout();
 };
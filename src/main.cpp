@@ -17,6 +17,8 @@
 #include "PasswordManager.h"
 #include "FontManager.h"
 #include "Settings.h"
+#include "ArchiveStream.h"
+#include "KeyDerivation.h"
 #include "FileDropQueue.h"
 
 static void glfw_error_callback(int error, const char* description) {
@@ -65,6 +67,13 @@ int main() {
     // Setup Dear ImGui style - Apply theme from settings
     Settings& settings = Settings::Instance();
     settings.ApplyTheme();
+    ArchiveStream::SetWorkerThreads(static_cast<size_t>(settings.GetArchiveCryptoThreads()));
+    // The first start benchmarks scrypt once; later starts reuse the cost.
+    if (settings.GetScryptCostLog2() == 0) {
+        settings.CalibrateKeyDerivation();
+        settings.SaveSettings();
+    }
+    KeyDerivation::SetPreferredScrypt(settings.GetScryptParameters());
     
     // Additional style customization moved to ApplyTheme() method
 
@@ -150,7 +159,7 @@ int main() {
                 
                 if (loginWindow.IsLoginSuccessful()) {
                     isLoggedIn = true;
-                    walletWindow.SetUserInfo(loginWindow.GetUsername(), loginWindow.GetPassword());
+                    walletWindow.OpenSession(loginWindow.TakeSession());
                     printf("Login successful!\n");
                     printf("Welcome, %s!\n", loginWindow.GetUsername().c_str());
                 } else {
@@ -1,10 +1,14 @@
+#include "AtomicFile.h"
+#include "ArchiveMerkle.h"
 #include "CryptoArchive.h"
 
 #include <chrono>
 #include <cstdint>
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include <string>
 #include <vector>
 
@@ -27,6 +31,23 @@ bool WriteBytes(const std::filesystem::path& path,
     return file.good();
 }
 
+std::vector<std::uint8_t> ReadBytes(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+// Xorshift bytes: incompressible and without repeated segments.
+std::vector<std::uint8_t> PseudoRandomBytes(std::size_t size, std::uint64_t seed) {
+    std::vector<std::uint8_t> bytes(size);
+    for (std::uint8_t& byte : bytes) {
+        seed ^= seed << 13U;
+        seed ^= seed >> 7U;
+        seed ^= seed << 17U;
+        byte = static_cast<std::uint8_t>(seed >> 56U);
+    }
+    return bytes;
+}
+
 } // namespace
 
 int main() {
@@ -40,16 +61,20 @@ int main() {
     try {
         fs::create_directories(root);
         fs::current_path(root);
+        // Seal and open chunks on several threads even on a single-core host,
+        // so the tamper checks below cover the parallel batches.
+        ArchiveStream::SetWorkerThreads(4);
 
         const fs::path emptyPath = root / "empty.bin";
         const fs::path largePath = root / "large.bin";
+        const fs::path smallPath = root / "small.bin";
         const std::vector<std::uint8_t> empty;
-        std::vector<std::uint8_t> large(8U * 1024U * 1024U);
-        for (std::size_t i = 0; i < large.size(); ++i) {
-            large[i] = static_cast<std::uint8_t>((i * 131U + 17U) & 0xffU);
-        }
+        const std::vector<std::uint8_t> small = {0x53, 0x4d, 0x4c};
+        const std::vector<std::uint8_t> large =
+            PseudoRandomBytes(8U * 1024U * 1024U, 0x9e3779b97f4a7c15ULL);
         success &= Expect(WriteBytes(emptyPath, empty), "create empty input file");
         success &= Expect(WriteBytes(largePath, large), "create representative large file");
+        success &= Expect(WriteBytes(smallPath, small), "create small file");
 
         const std::string password = "archive boundary password";
         CryptoArchive writer("limits", "security");
@@ -58,6 +83,8 @@ int main() {
                           "store an empty file");
         success &= Expect(writer.AddFile(largePath.string(), "large.bin"),
                           "store an 8 MiB file");
+        success &= Expect(writer.AddFile(smallPath.string(), "small.bin"),
+                          "store a file after the large one");
 
         CryptoArchive reader("limits", "security");
         success &= Expect(reader.LoadArchive(password), "reload large archive");
@@ -76,6 +103,499 @@ int main() {
         const auto emptySize = fs::file_size(extractionRoot / "empty.bin", sizeError);
         success &= Expect(!sizeError && emptySize == 0,
                           "empty extracted file has zero bytes");
+        success &= Expect(reader.ExtractFile("large.bin", extractionRoot.string()) &&
+                              ReadBytes(extractionRoot / "large.bin") == large,
+                          "stream a large entry to disk");
+
+        // A compacted PQCENC05 container holds the entry segments in name order
+        // after the 12 KiB head area; large.bin is the first non-empty entry
+        // and spans several sealed segments, each bound to its position. The
+        // sealed index closes the file.
+        const fs::path archivePath = root / "archives/limits_security.enc";
+        success &= Expect(writer.GetStorageStats().appendedCommits == 3,
+                          "each added file is appended to the container");
+        success &= Expect(writer.CompactArchive() &&
+                              writer.GetStorageStats().containerSize ==
+                                  writer.GetStorageStats().liveSize &&
+                              fs::file_size(archivePath) ==
+                                  writer.GetStorageStats().containerSize,
+                          "compaction leaves only live records");
+        const std::vector<std::uint8_t> sealed = ReadBytes(archivePath);
+        constexpr std::size_t headerSize = 12288;
+        constexpr std::size_t sealedChunkSize = 1024U * 1024U + 16U;
+        success &= Expect(sealed.size() > headerSize + 8 * sealedChunkSize,
+                          "large archive spans several sealed chunks");
+
+        auto flipped = sealed;
+        flipped[headerSize + 2 * sealedChunkSize + 4096] ^= 0x01;
+        success &= Expect(WriteBytes(archivePath, flipped), "write archive with modified chunk");
+        CryptoArchive flippedReader("limits", "security");
+        success &= Expect(flippedReader.LoadArchive(password),
+                          "open the index without decrypting entry payloads");
+        success &= Expect(flippedReader.GetFileData("large.bin").empty() &&
+                              !flippedReader.VerifyIntegrity(),
+                          "reject a modified byte inside a middle chunk on extraction");
+        success &= Expect(flippedReader.GetFileData("small.bin") == small,
+                          "extract an unmodified entry from the same container");
+        std::size_t lastChecked = 0;
+        std::size_t lastTotal = 0;
+        const auto flippedReport = flippedReader.CheckIntegrity(
+            [&](std::size_t checked, std::size_t total) {
+                lastChecked = std::max(lastChecked, checked);
+                lastTotal = total;
+            });
+        bool reportMatches = flippedReport.failures == 1 &&
+                             flippedReport.entries.size() == flippedReader.GetFileList().size();
+        for (const auto& check : flippedReport.entries) {
+            reportMatches &= check.name == "large.bin"
+                ? check.status == CryptoArchive::EntryStatus::Unreadable
+                : check.status == CryptoArchive::EntryStatus::Ok;
+        }
+        success &= Expect(reportMatches && lastChecked == flippedReport.entries.size() &&
+                              lastTotal == flippedReport.entries.size(),
+                          "the integrity report names only the modified entry");
+        success &= Expect(flippedReader.VerifyEntry("small.bin") &&
+                              !flippedReader.VerifyEntry("large.bin"),
+                          "verify one entry without reading the others");
+        const std::vector<std::uint8_t> previousOutput = {'o', 'l', 'd'};
+        const fs::path streamedOutput = extractionRoot / "streamed.bin";
+        success &= Expect(WriteBytes(streamedOutput, previousOutput) &&
+                              !flippedReader.ExtractFile("large.bin", streamedOutput.string()) &&
+                              ReadBytes(streamedOutput) == previousOutput,
+                          "a failed streaming extraction keeps the destination");
+        std::size_t leftovers = 0;
+        for (const auto& item : fs::directory_iterator(extractionRoot)) {
+            leftovers += item.path().filename().string().find(".tmp") != std::string::npos;
+        }
+        success &= Expect(leftovers == 0, "a failed streaming extraction leaves no temporary file");
+
+        auto swapped = sealed;
+        std::swap_ranges(swapped.begin() + headerSize,
+                         swapped.begin() + headerSize + sealedChunkSize,
+                         swapped.begin() + headerSize + sealedChunkSize);
+        success &= Expect(WriteBytes(archivePath, swapped), "write archive with reordered chunks");
+        CryptoArchive swappedReader("limits", "security");
+        std::vector<std::uint8_t> swappedData;
+        success &= Expect(swappedReader.LoadArchive(password) &&
+                              !swappedReader.ExtractFileToMemory("large.bin", swappedData) &&
+                              swappedData.empty(),
+                          "reject reordered chunks");
+
+        auto indexFlipped = sealed;
+        indexFlipped[indexFlipped.size() - 20] ^= 0x01;
+        success &= Expect(WriteBytes(archivePath, indexFlipped), "write archive with modified index");
+        CryptoArchive indexReader("limits", "security");
+        success &= Expect(!indexReader.LoadArchive(password), "reject a modified index");
+
+        auto truncated = sealed;
+        truncated.resize(truncated.size() - sealedChunkSize);
+        success &= Expect(WriteBytes(archivePath, truncated), "write archive without its last chunk");
+        CryptoArchive truncatedReader("limits", "security");
+        success &= Expect(!truncatedReader.LoadArchive(password),
+                          "reject an archive missing whole chunks");
+
+        success &= Expect(WriteBytes(archivePath, sealed), "restore the original archive");
+        CryptoArchive restoredReader("limits", "security");
+        success &= Expect(restoredReader.LoadArchive(password) &&
+                              restoredReader.GetFileData("large.bin") == large,
+                          "reload the unmodified multi-chunk archive");
+
+        // A removal appends a new index; the other blobs stay where they are.
+        const auto sizeBeforeRemoval = fs::file_size(archivePath);
+        success &= Expect(restoredReader.RemoveFile("empty.bin"),
+                          "append a removal while payloads are not resident");
+        success &= Expect(fs::file_size(archivePath) - sizeBeforeRemoval < 64U * 1024U,
+                          "a removal appends only a new index");
+        CryptoArchive appendedReader("limits", "security");
+        success &= Expect(appendedReader.LoadArchive(password) &&
+                              appendedReader.GetFileList().size() == 2 &&
+                              appendedReader.GetFileData("large.bin") == large &&
+                              appendedReader.VerifyIntegrity(),
+                          "reload the appended head");
+
+        // Compaction re-seals stored payloads straight from the old container.
+        success &= Expect(appendedReader.CompactArchive() &&
+                              fs::file_size(archivePath) < sizeBeforeRemoval,
+                          "compact the removed entry away");
+        CryptoArchive rewrittenReader("limits", "security");
+        success &= Expect(rewrittenReader.LoadArchive(password) &&
+                              rewrittenReader.GetFileData("large.bin") == large &&
+                              rewrittenReader.GetFileData("small.bin") == small &&
+                              rewrittenReader.VerifyIntegrity(),
+                          "re-sealed stored payloads round-trip");
+
+        // Adding to a large archive writes O(entry) bytes, not O(archive).
+        const auto sizeBeforeAppend = fs::file_size(archivePath);
+        success &= Expect(rewrittenReader.AddFile(smallPath.string(), "appended.bin"),
+                          "append a small file to a large archive");
+        success &= Expect(fs::file_size(archivePath) - sizeBeforeAppend < 64U * 1024U,
+                          "a small add does not rewrite the large payload");
+
+        // An interrupted append leaves an unreferenced tail behind the head.
+        {
+            std::ofstream tail(archivePath, std::ios::binary | std::ios::app);
+            const std::vector<char> garbage(5000, 0x5a);
+            tail.write(garbage.data(), static_cast<std::streamsize>(garbage.size()));
+        }
+        CryptoArchive tailReader("limits", "security");
+        success &= Expect(tailReader.LoadArchive(password) &&
+                              tailReader.GetFileData("appended.bin") == small,
+                          "ignore a tail left by an interrupted append");
+        success &= Expect(tailReader.RemoveFile("appended.bin"),
+                          "append after an interrupted append");
+
+        // A head slot torn by an interrupted commit falls back to the other slot.
+        const std::vector<std::uint8_t> beforeCommit = ReadBytes(archivePath);
+        success &= Expect(tailReader.AddFile(smallPath.string(), "torn.bin"),
+                          "commit a head into the other slot");
+        auto torn = ReadBytes(archivePath);
+        std::size_t tornSlot = 0;
+        for (std::size_t slot = 4096; slot <= 8192; slot += 4096) {
+            if (!std::equal(torn.begin() + slot, torn.begin() + slot + 52,
+                            beforeCommit.begin() + slot)) {
+                tornSlot = slot;
+            }
+        }
+        success &= Expect(tornSlot != 0, "a commit writes exactly one head slot");
+        torn[tornSlot + 30] ^= 0x40;
+        success &= Expect(WriteBytes(archivePath, torn), "write archive with a torn head");
+        CryptoArchive tornReader("limits", "security");
+        success &= Expect(tornReader.LoadArchive(password) &&
+                              tornReader.GetFileList().size() == 2 &&
+                              tornReader.GetFileData("large.bin") == large,
+                          "recover the previous head when the newest is torn");
+
+        // Replacing the large payload leaves most of the container dead, so the
+        // next commit compacts instead of appending.
+        success &= Expect(tornReader.AddFile(smallPath.string(), "large.bin"),
+                          "replace the large payload");
+        const auto compactedStats = tornReader.GetStorageStats();
+        success &= Expect(compactedStats.compactions == 1 &&
+                              compactedStats.containerSize == compactedStats.liveSize &&
+                              fs::file_size(archivePath) < 64U * 1024U,
+                          "dead space past the threshold triggers compaction");
+
+        // Stored payloads are opened straight from a read-only mapping of the
+        // container; a payload ending in a partial chunk mixes whole-chunk and
+        // buffered reads, and appends by another writer do not disturb it.
+        const fs::path oddPath = root / "odd.bin";
+        const std::vector<std::uint8_t> odd(large.begin(),
+                                            large.begin() + 1024U * 1024U + 4099U);
+        success &= Expect(WriteBytes(oddPath, odd), "create a file ending in a partial chunk");
+        const fs::path mappedPath = root / "archives/mapped_security.enc";
+        CryptoArchive oddWriter("mapped", "security");
+        success &= Expect(oddWriter.InitializeArchive(password), "initialize mapped archive");
+        const auto oddBlobOffset = static_cast<std::size_t>(fs::file_size(mappedPath));
+        success &= Expect(oddWriter.AddFile(oddPath.string(), "odd.bin"),
+                          "store a file ending in a partial chunk");
+        CryptoArchive oddReader("mapped", "security");
+        success &= Expect(oddReader.LoadArchive(password), "reload the partial-chunk archive");
+        success &= Expect(oddWriter.AddFile(smallPath.string(), "later.bin"),
+                          "append while another instance reads the container");
+        std::vector<std::uint8_t> oddData;
+        success &= Expect(oddReader.ExtractFileToMemory("odd.bin", oddData) && oddData == odd,
+                          "round-trip a partial final chunk from the mapped container");
+
+        auto tailFlipped = ReadBytes(mappedPath);
+        tailFlipped[oddBlobOffset + sealedChunkSize + 100] ^= 0x01;
+        success &= Expect(WriteBytes(mappedPath, tailFlipped),
+                          "write archive with a modified partial chunk");
+        CryptoArchive tailFlippedReader("mapped", "security");
+        std::vector<std::uint8_t> tailFlippedData;
+        success &= Expect(tailFlippedReader.LoadArchive(password) &&
+                              !tailFlippedReader.ExtractFileToMemory("odd.bin",
+                                                                     tailFlippedData) &&
+                              tailFlippedData.empty(),
+                          "reject a modified byte inside the partial final chunk");
+
+        // The chunk layout does not depend on the thread count.
+        ArchiveStream::SetWorkerThreads(1);
+        CryptoArchive serialReader("limits", "security");
+        success &= Expect(serialReader.LoadArchive(password) &&
+                              serialReader.GetFileData("small.bin") == small &&
+                              serialReader.VerifyIntegrity(),
+                          "reopen the archive on one thread");
+        success &= Expect(serialReader.AddFile(largePath.string(), "serial.bin"),
+                          "seal a large entry on one thread");
+        ArchiveStream::SetWorkerThreads(3);
+        CryptoArchive parallelReader("limits", "security");
+        success &= Expect(parallelReader.LoadArchive(password) &&
+                              parallelReader.GetFileData("serial.bin") == large,
+                          "open a serially sealed entry on three threads");
+
+        // Compressible payloads are deflated before sealing; compressed formats
+        // and high-entropy payloads are stored raw.
+        std::string logText;
+        for (int line = 0; logText.size() < 512U * 1024U; ++line) {
+            logText += "2026-01-01 12:00:00 INFO request " + std::to_string(line) +
+                       " served in 3 ms\n";
+        }
+        const std::vector<std::uint8_t> logBytes(logText.begin(), logText.end());
+        std::string rawLogText;
+        for (int line = 0; rawLogText.size() < 256U * 1024U; ++line) {
+            rawLogText += "2026-01-02 08:30:00 WARN job " + std::to_string(line) +
+                          " retried after timeout\n";
+        }
+        const std::vector<std::uint8_t> rawLogBytes(rawLogText.begin(), rawLogText.end());
+        std::vector<std::uint8_t> pngBytes(64U * 1024U, 0);
+        const std::uint8_t pngSignature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        std::copy(std::begin(pngSignature), std::end(pngSignature), pngBytes.begin());
+        const fs::path logPath = root / "service.log";
+        const fs::path rawLogPath = root / "jobs.log";
+        const fs::path pngPath = root / "picture.png";
+        success &= Expect(WriteBytes(logPath, logBytes) && WriteBytes(rawLogPath, rawLogBytes) &&
+                              WriteBytes(pngPath, pngBytes),
+                          "create compressible and precompressed inputs");
+
+        const fs::path codecPath = root / "archives/codec_security.enc";
+        CryptoArchive codecWriter("codec", "security");
+        success &= Expect(codecWriter.InitializeArchive(password), "initialize codec archive");
+        const auto codecBaseSize = fs::file_size(codecPath);
+        success &= Expect(codecWriter.AddFile(logPath.string(), "service.log"),
+                          "store a compressible log");
+        const auto logStats = codecWriter.GetStats();
+        success &= Expect(fs::file_size(codecPath) - codecBaseSize < logBytes.size() / 4 &&
+                              logStats.storedSize < logBytes.size() / 4 &&
+                              logStats.compressionRatio > 4.0,
+                          "a compressible log is stored deflated");
+        success &= Expect(codecWriter.AddFile(pngPath.string(), "picture.png"),
+                          "store a precompressed image");
+        success &= Expect(codecWriter.GetStats().storedSize == logStats.storedSize + pngBytes.size(),
+                          "a known compressed format is stored raw");
+        codecWriter.SetCompression(false);
+        success &= Expect(codecWriter.AddFile(rawLogPath.string(), "uncompressed.log") &&
+                              codecWriter.GetStats().storedSize ==
+                                  logStats.storedSize + pngBytes.size() + rawLogBytes.size(),
+                          "disabled compression stores new entries raw");
+
+        CryptoArchive codecReader("codec", "security");
+        success &= Expect(codecReader.LoadArchive(password) &&
+                              codecReader.GetFileData("service.log") == logBytes &&
+                              codecReader.GetFileData("picture.png") == pngBytes &&
+                              codecReader.GetFileData("uncompressed.log") == rawLogBytes &&
+                              codecReader.VerifyIntegrity(),
+                          "compressed and raw entries round-trip");
+        success &= Expect(codecReader.CompactArchive(), "compact an archive with compressed blobs");
+        CryptoArchive compactedCodecReader("codec", "security");
+        success &= Expect(compactedCodecReader.LoadArchive(password) &&
+                              compactedCodecReader.GetStats().storedSize ==
+                                  codecWriter.GetStats().storedSize &&
+                              compactedCodecReader.GetFileData("service.log") == logBytes,
+                          "compaction re-seals compressed blobs unchanged");
+
+        // Segments are written in name order, so the first compressed segment
+        // of the log follows the raw image after compaction.
+        auto codecFlipped = ReadBytes(codecPath);
+        const std::size_t logBlobOffset = headerSize + pngBytes.size() + 16U;
+        codecFlipped[logBlobOffset + 10] ^= 0x01;
+        success &= Expect(WriteBytes(codecPath, codecFlipped),
+                          "write archive with a modified compressed blob");
+        CryptoArchive codecFlippedReader("codec", "security");
+        std::vector<std::uint8_t> codecFlippedData;
+        success &= Expect(codecFlippedReader.LoadArchive(password) &&
+                              !codecFlippedReader.ExtractFileToMemory("service.log",
+                                                                      codecFlippedData) &&
+                              codecFlippedData.empty() &&
+                              codecFlippedReader.GetFileData("uncompressed.log") ==
+                                  rawLogBytes,
+                          "reject a modified compressed blob");
+
+        // Entries with the same content share their segments, and content
+        // shifted by an insertion still shares every segment after the edit.
+        std::vector<std::uint8_t> shifted(1000, 0x42);
+        shifted.insert(shifted.end(), large.begin(), large.end());
+        const fs::path shiftedPath = root / "shifted.bin";
+        success &= Expect(WriteBytes(shiftedPath, shifted), "create shifted content");
+        const fs::path dedupPath = root / "archives/dedup_security.enc";
+        CryptoArchive dedupWriter("dedup", "security");
+        success &= Expect(dedupWriter.InitializeArchive(password) &&
+                              dedupWriter.AddFile(largePath.string(), "original.bin"),
+                          "store the original content");
+        const auto dedupBaseSize = fs::file_size(dedupPath);
+        success &= Expect(dedupWriter.AddFile(largePath.string(), "copy.bin") &&
+                              fs::file_size(dedupPath) - dedupBaseSize < 64U * 1024U,
+                          "an identical file appends no payload");
+        const auto shiftedBaseSize = fs::file_size(dedupPath);
+        success &= Expect(dedupWriter.AddFile(shiftedPath.string(), "shifted.bin") &&
+                              fs::file_size(dedupPath) - shiftedBaseSize < 2U * 1024U * 1024U,
+                          "shifted content appends only the edited segments");
+        const auto dedupStats = dedupWriter.GetStats();
+        success &= Expect(dedupStats.totalSize == 2 * large.size() + shifted.size() &&
+                              dedupStats.storedSize == dedupStats.totalSize &&
+                              dedupStats.physicalSize < large.size() + 2U * 1024U * 1024U,
+                          "physical size counts shared segments once");
+
+        // Removing one user of a shared segment keeps it for the others.
+        success &= Expect(dedupWriter.RemoveFile("original.bin") && dedupWriter.CompactArchive(),
+                          "remove and compact one of the duplicates");
+        CryptoArchive dedupReader("dedup", "security");
+        success &= Expect(dedupReader.LoadArchive(password) &&
+                              dedupReader.GetFileData("copy.bin") == large &&
+                              dedupReader.GetFileData("shifted.bin") == shifted &&
+                              dedupReader.VerifyIntegrity() &&
+                              dedupReader.GetStats().physicalSize == dedupStats.physicalSize,
+                          "shared segments survive the removal and compaction");
+
+        // Decrypted segments are cached within the budget, so reading them
+        // again skips decryption; shrinking the budget evicts them.
+        const auto cacheBefore = dedupReader.GetCacheStats();
+        success &= Expect(cacheBefore.hits != 0 && cacheBefore.residentBytes != 0 &&
+                              cacheBefore.residentBytes <= cacheBefore.budget,
+                          "shared segments are served from the cache");
+        std::vector<std::uint8_t> cachedCopy;
+        success &= Expect(dedupReader.ExtractFileToMemory("copy.bin", cachedCopy) &&
+                              cachedCopy == large &&
+                              dedupReader.GetCacheStats().misses == cacheBefore.misses,
+                          "a cached entry is read without decryption");
+        const std::size_t smallBudget = 2U * 1024U * 1024U;
+        dedupReader.SetCacheBudget(smallBudget);
+        success &= Expect(dedupReader.GetCacheStats().residentBytes <= smallBudget &&
+                              dedupReader.GetCacheStats().evictions > cacheBefore.evictions,
+                          "shrinking the cache budget evicts segments");
+        success &= Expect(dedupReader.GetFileData("shifted.bin") == shifted &&
+                              dedupReader.GetCacheStats().residentBytes <= smallBudget,
+                          "reads stay within a small cache budget");
+        dedupReader.SetCacheBudget(0);
+        success &= Expect(dedupReader.GetCacheStats().residentBytes == 0 &&
+                              dedupReader.GetFileData("copy.bin") == large &&
+                              dedupReader.GetCacheStats().residentBytes == 0,
+                          "a zero cache budget disables the cache");
+
+        // A modified shared segment fails every entry that uses it.
+        auto dedupFlipped = ReadBytes(dedupPath);
+        dedupFlipped[headerSize + 3U * 1024U * 1024U] ^= 0x01;
+        success &= Expect(WriteBytes(dedupPath, dedupFlipped),
+                          "write archive with a modified shared segment");
+        CryptoArchive dedupFlippedReader("dedup", "security");
+        success &= Expect(dedupFlippedReader.LoadArchive(password) &&
+                              dedupFlippedReader.GetFileData("copy.bin").empty() &&
+                              dedupFlippedReader.GetFileData("shifted.bin").empty(),
+                          "reject a modified shared segment in every entry");
+
+        // Every leaf proves its membership with its own path, a changed leaf
+        // only rehashes its path, and an altered leaf or sibling fails.
+        std::vector<ArchiveMerkle::Hash> leaves;
+        for (int i = 0; i < 13; ++i) {
+            leaves.push_back(ArchiveMerkle::LeafHash("entry" + std::to_string(i) + ".bin",
+                                                     static_cast<std::uint64_t>(i), "hash"));
+        }
+        ArchiveMerkle::Tree tree;
+        tree.Build(leaves);
+        bool pathsValid = true;
+        for (std::size_t i = 0; i < leaves.size(); ++i) {
+            pathsValid &= tree.Path(i).size() <= 4 &&
+                          ArchiveMerkle::VerifyPath(leaves[i], tree.Path(i), tree.Root());
+        }
+        success &= Expect(pathsValid, "every leaf verifies against the root");
+        auto alteredPath = tree.Path(5);
+        alteredPath.front().sibling[0] ^= 0x01;
+        success &= Expect(!ArchiveMerkle::VerifyPath(leaves[5], alteredPath, tree.Root()) &&
+                              !ArchiveMerkle::VerifyPath(leaves[6], tree.Path(5), tree.Root()),
+                          "an altered sibling or leaf does not verify");
+        const ArchiveMerkle::Hash previousRoot = tree.Root();
+        leaves[12] = ArchiveMerkle::LeafHash("entry12.bin", 12, "other");
+        ArchiveMerkle::Tree rebuilt;
+        rebuilt.Build(leaves);
+        success &= Expect(tree.Update(12, leaves[12]) && tree.Root() == rebuilt.Root() &&
+                              tree.Root() != previousRoot,
+                          "updating one leaf matches a rebuilt tree");
+
+        // The root is sealed in the index, checked on load, and moves with
+        // every commit; a scrubber walks the entries a few at a time.
+        CryptoArchive rootWriter("root", "security");
+        success &= Expect(rootWriter.InitializeArchive(password) &&
+                              rootWriter.AddFiles({{smallPath.string(), "a.bin"},
+                                                   {smallPath.string(), "b.bin"},
+                                                   {smallPath.string(), "c.bin"}}),
+                          "create an archive with an integrity root");
+        const std::string firstRoot = rootWriter.GetStats().integrityRoot;
+        success &= Expect(firstRoot.size() == 64 && rootWriter.VerifyEntry("b.bin") &&
+                              rootWriter.AddFile(largePath.string(), "b.bin") &&
+                              rootWriter.GetStats().integrityRoot != firstRoot,
+                          "replacing an entry moves the integrity root");
+        CryptoArchive rootReader("root", "security");
+        success &= Expect(rootReader.LoadArchive(password) &&
+                              rootReader.GetStats().integrityRoot ==
+                                  rootWriter.GetStats().integrityRoot &&
+                              rootReader.VerifyEntry("b.bin"),
+                          "a reloaded archive has the same root");
+        const auto firstScrub = rootReader.ScrubIntegrity(2);
+        const auto secondScrub = rootReader.ScrubIntegrity(2);
+        success &= Expect(firstScrub.failures == 0 && firstScrub.entries.size() == 2 &&
+                              firstScrub.entries[0].name == "a.bin" &&
+                              secondScrub.entries.size() == 2 &&
+                              secondScrub.entries[0].name == "c.bin" &&
+                              secondScrub.entries[1].name == "a.bin",
+                          "the scrubber continues where it stopped and wraps around");
+        success &= Expect(rootReader.SetDeferredCommit(true, std::chrono::minutes(10)) &&
+                              rootReader.AddFile(smallPath.string(), "b.bin") &&
+                              rootReader.VerifyEntry("b.bin") &&
+                              rootReader.LeaseEntry("b.bin").valid() &&
+                              rootReader.GetFileData("b.bin").size() == small.size(),
+                          "a staged replacement is read before it has a sealed leaf");
+        success &= Expect(rootReader.SaveArchive() && rootReader.VerifyEntry("b.bin") &&
+                              rootReader.VerifyEntry("a.bin"),
+                          "the committed replacement matches its new leaf");
+
+        // A batch whose save fails restores the entries it replaced, and those
+        // are checked against their sealed leaves again.
+        CryptoArchive failedWriter("root", "security");
+        success &= Expect(failedWriter.LoadArchive(password), "load archive for a failed save");
+        AtomicFile::Testing::FailNextWriteBeforeReplace();
+        success &= Expect(!failedWriter.AddFile(smallPath.string(), "b.bin") &&
+                              failedWriter.VerifyEntry("b.bin"),
+                          "a failed save restores the replaced entry");
+        std::vector<std::uint8_t> rolledBack;
+        success &= Expect(CryptoArchiveTesting::ReplaceSealedLeaf(failedWriter, "b.bin") &&
+                              !failedWriter.VerifyEntry("b.bin") &&
+                              !failedWriter.ExtractFile("b.bin", (root / "rolled-back.bin").string()) &&
+                              !failedWriter.ExtractFileToMemory("b.bin", rolledBack),
+                          "a restored entry must still match its sealed leaf");
+
+        // Sources larger than one ingest block stream into the container, so
+        // an entry above the 512 MiB in-memory limit is stored and extracted
+        // without being held whole. The sparse source is mostly zeros, which
+        // collapse into one shared segment.
+        const fs::path hugePath = root / "huge.bin";
+        const std::uint64_t hugeSize = 513ULL * 1024ULL * 1024ULL;
+        {
+            std::ofstream hugeFile(hugePath, std::ios::binary | std::ios::trunc);
+            hugeFile.write(reinterpret_cast<const char*>(small.data()),
+                           static_cast<std::streamsize>(small.size()));
+        }
+        fs::resize_file(hugePath, hugeSize);
+        {
+            std::fstream hugeFile(hugePath, std::ios::binary | std::ios::in | std::ios::out);
+            hugeFile.seekp(static_cast<std::streamoff>(hugeSize - small.size()));
+            hugeFile.write(reinterpret_cast<const char*>(small.data()),
+                           static_cast<std::streamsize>(small.size()));
+        }
+        const fs::path hugeArchivePath = root / "archives/huge_security.enc";
+        CryptoArchive hugeWriter("huge", "security");
+        success &= Expect(hugeWriter.InitializeArchive(password) &&
+                              hugeWriter.AddFile(hugePath.string(), "huge.bin") &&
+                              fs::file_size(hugeArchivePath) < 16U * 1024U * 1024U,
+                          "stream an entry above the in-memory limit into the archive");
+        CryptoArchive hugeReader("huge", "security");
+        success &= Expect(hugeReader.LoadArchive(password) &&
+                              hugeReader.GetStats().totalSize == hugeSize &&
+                              hugeReader.GetFileData("huge.bin").empty(),
+                          "an entry above the in-memory limit is not loaded whole");
+        const fs::path hugeOutput = root / "huge_output";
+        fs::create_directories(hugeOutput);
+        success &= Expect(hugeReader.VerifyIntegrity() &&
+                              hugeReader.ExtractFile("huge.bin", hugeOutput.string()) &&
+                              fs::file_size(hugeOutput / "huge.bin") == hugeSize,
+                          "verify and extract an entry above the in-memory limit");
+        std::vector<std::uint8_t> hugeTail(small.size());
+        {
+            std::ifstream extracted(hugeOutput / "huge.bin", std::ios::binary);
+            extracted.seekg(static_cast<std::streamoff>(hugeSize - small.size()));
+            extracted.read(reinterpret_cast<char*>(hugeTail.data()),
+                           static_cast<std::streamsize>(hugeTail.size()));
+        }
+        success &= Expect(hugeTail == small, "the streamed entry keeps its last bytes");
+        fs::remove(hugeOutput / "huge.bin");
     } catch (const std::exception& error) {
         std::cerr << "FAILED with exception: " << error.what() << std::endl;
         success = false;
@@ -1,6 +1,7 @@
 #include "AtomicFile.h"
 #include "CryptoArchive.h"
 
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <cstdint>
@@ -154,6 +155,185 @@ int main() {
         success &= Expect(CountTemporaryFiles(testRoot) == 0,
                           "removal failure leaves no temporary files");
 
+        const fs::path batchFirstPath = testRoot / "batch_first.bin";
+        const fs::path batchSecondPath = testRoot / "batch_second.bin";
+        const std::vector<std::uint8_t> batchFirst = {0x51, 0x52};
+        const std::vector<std::uint8_t> batchSecond(70000, 0x53);
+        success &= Expect(WritePayload(batchFirstPath, batchFirst) &&
+                          WritePayload(batchSecondPath, batchSecond),
+                          "write batch payload fixtures");
+        const auto beforeBatch = ReadAll(archivePath);
+        std::string batchError;
+        success &= Expect(!archive.AddFiles({{batchFirstPath.string(), "one.bin"},
+                                             {batchSecondPath.string(), "ONE.bin"}},
+                                            &batchError) &&
+                          !batchError.empty(),
+                          "reject a batch whose names collide with each other");
+        success &= Expect(!archive.AddFiles({{batchFirstPath.string(), "one.bin"},
+                                             {(testRoot / "missing.bin").string(), "two.bin"}}),
+                          "reject a batch with an unreadable source");
+        AtomicFile::Testing::FailNextWriteBeforeReplace();
+        success &= Expect(!archive.AddFiles({{batchFirstPath.string(), "one.bin"},
+                                             {batchSecondPath.string(), "record.bin"}}),
+                          "rollback a failed batch commit");
+        success &= Expect(ReadAll(archivePath) == beforeBatch,
+                          "failed batches preserve disk bytes");
+        success &= Expect(archive.GetFileList().size() == 1 &&
+                          archive.GetFileData("record.bin") == replacementPayload,
+                          "failed batches restore memory entries");
+
+        const auto commitsBeforeBatch = archive.GetStorageStats().appendedCommits;
+        success &= Expect(archive.AddFiles({{batchFirstPath.string(), "one.bin"},
+                                            {batchSecondPath.string(), ""}}),
+                          "commit a batch of files");
+        success &= Expect(archive.GetStorageStats().appendedCommits == commitsBeforeBatch + 1,
+                          "a batch is committed by a single save");
+        CryptoArchive batchReader("alice", "transactions");
+        success &= Expect(batchReader.LoadArchive(password) &&
+                          batchReader.GetFileData("one.bin") == batchFirst &&
+                          batchReader.GetFileData("batch_second.bin") == batchSecond &&
+                          batchReader.GetFileData("record.bin") == replacementPayload,
+                          "committed batch is readable from disk");
+        success &= Expect(archive.RemoveFile("one.bin") &&
+                          archive.RemoveFile("batch_second.bin"),
+                          "remove batch entries");
+
+        {
+            // More entries than the former 1000-entry cap, in one batch.
+            std::vector<std::pair<std::string, std::string>> manyFiles;
+            for (int i = 0; i < 1500; ++i) {
+                manyFiles.emplace_back(batchFirstPath.string(),
+                                       "entry" + std::to_string(i) + ".bin");
+            }
+            CryptoArchive many("alice", "many");
+            success &= Expect(many.InitializeArchive(password) && many.AddFiles(manyFiles),
+                              "commit a batch of 1500 entries");
+            CryptoArchive manyReader("alice", "many");
+            std::vector<std::uint8_t> folded;
+            success &= Expect(manyReader.LoadArchive(password) &&
+                              manyReader.GetFileList().size() == manyFiles.size() &&
+                              manyReader.ExtractFileToMemory("ENTRY1499.BIN", folded) &&
+                              folded == batchFirst,
+                              "load 1500 entries and find one by its case-folded name");
+            success &= Expect(!manyReader.AddFile(batchFirstPath.string(), "Entry7.BIN"),
+                              "reject a name equivalent to one of many entries");
+        }
+
+        {
+            // A lease reads one entry without copying it and pins the entry
+            // until it is released.
+            CryptoArchive leased("alice", "leases");
+            success &= Expect(leased.InitializeArchive(password) &&
+                              leased.AddFile(batchFirstPath.string(), "stored.bin"),
+                              "create an archive for leases");
+            auto stored = leased.LeaseEntry("stored.bin", true);
+            success &= Expect(stored && stored.size() == batchFirst.size() &&
+                              std::equal(batchFirst.begin(), batchFirst.end(), stored.data()) &&
+                              stored.data()[stored.size()] == 0,
+                              "lease a stored entry with a terminating zero");
+            success &= Expect(!leased.RemoveFile("stored.bin") &&
+                              !leased.AddFile(batchSecondPath.string(), "stored.bin") &&
+                              !leased.ReloadArchive() && !leased.RepairArchive() &&
+                              leased.GetFileData("stored.bin") == batchFirst,
+                              "a leased entry cannot be replaced, removed or reloaded");
+            auto moved = std::move(stored);
+            success &= Expect(moved && moved.size() == batchFirst.size(),
+                              "a moved lease keeps the pin");
+            moved.Release();
+            success &= Expect(leased.RemoveFile("stored.bin"),
+                              "releasing the lease unpins the entry");
+
+            success &= Expect(leased.SetDeferredCommit(true, std::chrono::minutes(10)) &&
+                              leased.AddFile(batchSecondPath.string(), "resident.bin"),
+                              "stage a resident entry");
+            auto resident = leased.LeaseEntry("resident.bin");
+            const std::uint8_t* residentData = resident.data();
+            success &= Expect(resident && leased.Flush() && resident.data() == residentData &&
+                              std::equal(batchSecond.begin(), batchSecond.end(), resident.data()),
+                              "a resident lease is viewed in place across a commit");
+            resident.Release();
+            success &= Expect(!leased.LeaseEntry("missing.bin"), "no lease for a missing entry");
+        }
+
+        {
+            CryptoArchive deferred("alice", "deferred");
+            success &= Expect(deferred.InitializeArchive(password) &&
+                              deferred.SetDeferredCommit(true, std::chrono::minutes(10)),
+                              "enable write-behind commits");
+            const fs::path deferredPath = testRoot / "archives/alice_deferred.enc";
+            const auto beforeStaging = ReadAll(deferredPath);
+            const auto commitsBefore = deferred.GetStorageStats().appendedCommits;
+            success &= Expect(deferred.AddFile(batchFirstPath.string(), "one.bin") &&
+                              deferred.AddFile(batchSecondPath.string(), "two.bin") &&
+                              deferred.RemoveFile("one.bin"),
+                              "stage changes without committing");
+            auto status = deferred.GetCommitStatus();
+            success &= Expect(ReadAll(deferredPath) == beforeStaging && status.dirty &&
+                              status.pendingChanges == 3,
+                              "staged changes leave the container untouched");
+            success &= Expect(deferred.Flush(), "flush staged changes");
+            status = deferred.GetCommitStatus();
+            success &= Expect(!status.dirty && status.deferredCommits == 1 &&
+                              status.coalescedChanges == 3 &&
+                              deferred.GetStorageStats().appendedCommits == commitsBefore + 1,
+                              "three staged changes are coalesced into one commit");
+            CryptoArchive flushedReader("alice", "deferred");
+            success &= Expect(flushedReader.LoadArchive(password) &&
+                              flushedReader.GetFileList().size() == 1 &&
+                              flushedReader.GetFileData("two.bin") == batchSecond,
+                              "flushed commit is readable from disk");
+
+            success &= Expect(deferred.AddFile(batchFirstPath.string(), "three.bin"),
+                              "stage a change before a concurrent write");
+            success &= Expect(flushedReader.AddFile(batchFirstPath.string(), "other.bin"),
+                              "concurrent instance commits first");
+            const auto afterConcurrentWrite = ReadAll(deferredPath);
+            success &= Expect(!deferred.Flush(), "stale staged commit is rejected");
+            status = deferred.GetCommitStatus();
+            success &= Expect(status.dirty && !status.lastError.empty() &&
+                              ReadAll(deferredPath) == afterConcurrentWrite,
+                              "rejected commit keeps the other writer's update and reports it");
+            success &= Expect(deferred.ReloadArchive() && !deferred.GetCommitStatus().dirty,
+                              "reload discards the stale staged change");
+
+            success &= Expect(deferred.SetDeferredCommit(true, std::chrono::milliseconds(20)) &&
+                              deferred.AddFile(batchFirstPath.string(), "background.bin"),
+                              "stage a change for the background committer");
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (deferred.GetCommitStatus().dirty &&
+                   std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            CryptoArchive backgroundReader("alice", "deferred");
+            success &= Expect(!deferred.GetCommitStatus().dirty &&
+                              backgroundReader.LoadArchive(password) &&
+                              backgroundReader.GetFileData("background.bin") == batchFirst,
+                              "background committer saves after the idle delay");
+
+            success &= Expect(deferred.SetDeferredCommit(true, std::chrono::minutes(10)) &&
+                              deferred.AddFile(batchFirstPath.string(), "on-close.bin"),
+                              "stage a change before closing");
+        }
+        CryptoArchive closedReader("alice", "deferred");
+        success &= Expect(closedReader.LoadArchive(password) &&
+                          closedReader.GetFileData("on-close.bin") == batchFirst,
+                          "closing the archive commits staged changes");
+        success &= Expect(closedReader.RemoveFile("on-close.bin") &&
+                          closedReader.AddFile(batchFirstPath.string(), "again.bin"),
+                          "commit twice after loading");
+        auto revisionStats = closedReader.GetStorageStats();
+        success &= Expect(revisionStats.revisionMetadataChecks == 2 &&
+                          revisionStats.revisionReads == 0,
+                          "own commits are checked from file metadata only");
+        const fs::path closedPath = testRoot / "archives/alice_deferred.enc";
+        fs::last_write_time(closedPath,
+                            fs::last_write_time(closedPath) - std::chrono::hours(1));
+        success &= Expect(closedReader.RemoveFile("again.bin"),
+                          "commit after the file metadata changed");
+        revisionStats = closedReader.GetStorageStats();
+        success &= Expect(revisionStats.revisionReads == 1,
+                          "changed metadata falls back to reading the revision");
+
         const fs::path repairPath = testRoot / "archives/bob_repair.enc";
         success &= Expect(WriteLegacyRepairFixture(repairPath, password),
                           "create repair fixture with invalid metadata");
@@ -164,6 +344,12 @@ int main() {
                           repairMetadata.front().hash == "invalid-hash",
                           "fixture requires metadata repair");
         const auto beforeRepair = ReadAll(repairPath);
+        const auto repairReport = repairArchive.CheckIntegrity();
+        success &= Expect(repairReport.failures == 1 && repairReport.entries.size() == 1 &&
+                          repairReport.entries.front().status ==
+                              CryptoArchive::EntryStatus::HashMismatch &&
+                          !repairReport.entries.front().actualHash.empty(),
+                          "integrity report finds the stale hash");
 
         AtomicFile::Testing::FailNextWriteBeforeTemporaryCreate();
         success &= Expect(!repairArchive.RepairArchive(),
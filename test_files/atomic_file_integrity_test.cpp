@@ -59,6 +59,28 @@ int main() {
         success &= Expect(ReadAll(destination) == "new-complete-data",
                           "successful write publishes all new bytes");
 
+        const std::string appended = "-tail";
+        success &= Expect(AtomicFile::WriteAt(destination, ReadAll(destination).size(),
+                                              [&appended](const AtomicFile::ChunkWriter& writer) {
+                                                  return writer(reinterpret_cast<const uint8_t*>(
+                                                                    appended.data()),
+                                                                appended.size());
+                                              }),
+                          "append in place");
+        success &= Expect(AtomicFile::WriteAt(destination, 0,
+                                              [](const AtomicFile::ChunkWriter& writer) {
+                                                  const uint8_t head[] = {'N', 'E', 'X'};
+                                                  return writer(head, sizeof(head));
+                                              }),
+                          "overwrite a range in place");
+        success &= Expect(ReadAll(destination) == "NEX-complete-data-tail",
+                          "in-place writes change only their own range");
+        success &= Expect(!AtomicFile::WriteAt(testRoot / "missing.enc", 0,
+                                               [](const AtomicFile::ChunkWriter&) {
+                                                   return true;
+                                               }),
+                          "in-place writes never create files");
+
 #ifndef _WIN32
         const auto permissions = fs::status(destination).permissions();
         const auto groupOrOther = fs::perms::group_all | fs::perms::others_all;
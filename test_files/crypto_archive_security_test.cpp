@@ -1,6 +1,12 @@
 #include "CryptoArchive.h"
 #include "AtomicFile.h"
+#include "FormatValidation.h"
+#include "KeyDerivation.h"
+#include "Log.h"
+#include "Metrics.h"
 
+#include <algorithm>
+#include <atomic>
 #include <array>
 #include <chrono>
 #include <cstdint>
@@ -9,10 +15,14 @@
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <openssl/evp.h>
+#include <openssl/rand.h>
 
 namespace {
 
@@ -84,6 +94,93 @@ bool WriteLegacyEmptyArchive(const std::filesystem::path& path, const std::strin
     return file.good();
 }
 
+void AppendBe32(std::vector<uint8_t>& output, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        output.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+void AppendBe64(std::vector<uint8_t>& output, uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        output.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+template <typename Integer>
+void AppendNative(std::vector<uint8_t>& output, Integer value) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+    output.insert(output.end(), bytes, bytes + sizeof(value));
+}
+
+// Writes a single-message PQCENC02 archive holding one entry, exactly as the
+// previous release produced it, to prove that it remains readable.
+bool WriteV2Archive(const std::filesystem::path& path, const std::string& password,
+                    const std::string& name, const std::vector<uint8_t>& data) {
+    const std::string timestamp = "2024-01-01 00:00:00";
+    const std::string hash = "not-verified-on-load";
+    std::vector<uint8_t> plaintext;
+    AppendNative(plaintext, uint32_t{1});
+    AppendNative(plaintext, static_cast<uint32_t>(name.size()));
+    plaintext.insert(plaintext.end(), name.begin(), name.end());
+    AppendNative(plaintext, static_cast<uint64_t>(data.size()));
+    plaintext.insert(plaintext.end(), data.begin(), data.end());
+    AppendNative(plaintext, static_cast<uint32_t>(timestamp.size()));
+    plaintext.insert(plaintext.end(), timestamp.begin(), timestamp.end());
+    AppendNative(plaintext, static_cast<uint32_t>(hash.size()));
+    plaintext.insert(plaintext.end(), hash.begin(), hash.end());
+
+    std::array<uint8_t, 32> salt{};
+    std::array<uint8_t, 12> nonce{};
+    std::array<uint8_t, 32> key{};
+    if (RAND_bytes(salt.data(), static_cast<int>(salt.size())) != 1 ||
+        RAND_bytes(nonce.data(), static_cast<int>(nonce.size())) != 1 ||
+        EVP_PBE_scrypt(password.data(), password.size(), salt.data(), salt.size(),
+                       32768, 8, 1, 128ULL * 1024ULL * 1024ULL, key.data(), key.size()) != 1) {
+        return false;
+    }
+
+    std::vector<uint8_t> header = {'P', 'Q', 'C', 'E', 'N', 'C', '0', '2'};
+    AppendBe32(header, 2);
+    AppendBe32(header, 1);
+    AppendBe64(header, 32768);
+    AppendBe32(header, 8);
+    AppendBe32(header, 1);
+    AppendBe32(header, static_cast<uint32_t>(salt.size()));
+    AppendBe32(header, static_cast<uint32_t>(nonce.size()));
+    AppendBe32(header, 16);
+    AppendBe64(header, plaintext.size());
+    header.insert(header.end(), salt.begin(), salt.end());
+    header.insert(header.end(), nonce.begin(), nonce.end());
+
+    std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> context(
+        EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free);
+    std::vector<uint8_t> ciphertext(plaintext.size());
+    std::array<uint8_t, 16> tag{};
+    int length = 0;
+    if (!context ||
+        EVP_EncryptInit_ex(context.get(), EVP_aes_256_gcm(), nullptr, key.data(),
+                           nonce.data()) != 1 ||
+        EVP_EncryptUpdate(context.get(), nullptr, &length, header.data(),
+                          static_cast<int>(header.size())) != 1 ||
+        EVP_EncryptUpdate(context.get(), ciphertext.data(), &length, plaintext.data(),
+                          static_cast<int>(plaintext.size())) != 1 ||
+        EVP_EncryptFinal_ex(context.get(), ciphertext.data() + length, &length) != 1 ||
+        EVP_CIPHER_CTX_ctrl(context.get(), EVP_CTRL_GCM_GET_TAG,
+                            static_cast<int>(tag.size()), tag.data()) != 1) {
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(header.data()),
+               static_cast<std::streamsize>(header.size()));
+    file.write(reinterpret_cast<const char*>(ciphertext.data()),
+               static_cast<std::streamsize>(ciphertext.size()));
+    file.write(reinterpret_cast<const char*>(tag.data()),
+               static_cast<std::streamsize>(tag.size()));
+    file.flush();
+    return file.good();
+}
+
 } // namespace
 
 int main() {
@@ -114,7 +211,11 @@ int main() {
                           "add and persist payload");
 
         const fs::path archivePath = testRoot / "archives/alice_secure.enc";
-        success &= Expect(HasMagic(archivePath, "PQCENC02"), "write PQCENC02 header");
+        success &= Expect(HasMagic(archivePath, "PQCENC05"), "write log-structured PQCENC05 preamble");
+        const auto createdKeyStats = archive.GetKeyDerivationStats();
+        success &= Expect(createdKeyStats.scryptRuns == 1 &&
+                              createdKeyStats.scryptRunsAvoided == 1,
+                          "derive the archive key once and reuse it for the next save");
 
         const std::vector<uint8_t> firstEncryption = ReadAll(archivePath);
         AtomicFile::Testing::FailNextWriteBeforeReplace();
@@ -127,7 +228,14 @@ int main() {
         success &= Expect(archive.SaveArchive(), "save unchanged archive again");
         const std::vector<uint8_t> secondEncryption = ReadAll(archivePath);
         success &= Expect(firstEncryption != secondEncryption,
-                          "generate a fresh salt and nonce for every save");
+                          "generate fresh blob ids and index nonce for every save");
+        success &= Expect(firstEncryption.size() > 80 && secondEncryption.size() > 80 &&
+                              std::equal(firstEncryption.begin() + 48,
+                                         firstEncryption.begin() + 80,
+                                         secondEncryption.begin() + 48),
+                          "keep the unlocked key's salt across saves");
+        success &= Expect(archive.GetKeyDerivationStats().scryptRuns == 1,
+                          "saves with an unchanged password skip scrypt");
 
         CryptoArchive validReader("alice", "secure");
         success &= Expect(validReader.LoadArchive(password), "load archive with correct password");
@@ -138,11 +246,83 @@ int main() {
                           metadata.front().size == expectedPayload.size(),
                           "return archive metadata without duplicating decrypted payloads");
 
+        CryptoArchive rekeyed("alice", "rekey");
+        success &= Expect(rekeyed.InitializeArchive(password) &&
+                              rekeyed.AddFile(payloadPath.string(), "payload.bin"),
+                          "create archive for password change");
+        const std::string changedPassword = "a different passphrase";
+        success &= Expect(rekeyed.ChangePassword(password, changedPassword),
+                          "change archive password");
+        const auto rekeyedStats = rekeyed.GetKeyDerivationStats();
+        success &= Expect(rekeyedStats.scryptRuns == 3 && rekeyedStats.scryptRunsAvoided == 1,
+                          "a password change verifies once and derives one new key");
+        success &= Expect(rekeyed.RemoveFile("payload.bin") &&
+                              rekeyed.GetKeyDerivationStats().scryptRuns == 3,
+                          "saves after a password change reuse the new key");
+        CryptoArchive rekeyedReader("alice", "rekey");
+        success &= Expect(!rekeyedReader.LoadArchive(password) &&
+                              rekeyedReader.LoadArchive(changedPassword) &&
+                              rekeyedReader.GetFileList().empty(),
+                          "only the new password opens the re-keyed archive");
+
+        // Archives record their scrypt cost; another preferred cost re-keys
+        // them on the next save.
+        const auto storedScryptN = [](const fs::path& path) {
+            const std::vector<uint8_t> bytes = ReadAll(path);
+            uint64_t n = 0;
+            for (size_t i = 16; i < 24 && i < bytes.size(); ++i) {
+                n = (n << 8U) | bytes[i];
+            }
+            return n;
+        };
+        KeyDerivation::ScryptParameters cheap;
+        cheap.n = FormatValidation::MIN_SCRYPT_N;
+        const fs::path tunedPath = testRoot / "archives/alice_tuned.enc";
+        success &= Expect(KeyDerivation::SetPreferredScrypt(cheap), "prefer a cheaper scrypt cost");
+        {
+            CryptoArchive tuned("alice", "tuned");
+            success &= Expect(tuned.InitializeArchive(password) &&
+                                  tuned.AddFile(payloadPath.string(), "payload.bin") &&
+                                  storedScryptN(tunedPath) == cheap.n,
+                              "record the preferred scrypt cost in the preamble");
+        }
+        success &= Expect(KeyDerivation::SetPreferredScrypt(KeyDerivation::DEFAULT_SCRYPT),
+                          "restore the default scrypt cost");
+        CryptoArchive tunedReader("alice", "tuned");
+        success &= Expect(tunedReader.LoadArchive(password) &&
+                              tunedReader.GetKeyDerivationStats().scrypt == cheap &&
+                              tunedReader.GetFileData("payload.bin") == expectedPayload,
+                          "open an archive with the scrypt cost of its header");
+        success &= Expect(tunedReader.SaveArchive() &&
+                              storedScryptN(tunedPath) == KeyDerivation::DEFAULT_SCRYPT.n &&
+                              tunedReader.GetKeyDerivationStats().scrypt ==
+                                  KeyDerivation::DEFAULT_SCRYPT &&
+                              tunedReader.GetKeyDerivationStats().scryptRuns == 2,
+                          "re-key with the preferred scrypt cost on the next save");
+        success &= Expect(tunedReader.SaveArchive() &&
+                              tunedReader.GetKeyDerivationStats().scryptRuns == 2,
+                          "saves after the upgrade reuse the new key");
+        KeyDerivation::ScryptParameters weak;
+        weak.n = 1024;
+        success &= Expect(!KeyDerivation::SetPreferredScrypt(weak) &&
+                              KeyDerivation::PreferredScrypt() == KeyDerivation::DEFAULT_SCRYPT,
+                          "reject scrypt costs outside the supported bounds");
+        const KeyDerivation::ScryptParameters calibrated =
+            KeyDerivation::CalibrateScrypt(std::chrono::milliseconds(1), 1024U * 1024U);
+        success &= Expect(calibrated.n == FormatValidation::MIN_SCRYPT_N &&
+                              KeyDerivation::IsSupported(calibrated),
+                          "calibration never goes below the supported minimum");
+        const std::atomic<bool> stopCalibration{true};
+        const KeyDerivation::ScryptParameters stopped = KeyDerivation::CalibrateScrypt(
+            std::chrono::milliseconds(60000), 1024U * 1024U * 1024U, &stopCalibration);
+        success &= Expect(stopped.n == FormatValidation::MIN_SCRYPT_N,
+                          "a stopped calibration keeps the cost reached so far");
+
         CryptoArchive wrongPasswordReader("alice", "secure");
         success &= Expect(!wrongPasswordReader.LoadArchive("wrong password"),
                           "reject incorrect password");
 
-        success &= Expect(TamperLastByte(archivePath), "modify authentication tag");
+        success &= Expect(TamperLastByte(archivePath), "modify index authentication tag");
         CryptoArchive tamperedReader("alice", "secure");
         success &= Expect(!tamperedReader.LoadArchive(password), "reject modified archive");
 
@@ -153,7 +333,21 @@ int main() {
         CryptoArchive legacyReader("bob", "legacy");
         success &= Expect(legacyReader.LoadArchive(password), "load legacy PQCENC01 archive");
         success &= Expect(legacyReader.SaveArchive(), "migrate legacy archive on save");
-        success &= Expect(HasMagic(legacyPath, "PQCENC02"), "rewrite legacy archive as PQCENC02");
+        success &= Expect(HasMagic(legacyPath, "PQCENC05"), "rewrite legacy archive as PQCENC05");
+
+        const fs::path v2Path = testRoot / "archives/bob_previous.enc";
+        success &= Expect(WriteV2Archive(v2Path, password, "payload.bin", expectedPayload),
+                          "create PQCENC02 compatibility fixture");
+        CryptoArchive v2Reader("bob", "previous");
+        success &= Expect(v2Reader.LoadArchive(password), "load single-message PQCENC02 archive");
+        success &= Expect(v2Reader.GetFileData("payload.bin") == expectedPayload,
+                          "read PQCENC02 payload without modification");
+        success &= Expect(v2Reader.SaveArchive() && HasMagic(v2Path, "PQCENC05"),
+                          "migrate PQCENC02 archive to PQCENC05 on save");
+        CryptoArchive migratedReader("bob", "previous");
+        success &= Expect(migratedReader.LoadArchive(password) &&
+                              migratedReader.GetFileData("payload.bin") == expectedPayload,
+                          "reload migrated PQCENC05 archive");
 
         CryptoArchive renameSource("carol", "photos");
         success &= Expect(renameSource.InitializeArchive(password), "create archive for rename");
@@ -183,6 +377,142 @@ int main() {
         success &= Expect(fs::is_regular_file(renamedPath) &&
                               ReadAll(collisionPath) == collisionBytes,
                           "preserve both archives after rejected collision");
+
+        std::mutex recordsMutex;
+        std::vector<std::pair<Log::Level, std::string>> records;
+        Log::SetSink([&](Log::Level level, Log::Module, const std::string& message) {
+            const std::lock_guard<std::mutex> lock(recordsMutex);
+            records.emplace_back(level, message);
+        });
+        const auto recordsMention = [&](const std::string& text) {
+            Log::Flush();
+            const std::lock_guard<std::mutex> lock(recordsMutex);
+            return std::any_of(records.begin(), records.end(), [&](const auto& record) {
+                return record.second.find(text) != std::string::npos;
+            });
+        };
+        {
+            CryptoArchive quietWriter("dave", "quiet");
+            success &= Expect(quietWriter.InitializeArchive(password) &&
+                                  quietWriter.AddFile(payloadPath.string(), "payload.bin"),
+                              "create archive for logging checks");
+        }
+        CryptoArchive quietReader("dave", "quiet");
+        std::vector<uint8_t> quietPayload;
+        success &= Expect(quietReader.LoadArchive(password) &&
+                              quietReader.ExtractFileToMemory("payload.bin", quietPayload),
+                          "load and extract with the default log level");
+        success &= Expect(recordsMention("Successfully loaded archive") &&
+                              !recordsMention("payload.bin"),
+                          "log progress but no entry names at the default Info level");
+
+        Log::SetModuleLevel(Log::Module::Archive, Log::Level::Debug);
+        success &= Expect(quietReader.ExtractFileToMemory("payload.bin", quietPayload) &&
+                              recordsMention("payload.bin") &&
+                              !Log::Enabled(Log::Level::Debug, Log::Module::Database),
+                          "raise one module to Debug without touching the others");
+        Log::SetModuleLevel(Log::Module::Archive, Log::Level::Info);
+
+        {
+            const std::lock_guard<std::mutex> lock(recordsMutex);
+            records.clear();
+        }
+        for (int i = 0; i < 1000; ++i) {
+            PQC_LOG_INFO(Log::Module::Transactions) << "ordered " << i;
+        }
+        Log::Flush();
+        bool ordered = true;
+        {
+            const std::lock_guard<std::mutex> lock(recordsMutex);
+            ordered = records.size() + Log::Dropped() == 1000;
+            for (std::size_t i = 1; i < records.size(); ++i) {
+                ordered &= std::stoi(records[i - 1].second.substr(8)) <
+                           std::stoi(records[i].second.substr(8));
+            }
+        }
+        success &= Expect(ordered, "deliver queued records in order once flushed");
+
+        {
+            const std::lock_guard<std::mutex> lock(recordsMutex);
+            records.clear();
+        }
+        const std::uint64_t droppedBefore = Log::Dropped();
+        for (int round = 0; round < 20; ++round) {
+            // Let the writer go idle so each burst has to wake it.
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            std::vector<std::thread> producers;
+            for (int producer = 0; producer < 4; ++producer) {
+                producers.emplace_back([round, producer] {
+                    PQC_LOG_INFO(Log::Module::Transactions) << "burst " << round << ' ' << producer;
+                });
+            }
+            for (auto& thread : producers) {
+                thread.join();
+            }
+            Log::Flush();
+        }
+        {
+            const std::lock_guard<std::mutex> lock(recordsMutex);
+            success &= Expect(records.size() + (Log::Dropped() - droppedBefore) == 80,
+                              "wake an idle writer for records from several threads");
+        }
+        Log::SetSink(nullptr);
+
+        const auto stageCount = [](Metrics::Stage stage) {
+            return Metrics::Snapshot()[static_cast<std::size_t>(stage)].count;
+        };
+        Metrics::Reset();
+        success &= Expect(quietReader.ExtractFileToMemory("payload.bin", quietPayload) &&
+                              stageCount(Metrics::Stage::Extract) == 0,
+                          "record nothing while metrics are disabled");
+        Metrics::SetEnabled(true);
+        success &= Expect(quietReader.ExtractFileToMemory("payload.bin", quietPayload) &&
+                              quietReader.AddFile(payloadPath.string(), "second.bin"),
+                          "extract and commit with metrics enabled");
+        const std::vector<Metrics::StageStats> stages = Metrics::Snapshot();
+        const auto& aesGcm = stages[static_cast<std::size_t>(Metrics::Stage::AesGcm)];
+        success &= Expect(stages[static_cast<std::size_t>(Metrics::Stage::Extract)].count == 1 &&
+                              stages[static_cast<std::size_t>(Metrics::Stage::Commit)].count == 1 &&
+                              stages[static_cast<std::size_t>(Metrics::Stage::Fsync)].count > 0 &&
+                              aesGcm.count > 0 && aesGcm.bytes >= quietPayload.size(),
+                          "time extraction, commit, fsync and AES-GCM stages");
+        const fs::path metricsReport = testRoot / "metrics.txt";
+        success &= Expect(Metrics::DumpToFile(metricsReport) &&
+                              ReadAll(metricsReport).size() > 0,
+                          "write the metrics report on demand");
+        Metrics::SetEnabled(false);
+        Metrics::Reset();
+        success &= Expect(stageCount(Metrics::Stage::AesGcm) == 0, "reset clears every stage");
+        Metrics::SetEnabled(true);
+        {
+            Metrics::ScopedTimer outer(Metrics::Stage::Load);
+            const Metrics::ScopedExclusion nested(outer);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        const auto outerLoad = Metrics::Snapshot()[static_cast<std::size_t>(Metrics::Stage::Load)];
+        success &= Expect(outerLoad.maxNanoseconds < 25'000'000ULL,
+                          "time spent in a nested stage is left out of the outer one");
+        Metrics::SetEnabled(false);
+        Metrics::Reset();
+
+        // Closing an archive hands the pages of its payloads back to the
+        // system instead of keeping them locked for the process.
+        const fs::path largePath = testRoot / "large.bin";
+        {
+            const std::vector<char> block(1024 * 1024, 'x');
+            std::ofstream large(largePath, std::ios::binary);
+            large.write(block.data(), static_cast<std::streamsize>(block.size()));
+        }
+        const std::size_t mappedBefore = SecureMemory::DefaultArena().GetStats().mapped;
+        {
+            CryptoArchive arenaArchive("erin", "arena");
+            success &= Expect(arenaArchive.InitializeArchive(password) &&
+                                  arenaArchive.AddFile(largePath.string(), "large.bin") &&
+                                  arenaArchive.LeaseEntry("large.bin").valid(),
+                              "hold a large payload in the secure arena");
+        }
+        success &= Expect(SecureMemory::DefaultArena().GetStats().mapped <= mappedBefore,
+                          "closing an archive releases its arena pages");
     } catch (const std::exception& exception) {
         std::cerr << "FAILED with exception: " << exception.what() << std::endl;
         success = false;
@@ -1,5 +1,7 @@
 #include "EncryptedDatabase.h"
 #include "AtomicFile.h"
+#include "KeyDerivation.h"
+#include "Metrics.h"
 
 #include <algorithm>
 #include <array>
@@ -133,6 +135,38 @@ int main() {
                           rekeyedRecord.email == record.email,
                           "preserve records during master-password rekey");
 
+        // The header carries the scrypt cost; the next save uses the preferred one.
+        const auto storedScryptN = [&databasePath]() {
+            const std::vector<uint8_t> bytes = ReadAll(databasePath);
+            uint64_t n = 0;
+            for (size_t i = 16; i < 24 && i < bytes.size(); ++i) {
+                n = (n << 8U) | bytes[i];
+            }
+            return n;
+        };
+        KeyDerivation::ScryptParameters cheap;
+        cheap.n = 1ULL << 14;
+        KeyDerivation::SetPreferredScrypt(cheap);
+        success &= Expect(newMasterReader.addUser(MakeRecord("bob")) && storedScryptN() == cheap.n,
+                          "save the database with the preferred scrypt cost");
+        KeyDerivation::SetPreferredScrypt(KeyDerivation::DEFAULT_SCRYPT);
+        EncryptedDatabase tunedReader(databasePath.string(), newPassword);
+        EncryptedDatabase::UserRecord tunedRecord;
+        success &= Expect(tunedReader.initialize() && tunedReader.getUser("bob", tunedRecord),
+                          "open a database with the scrypt cost of its header");
+        success &= Expect(tunedReader.addUser(MakeRecord("carol")) &&
+                              storedScryptN() == KeyDerivation::DEFAULT_SCRYPT.n,
+                          "move the database to the preferred cost on the next save");
+        Metrics::Reset();
+        Metrics::SetEnabled(true);
+        EncryptedDatabase timedReader(databasePath.string(), newPassword);
+        const bool timedSave = timedReader.initialize() && timedReader.addUser(MakeRecord("dave"));
+        const auto aesGcm = Metrics::Snapshot()[static_cast<std::size_t>(Metrics::Stage::AesGcm)];
+        Metrics::SetEnabled(false);
+        Metrics::Reset();
+        success &= Expect(timedSave && aesGcm.count == 2 && aesGcm.bytes > 0,
+                          "time the database AES-GCM decrypt and encrypt");
+
         const std::vector<uint8_t> beforeWrongPassword = ReadAll(databasePath);
         EncryptedDatabase wrongPasswordReader(databasePath.string(), "wrong password");
         success &= Expect(!wrongPasswordReader.initialize(), "reject incorrect master password");
@@ -46,6 +46,34 @@ std::vector<std::uint8_t> MakeUserV5() {
     return result;
 }
 
+// A V5 user file whose optional tenth component carries scrypt N, r and p.
+std::vector<std::uint8_t> MakeUserV5WithKdf(std::uint64_t n, std::uint32_t r, std::uint32_t p) {
+    std::vector<std::uint8_t> result{'P', 'Q', 'C', 'U', 'S', 'R', '0', '5'};
+    AppendBe32(result, 5);
+    AppendBe64(result, 24 + 9 * 9 + 8 + 16);
+    AppendBe32(result, 10);
+    for (std::uint8_t value = 1; value <= 9; ++value) {
+        AppendBe64(result, 1);
+        result.push_back(value);
+    }
+    AppendBe64(result, 16);
+    AppendBe64(result, n);
+    AppendBe32(result, r);
+    AppendBe32(result, p);
+    return result;
+}
+
+// Overwrites the scrypt N, r and p that follow the magic, version and KDF id.
+std::vector<std::uint8_t> WithScrypt(std::vector<std::uint8_t> container, std::uint64_t n,
+                                     std::uint32_t r, std::uint32_t p) {
+    std::vector<std::uint8_t> fields;
+    AppendBe64(fields, n);
+    AppendBe32(fields, r);
+    AppendBe32(fields, p);
+    std::copy(fields.begin(), fields.end(), container.begin() + 16);
+    return container;
+}
+
 std::vector<std::uint8_t> MakeNativeUser(std::uint32_t version,
                                          std::size_t componentCount,
                                          bool sizeTLengths) {
@@ -79,6 +107,72 @@ std::vector<std::uint8_t> MakeAuthenticatedContainer(const char (&magic)[9]) {
     return result;
 }
 
+std::vector<std::uint8_t> MakeStreamedArchive(std::uint32_t chunkSize,
+                                              std::uint64_t payloadSize) {
+    std::vector<std::uint8_t> result{'P', 'Q', 'C', 'E', 'N', 'C', '0', '3'};
+    AppendBe32(result, 3);
+    AppendBe32(result, 1);
+    AppendBe64(result, 32768);
+    AppendBe32(result, 8);
+    AppendBe32(result, 1);
+    AppendBe32(result, 32);
+    AppendBe32(result, 12);
+    AppendBe32(result, 16);
+    AppendBe32(result, chunkSize);
+    AppendBe64(result, payloadSize);
+    result.insert(result.end(), 32 + 12, 0x5a);
+    const std::uint64_t chunks = (payloadSize + chunkSize - 1) / chunkSize;
+    result.insert(result.end(), static_cast<std::size_t>(payloadSize + chunks * 16), 0xa5);
+    return result;
+}
+
+std::vector<std::uint8_t> MakeIndexedArchive(std::uint32_t chunkSize,
+                                             std::uint64_t blobBytes,
+                                             std::uint64_t indexSize) {
+    std::vector<std::uint8_t> result{'P', 'Q', 'C', 'E', 'N', 'C', '0', '4'};
+    AppendBe32(result, 4);
+    AppendBe32(result, 1);
+    AppendBe64(result, 32768);
+    AppendBe32(result, 8);
+    AppendBe32(result, 1);
+    AppendBe32(result, 32);
+    AppendBe32(result, 12);
+    AppendBe32(result, 16);
+    AppendBe32(result, chunkSize);
+    AppendBe64(result, 108 + blobBytes);
+    AppendBe64(result, indexSize);
+    result.insert(result.end(), 32 + 12, 0x5a);
+    result.insert(result.end(), static_cast<std::size_t>(blobBytes), 0x3c);
+    const std::uint64_t chunks = (indexSize + chunkSize - 1) / chunkSize;
+    result.insert(result.end(), static_cast<std::size_t>(indexSize + chunks * 16), 0xa5);
+    return result;
+}
+
+// Preamble, two head slots (slot 0 committed, slot 1 empty), then one sealed
+// index right at the start of the data region.
+std::vector<std::uint8_t> MakeLogArchive(std::uint32_t chunkSize, std::uint64_t indexSize) {
+    std::vector<std::uint8_t> result{'P', 'Q', 'C', 'E', 'N', 'C', '0', '5'};
+    AppendBe32(result, 5);
+    AppendBe32(result, 1);
+    AppendBe64(result, 32768);
+    AppendBe32(result, 8);
+    AppendBe32(result, 1);
+    AppendBe32(result, 32);
+    AppendBe32(result, 12);
+    AppendBe32(result, 16);
+    AppendBe32(result, chunkSize);
+    result.insert(result.end(), 32, 0x5a);
+    result.resize(4096, 0);
+    AppendBe64(result, 1);
+    AppendBe64(result, 12288);
+    AppendBe64(result, indexSize);
+    result.insert(result.end(), 12 + 16, 0x5a);
+    result.resize(12288, 0);
+    const std::uint64_t chunks = (indexSize + chunkSize - 1) / chunkSize;
+    result.insert(result.end(), static_cast<std::size_t>(indexSize + chunks * 16), 0xa5);
+    return result;
+}
+
 bool ValidateUserAs(const std::vector<std::uint8_t>& input,
                     FormatValidation::UserFormat expected) {
     FormatValidation::UserFormat actual = FormatValidation::UserFormat::Invalid;
@@ -124,6 +218,26 @@ int main() {
     success &= Expect(!FormatValidation::ValidateUserFile(maliciousUser.data(), maliciousUser.size()),
                       "reject malicious V5 component length");
 
+    success &= Expect(ValidateUserAs(MakeUserV5WithKdf(1ULL << 16, 8, 1),
+                                     FormatValidation::UserFormat::V5),
+                      "accept V5 user scrypt parameters");
+    const auto weakUser = MakeUserV5WithKdf(1024, 8, 1);
+    success &= Expect(!FormatValidation::ValidateUserFile(weakUser.data(), weakUser.size()),
+                      "reject V5 user scrypt parameters below the minimum");
+
+    success &= Expect(FormatValidation::ValidateScryptParameters(1ULL << 14, 8, 1) &&
+                          FormatValidation::ValidateScryptParameters(1ULL << 20, 8, 1) &&
+                          FormatValidation::ValidateScryptParameters(1ULL << 15, 16, 4),
+                      "accept scrypt parameters within bounds");
+    success &= Expect(!FormatValidation::ValidateScryptParameters(1ULL << 13, 8, 1) &&
+                          !FormatValidation::ValidateScryptParameters(1ULL << 21, 8, 1) &&
+                          !FormatValidation::ValidateScryptParameters(49152, 8, 1) &&
+                          !FormatValidation::ValidateScryptParameters(1ULL << 15, 4, 1) &&
+                          !FormatValidation::ValidateScryptParameters(1ULL << 20, 16, 1) &&
+                          !FormatValidation::ValidateScryptParameters(1ULL << 15, 8, 0) &&
+                          !FormatValidation::ValidateScryptParameters(1ULL << 15, 8, 5),
+                      "reject weak, oversized or malformed scrypt parameters");
+
     auto archiveV1 = std::vector<std::uint8_t>{'P', 'Q', 'C', 'E', 'N', 'C', '0', '1'};
     AppendNative(archiveV1, std::uint64_t{1});
     archiveV1.push_back(0x42);
@@ -136,6 +250,108 @@ int main() {
                       "accept PQCENC02 structure");
     success &= Expect(FormatValidation::ValidateDatabaseV2(databaseV2.data(), databaseV2.size()),
                       "accept PQCDB002 structure");
+    const auto tunedDatabase = WithScrypt(databaseV2, 1ULL << 17, 8, 1);
+    const auto weakDatabase = WithScrypt(databaseV2, 1ULL << 10, 8, 1);
+    success &= Expect(FormatValidation::ValidateDatabaseV2(tunedDatabase.data(),
+                                                           tunedDatabase.size()) &&
+                          !FormatValidation::ValidateDatabaseV2(weakDatabase.data(),
+                                                                weakDatabase.size()),
+                      "check PQCDB002 scrypt parameters against the bounds");
+
+    const auto archiveV3 = MakeStreamedArchive(4096, 3 * 4096 + 17);
+    success &= Expect(FormatValidation::ValidateArchiveFile(archiveV3.data(), archiveV3.size()),
+                      "accept chunked PQCENC03 structure");
+    success &= Expect(FormatValidation::ValidateArchiveV3Header(
+                          archiveV3.data(), FormatValidation::ARCHIVE_V3_HEADER_SIZE,
+                          archiveV3.size()),
+                      "validate PQCENC03 header against the streamed container size");
+    auto truncatedV3 = archiveV3;
+    truncatedV3.resize(truncatedV3.size() - 16);
+    success &= Expect(!FormatValidation::ValidateArchiveFile(truncatedV3.data(),
+                                                              truncatedV3.size()),
+                      "reject PQCENC03 missing a chunk tag");
+    auto trailingV3 = archiveV3;
+    trailingV3.push_back(0);
+    success &= Expect(!FormatValidation::ValidateArchiveFile(trailingV3.data(),
+                                                              trailingV3.size()),
+                      "reject trailing PQCENC03 data");
+    const auto tinyChunks = MakeStreamedArchive(512, 1024);
+    success &= Expect(!FormatValidation::ValidateArchiveFile(tinyChunks.data(),
+                                                              tinyChunks.size()),
+                      "reject PQCENC03 chunk sizes below the minimum");
+    auto hugeDeclaration = archiveV3;
+    std::fill(hugeDeclaration.begin() + 48, hugeDeclaration.begin() + 56, 0xff);
+    success &= Expect(!FormatValidation::ValidateArchiveV3Header(
+                          hugeDeclaration.data(), hugeDeclaration.size(),
+                          hugeDeclaration.size()),
+                      "reject oversized PQCENC03 payload declaration");
+    const auto emptyPayload = MakeStreamedArchive(4096, 0);
+    success &= Expect(!FormatValidation::ValidateArchiveFile(emptyPayload.data(),
+                                                              emptyPayload.size()),
+                      "reject PQCENC03 without payload");
+
+    const auto archiveV4 = MakeIndexedArchive(4096, 2 * 4096 + 40, 4096 + 9);
+    success &= Expect(FormatValidation::ValidateArchiveFile(archiveV4.data(), archiveV4.size()),
+                      "accept indexed PQCENC04 structure");
+    success &= Expect(FormatValidation::ValidateArchiveV4Header(
+                          archiveV4.data(), FormatValidation::ARCHIVE_V4_HEADER_SIZE,
+                          archiveV4.size()),
+                      "validate PQCENC04 header against the container size");
+    const auto emptyV4 = MakeIndexedArchive(4096, 0, 8);
+    success &= Expect(FormatValidation::ValidateArchiveFile(emptyV4.data(), emptyV4.size()),
+                      "accept PQCENC04 with an empty index");
+    auto truncatedV4 = archiveV4;
+    truncatedV4.resize(truncatedV4.size() - 16);
+    success &= Expect(!FormatValidation::ValidateArchiveFile(truncatedV4.data(),
+                                                              truncatedV4.size()),
+                      "reject PQCENC04 missing an index tag");
+    auto trailingV4 = archiveV4;
+    trailingV4.push_back(0);
+    success &= Expect(!FormatValidation::ValidateArchiveFile(trailingV4.data(),
+                                                              trailingV4.size()),
+                      "reject trailing data after the PQCENC04 index");
+    const auto shortIndex = MakeIndexedArchive(4096, 0, 7);
+    success &= Expect(!FormatValidation::ValidateArchiveFile(shortIndex.data(),
+                                                              shortIndex.size()),
+                      "reject a PQCENC04 index shorter than its fixed fields");
+    auto indexInsideHeader = MakeIndexedArchive(4096, 0, 8);
+    std::fill(indexInsideHeader.begin() + 48, indexInsideHeader.begin() + 56, 0);
+    success &= Expect(!FormatValidation::ValidateArchiveFile(indexInsideHeader.data(),
+                                                              indexInsideHeader.size()),
+                      "reject a PQCENC04 index overlapping the header");
+    auto hugeIndex = archiveV4;
+    std::fill(hugeIndex.begin() + 56, hugeIndex.begin() + 64, 0xff);
+    success &= Expect(!FormatValidation::ValidateArchiveV4Header(
+                          hugeIndex.data(), hugeIndex.size(), hugeIndex.size()),
+                      "reject oversized PQCENC04 index declaration");
+
+    const auto archiveV5 = MakeLogArchive(4096, 4096 + 9);
+    success &= Expect(FormatValidation::ValidateArchiveFile(archiveV5.data(), archiveV5.size()),
+                      "accept log-structured PQCENC05 structure");
+    const auto tunedV5 = WithScrypt(archiveV5, 1ULL << 14, 8, 1);
+    const auto hugeV5 = WithScrypt(archiveV5, 1ULL << 20, 32, 1);
+    success &= Expect(FormatValidation::ValidateArchiveFile(tunedV5.data(), tunedV5.size()) &&
+                          !FormatValidation::ValidateArchiveFile(hugeV5.data(), hugeV5.size()),
+                      "check PQCENC05 scrypt parameters against the bounds");
+    auto appendedV5 = archiveV5;
+    appendedV5.insert(appendedV5.end(), 100, 0x3c);
+    success &= Expect(FormatValidation::ValidateArchiveFile(appendedV5.data(), appendedV5.size()),
+                      "accept bytes after the PQCENC05 head index");
+    auto truncatedV5 = archiveV5;
+    truncatedV5.resize(truncatedV5.size() - 16);
+    success &= Expect(!FormatValidation::ValidateArchiveFile(truncatedV5.data(),
+                                                              truncatedV5.size()),
+                      "reject PQCENC05 missing an index tag");
+    auto noHeadV5 = archiveV5;
+    std::fill(noHeadV5.begin() + 4096, noHeadV5.begin() + 4096 + 8, 0);
+    success &= Expect(!FormatValidation::ValidateArchiveFile(noHeadV5.data(), noHeadV5.size()),
+                      "reject PQCENC05 without a committed head");
+    auto indexInPreamble = archiveV5;
+    std::fill(indexInPreamble.begin() + 4096 + 8, indexInPreamble.begin() + 4096 + 16, 0);
+    success &= Expect(!FormatValidation::ValidateArchiveV5Slot(
+                          indexInPreamble.data() + 4096, FormatValidation::ARCHIVE_V5_SLOT_SIZE,
+                          4096, indexInPreamble.size()),
+                      "reject a PQCENC05 index inside the head pages");
 
     auto truncatedArchive = archiveV2;
     truncatedArchive.pop_back();
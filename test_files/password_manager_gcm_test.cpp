@@ -1,5 +1,6 @@
 #include "PasswordManager.h"
 #include "AtomicFile.h"
+#include "LoginTask.h"
 
 #include <algorithm>
 #include <array>
@@ -13,6 +14,7 @@
 #include <limits>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <oqs/oqs.h>
@@ -335,6 +337,13 @@ bool WriteV4MlKemUser(const std::filesystem::path& path, const std::string& pass
     return WriteModernKemUser(path, password, OQS_KEM_alg_ml_kem_768, 4);
 }
 
+LoginTask::Stage WaitForLogin(const LoginTask& task) {
+    while (task.IsRunning()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return task.GetStage();
+}
+
 bool TamperLastByte(const std::filesystem::path& path) {
     std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
     if (!file) {
@@ -525,6 +534,48 @@ int main() {
                           "reject old password after change");
         success &= Expect(manager.VerifyPassword("alice", newPassword),
                           "verify new password after change");
+
+        LoginTask loginTask;
+        success &= Expect(loginTask.Start("alice", newPassword), "start asynchronous login");
+        success &= Expect(!loginTask.Start("alice", newPassword),
+                          "refuse a second login while one is running");
+        success &= Expect(WaitForLogin(loginTask) == LoginTask::Stage::Succeeded,
+                          "asynchronous login succeeds");
+        std::unique_ptr<LoginTask::Session> session = loginTask.TakeSession();
+        success &= Expect(session && session->username == "alice" &&
+                              session->password.get() == newPassword,
+                          "login hands back the verified user and password");
+        success &= Expect(session && session->database,
+                          "login opens the password database");
+        success &= Expect(session && session->archive && session->archiveCreated &&
+                              session->archive->ArchiveExists(),
+                          "first login creates the default archive");
+        success &= Expect(loginTask.GetStage() == LoginTask::Stage::Idle &&
+                              !loginTask.TakeSession(),
+                          "the session is handed back only once");
+        session.reset();
+
+        success &= Expect(loginTask.Start("alice", newPassword) &&
+                              WaitForLogin(loginTask) == LoginTask::Stage::Succeeded,
+                          "log in again");
+        session = loginTask.TakeSession();
+        success &= Expect(session && session->archive && !session->archiveCreated,
+                          "later logins load the existing archive");
+        session.reset();
+
+        success &= Expect(loginTask.Start("alice", password) &&
+                              WaitForLogin(loginTask) == LoginTask::Stage::Failed &&
+                              !loginTask.TakeSession(),
+                          "asynchronous login rejects the old password");
+        loginTask.Reset();
+        success &= Expect(loginTask.GetStage() == LoginTask::Stage::Idle,
+                          "reset returns a failed login to idle");
+
+        success &= Expect(loginTask.Start("alice", newPassword), "start a login to cancel");
+        loginTask.Cancel();
+        success &= Expect(WaitForLogin(loginTask) == LoginTask::Stage::Cancelled &&
+                              !loginTask.TakeSession(),
+                          "a cancelled login discards the verified session");
     } catch (const std::exception& exception) {
         std::cerr << "FAILED with exception: " << exception.what() << std::endl;
         success = false;
@@ -102,6 +102,25 @@ int main() {
                           "reject decomposed combining form");
         success &= Expect(PathSecurity::NamesCollide("Vault", "vault"),
                           "detect portable case collision");
+        success &= Expect(PathSecurity::CollisionKey("Vault.TXT") == "vault.txt" &&
+                              PathSecurity::CollisionKey(u8"\u00C9t\u00E9") == u8"\u00C9t\u00E9",
+                          "fold only ASCII letters in collision keys");
+
+        EntryTable table;
+        FileEntry photo;
+        photo.name = "Photo.JPG";
+        photo.size = 0;
+        success &= Expect(table.insert(photo.name, photo) && table.count("Photo.JPG") == 1 &&
+                              table.count("photo.jpg") == 0 &&
+                              table.FindEquivalent("photo.jpg") == table.find("Photo.JPG"),
+                          "find an entry by its exact or equivalent name");
+        success &= Expect(!table.insert("PHOTO.jpg", photo) && table.size() == 1,
+                          "refuse an entry whose name collides with a stored one");
+        auto extracted = table.extract("Photo.JPG");
+        success &= Expect(table.empty() && table.FindEquivalent("photo.jpg") == table.end() &&
+                              table.insert("photo.jpg", photo) &&
+                              table.insert(std::move(extracted)) == false,
+                          "release the name of an extracted entry");
 
         fs::path resolved;
         success &= Expect(!PathSecurity::ResolveContainedPath("users", "../outside.enc",
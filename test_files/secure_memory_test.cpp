@@ -1,6 +1,8 @@
+#include "SecureArena.h"
 #include "SecureMemory.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <type_traits>
@@ -50,5 +52,50 @@ int main() {
                                  [](char value) { return value == 0; }),
                       "cleanse plaintext string");
 
+    SecureMemory::Arena arena;
+    auto* small = static_cast<unsigned char*>(arena.Allocate(100));
+    std::fill(small, small + 100, 0x5a);
+    arena.Deallocate(small, 100);
+    success &= Expect(std::all_of(small + sizeof(void*), small + 100,
+                                 [](unsigned char value) { return value == 0; }),
+                      "cleanse a small arena block when it is freed");
+    success &= Expect(arena.Allocate(90) == small, "recycle freed blocks of one size class");
+    arena.Deallocate(small, 90);
+
+    const std::size_t largeSize = SecureMemory::Arena::MAX_SMALL_BLOCK * 4;
+    void* large = arena.Allocate(largeSize);
+    const auto peakStats = arena.GetStats();
+    arena.Deallocate(large, largeSize);
+    success &= Expect(arena.Allocate(largeSize) == large && arena.GetStats().mappings == 2,
+                      "reuse a kept large mapping instead of mapping again");
+    arena.Deallocate(large, largeSize);
+    const auto freedStats = arena.GetStats();
+    success &= Expect(peakStats.inUse >= largeSize && freedStats.inUse == 0 &&
+                          freedStats.highWater == peakStats.inUse,
+                      "track bytes in use and the high-water mark");
+    success &= Expect(arena.Reset() == freedStats.mapped && arena.GetStats().mapped == 0 &&
+                          arena.GetStats().locked == 0,
+                      "release empty slabs and kept mappings on reset");
+
+    arena.SetLockLimit(0);
+    arena.Deallocate(arena.Allocate(64), 64);
+    success &= Expect(arena.GetStats().lockFailures > freedStats.lockFailures,
+                      "keep serving pages past the lock limit");
+
+    const auto defaultBefore = SecureMemory::DefaultArena().GetStats();
+    {
+        SecureMemory::SecureBytes payload;
+        for (std::uint32_t i = 0; i < 100000; ++i) {
+            payload.push_back(static_cast<std::uint8_t>(i));
+        }
+        success &= Expect(payload.size() == 100000 && payload[99999] == (99999 & 0xff) &&
+                              SecureMemory::DefaultArena().GetStats().inUse >=
+                                  defaultBefore.inUse + payload.size(),
+                          "grow a secure byte buffer inside the default arena");
+        SecureMemory::Cleanse(payload);
+    }
+    success &= Expect(SecureMemory::DefaultArena().GetStats().inUse == defaultBefore.inUse,
+                      "return secure byte buffers to the default arena");
+
     return success ? 0 : 1;
 }